@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_arena.c
+//  Description    : This file contains the bump arena of the driver metadata.
+//                   Chunks come straight from malloc, large enough that the
+//                   C library maps them, so freeing the arena hands the
+//                   memory back to the system in a few calls.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_arena.h>
+
+//
+// Functional Prototypes
+
+void * carveSGArena( SG_Arena *arena, size_t size, size_t align );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initSGArena
+// Description  : Initialize an empty arena
+//
+// Inputs       : arena - the arena
+// Outputs      : none
+
+void initSGArena( SG_Arena *arena ) {
+    memset(arena, 0, sizeof(SG_Arena));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocSGArena
+// Description  : Allocate zeroed, aligned memory from the arena
+//
+// Inputs       : arena - the arena
+//                size - the number of bytes
+// Outputs      : the memory, NULL if out of memory
+
+void * allocSGArena( SG_Arena *arena, size_t size ) {
+    return carveSGArena(arena, size, SG_ARENA_ALIGN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : internSGArena
+// Description  : Copy a string into the arena (packed, no alignment)
+//
+// Inputs       : arena - the arena
+//                str - the string
+// Outputs      : the copy, NULL if out of memory
+
+char * internSGArena( SG_Arena *arena, const char *str ) {
+    size_t len = strlen(str) + 1;
+    char *copy;
+
+    if ((copy = (char *) carveSGArena(arena, len, 1)) != NULL) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeSGArena
+// Description  : Release all chunks of the arena
+//
+// Inputs       : arena - the arena
+// Outputs      : none
+
+void freeSGArena( SG_Arena *arena ) {
+    SG_Arena_Chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    initSGArena(arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : carveSGArena
+// Description  : Carve memory out of the current chunk, adding a chunk if it
+//                is full (what is left of the full one is not used)
+//
+// Inputs       : arena - the arena
+//                size - the number of bytes
+//                align - the alignment (power of two)
+// Outputs      : the memory, NULL if out of memory
+
+void * carveSGArena( SG_Arena *arena, size_t size, size_t align ) {
+    SG_Arena_Chunk *chunk = arena->chunks;
+    size_t chunkSize, start = 0;
+
+    if (chunk != NULL) {
+        start = (chunk->used + align - 1) & ~(align - 1);
+    }
+    if ((chunk == NULL) || (start > chunk->size) || (chunk->size - start < size)) {
+
+        // Double the chunk size up to the cap, a large object gets a chunk to itself
+        chunkSize = (chunk == NULL) ? SG_ARENA_FIRST_CHUNK : chunk->size * 2;
+        chunkSize = (chunkSize > SG_ARENA_MAX_CHUNK) ? SG_ARENA_MAX_CHUNK : chunkSize;
+        chunkSize = (size > chunkSize) ? size : chunkSize;
+        if ((chunk = (SG_Arena_Chunk *) calloc(1, sizeof(SG_Arena_Chunk) + chunkSize)) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "carveSGArena: out of memory (chunk of %lu bytes)", chunkSize);
+            return NULL;
+        }
+        chunk->size = chunkSize;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunkCount++;
+        arena->allocated += chunkSize;
+        start = 0;
+    }
+    arena->used += size + (start - chunk->used);
+    chunk->used = start + size;
+    return &chunk->data[start];
+}
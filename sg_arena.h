@@ -0,0 +1,56 @@
+#ifndef SG_ARENA_INCLUDED
+#define SG_ARENA_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_arena.h
+//  Description    : This is the declaration of the bump arena backing the
+//                   driver metadata (files, paths, node tables).  Objects are
+//                   carved out of a few large chunks, each twice the size of
+//                   the one before up to a cap, and are never freed one by
+//                   one; the whole arena is released at once.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stddef.h>
+
+//
+// Defines
+#define SG_ARENA_FIRST_CHUNK (64 * 1024)        // size of the first chunk
+#define SG_ARENA_MAX_CHUNK (16 * 1024 * 1024)   // chunks stop growing at this size
+#define SG_ARENA_ALIGN 8                        // alignment of the objects
+
+// Type definitions
+typedef struct SG_Arena_Chunk_t {
+    struct SG_Arena_Chunk_t * next; // the chunk allocated before this one
+    size_t size;                    // bytes of data in the chunk
+    size_t used;                    // bytes handed out
+    char data[];                    // the objects
+} SG_Arena_Chunk;
+
+typedef struct {
+    SG_Arena_Chunk * chunks;    // the current chunk, older ones linked after it
+    size_t chunkCount;          // number of chunks
+    size_t allocated;           // bytes in the chunks
+    size_t used;                // bytes handed out
+} SG_Arena;
+
+//
+// Arena functions
+
+void initSGArena( SG_Arena *arena );
+    // Initialize an empty arena (no chunk is allocated until used)
+
+void * allocSGArena( SG_Arena *arena, size_t size );
+    // Allocate size bytes (aligned, zeroed), NULL if out of memory
+
+char * internSGArena( SG_Arena *arena, const char *str );
+    // Copy a string into the arena, NULL if out of memory
+
+void freeSGArena( SG_Arena *arena );
+    // Release all chunks of the arena, leaving it empty
+
+#endif
@@ -0,0 +1,1486 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_bench.c
+//  Description    : This is the benchmark program for the ScatterGather
+//                   driver.  It runs the driver against the local stand-in
+//                   service so that the numbers measure the driver, not the
+//                   reference service.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_defs.h>
+#include <sg_driver.h>
+#include <sg_service.h>
+#include <sg_blockmap.h>
+
+// Defines
+#define SG_BENCH_ARGUMENTS "hm:c:w"
+#define SG_BENCH_CORPUS 4096 // packets in the codec corpus
+#define SG_BENCH_SEED 0x5347636f64656321ULL // seed the corpus packets are drawn from
+#define SG_BENCH_HASH 0xcbf29ce484222325ULL // FNV-1a hash start
+#define SG_REF_CODEC_KEY 0xff11aabb // key of the reference codec calls
+#define SG_BENCH_SNAPSHOT "sg_bench_restart.snap" // metadata snapshot of the restart benchmark
+#define SG_BENCH_CRASHED "sg_bench_crashed.snap"  // the metadata as a crash would leave it
+#define SG_BENCH_LOCAL "sg_bench_import.dat"       // local file of the import benchmark
+#define SG_BENCH_EXPORTED "sg_bench_export.dat"    // local file it is exported to
+#define SG_BENCH_HOT_BLOCKS 48 // blocks of the hot file of the advise benchmark (fits the pins)
+#define SG_BENCH_ROUNDS 4      // hot file reads and scans of the advise benchmark
+#define SG_BENCH_ADVISE_IDLE_NS 2000000 // client time between WILLNEED and the hot file read (idle run)
+#define SG_BENCH_PREFETCH_ROUNDS 8 // passes over the file of the prefetch benchmark
+#define SG_BENCH_POST_NS 20000     // service time of a post in the prefetch benchmark
+#define SG_BENCH_THINK_NS 20000    // client time between two reads of the prefetch benchmark
+#define USAGE \
+	"USAGE: sg_bench [-h] [-m <megabytes>] [-c <corpus>] [-w] <benchmark>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -m - amount of data to move per run (default 16 MB, the codec\n" \
+	"         runs 64K packets per MB, files opens 64K files per MB,\n" \
+	"         restart creates 4K one-block files per MB, clone copies a\n" \
+	"         file of 4K blocks per MB, advise scans 1K blocks per MB,\n" \
+	"         prefetch reads a file of 1K blocks per MB)\n" \
+	"    -c - codec corpus file (default sg-codec-corpus.txt)\n" \
+	"    -w - record the codec corpus from the current codec, no timing\n" \
+	"and\n" \
+	"    benchmark - is one of:\n" \
+	"        blocksize - sequential write/read throughput per block size\n" \
+	"        blockmap - block map insert/lookup latency (16K blocks per MB)\n" \
+	"        codec - packet encode/decode cost against the reference codec,\n" \
+	"                after checking it reproduces the fuzzed corpus results\n" \
+	"        files - open, reopen and close many files, driver metadata\n" \
+	"                bytes per file and shutdown time\n" \
+	"        restart - restart the driver from its metadata journal (as after\n" \
+	"                  a crash), then from its snapshot, reading the files back\n" \
+	"        clone - copy a file by reading and writing it against sgclone,\n" \
+	"                then write half the clone's blocks (copy on write)\n" \
+	"        import - load a local file with an sgwrite loop against sgimport,\n" \
+	"                 and save it with an sgread loop against sgexport\n" \
+	"        advise - reread a hot file between scans of a large one, with\n" \
+	"                 each sgadvise policy\n" \
+	"        prefetch - read a file over and over in one shuffled block order,\n" \
+	"                   without and with the prefetcher, and in a new order\n" \
+	"                   each pass (20 us posts, 20 us between reads)\n" \
+	"\n" \
+
+// Type definitions
+typedef struct {
+	SG_Node_ID   loc;                 // the local node
+	SG_Node_ID   rem;                 // the remote node
+	SG_Block_ID  blk;                 // the block
+	SG_System_OP op;                  // the operation
+	SG_SeqNum    sseq;                // the sender sequence number
+	SG_SeqNum    rseq;                // the receiver sequence number
+	int          block;               // the packet carries the data block
+	char         data[SG_BLOCK_SIZE]; // the data block
+} benchPacket;
+
+//
+// Global Data
+unsigned long SGServiceLevel; // Service log level
+unsigned long SGDriverLevel; // Controller log level
+unsigned long SGSimulatorLevel; // Simulation log level
+
+//
+// Functional Prototypes
+
+int benchBlockSize( size_t total ); // Throughput per block size
+int benchBlockMap( uint64_t blocks ); // Block map latency
+int benchCodec( uint64_t packets, const char *corpus, int rewrite ); // Packet codec cost
+int checkCodecCorpus( const char *corpus, int rewrite ); // Codec results on the fuzzed corpus
+int benchFiles( uint64_t files ); // Driver metadata cost per file
+int benchRestart( uint64_t files ); // Driver restart from the metadata checkpoint
+int benchRestartPass( uint64_t files, double *restart, double *reads ); // Restart and read back the files
+void benchRestartBlock( uint64_t file, char *block ); // Contents of a file of the restart benchmark
+int benchCopyFile( const char *from, const char *to ); // Copy a file
+int benchClone( uint64_t blocks ); // File copy against a copy-on-write clone
+int benchCloneCheck( SgFHandle fh, uint64_t blocks, uint64_t written ); // Check the blocks of a file
+int benchImport( size_t total ); // Local file import/export against the call loops
+int benchSameFile( const char *a, const char *b ); // Do two local files hold the same bytes
+int benchAdvise( uint64_t blocks ); // Hot set kept across scans per advice
+int benchAdviseRun( uint64_t blocks, const char *policy, SG_Advice hot, SG_Advice scan, long idle ); // One advice policy
+int benchReadFile( SgFHandle fh, uint64_t blocks ); // Read a file through
+int benchPrefetch( uint64_t blocks ); // Demand misses saved by the prefetcher
+int benchPrefetchRun( uint64_t blocks, const char *name, size_t entries, int reshuffle ); // One prefetcher setting
+void benchShuffle( uint64_t *rnd, uint64_t *order, uint64_t count ); // Shuffle an order
+int benchSlowPost( char *packet, size_t *len, char *rpacket, size_t *rlen ); // Local service, SG_BENCH_POST_NS a post
+void benchSpin( uint64_t ns ); // Busy wait
+void makeCodecFields( uint64_t *rnd, benchPacket *in ); // Fields of a corpus packet
+uint64_t benchHash( const void *buf, size_t len, uint64_t hash ); // FNV-1a hash
+uint64_t benchRandom( uint64_t *rnd ); // Next xorshift random number
+double benchSeconds( void ); // Monotonic time in seconds
+size_t benchHeapBytes( void ); // Heap bytes in use
+
+// The reference codec (libsglib.a), key first, the encoder skips validation if
+// nocheck is set and takes the size of the packet buffer in plen
+extern SG_Packet_Status sgsys_serialize_sg_packet( uint32_t key, int nocheck, SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk,
+	SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, char *packet, size_t *plen );
+extern SG_Packet_Status sgsys_deserialize_sg_packet( uint32_t key, SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk,
+	SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, char *data, char *packet, size_t plen );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the ScatterGather benchmarks
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, rewrite = 0;
+	size_t megabytes = 16;
+	char *corpus = "sg-codec-corpus.txt";
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, SG_BENCH_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'm': // Data per run
+			megabytes = atoi( optarg );
+			break;
+
+		case 'c': // Codec corpus file
+			corpus = optarg;
+			break;
+
+		case 'w': // Record the codec corpus
+			rewrite = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log, keep the driver quiet
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	SGServiceLevel = registerLogLevel("SG_SERVICE", 0); // Service log level
+	SGDriverLevel = registerLogLevel("SG_DRIVER", 0); // Controller log level
+	SGSimulatorLevel = registerLogLevel("SG_SIMULATOR", 0); // Simulation log level
+
+	// The benchmark name should be the next option
+	if ( argv[optind] == NULL ) {
+		fprintf( stderr, "Missing benchmark name, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+	if ( strcmp(argv[optind], "blocksize") == 0 ) {
+		return( benchBlockSize(megabytes * 1024 * 1024) );
+	}
+	if ( strcmp(argv[optind], "blockmap") == 0 ) {
+		return( benchBlockMap((uint64_t)megabytes * 16384) );
+	}
+	if ( strcmp(argv[optind], "codec") == 0 ) {
+		return( benchCodec((uint64_t)megabytes * 65536, corpus, rewrite) );
+	}
+	if ( strcmp(argv[optind], "files") == 0 ) {
+		return( benchFiles((uint64_t)megabytes * 65536) );
+	}
+	if ( strcmp(argv[optind], "restart") == 0 ) {
+		return( benchRestart((uint64_t)megabytes * 4096) );
+	}
+	if ( strcmp(argv[optind], "clone") == 0 ) {
+		return( benchClone((uint64_t)megabytes * 4096) );
+	}
+	if ( strcmp(argv[optind], "import") == 0 ) {
+		return( benchImport(megabytes * 1024 * 1024) );
+	}
+	if ( strcmp(argv[optind], "advise") == 0 ) {
+		return( benchAdvise((uint64_t)megabytes * 1024) );
+	}
+	if ( strcmp(argv[optind], "prefetch") == 0 ) {
+		return( benchPrefetch((uint64_t)megabytes * 1024) );
+	}
+	fprintf( stderr, "Unknown benchmark [%s], aborting.\n", argv[optind] );
+	return( -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchBlockSize
+// Description  : Write then read back a file sequentially, in whole blocks,
+//                for each of the common block sizes
+//
+// Inputs       : total - the number of bytes to write and read per run
+// Outputs      : 0 if successful, -1 if failure
+
+int benchBlockSize( size_t total ) {
+
+	// Local variables
+	size_t sizes[] = { 1024, 4096, 16384, 65536 };
+	SG_Endpoint_Config config = { sgLocalServicePost, SG_FEATURE_BLOCK_SIZE, 0 };
+	char *data, *buf;
+	double start, wtime, rtime;
+	SgFHandle fh;
+	size_t i, blk, nblks;
+
+	// Random printable data, reused for every block
+	data = malloc( SG_MAX_BLOCK_SIZE );
+	buf = malloc( SG_MAX_BLOCK_SIZE );
+	for ( i = 0; i < SG_MAX_BLOCK_SIZE; i++ ) {
+		data[i] = ' ' + (rand() % 95);
+	}
+
+	printf( "%10s %10s %12s %12s %12s\n", "blocksize", "blocks", "write MB/s", "read MB/s", "us/block" );
+	for ( i = 0; i < sizeof(sizes) / sizeof(size_t); i++ ) {
+
+		// Setup the endpoint for this block size
+		config.blockSize = sizes[i];
+		nblks = total / sizes[i];
+		if ( sgConfigureEndpoint(&config) || (fh = sgopen("sg_bench_blocksize")) == -1 ) {
+			fprintf( stderr, "Endpoint setup failed for block size %lu, aborting.\n", sizes[i] );
+			return( -1 );
+		}
+		if ( sgBlockSize != sizes[i] ) {
+			fprintf( stderr, "Service refused block size %lu, aborting.\n", sizes[i] );
+			return( -1 );
+		}
+
+		// Write the file, then read it back
+		start = benchSeconds();
+		for ( blk = 0; blk < nblks; blk++ ) {
+			if ( sgwrite(fh, data, sizes[i]) != sizes[i] ) {
+				fprintf( stderr, "Write failed at block %lu, aborting.\n", blk );
+				return( -1 );
+			}
+		}
+		wtime = benchSeconds() - start;
+		sgseek( fh, 0 );
+		start = benchSeconds();
+		for ( blk = 0; blk < nblks; blk++ ) {
+			if ( (sgread(fh, buf, sizes[i]) != sizes[i]) || memcmp(buf, data, sizes[i]) ) {
+				fprintf( stderr, "Read failed at block %lu, aborting.\n", blk );
+				return( -1 );
+			}
+		}
+		rtime = benchSeconds() - start;
+		sgclose( fh );
+		sgshutdown();
+
+		printf( "%10lu %10lu %12.1f %12.1f %12.2f\n", sizes[i], nblks,
+			(nblks * sizes[i]) / wtime / 1048576, (nblks * sizes[i]) / rtime / 1048576,
+			(wtime + rtime) * 1e6 / (nblks * 2) );
+	}
+
+	// Clean up, return successfully
+	free( data );
+	free( buf );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchBlockMap
+// Description  : Fill a block map the way a growing file does, then look
+//                entries up sequentially and at random, reporting the mean
+//                and worst case cost of each operation
+//
+// Inputs       : blocks - the number of blocks in the map
+// Outputs      : 0 if successful, -1 if failure
+
+int benchBlockMap( uint64_t blocks ) {
+
+	// Local variables
+	SG_Block_Map map;
+	SG_Block_Entry *entry;
+	double start, now, last, worst;
+	uint64_t i, idx, rnd = 88172645463325252ULL;
+	const char *names[] = { "insert", "sequential", "random" };
+	int pass;
+
+	initBlockMap( &map );
+	printf( "%12s %12s %12s %12s\n", "operation", "blocks", "ns/op", "worst ns" );
+	for ( pass = 0; pass < 3; pass++ ) {
+		start = last = benchSeconds();
+		worst = 0;
+		for ( i = 0; i < blocks; i++ ) {
+
+			// Pick the block, random lookups use an xorshift sequence
+			idx = i;
+			if ( pass == 2 ) {
+				rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+				idx = rnd % blocks;
+			}
+			if ( pass == 0 ) {
+				if ( (entry = insertBlockMap(&map, idx)) == NULL ) {
+					fprintf( stderr, "Block map insert failed at block %lu, aborting.\n", idx );
+					return( -1 );
+				}
+				entry->nodeID = idx;
+				entry->blockID = ~idx;
+			} else if ( ((entry = lookupBlockMap(&map, idx)) == NULL) || (entry->blockID != ~idx) ) {
+				fprintf( stderr, "Block map lookup failed at block %lu, aborting.\n", idx );
+				return( -1 );
+			}
+
+			// Track the worst case over groups of 64 operations (timer cost)
+			if ( (i & 63) == 63 ) {
+				now = benchSeconds();
+				if ( now - last > worst ) {
+					worst = now - last;
+				}
+				last = now;
+			}
+		}
+		now = benchSeconds();
+		printf( "%12s %12lu %12.1f %12.1f\n", names[pass], blocks,
+			(now - start) * 1e9 / blocks, worst * 1e9 / 64 );
+	}
+	printf( "%lu pages, %.1f MB of metadata\n", map.pages, map.pages * 8192.0 / 1048576 );
+
+	// Clean up, return successfully
+	freeBlockMap( &map );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchCodec
+// Description  : Time the packet codec against the reference one, for header
+//                and data packets and for packets that fail validation.  The
+//                codec must first reproduce the results recorded in the
+//                corpus, so a faster codec is only timed once it is known to
+//                behave the same.
+//
+// Inputs       : packets - the number of packets per case
+//                corpus - the corpus file
+//                rewrite - record the corpus from this codec instead
+// Outputs      : 0 if successful, -1 if failure
+
+int benchCodec( uint64_t packets, const char *corpus, int rewrite ) {
+
+	// Local variables
+	const char *names[] = { "encode header", "encode data", "decode header", "decode data",
+		"decode bad magic", "decode bad op", "decode bad length" };
+	char data[SG_BLOCK_SIZE], out[SG_BLOCK_SIZE];
+	char hdr[SG_BASE_PACKET_SIZE], blk[SG_DATA_PACKET_SIZE], bad[3][SG_DATA_PACKET_SIZE], pkt[SG_DATA_PACKET_SIZE];
+	size_t hlen, blen, plen, badlen[3];
+	SG_Node_ID loc, rem;
+	SG_Block_ID bid;
+	SG_System_OP op;
+	SG_SeqNum sseq, rseq;
+	SG_Packet_Status status;
+	double start, times[2];
+	uint64_t i, ok;
+	int cs, ref, ret;
+
+	// The validation failures log an error each, keep them out of the timings
+	disableLogLevels( LOG_ERROR_LEVEL );
+	ret = checkCodecCorpus( corpus, rewrite );
+	if ( ret || rewrite ) {
+		enableLogLevels( LOG_ERROR_LEVEL );
+		return( ret );
+	}
+
+	// The packets decoded: valid ones, then a bad magic, op and length
+	for ( i = 0; i < SG_BLOCK_SIZE; i++ ) {
+		data[i] = ' ' + (i % 95);
+	}
+	serialize_sg_packet( 11, 22, 33, SG_OBTAIN_BLOCK, 10001, 10002, NULL, hdr, &hlen );
+	serialize_sg_packet( 11, 22, 33, SG_UPDATE_BLOCK, 10001, 10002, data, blk, &blen );
+	memcpy( bad[0], blk, blen );
+	bad[0][0] ^= 1;
+	badlen[0] = blen;
+	memcpy( bad[1], blk, blen );
+	bad[1][offsetof(SG_Packet_Buffer, operation)] = SG_MAXVAL_OP;
+	badlen[1] = blen;
+	memcpy( bad[2], blk, blen );
+	badlen[2] = blen - 1;
+
+	printf( "%18s %10s %12s %12s %10s\n", "case", "packets", "ns/packet", "ref ns", "speedup" );
+	for ( cs = 0; cs < 7; cs++ ) {
+		for ( ref = 0; ref < 2; ref++ ) {
+			ok = 0;
+			start = benchSeconds();
+			for ( i = 0; i < packets; i++ ) {
+
+				// Vary the sequence numbers so the calls cannot be folded
+				sseq = 10000 + (i & 1023);
+				plen = sizeof(pkt);
+				switch ( cs ) {
+				case 0:
+				case 1:
+					status = ref ?
+						sgsys_serialize_sg_packet( SG_REF_CODEC_KEY, 0, 11, 22, 33, SG_UPDATE_BLOCK, sseq,
+							10002, (cs == 1) ? data : NULL, pkt, &plen ) :
+						serialize_sg_packet( 11, 22, 33, SG_UPDATE_BLOCK, sseq, 10002,
+							(cs == 1) ? data : NULL, pkt, &plen );
+					break;
+				case 2:
+				case 3:
+					status = ref ?
+						sgsys_deserialize_sg_packet( SG_REF_CODEC_KEY, &loc, &rem, &bid, &op, &sseq, &rseq,
+							out, (cs == 2) ? hdr : blk, (cs == 2) ? hlen : blen ) :
+						deserialize_sg_packet( &loc, &rem, &bid, &op, &sseq, &rseq, out,
+							(cs == 2) ? hdr : blk, (cs == 2) ? hlen : blen );
+					break;
+				default:
+					status = ref ?
+						sgsys_deserialize_sg_packet( SG_REF_CODEC_KEY, &loc, &rem, &bid, &op, &sseq, &rseq,
+							out, bad[cs - 4], badlen[cs - 4] ) :
+						deserialize_sg_packet( &loc, &rem, &bid, &op, &sseq, &rseq, out,
+							bad[cs - 4], badlen[cs - 4] );
+					break;
+				}
+				ok += (status == SG_PACKT_OK);
+			}
+			times[ref] = benchSeconds() - start;
+
+			// The valid cases must pass, the bad ones fail, every time
+			if ( ok != ((cs < 4) ? packets : 0) ) {
+				fprintf( stderr, "Codec case [%s] gave the wrong status (%s), aborting.\n",
+					names[cs], ref ? "reference" : "driver" );
+				enableLogLevels( LOG_ERROR_LEVEL );
+				return( -1 );
+			}
+		}
+		printf( "%18s %10lu %12.1f %12.1f %9.2fx\n", names[cs], packets, times[0] * 1e9 / packets,
+			times[1] * 1e9 / packets, times[1] / times[0] );
+	}
+
+	// Clean up, return successfully
+	enableLogLevels( LOG_ERROR_LEVEL );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkCodecCorpus
+// Description  : Run the codec over the fuzzed corpus and compare its results
+//                with the recorded ones.  Each corpus packet is encoded from
+//                random (possibly invalid) fields, mutated (flipped bytes,
+//                indicator, trailing magic, length) and decoded; the line
+//                recorded is the status and a hash of the output of both
+//                steps.  The reference codec must also agree wherever the
+//                driver accepts (it does not check the length or trailing
+//                magic, so it accepts more) and rejects the data indicators
+//                the driver reads as "no data".
+//
+// Inputs       : corpus - the corpus file
+//                rewrite - record the corpus from this codec instead
+// Outputs      : 0 if the results match, -1 if not
+
+int checkCodecCorpus( const char *corpus, int rewrite ) {
+
+	// Local variables
+	char packet[SG_DATA_PACKET_SIZE + 8], copy[SG_DATA_PACKET_SIZE + 8], data[2][SG_BLOCK_SIZE];
+	char line[128], expect[128];
+	benchPacket in;
+	SG_Node_ID loc[2], rem[2];
+	SG_Block_ID blk[2];
+	SG_System_OP op[2];
+	SG_SeqNum sseq[2], rseq[2];
+	SG_Packet_Status enc, dec, status;
+	SG_Packet_Buffer buffer;
+	uint64_t rnd = SG_BENCH_SEED, ehash, dhash, r;
+	size_t i, plen, rlen, valid = 0, diffs = 0, refdiffs = 0;
+	FILE *fp;
+	int mut;
+
+	if ( (fp = fopen(corpus, rewrite ? "w" : "r")) == NULL ) {
+		fprintf( stderr, "Failed opening codec corpus [%s], aborting.\n", corpus );
+		return( -1 );
+	}
+	if ( rewrite ) {
+		fprintf( fp, "# sg_bench codec corpus: packet, encode status, encode hash, decode status, decode hash\n" );
+		fprintf( fp, "# %d packets from seed 0x%llx, rewrite with sg_bench -w codec\n", SG_BENCH_CORPUS, SG_BENCH_SEED );
+	}
+	for ( i = 0; i < SG_BENCH_CORPUS; i++ ) {
+
+		// Encode random fields, an invalid encoding still gives a header to mutate
+		makeCodecFields( &rnd, &in );
+		memset( packet, 0, sizeof(packet) );
+		enc = serialize_sg_packet( in.loc, in.rem, in.blk, in.op, in.sseq, in.rseq, in.block ? in.data : NULL,
+			packet, &plen );
+		ehash = (enc == SG_PACKT_OK) ? benchHash( packet, plen, SG_BENCH_HASH ) : 0;
+		rlen = sizeof(copy);
+		status = sgsys_serialize_sg_packet( SG_REF_CODEC_KEY, 0, in.loc, in.rem, in.blk, in.op, in.sseq, in.rseq,
+			in.block ? in.data : NULL, copy, &rlen );
+		if ( (status != enc) || ((enc == SG_PACKT_OK) && ((rlen != plen) || memcmp(copy, packet, plen))) ) {
+			fprintf( stderr, "Codec corpus packet %lu: reference encode differs (status %d, driver %d).\n",
+				i, status, enc );
+			refdiffs++;
+		}
+		if ( enc != SG_PACKT_OK ) {
+			construct_sg_packet_buffer( &buffer, SG_MAGIC_VALUE, in.loc, in.rem, in.blk, in.op, in.sseq,
+				in.rseq, 0 );
+			memcpy( packet, &buffer, sizeof(SG_Packet_Buffer) );
+			memcpy( &packet[sizeof(SG_Packet_Buffer)], &buffer.magic, sizeof(SG_Magic) );
+			plen = SG_BASE_PACKET_SIZE;
+		}
+
+		// Mutate three packets in four, one to three times
+		for ( mut = benchRandom(&rnd) & 3; mut > 0; mut-- ) {
+			r = benchRandom( &rnd );
+			switch ( r & 3 ) {
+			case 0: // flip a bit
+				packet[(r >> 8) % plen] ^= (char)(1 << ((r >> 4) & 7));
+				break;
+			case 1: // change the data indicator (base protocol values only)
+				packet[offsetof(SG_Packet_Buffer, indicator)] = (r >> 8) % 3;
+				break;
+			case 2: // corrupt the trailing magic
+				packet[plen - 1 - ((r >> 8) & 3)] ^= 0x5a;
+				break;
+			case 3: // shorten or lengthen the packet
+				plen = plen + ((r >> 8) & 7) - 4;
+				plen = (plen < sizeof(SG_Packet_Buffer)) ? sizeof(SG_Packet_Buffer) : plen;
+				break;
+			}
+		}
+
+		// Decode with both, the reference writes into the packet so it gets a copy
+		memcpy( copy, packet, sizeof(packet) );
+		memset( data, 0, sizeof(data) );
+		dec = deserialize_sg_packet( &loc[0], &rem[0], &blk[0], &op[0], &sseq[0], &rseq[0], data[0], packet, plen );
+		status = sgsys_deserialize_sg_packet( SG_REF_CODEC_KEY, &loc[1], &rem[1], &blk[1], &op[1], &sseq[1],
+			&rseq[1], data[1], copy, plen );
+		dhash = 0;
+		if ( dec == SG_PACKT_OK ) {
+			dhash = benchHash( &loc[0], sizeof(SG_Node_ID), SG_BENCH_HASH );
+			dhash = benchHash( &rem[0], sizeof(SG_Node_ID), dhash );
+			dhash = benchHash( &blk[0], sizeof(SG_Block_ID), dhash );
+			dhash = benchHash( &op[0], sizeof(SG_System_OP), dhash );
+			dhash = benchHash( &sseq[0], sizeof(SG_SeqNum), dhash );
+			dhash = benchHash( &rseq[0], sizeof(SG_SeqNum), dhash );
+			dhash = benchHash( data[0], SG_BLOCK_SIZE, dhash );
+			if ( (packet[offsetof(SG_Packet_Buffer, indicator)] <= SG_DATA_BLOCK) &&
+				((status != SG_PACKT_OK) || (loc[0] != loc[1]) || (rem[0] != rem[1]) || (blk[0] != blk[1]) ||
+				(op[0] != op[1]) || (sseq[0] != sseq[1]) || (rseq[0] != rseq[1]) ||
+				memcmp(data[0], data[1], SG_BLOCK_SIZE)) ) {
+				fprintf( stderr, "Codec corpus packet %lu: reference decode differs (status %d).\n", i, status );
+				refdiffs++;
+			}
+			valid++;
+		}
+
+		// Record the results, or compare them with the recorded ones
+		snprintf( line, sizeof(line), "%lu %d %016lx %d %016lx\n", i, enc, ehash, dec, dhash );
+		if ( rewrite ) {
+			fputs( line, fp );
+			continue;
+		}
+		do {
+			if ( fgets(expect, sizeof(expect), fp) == NULL ) {
+				fprintf( stderr, "Codec corpus [%s] ends at packet %lu, aborting.\n", corpus, i );
+				fclose( fp );
+				return( -1 );
+			}
+		} while ( expect[0] == '#' );
+		if ( strcmp(line, expect) ) {
+			if ( diffs++ < 10 ) {
+				fprintf( stderr, "Codec corpus packet %lu differs:\n  expected %s       got %s", i, expect, line );
+			}
+		}
+	}
+	if ( fclose(fp) ) {
+		fprintf( stderr, "Failed writing codec corpus [%s], aborting.\n", corpus );
+		return( -1 );
+	}
+	if ( diffs || refdiffs ) {
+		fprintf( stderr, "Codec corpus: %lu packets differ from [%s], %lu from the reference, aborting.\n",
+			diffs, corpus, refdiffs );
+		return( -1 );
+	}
+	printf( "codec corpus: %d packets (%lu decode), %s [%s]\n", SG_BENCH_CORPUS, valid,
+		rewrite ? "recorded to" : "match", corpus );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchFiles
+// Description  : Open many files (the driver metadata only, no data), open
+//                them all again, close them, then shut the driver down,
+//                reporting the heap bytes per file and the time of each step
+//
+// Inputs       : files - the number of files
+// Outputs      : 0 if successful, -1 if failure
+
+int benchFiles( uint64_t files ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { sgLocalServicePost, 0, SG_BLOCK_SIZE };
+	const char *names[] = { "open", "reopen", "close" };
+	double start, times[3], shutdown;
+	size_t before, after;
+	char path[64];
+	uint64_t i;
+	int pass;
+
+	// The first open initializes the endpoint, count the heap after it
+	if ( sgConfigureEndpoint(&config) || (sgopen("sg_bench_files") == -1) ) {
+		fprintf( stderr, "Endpoint setup failed, aborting.\n" );
+		return( -1 );
+	}
+	before = benchHeapBytes();
+	for ( pass = 0; pass < 3; pass++ ) {
+		start = benchSeconds();
+		for ( i = 0; i < files; i++ ) {
+			snprintf( path, sizeof(path), "sg_bench_files/%012lu", i );
+			if ( (pass < 2) && (sgopen(path) != i + 1) ) {
+				fprintf( stderr, "Open of file %lu failed, aborting.\n", i );
+				return( -1 );
+			}
+			if ( (pass == 2) && sgclose(i + 1) ) {
+				fprintf( stderr, "Close of file %lu failed, aborting.\n", i );
+				return( -1 );
+			}
+		}
+		times[pass] = benchSeconds() - start;
+		if ( pass == 0 ) {
+			after = benchHeapBytes();
+		}
+	}
+	start = benchSeconds();
+	if ( sgshutdown() ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+	shutdown = benchSeconds() - start;
+
+	printf( "%12s %12s %12s\n", "operation", "files", "ns/file" );
+	for ( pass = 0; pass < 3; pass++ ) {
+		printf( "%12s %12lu %12.1f\n", names[pass], files, times[pass] * 1e9 / files );
+	}
+	printf( "%.1f bytes of heap per file, shutdown %.3f ms\n", (double)(after - before) / files, shutdown * 1e3 );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchRestart
+// Description  : Create many one-block files with the metadata kept on disk,
+//                copy the journal aside (what a crash would leave), shut
+//                down (writing the snapshot), then restart from the copied
+//                journal alone and from a snapshot, reading every file back.
+//                The local service keeps its blocks across the restarts.
+//
+// Inputs       : files - the number of files
+// Outputs      : 0 if successful, -1 if failure
+
+int benchRestart( uint64_t files ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { sgLocalServicePost, 0, SG_BLOCK_SIZE };
+	double start, create, shutdown, restart[2], reads[2];
+	char path[64], block[SG_BLOCK_SIZE];
+	struct stat journal, snapshot;
+	uint64_t i;
+	SgFHandle fh;
+
+	// Start with no metadata kept, create the files
+	unlink( SG_BENCH_SNAPSHOT );
+	unlink( SG_BENCH_SNAPSHOT ".journal" );
+	unlink( SG_BENCH_CRASHED );
+	unlink( SG_BENCH_CRASHED ".journal" );
+	sgLocalServiceKeepBlocks( 1 );
+	if ( sgConfigureEndpoint(&config) || sgCheckpointConfigure(SG_BENCH_SNAPSHOT) ) {
+		fprintf( stderr, "Endpoint setup failed, aborting.\n" );
+		return( -1 );
+	}
+	start = benchSeconds();
+	for ( i = 0; i < files; i++ ) {
+		snprintf( path, sizeof(path), "sg_bench_restart/%012lu", i );
+		benchRestartBlock( i, block );
+		if ( ((fh = sgopen(path)) == -1) || (sgwrite(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) || sgclose(fh) ) {
+			fprintf( stderr, "Create of file %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	create = benchSeconds() - start;
+
+	// The journal is all there is until the first snapshot (at shutdown)
+	if ( stat(SG_BENCH_SNAPSHOT ".journal", &journal) ||
+			benchCopyFile(SG_BENCH_SNAPSHOT ".journal", SG_BENCH_CRASHED ".journal") ) {
+		fprintf( stderr, "Copy of the journal failed, aborting.\n" );
+		return( -1 );
+	}
+	start = benchSeconds();
+	if ( sgshutdown() ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+	shutdown = benchSeconds() - start;
+
+	// Restart as after the crash (journal replay), its shutdown writes a
+	// snapshot, then restart from that snapshot
+	if ( sgCheckpointConfigure(SG_BENCH_CRASHED) || benchRestartPass(files, &restart[0], &reads[0]) ||
+			stat(SG_BENCH_CRASHED, &snapshot) || benchRestartPass(files, &restart[1], &reads[1]) ) {
+		return( -1 );
+	}
+	sgCheckpointConfigure( NULL );
+	sgLocalServiceKeepBlocks( 0 );
+	unlink( SG_BENCH_SNAPSHOT );
+	unlink( SG_BENCH_SNAPSHOT ".journal" );
+	unlink( SG_BENCH_CRASHED );
+	unlink( SG_BENCH_CRASHED ".journal" );
+
+	printf( "%12s %12lu files, %8.1f ns/file, %6.1f journal bytes/file\n", "create", files, create * 1e9 / files,
+		(double)journal.st_size / files );
+	printf( "%12s %12.3f ms, %6.1f snapshot bytes/file\n", "shutdown", shutdown * 1e3, (double)snapshot.st_size / files );
+	printf( "%12s %12.3f ms to restore, %8.1f ns/file to read back\n", "replay", restart[0] * 1e3, reads[0] * 1e9 / files );
+	printf( "%12s %12.3f ms to restore, %8.1f ns/file to read back\n", "snapshot", restart[1] * 1e3, reads[1] * 1e9 / files );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchRestartPass
+// Description  : Restart the driver (the first open restores the metadata),
+//                read every file back and check it, then shut down
+//
+// Inputs       : files - the number of files
+//                restart - place to put the time the restore took
+//                reads - place to put the time to read all files back
+// Outputs      : 0 if successful, -1 if failure
+
+int benchRestartPass( uint64_t files, double *restart, double *reads ) {
+
+	// Local variables
+	char path[64], block[SG_BLOCK_SIZE], expect[SG_BLOCK_SIZE];
+	SG_Driver_Stats stats;
+	double start;
+	uint64_t i;
+	SgFHandle fh;
+
+	// The first open restores the metadata (the rest of the endpoint setup
+	// is slowed by the heap the local service leaves, a process would not)
+	if ( (sgopen("sg_bench_restart/000000000000") != 0) || sgGetStats(&stats) ) {
+		fprintf( stderr, "Restart failed, aborting.\n" );
+		return( -1 );
+	}
+	*restart = stats.restoreTime / 1e9;
+	start = benchSeconds();
+	for ( i = 0; i < files; i++ ) {
+		snprintf( path, sizeof(path), "sg_bench_restart/%012lu", i );
+		benchRestartBlock( i, expect );
+		if ( ((fh = sgopen(path)) != i) || (sgread(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) || sgclose(fh) ) {
+			fprintf( stderr, "Read back of file %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+		if ( memcmp(block, expect, SG_BLOCK_SIZE) ) {
+			fprintf( stderr, "File %lu read back wrong data, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	*reads = benchSeconds() - start;
+	if ( sgshutdown() ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchRestartBlock
+// Description  : The contents of a file of the restart benchmark
+//
+// Inputs       : file - the file number
+//                block - place to put the block
+// Outputs      : none
+
+void benchRestartBlock( uint64_t file, char *block ) {
+	memset( block, 1 + file % 251, SG_BLOCK_SIZE );
+	memcpy( block, &file, sizeof(file) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchCopyFile
+// Description  : Copy a file
+//
+// Inputs       : from - the file to copy
+//                to - the copy
+// Outputs      : 0 if successful, -1 if failure
+
+int benchCopyFile( const char *from, const char *to ) {
+
+	// Local variables
+	char buf[65536];
+	FILE *in, *out;
+	size_t len;
+	int ret = 0;
+
+	if ( (in = fopen(from, "r")) == NULL ) {
+		return( -1 );
+	}
+	if ( (out = fopen(to, "w")) == NULL ) {
+		fclose( in );
+		return( -1 );
+	}
+	while ( (len = fread(buf, 1, sizeof(buf), in)) > 0 ) {
+		if ( fwrite(buf, 1, len, out) != len ) {
+			ret = -1;
+			break;
+		}
+	}
+	fclose( in );
+	if ( fclose(out) ) {
+		ret = -1;
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchClone
+// Description  : Write a file, copy it by reading and writing every block,
+//                then clone it, write every other block of the clone and
+//                check both files read back as they should
+//
+// Inputs       : blocks - the number of blocks in the file
+// Outputs      : 0 if successful, -1 if failure
+
+int benchClone( uint64_t blocks ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { sgLocalServicePost, 0, SG_BLOCK_SIZE };
+	double start, copy, clone, cow;
+	char block[SG_BLOCK_SIZE];
+	SG_Driver_Stats stats;
+	SgFHandle src, dst;
+	uint64_t i;
+
+	// Write the file to copy
+	if ( sgConfigureEndpoint(&config) || ((src = sgopen("sg_bench_clone/source")) == -1) ) {
+		fprintf( stderr, "Endpoint setup failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		benchRestartBlock( i, block );
+		if ( sgwrite(src, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Write of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+
+	// Copy it the only way there was, reading and writing every block
+	start = benchSeconds();
+	if ( (sgseek(src, 0) == -1) || ((dst = sgopen("sg_bench_clone/copy")) == -1) ) {
+		fprintf( stderr, "Open of the copy failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		if ( (sgread(src, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) || (sgwrite(dst, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) ) {
+			fprintf( stderr, "Copy of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	copy = benchSeconds() - start;
+
+	// Clone it, then write every other block of the clone
+	start = benchSeconds();
+	if ( (dst = sgclone(src, "sg_bench_clone/clone")) == -1 ) {
+		fprintf( stderr, "Clone failed, aborting.\n" );
+		return( -1 );
+	}
+	clone = benchSeconds() - start;
+	start = benchSeconds();
+	for ( i = 0; i < blocks; i += 2 ) {
+		benchRestartBlock( i + blocks, block );
+		if ( (sgseek(dst, i * SG_BLOCK_SIZE) == -1) || (sgwrite(dst, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) ) {
+			fprintf( stderr, "Write of clone block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	cow = benchSeconds() - start;
+	if ( benchCloneCheck(src, blocks, 0) || benchCloneCheck(dst, blocks, 1) || sgGetStats(&stats) ) {
+		return( -1 );
+	}
+	if ( sgshutdown() ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+
+	printf( "%12s %12lu blocks, %10.3f ms, %8.1f ns/block\n", "copy", blocks, copy * 1e3, copy * 1e9 / blocks );
+	printf( "%12s %12lu blocks, %10.3f ms, %8.1f ns/block\n", "clone", blocks, clone * 1e3, clone * 1e9 / blocks );
+	printf( "%12s %12lu blocks, %10.3f ms, %8.1f ns/block, %lu still shared\n", "cow write", stats.copiedBlocks,
+		cow * 1e3, cow * 1e9 / ((blocks + 1) / 2), stats.sharedBlocks );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchCloneCheck
+// Description  : Read a file of the clone benchmark back and check it
+//
+// Inputs       : fh - the file
+//                blocks - the number of blocks in the file
+//                written - the even blocks were written after the clone
+// Outputs      : 0 if successful, -1 if failure
+
+int benchCloneCheck( SgFHandle fh, uint64_t blocks, uint64_t written ) {
+
+	// Local variables
+	char block[SG_BLOCK_SIZE], expect[SG_BLOCK_SIZE];
+	uint64_t i;
+
+	if ( sgseek(fh, 0) == -1 ) {
+		fprintf( stderr, "Seek failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		benchRestartBlock( (written && (i % 2 == 0)) ? i + blocks : i, expect );
+		if ( sgread(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Read back of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+		if ( memcmp(block, expect, SG_BLOCK_SIZE) ) {
+			fprintf( stderr, "Block %lu of the %s read back wrong data, aborting.\n", i, written ? "clone" : "source" );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchImport
+// Description  : Load a local file into the store with a loop of block-sized
+//                sgwrite calls, then with sgimport, and save it back with a
+//                loop of sgread calls, then with sgexport, checking the saved
+//                files hold what was loaded
+//
+// Inputs       : total - the size of the local file (a multiple of the block size)
+// Outputs      : 0 if successful, -1 if failure
+
+int benchImport( size_t total ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { sgLocalServicePost, 0, SG_BLOCK_SIZE };
+	double start, times[4];
+	char block[SG_BLOCK_SIZE];
+	uint64_t i, rnd = SG_BENCH_SEED;
+	SgFHandle fh;
+	FILE *out;
+
+	// Random local file, every block different
+	if ( (out = fopen(SG_BENCH_LOCAL, "w")) == NULL ) {
+		fprintf( stderr, "Create of [%s] failed, aborting.\n", SG_BENCH_LOCAL );
+		return( -1 );
+	}
+	for ( i = 0; i < total / SG_BLOCK_SIZE; i++ ) {
+		benchRestartBlock( benchRandom(&rnd), block );
+		fwrite( block, 1, SG_BLOCK_SIZE, out );
+	}
+	if ( fclose(out) || sgConfigureEndpoint(&config) ) {
+		fprintf( stderr, "Setup failed, aborting.\n" );
+		return( -1 );
+	}
+
+	// Load it a block at a time, then in one call
+	start = benchSeconds();
+	if ( ((out = fopen(SG_BENCH_LOCAL, "r")) == NULL) || ((fh = sgopen("sg_bench_import/loop")) == -1) ) {
+		fprintf( stderr, "Open for the write loop failed, aborting.\n" );
+		return( -1 );
+	}
+	while ( fread(block, 1, SG_BLOCK_SIZE, out) == SG_BLOCK_SIZE ) {
+		if ( sgwrite(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Write loop failed, aborting.\n" );
+			return( -1 );
+		}
+	}
+	fclose( out );
+	times[0] = benchSeconds() - start;
+	start = benchSeconds();
+	if ( sgimport(SG_BENCH_LOCAL, "sg_bench_import/bulk") != total ) {
+		fprintf( stderr, "Import failed, aborting.\n" );
+		return( -1 );
+	}
+	times[1] = benchSeconds() - start;
+
+	// Save the loop's file a block at a time, then the bulk one in one call
+	// (the cache holds the last blocks written either way)
+	start = benchSeconds();
+	if ( (sgseek(fh, 0) == -1) || ((out = fopen(SG_BENCH_EXPORTED, "w")) == NULL) ) {
+		fprintf( stderr, "Open for the read loop failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < total / SG_BLOCK_SIZE; i++ ) {
+		if ( sgread(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Read loop failed, aborting.\n" );
+			return( -1 );
+		}
+		fwrite( block, 1, SG_BLOCK_SIZE, out );
+	}
+	if ( fclose(out) ) {
+		fprintf( stderr, "Write of [%s] failed, aborting.\n", SG_BENCH_EXPORTED );
+		return( -1 );
+	}
+	times[2] = benchSeconds() - start;
+	if ( benchSameFile(SG_BENCH_LOCAL, SG_BENCH_EXPORTED) ) {
+		return( -1 );
+	}
+	start = benchSeconds();
+	if ( sgexport("sg_bench_import/bulk", SG_BENCH_EXPORTED) != total ) {
+		fprintf( stderr, "Export failed, aborting.\n" );
+		return( -1 );
+	}
+	times[3] = benchSeconds() - start;
+	if ( benchSameFile(SG_BENCH_LOCAL, SG_BENCH_EXPORTED) || sgshutdown() ) {
+		return( -1 );
+	}
+	unlink( SG_BENCH_LOCAL );
+	unlink( SG_BENCH_EXPORTED );
+
+	printf( "%12s %12s %12s\n", "", "loop MB/s", "bulk MB/s" );
+	printf( "%12s %12.1f %12.1f\n", "import", total / times[0] / 1e6, total / times[1] / 1e6 );
+	printf( "%12s %12.1f %12.1f\n", "export", total / times[2] / 1e6, total / times[3] / 1e6 );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchSameFile
+// Description  : Check two local files hold the same bytes
+//
+// Inputs       : a - the first file
+//                b - the second file
+// Outputs      : 0 if they do, -1 if not
+
+int benchSameFile( const char *a, const char *b ) {
+
+	// Local variables
+	char bufa[65536], bufb[65536];
+	FILE *ina, *inb;
+	size_t lena, lenb;
+	int ret = 0;
+
+	if ( (ina = fopen(a, "r")) == NULL ) {
+		fprintf( stderr, "Open of [%s] failed, aborting.\n", a );
+		return( -1 );
+	}
+	if ( (inb = fopen(b, "r")) == NULL ) {
+		fprintf( stderr, "Open of [%s] failed, aborting.\n", b );
+		fclose( ina );
+		return( -1 );
+	}
+	do {
+		lena = fread( bufa, 1, sizeof(bufa), ina );
+		lenb = fread( bufb, 1, sizeof(bufb), inb );
+		if ( (lena != lenb) || memcmp(bufa, bufb, lena) ) {
+			fprintf( stderr, "[%s] does not match [%s], aborting.\n", b, a );
+			ret = -1;
+			break;
+		}
+	} while ( lena > 0 );
+	fclose( ina );
+	fclose( inb );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchAdvise
+// Description  : Read a small hot file, then scan a large file, a few
+//                rounds over, for each advice policy: none, the scan read
+//                sequentially or used once, the hot file pinned or wanted
+//                before each round (read at once, or after the client idles
+//                long enough for the scheduler to fetch it)
+//
+// Inputs       : blocks - the number of blocks in the scanned file
+// Outputs      : 0 if successful, -1 if failure
+
+int benchAdvise( uint64_t blocks ) {
+	printf( "%12s %14s %16s %14s\n", "policy", "hot misses", "posts/round", "ms/round" );
+	if ( benchAdviseRun(blocks, "none", SG_ADVICE_NORMAL, SG_ADVICE_NORMAL, 0) ||
+			benchAdviseRun(blocks, "sequential", SG_ADVICE_NORMAL, SG_ADVICE_SEQUENTIAL, 0) ||
+			benchAdviseRun(blocks, "noreuse", SG_ADVICE_NORMAL, SG_ADVICE_NOREUSE, 0) ||
+			benchAdviseRun(blocks, "pin", SG_ADVICE_PIN, SG_ADVICE_NORMAL, 0) ||
+			benchAdviseRun(blocks, "willneed", SG_ADVICE_WILLNEED, SG_ADVICE_NORMAL, 0) ||
+			benchAdviseRun(blocks, "willneed 2ms", SG_ADVICE_WILLNEED, SG_ADVICE_NORMAL, SG_BENCH_ADVISE_IDLE_NS) ) {
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchAdviseRun
+// Description  : Run the rounds of the advise benchmark with one policy,
+//                PIN is given once, WILLNEED before each read of the hot file
+//
+// Inputs       : blocks - the number of blocks in the scanned file
+//                policy - the name of the policy
+//                hot - advice for the hot file
+//                scan - advice for the scanned file
+//                idle - client time (ns) between the advice and the hot file read
+// Outputs      : 0 if successful, -1 if failure
+
+int benchAdviseRun( uint64_t blocks, const char *policy, SG_Advice hot, SG_Advice scan, long idle ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { sgLocalServicePost, 0, SG_BLOCK_SIZE };
+	char block[SG_BLOCK_SIZE];
+	struct timespec wait = { idle / 1000000000L, idle % 1000000000L };
+	SG_Driver_Stats stats;
+	size_t posts, misses = 0;
+	SgFHandle hfh, sfh;
+	double start;
+	uint64_t i;
+	int round;
+
+	// Write both files
+	if ( sgConfigureEndpoint(&config) || ((hfh = sgopen("sg_bench_advise/hot")) == -1) ||
+			((sfh = sgopen("sg_bench_advise/scan")) == -1) ) {
+		fprintf( stderr, "Endpoint setup failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < SG_BENCH_HOT_BLOCKS + blocks; i++ ) {
+		benchRestartBlock( i, block );
+		if ( sgwrite((i < SG_BENCH_HOT_BLOCKS) ? hfh : sfh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Write of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	if ( ((hot == SG_ADVICE_PIN) && sgadvise(hfh, 0, 0, hot)) || sgadvise(sfh, 0, 0, scan) || sgGetStats(&stats) ) {
+		fprintf( stderr, "Advice failed, aborting.\n" );
+		return( -1 );
+	}
+	posts = stats.posts[SG_OBTAIN_BLOCK];
+
+	// Read the hot file, counting its misses, then scan
+	start = benchSeconds();
+	for ( round = 0; round < SG_BENCH_ROUNDS; round++ ) {
+		if ( (hot == SG_ADVICE_WILLNEED) && sgadvise(hfh, 0, 0, hot) ) {
+			fprintf( stderr, "Advice failed, aborting.\n" );
+			return( -1 );
+		}
+		if ( idle ) {
+			nanosleep( &wait, NULL );
+		}
+		if ( sgGetStats(&stats) ) {
+			return( -1 );
+		}
+		misses -= stats.cacheMisses;
+		if ( benchReadFile(hfh, SG_BENCH_HOT_BLOCKS) || sgGetStats(&stats) ) {
+			return( -1 );
+		}
+		misses += stats.cacheMisses;
+		if ( benchReadFile(sfh, blocks) ) {
+			return( -1 );
+		}
+	}
+	if ( sgGetStats(&stats) || sgshutdown() ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+	printf( "%12s %13.1f%% %16.1f %14.3f\n", policy, misses * 100.0 / (SG_BENCH_ROUNDS * SG_BENCH_HOT_BLOCKS),
+		(double)(stats.posts[SG_OBTAIN_BLOCK] - posts) / SG_BENCH_ROUNDS, (benchSeconds() - start) * 1e3 / SG_BENCH_ROUNDS );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchReadFile
+// Description  : Read a file through from its start, a block at a time
+//
+// Inputs       : fh - the file
+//                blocks - the number of blocks in the file
+// Outputs      : 0 if successful, -1 if failure
+
+int benchReadFile( SgFHandle fh, uint64_t blocks ) {
+
+	// Local variables
+	char block[SG_BLOCK_SIZE];
+	uint64_t i;
+
+	if ( sgseek(fh, 0) == -1 ) {
+		fprintf( stderr, "Seek failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		if ( sgread(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Read of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchPrefetch
+// Description  : Read a file larger than the cache a few passes over, in
+//                one shuffled block order (repeatable but not sequential),
+//                without the prefetcher, with it, with a table of a quarter
+//                of the blocks, and shuffled again each pass; the posts take
+//                as long as on a network and the client works between reads,
+//                so the prefetches can be posted while it does
+//
+// Inputs       : blocks - the number of blocks in the file
+// Outputs      : 0 if successful, -1 if failure
+
+int benchPrefetch( uint64_t blocks ) {
+	// sleeps of microseconds, not the default slack of 50
+	prctl( PR_SET_TIMERSLACK, 1 );
+	printf( "%12s %14s %10s %10s %14s %12s %12s\n", "prefetch", "misses/pass", "accuracy", "coverage", "posts/pass", "ms/pass", "read p99 us" );
+	if ( benchPrefetchRun(blocks, "off", 0, 0) ||
+			benchPrefetchRun(blocks, "on", blocks, 0) ||
+			benchPrefetchRun(blocks, "1/4 table", blocks / 4, 0) ||
+			benchPrefetchRun(blocks, "reshuffled", blocks, 1) ) {
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchPrefetchRun
+// Description  : Run the passes of the prefetch benchmark with one setting,
+//                the accuracy is of the prefetches used or wasted, the
+//                coverage the share of the misses they saved
+//
+// Inputs       : blocks - the number of blocks in the file
+//                name - the name of the setting
+//                entries - the prefetcher table entries, 0 for none
+//                reshuffle - read in a new order each pass
+// Outputs      : 0 if successful, -1 if failure
+
+int benchPrefetchRun( uint64_t blocks, const char *name, size_t entries, int reshuffle ) {
+
+	// Local variables
+	SG_Endpoint_Config config = { benchSlowPost, 0, SG_BLOCK_SIZE };
+	char block[SG_BLOCK_SIZE];
+	uint64_t i, rnd = SG_BENCH_SEED, *order;
+	SG_Driver_Stats stats;
+	SG_Histogram reads;
+	size_t posts, misses, used, wasted;
+	SgFHandle fh;
+	double start;
+	int pass;
+
+	// Write the file, then shuffle the order it is read in
+	if ( sgConfigureEndpoint(&config) || sgPrefetchConfigure(entries, 60) || ((fh = sgopen("sg_bench_prefetch/file")) == -1) ) {
+		fprintf( stderr, "Endpoint setup failed, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		benchRestartBlock( i, block );
+		if ( sgwrite(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE ) {
+			fprintf( stderr, "Write of block %lu failed, aborting.\n", i );
+			return( -1 );
+		}
+	}
+	if ( (order = malloc(blocks * sizeof(uint64_t))) == NULL ) {
+		fprintf( stderr, "Out of memory, aborting.\n" );
+		return( -1 );
+	}
+	for ( i = 0; i < blocks; i++ ) {
+		order[i] = i;
+	}
+	benchShuffle( &rnd, order, blocks );
+	if ( sgGetStats(&stats) ) {
+		free( order );
+		return( -1 );
+	}
+	posts = stats.posts[SG_OBTAIN_BLOCK];
+	misses = stats.cacheMisses;
+	reads = stats.calls[SG_CALL_READ];
+	used = stats.prefetchUsed;
+	wasted = stats.prefetchWasted;
+
+	// Read the passes
+	start = benchSeconds();
+	for ( pass = 0; pass < SG_BENCH_PREFETCH_ROUNDS; pass++ ) {
+		if ( reshuffle && pass ) {
+			benchShuffle( &rnd, order, blocks );
+		}
+		for ( i = 0; i < blocks; i++ ) {
+			if ( (sgseek(fh, order[i] * SG_BLOCK_SIZE) == -1) || (sgread(fh, block, SG_BLOCK_SIZE) != SG_BLOCK_SIZE) ) {
+				fprintf( stderr, "Read of block %lu failed, aborting.\n", order[i] );
+				free( order );
+				return( -1 );
+			}
+			benchSpin( SG_BENCH_THINK_NS );
+		}
+	}
+	free( order );
+	if ( sgGetStats(&stats) || sgshutdown() || sgPrefetchConfigure(0, 0) ) {
+		fprintf( stderr, "Shutdown failed, aborting.\n" );
+		return( -1 );
+	}
+	misses = stats.cacheMisses - misses;
+	used = stats.prefetchUsed - used;
+	wasted = stats.prefetchWasted - wasted;
+	for ( i = 0; i < SG_HISTOGRAM_BUCKETS; i++ ) {
+		reads.counts[i] = stats.calls[SG_CALL_READ].counts[i] - reads.counts[i];
+	}
+	reads.count = stats.calls[SG_CALL_READ].count - reads.count;
+	reads.max = stats.calls[SG_CALL_READ].max;
+	printf( "%12s %14.1f %9.1f%% %9.1f%% %14.1f %12.3f %12.1f\n", name, (double)misses / SG_BENCH_PREFETCH_ROUNDS,
+		used + wasted ? used * 100.0 / (used + wasted) : 0.0, used + misses ? used * 100.0 / (used + misses) : 0.0,
+		(double)(stats.posts[SG_OBTAIN_BLOCK] - posts) / SG_BENCH_PREFETCH_ROUNDS,
+		(benchSeconds() - start) * 1e3 / SG_BENCH_PREFETCH_ROUNDS, getSGHistogramPercentile(&reads, 99) / 1e3 );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchShuffle
+// Description  : Shuffle an order in place (Fisher-Yates)
+//
+// Inputs       : rnd - the random state
+//                order - the order
+//                count - its length
+// Outputs      : none
+
+void benchShuffle( uint64_t *rnd, uint64_t *order, uint64_t count ) {
+
+	// Local variables
+	uint64_t i, j, t;
+
+	for ( i = count; i > 1; i-- ) {
+		j = benchRandom( rnd ) % i;
+		t = order[i - 1];
+		order[i - 1] = order[j];
+		order[j] = t;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchSlowPost
+// Description  : Post a packet to the local service, then sleep for
+//                SG_BENCH_POST_NS as a remote service would (waiting, the
+//                processor is free for the client)
+//
+// Inputs       : packet - the packet to send
+//                len - its length
+//                rpacket - place to put the reply
+//                rlen - the size of the reply buffer, then its length
+// Outputs      : 0 if successful, -1 if failure
+
+int benchSlowPost( char *packet, size_t *len, char *rpacket, size_t *rlen ) {
+	struct timespec wait = { 0, SG_BENCH_POST_NS };
+	int ret = sgLocalServicePost( packet, len, rpacket, rlen );
+	nanosleep( &wait, NULL );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchSpin
+// Description  : Busy wait (a sleep is too coarse for microseconds)
+//
+// Inputs       : ns - the time to wait
+// Outputs      : none
+
+void benchSpin( uint64_t ns ) {
+	uint64_t due = getSGTimeNS() + ns;
+	while ( getSGTimeNS() < due );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : makeCodecFields
+// Description  : Draw the fields of the next corpus packet, one in eight of
+//                the identifiers and sequence numbers zero (invalid) and the
+//                operations including one past the last
+//
+// Inputs       : rnd - the random state
+//                in - the fields to fill
+// Outputs      : none
+
+void makeCodecFields( uint64_t *rnd, benchPacket *in ) {
+
+	// Local variables
+	uint64_t r = benchRandom( rnd );
+	size_t i;
+
+	in->loc = (r & 7) ? benchRandom( rnd ) : 0;
+	in->rem = (r & (7 << 3)) ? benchRandom( rnd ) : 0;
+	in->blk = (r & (7 << 6)) ? benchRandom( rnd ) : 0;
+	in->op = (r >> 9) % (SG_MAXVAL_OP + 2);
+	in->sseq = (r & (7 << 13)) ? benchRandom( rnd ) : 0;
+	in->rseq = (r & (7 << 16)) ? benchRandom( rnd ) : 0;
+	in->block = (r >> 19) & 1;
+	for ( i = 0; i < SG_BLOCK_SIZE; i += sizeof(uint64_t) ) {
+		r = benchRandom( rnd );
+		memcpy( &in->data[i], &r, sizeof(uint64_t) );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchHash
+// Description  : Hash a buffer (FNV-1a), chaining from a previous hash
+//
+// Inputs       : buf - the buffer
+//                len - its length
+//                hash - the hash so far (SG_BENCH_HASH to start)
+// Outputs      : the hash
+
+uint64_t benchHash( const void *buf, size_t len, uint64_t hash ) {
+	const unsigned char *p = buf;
+	while ( len-- ) {
+		hash = (hash ^ *p++) * 0x100000001b3ULL;
+	}
+	return( hash );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchRandom
+// Description  : Get the next xorshift random number
+//
+// Inputs       : rnd - the random state
+// Outputs      : the random number
+
+uint64_t benchRandom( uint64_t *rnd ) {
+	*rnd ^= *rnd << 13; *rnd ^= *rnd >> 7; *rnd ^= *rnd << 17;
+	return( *rnd );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchSeconds
+// Description  : Get a monotonic timestamp
+//
+// Inputs       : none
+// Outputs      : the time in seconds
+
+double benchSeconds( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ts.tv_sec + ts.tv_nsec / 1e9 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : benchHeapBytes
+// Description  : Get the heap bytes in use (allocated chunks and mappings)
+//
+// Inputs       : none
+// Outputs      : the bytes in use
+
+size_t benchHeapBytes( void ) {
+	struct mallinfo2 info = mallinfo2();
+
+	return( info.uordblks + info.hblkhd );
+}
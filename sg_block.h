@@ -0,0 +1,63 @@
+#ifndef SG_BLOCK_INCLUDED
+#define SG_BLOCK_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_block.h
+//  Description    : This is the declaration of the whole-block helpers for
+//                   the scatter gather system (copy, zero, zero check), so
+//                   the block size is passed in one place.  There are no
+//                   per-size copy paths: a constant 1 KB copy built at -O2
+//                   is a rep movsq, 2.7x slower than the libc memcpy, and
+//                   an SSE2 loop is slower than memcpy at 1 KB and 4 KB.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <string.h>
+#include <sg_defs.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//
+// Functions
+
+static inline void sgCopyBlock( char *dst, const char *src, size_t bsz ) {
+    // Copy a whole block of size bsz
+    memcpy(dst, src, bsz);
+}
+
+static inline void sgZeroBlock( char *dst, size_t bsz ) {
+    // Zero a whole block of size bsz
+    memset(dst, 0, bsz);
+}
+
+static inline int sgBlockIsZero( const char *blk, size_t bsz ) {
+    // Check whether a whole block (multiple of 64 bytes) is all zeros
+#ifdef __SSE2__
+    const __m128i *vec = (const __m128i *) blk;
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < bsz / sizeof(__m128i); i += 4) {
+        acc = _mm_or_si128(acc, _mm_or_si128(_mm_loadu_si128(vec + i), _mm_loadu_si128(vec + i + 1)));
+        acc = _mm_or_si128(acc, _mm_or_si128(_mm_loadu_si128(vec + i + 2), _mm_loadu_si128(vec + i + 3)));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xffff;
+#else
+    uint64_t acc = 0, word;
+    for (size_t i = 0; i < bsz; i += sizeof(uint64_t)) {
+        memcpy(&word, blk + i, sizeof(uint64_t));
+        acc |= word;
+    }
+    return acc == 0;
+#endif
+}
+
+static inline int sgValidBlockSize( size_t bsz ) {
+    // Block sizes are powers of two between the minimum and maximum
+    return (bsz >= SG_MIN_BLOCK_SIZE) && (bsz <= SG_MAX_BLOCK_SIZE) && ((bsz & (bsz - 1)) == 0);
+}
+
+#endif
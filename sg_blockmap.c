@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_blockmap.c
+//  Description    : This file contains the per-file block map of the scatter
+//                   gather driver.  Leaf pages hold SG_BLOCKMAP_FANOUT 
+//                   (node, block) entries, interior pages hold pointers to
+//                   the level below.  The tree grows by adding a root above
+//                   the old one, so no entry is ever copied, and a lookup 
+//                   touches at most one page per level.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+
+// Project Includes
+#include <sg_blockmap.h>
+
+// Defines
+#define SG_BLOCKMAP_MASK (SG_BLOCKMAP_FANOUT - 1)
+
+// Functional Prototypes
+void freeBlockMapPage( void *page, int height );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initBlockMap
+// Description  : Initialize an empty block map
+//
+// Inputs       : map - the block map
+// Outputs      : none
+
+void initBlockMap( SG_Block_Map *map ) {
+    map->root = NULL;
+    map->height = 0;
+    map->hintBase = 0;
+    map->hintLeaf = NULL;
+    map->pages = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lookupBlockMap
+// Description  : Find the entry of a block, NULL if never set (a hole)
+//
+// Inputs       : map - the block map
+//                idx - the block index within the file
+// Outputs      : pointer to the entry, NULL if not in the map
+
+SG_Block_Entry * lookupBlockMap( SG_Block_Map *map, uint64_t idx ) {
+    void * page = map->root;
+    int level;
+
+    // same leaf page as last time (the common, sequential case)
+    if (map->hintLeaf && (idx & ~(uint64_t) SG_BLOCKMAP_MASK) == map->hintBase) {
+        return &map->hintLeaf[idx & SG_BLOCKMAP_MASK];
+    }
+    // index beyond what the tree can hold at this height
+    if (map->height == 0 || (map->height < SG_BLOCKMAP_MAX_HEIGHT && 
+                             (idx >> (SG_BLOCKMAP_BITS * map->height)) != 0)) {
+        return NULL;
+    }
+    // walk down the interior pages
+    for (level = map->height - 1; level > 0 && page; level--) {
+        page = ((void **) page)[(idx >> (SG_BLOCKMAP_BITS * level)) & SG_BLOCKMAP_MASK];
+    }
+    if (page == NULL) {
+        return NULL;
+    }
+    map->hintBase = idx & ~(uint64_t) SG_BLOCKMAP_MASK;
+    map->hintLeaf = (SG_Block_Entry *) page;
+    return &map->hintLeaf[idx & SG_BLOCKMAP_MASK];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : insertBlockMap
+// Description  : Find or create the entry of a block (new entries are holes)
+//
+// Inputs       : map - the block map
+//                idx - the block index within the file
+// Outputs      : pointer to the entry, NULL if out of memory
+
+SG_Block_Entry * insertBlockMap( SG_Block_Map *map, uint64_t idx ) {
+    SG_Block_Entry * entry;
+    void ** slot;
+    int level, i;
+
+    if ((entry = lookupBlockMap(map, idx)) != NULL) {
+        return entry;
+    }
+    // grow the tree upwards until the index fits, the old root becomes child 0
+    if (map->height == 0) {
+        map->height = 1;
+    }
+    while (map->height < SG_BLOCKMAP_MAX_HEIGHT && (idx >> (SG_BLOCKMAP_BITS * map->height)) != 0) {
+        if (map->root) {
+            void ** root = (void **) calloc(SG_BLOCKMAP_FANOUT, sizeof(void *));
+            if (root == NULL) {
+                return NULL;
+            }
+            root[0] = map->root;
+            map->root = root;
+            map->pages++;
+        }
+        map->height++;
+    }
+    // walk down, allocating missing interior pages and the leaf page
+    slot = &map->root;
+    for (level = map->height - 1; level > 0; level--) {
+        if (*slot == NULL) {
+            if ((*slot = calloc(SG_BLOCKMAP_FANOUT, sizeof(void *))) == NULL) {
+                return NULL;
+            }
+            map->pages++;
+        }
+        slot = &((void **) *slot)[(idx >> (SG_BLOCKMAP_BITS * level)) & SG_BLOCKMAP_MASK];
+    }
+    if (*slot == NULL) {
+        if ((entry = (SG_Block_Entry *) malloc(SG_BLOCKMAP_FANOUT * sizeof(SG_Block_Entry))) == NULL) {
+            return NULL;
+        }
+        for (i = 0; i < SG_BLOCKMAP_FANOUT; i++) {
+            entry[i].nodeID = SG_NODE_UNKNOWN;
+            entry[i].blockID = SG_BLOCK_UNKNOWN;
+        }
+        *slot = entry;
+        map->pages++;
+    }
+    map->hintBase = idx & ~(uint64_t) SG_BLOCKMAP_MASK;
+    map->hintLeaf = (SG_Block_Entry *) *slot;
+    return &map->hintLeaf[idx & SG_BLOCKMAP_MASK];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeBlockMap
+// Description  : Release all pages of the block map
+//
+// Inputs       : map - the block map
+// Outputs      : none
+
+void freeBlockMap( SG_Block_Map *map ) {
+    if (map->root) {
+        freeBlockMapPage(map->root, map->height);
+    }
+    initBlockMap(map);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeBlockMapPage
+// Description  : Release a page of the block map and everything below it
+//
+// Inputs       : page - the page to release
+//                height - the height of the page (1 for leaf pages)
+// Outputs      : none
+
+void freeBlockMapPage( void *page, int height ) {
+    if (height > 1) {
+        for (int i = 0; i < SG_BLOCKMAP_FANOUT; i++) {
+            if (((void **) page)[i]) {
+                freeBlockMapPage(((void **) page)[i], height - 1);
+            }
+        }
+    }
+    free(page);
+}
@@ -0,0 +1,53 @@
+#ifndef SG_BLOCKMAP_INCLUDED
+#define SG_BLOCKMAP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_blockmap.h
+//  Description    : This is the declaration of the per-file block map of the
+//                   scatter gather driver, a paged radix tree from the block
+//                   index in the file to the remote (node, block) pair.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <sg_defs.h>
+
+//
+// Defines
+#define SG_BLOCKMAP_BITS 9                          // index bits per tree level
+#define SG_BLOCKMAP_FANOUT (1 << SG_BLOCKMAP_BITS)  // entries per page (8 KB leaf pages)
+#define SG_BLOCKMAP_MAX_HEIGHT 7                    // enough levels for 64-bit indices
+
+// Type definitions
+typedef struct {
+    SG_Node_ID nodeID;          // the remote node holding the block
+    SG_Block_ID blockID;        // the remote block (SG_BLOCK_UNKNOWN if a hole)
+} SG_Block_Entry;
+
+typedef struct {
+    void * root;                // root page (leaf page if height is 1)
+    int height;                 // number of levels in the tree (0 if empty)
+    uint64_t hintBase;          // first index of the last leaf page used
+    SG_Block_Entry * hintLeaf;  // the last leaf page used (sequential access)
+    size_t pages;               // number of pages allocated
+} SG_Block_Map;
+
+//
+// Block map functions
+
+void initBlockMap( SG_Block_Map *map );
+    // Initialize an empty block map
+
+SG_Block_Entry * lookupBlockMap( SG_Block_Map *map, uint64_t idx );
+    // Find the entry of a block, NULL if never set (a hole)
+
+SG_Block_Entry * insertBlockMap( SG_Block_Map *map, uint64_t idx );
+    // Find or create the entry of a block (new entries are holes)
+
+void freeBlockMap( SG_Block_Map *map );
+    // Release all pages of the block map
+
+#endif
@@ -0,0 +1,231 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_blockref.c
+//  Description    : This file contains the reference counts of the remote
+//                   blocks shared by cloned files, an open addressing table
+//                   from the (node, block) pair to the number of block map
+//                   entries holding it.  A block leaves the table when only
+//                   one entry is left, so the table only ever holds the
+//                   shared blocks.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_blockref.h>
+
+// Functional Prototypes
+size_t slotBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk );
+size_t findBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk );
+int growBlockRefs( SG_Block_Refs *refs );
+void removeBlockRefs( SG_Block_Refs *refs, size_t slot );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initBlockRefs
+// Description  : Initialize an empty table
+//
+// Inputs       : refs - the table
+// Outputs      : none
+
+void initBlockRefs( SG_Block_Refs *refs ) {
+    refs->slots = NULL;
+    refs->size = 0;
+    refs->used = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : countBlockRefs
+// Description  : The number of block map entries holding a block
+//
+// Inputs       : refs - the table
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : the number of entries, 1 if the block is not shared
+
+uint64_t countBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk ) {
+    size_t slot;
+
+    if (refs->used == 0) {
+        return 1;
+    }
+    slot = findBlockRefs(refs, nde, blk);
+    return refs->slots[slot].refs ? refs->slots[slot].refs : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : setBlockRefs
+// Description  : Set the number of block map entries holding a block, the
+//                table doubles when half full
+//
+// Inputs       : refs - the table
+//                nde - the remote node of the block
+//                blk - the remote block
+//                count - the number of entries (1 or less, not shared)
+// Outputs      : 0 if successful, -1 if failure
+
+int setBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk, uint64_t count ) {
+    size_t slot;
+
+    if (count <= 1) {
+        if ((refs->used > 0) && refs->slots[slot = findBlockRefs(refs, nde, blk)].refs) {
+            removeBlockRefs(refs, slot);
+        }
+        return 0;
+    }
+    if ((refs->used > 0) && refs->slots[slot = findBlockRefs(refs, nde, blk)].refs) {
+        refs->slots[slot].refs = count;
+        return 0;
+    }
+
+    // a block newly shared
+    if (((refs->used + 1) * 2 > refs->size) && growBlockRefs(refs)) {
+        return -1;
+    }
+    slot = findBlockRefs(refs, nde, blk);
+    refs->slots[slot].nodeID = nde;
+    refs->slots[slot].blockID = blk;
+    refs->slots[slot].refs = count;
+    refs->used++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addBlockRef
+// Description  : Count one more block map entry holding a block
+//
+// Inputs       : refs - the table
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : 0 if successful, -1 if failure
+
+int addBlockRef( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk ) {
+    return setBlockRefs(refs, nde, blk, countBlockRefs(refs, nde, blk) + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dropBlockRef
+// Description  : Count one block map entry fewer holding a block
+//
+// Inputs       : refs - the table
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : 0 if successful, -1 if failure
+
+int dropBlockRef( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk ) {
+    return setBlockRefs(refs, nde, blk, countBlockRefs(refs, nde, blk) - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeBlockRefs
+// Description  : Release the table
+//
+// Inputs       : refs - the table
+// Outputs      : none
+
+void freeBlockRefs( SG_Block_Refs *refs ) {
+    free(refs->slots);
+    initBlockRefs(refs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : slotBlockRefs
+// Description  : The home slot of a block in the table
+//
+// Inputs       : refs - the table
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : the slot
+
+size_t slotBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk ) {
+    uint64_t key = (blk ^ ((nde << 32) | (nde >> 32))) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (key >> 32) & (refs->size - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findBlockRefs
+// Description  : Find the slot of a block, or the free slot it would go in
+//
+// Inputs       : refs - the table (with slots)
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : the slot
+
+size_t findBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk ) {
+    size_t slot = slotBlockRefs(refs, nde, blk);
+
+    while (refs->slots[slot].refs &&
+           ((refs->slots[slot].nodeID != nde) || (refs->slots[slot].blockID != blk))) {
+        slot = (slot + 1) & (refs->size - 1);
+    }
+    return slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : growBlockRefs
+// Description  : Rehash the table into one twice the size
+//
+// Inputs       : refs - the table
+// Outputs      : 0 if successful, -1 if failure
+
+int growBlockRefs( SG_Block_Refs *refs ) {
+    SG_Block_Ref *old = refs->slots;
+    size_t oldSize = refs->size, i;
+
+    refs->size = oldSize ? oldSize * 2 : SG_BLOCKREF_SLOTS;
+    if ((refs->slots = (SG_Block_Ref *) calloc(refs->size, sizeof(SG_Block_Ref))) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "growBlockRefs: out of memory (%lu slots)", refs->size);
+        refs->slots = old;
+        refs->size = oldSize;
+        return -1;
+    }
+    for (i = 0; i < oldSize; i++) {
+        if (old[i].refs) {
+            refs->slots[findBlockRefs(refs, old[i].nodeID, old[i].blockID)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : removeBlockRefs
+// Description  : Free the slot of a block, moving back the blocks probed
+//                past it so that no probe stops early
+//
+// Inputs       : refs - the table
+//                slot - the slot of the block
+// Outputs      : none
+
+void removeBlockRefs( SG_Block_Refs *refs, size_t slot ) {
+    size_t mask = refs->size - 1, next, home;
+
+    for (next = (slot + 1) & mask; refs->slots[next].refs; next = (next + 1) & mask) {
+        // a block can fill the hole if its home slot is not between the hole and it
+        home = slotBlockRefs(refs, refs->slots[next].nodeID, refs->slots[next].blockID);
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            refs->slots[slot] = refs->slots[next];
+            slot = next;
+        }
+    }
+    refs->slots[slot].refs = 0;
+    refs->used--;
+}
@@ -0,0 +1,58 @@
+#ifndef SG_BLOCKREF_INCLUDED
+#define SG_BLOCKREF_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_blockref.h
+//  Description    : This is the declaration of the reference counts of the
+//                   remote blocks shared by cloned files.  Only shared blocks
+//                   are in the table, any other block has the one file that
+//                   maps it, so files that were never cloned cost nothing.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stddef.h>
+#include <sg_defs.h>
+
+//
+// Defines
+#define SG_BLOCKREF_SLOTS 256   // initial slots of the table (power of two)
+
+// Type definitions
+typedef struct {
+    SG_Node_ID nodeID;          // the remote node holding the block
+    SG_Block_ID blockID;        // the remote block
+    uint64_t refs;              // number of block map entries holding it, 0 if the slot is free
+} SG_Block_Ref;
+
+typedef struct {
+    SG_Block_Ref * slots;       // open addressing table (linear probing)
+    size_t size;                // number of slots (power of two, at most half used)
+    size_t used;                // number of shared blocks
+} SG_Block_Refs;
+
+//
+// Block reference functions
+
+void initBlockRefs( SG_Block_Refs *refs );
+    // Initialize an empty table (no slots are allocated until used)
+
+uint64_t countBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk );
+    // The number of files mapping a block (1 if it is not shared)
+
+int setBlockRefs( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk, uint64_t count );
+    // Set the number of files mapping a block (1 takes it out of the table)
+
+int addBlockRef( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk );
+    // One more file maps the block
+
+int dropBlockRef( SG_Block_Refs *refs, SG_Node_ID nde, SG_Block_ID blk );
+    // One file fewer maps the block
+
+void freeBlockRefs( SG_Block_Refs *refs );
+    // Release the table, leaving it empty
+
+#endif
@@ -16,23 +16,40 @@
 
 // Project Includes
 #include <sg_cache.h>
+#include <sg_block.h>
+#include <sg_log.h>
+#include <sg_span.h>
 
 // Defines
 typedef struct {
-    size_t accessTime;
+    size_t accessTime;      // query count of the last use, 0 at the cold end
+    int pinned;             // never evicted (sgadvise PIN)
+    int prefetched;         // put by the prefetcher and not read since
     SG_Block_ID blockID;
     SG_Node_ID nodeID;
-    SGDataBlock block;
+    char block[];           // cache line, sized to the block size
 } SG_Cache_Data;
 
 // LRU Cache defined
 SG_Cache_Data * cache[SG_MAX_CACHE_ELEMENTS];
 int cache_size;
+size_t cache_block_size;
 int next_location = 0;
 size_t queries = 0;
 size_t hit = 0;
+size_t evicted = 0;
+int pinned = 0;         // number of pinned lines
+size_t prefetch_used = 0;   // prefetched lines read before eviction
+size_t prefetch_wasted = 0; // prefetched lines evicted or replaced unread
+int16_t cache_index[SG_CACHE_INDEX_SIZE]; // line of the block hashed to each slot, -1 if free
 // Functional Prototypes
 
+int claimSGCacheLine( void );
+size_t slotSGCache( SG_Node_ID nde, SG_Block_ID blk );
+int findSGCacheLine( SG_Node_ID nde, SG_Block_ID blk );
+void indexSGCacheLine( int line );
+void unindexSGCacheLine( int line );
+
 //
 // Functions
 
@@ -42,14 +59,17 @@ size_t hit = 0;
 // Description  : Initialize the cache of block elements
 //
 // Inputs       : maxElements - maximum number of elements allowed
+//                blockSize - the size of the blocks (cache lines)
 // Outputs      : 0 if successful, -1 if failure
 
-int initSGCache( uint16_t maxElements ) {
+int initSGCache( uint16_t maxElements, size_t blockSize ) {
     // dynamically allocate memory for cache lines
     for (int i = 0; i < maxElements; i++) {
-        cache[i] = (SG_Cache_Data *) malloc(sizeof(SG_Cache_Data));
+        cache[i] = (SG_Cache_Data *) malloc(sizeof(SG_Cache_Data) + blockSize);
     }
     cache_size = maxElements;
+    cache_block_size = blockSize;
+    memset(cache_index, 0xff, sizeof(cache_index));
 
     // Return successfully
     return 0;
@@ -69,11 +89,48 @@ int closeSGCache( void ) {
         free(cache[i]);
     }
     // Return successfully
-    logMessage(SGDriverLevel, "Closing cache: %d queries, %d hits (%.2f%% hit rate).", queries, hit, (float) hit * 100 / queries);
-    logMessage(LOG_INFO_LEVEL, "Closed cmpsc311 cache, deleting %d items", next_location);
+    SG_LOG(SGDriverLevel, "Closing cache: %lu queries, %lu hits (%.2f%% hit rate).", queries, hit, (float) hit * 100 / queries);
+    SG_LOG(LOG_INFO_LEVEL, "Closed cmpsc311 cache, deleting %d items", next_location);
+    next_location = 0;
+    queries = 0;
+    hit = 0;
+    evicted = 0;
+    pinned = 0;
+    prefetch_used = 0;
+    prefetch_wasted = 0;
     return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGCacheStats
+// Description  : Get the number of cache lookups, hits and evictions since
+//                the cache was opened
+//
+// Inputs       : lookups - place to put the number of lookups
+//                hits - place to put the number of hits
+//                evictions - place to put the number of evictions
+// Outputs      : 0 always
+
+int getSGCacheStats( size_t *lookups, size_t *hits, size_t *evictions ) {
+    *lookups = queries;
+    *hits = hit;
+    *evictions = evicted;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGCachePinned
+// Description  : Get the number of pinned cache lines
+//
+// Inputs       : none
+// Outputs      : the number of pinned lines
+
+int getSGCachePinned( void ) {
+    return pinned;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : getSGDataBlock
@@ -84,15 +141,55 @@ int closeSGCache( void ) {
 // Outputs      : pointer to block or NULL if not found
 
 char * getSGDataBlock( SG_Node_ID nde, SG_Block_ID blk ) {
+    SG_SPAN("cache get");
     queries += 1;
-    int i = 0;
-    for (i = 0; i < next_location; i++) {
-        // if match, increase # hits by 1 and assign block
-        if (nde == cache[i]->nodeID && blk == cache[i]->blockID) {
-            hit += 1;
-            cache[i]->accessTime = queries;
-            return cache[i]->block;
-        }
+    int i = findSGCacheLine(nde, blk);
+    // if match, increase # hits by 1 and assign block
+    if (i != -1) {
+        hit += 1;
+        cache[i]->accessTime = queries;
+        prefetch_used += cache[i]->prefetched;
+        cache[i]->prefetched = 0;
+        return cache[i]->block;
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : peekSGDataBlock
+// Description  : Look a data block up in the block cache, without counting a
+//                query or changing its place in the LRU order
+//
+// Inputs       : nde - node ID to find
+//                blk - block ID to find
+// Outputs      : pointer to block or NULL if not found
+
+char * peekSGDataBlock( SG_Node_ID nde, SG_Block_ID blk ) {
+    int i = findSGCacheLine(nde, blk);
+    return (i == -1) ? NULL : cache[i]->block;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGColdDataBlock
+// Description  : Get the data block from the block cache, counted as a query
+//                but left where it is in the LRU order (a read the client
+//                said it will not repeat)
+//
+// Inputs       : nde - node ID to find
+//                blk - block ID to find
+// Outputs      : pointer to block or NULL if not found
+
+char * getSGColdDataBlock( SG_Node_ID nde, SG_Block_ID blk ) {
+    SG_SPAN("cache get");
+    queries += 1;
+    int i = findSGCacheLine(nde, blk);
+    if (i != -1) {
+        hit += 1;
+        prefetch_used += cache[i]->prefetched;
+        cache[i]->prefetched = 0;
+        return cache[i]->block;
     }
     return NULL;
 }
@@ -108,40 +205,299 @@ char * getSGDataBlock( SG_Node_ID nde, SG_Block_ID blk ) {
 // Outputs      : 0 if successful, -1 if failure
 
 int putSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, char *block ) {
-    for (int i = 0; i < next_location; i++) {
-        // update block information
-        if (nde == cache[i]->nodeID && blk == cache[i]->blockID) {
-            queries += 1;
-            memcpy(cache[i]->block, block, SG_BLOCK_SIZE);
-            cache[i]->accessTime = queries;
-            hit += 1;
-            return 0;
+    SG_SPAN("cache put");
+    int i = findSGCacheLine(nde, blk);
+    // update block information
+    if (i != -1) {
+        queries += 1;
+        sgCopyBlock(cache[i]->block, block, cache_block_size);
+        cache[i]->accessTime = queries;
+        hit += 1;
+        prefetch_wasted += cache[i]->prefetched;
+        cache[i]->prefetched = 0;
+        return 0;
+    }
+    // map the block into a free line, or the least recently used one
+    i = claimSGCacheLine();
+    cache[i]->accessTime = queries;
+    cache[i]->blockID = blk;
+    cache[i]->nodeID = nde;
+    indexSGCacheLine(i);
+    sgCopyBlock(cache[i]->block, block, cache_block_size);
+
+    // Return successfully
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : putSGColdDataBlock
+// Description  : Put a data block in the block cache at the cold end, so it
+//                is the next evicted unless used again first (a block the
+//                client said it will not reuse); a cached copy is updated
+//                where it is
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+//                block - block to insert into cache
+// Outputs      : 0 if successful, -1 if failure
+
+int putSGColdDataBlock( SG_Node_ID nde, SG_Block_ID blk, char *block ) {
+    SG_SPAN("cache put");
+    int i = findSGCacheLine(nde, blk);
+
+    if (i == -1) {
+        i = claimSGCacheLine();
+        cache[i]->accessTime = 0;
+        cache[i]->blockID = blk;
+        cache[i]->nodeID = nde;
+        indexSGCacheLine(i);
+    }
+    prefetch_wasted += cache[i]->prefetched;
+    cache[i]->prefetched = 0;
+    sgCopyBlock(cache[i]->block, block, cache_block_size);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : putSGPrefetchBlock
+// Description  : Put a prefetched data block in the block cache as most
+//                recently used, without counting a query; it counts as used
+//                when first read, as wasted if evicted or replaced before
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+//                block - block to insert into cache
+// Outputs      : 0 if successful, -1 if already in cache
+
+int putSGPrefetchBlock( SG_Node_ID nde, SG_Block_ID blk, char *block ) {
+    SG_SPAN("cache prefetch");
+    int i;
+
+    if (findSGCacheLine(nde, blk) != -1) {
+        return -1;
+    }
+    i = claimSGCacheLine();
+    cache[i]->accessTime = queries;
+    cache[i]->blockID = blk;
+    cache[i]->nodeID = nde;
+    cache[i]->prefetched = 1;
+    indexSGCacheLine(i);
+    sgCopyBlock(cache[i]->block, block, cache_block_size);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGPrefetchStats
+// Description  : Get the number of prefetched blocks used and wasted since
+//                the cache was opened
+//
+// Inputs       : used - place to put the number read before eviction
+//                wasted - place to put the number evicted or replaced unread
+// Outputs      : 0 always
+
+int getSGPrefetchStats( size_t *used, size_t *wasted ) {
+    *used = prefetch_used;
+    *wasted = prefetch_wasted;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dropSGDataBlock
+// Description  : Evict a data block from the block cache, pinned or not, the
+//                last line in use moves into its place
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+// Outputs      : 0 if the block was evicted, -1 if not in cache
+
+int dropSGDataBlock( SG_Node_ID nde, SG_Block_ID blk ) {
+    SG_Cache_Data * line;
+    int i = findSGCacheLine(nde, blk), last = next_location - 1;
+
+    if (i == -1) {
+        return -1;
+    }
+    pinned -= cache[i]->pinned;
+    cache[i]->pinned = 0;
+    prefetch_wasted += cache[i]->prefetched;
+    cache[i]->prefetched = 0;
+    unindexSGCacheLine(i);
+    if (i != last) {
+        unindexSGCacheLine(last);
+        line = cache[i];
+        cache[i] = cache[last];
+        cache[last] = line;
+        indexSGCacheLine(i);
+    }
+    next_location--;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pinSGDataBlock
+// Description  : Pin a cached data block so that it is never evicted, or
+//                unpin it; at most 1/SG_CACHE_PIN_SHARE of the lines can be
+//                pinned so that the other blocks still have room
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+//                pin - 1 to pin, 0 to unpin
+// Outputs      : 0 if successful, -1 if not in cache or too many pinned
+
+int pinSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, int pin ) {
+    int i = findSGCacheLine(nde, blk);
+
+    if (i == -1) {
+        return -1;
+    }
+    if (pin && !cache[i]->pinned && (pinned >= cache_size / SG_CACHE_PIN_SHARE)) {
+        return -1;
+    }
+    pinned += (pin ? 1 : 0) - cache[i]->pinned;
+    cache[i]->pinned = pin ? 1 : 0;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : patchSGDataBlock
+// Description  : Update a byte range of a block, if it is in the block cache
+//
+// Inputs       : nde - node ID to find
+//                blk - block ID to find
+//                off - offset of the range within the block
+//                data - the bytes to copy into the block
+//                len - the length of the range
+// Outputs      : 0 if the cached block was updated, -1 if not in cache
+
+int patchSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, size_t off, char *data, size_t len ) {
+    SG_SPAN("cache patch");
+    int i = findSGCacheLine(nde, blk);
+    // update the range in place, cache line stays most recently used
+    if (i != -1) {
+        queries += 1;
+        memcpy(cache[i]->block + off, data, len);
+        cache[i]->accessTime = queries;
+        hit += 1;
+        return 0;
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : claimSGCacheLine
+// Description  : Find the line a new block goes in: the next free one, or
+//                else the least recently used line that is not pinned,
+//                taken out of the index
+//
+// Inputs       : none
+// Outputs      : the index of the line
+
+int claimSGCacheLine( void ) {
+    size_t timeLRU = SIZE_MAX;
+    int idx = 0;
+
+    if (next_location < cache_size) {
+        cache[next_location]->pinned = 0;
+        cache[next_location]->prefetched = 0;
+        return next_location++;
+    }
+    // evict element which is LRU (the first at the cold end)
+    for (int i = 0; i < cache_size; i++) {
+        if (!cache[i]->pinned && (cache[i]->accessTime < timeLRU)) {
+            idx = i;
+            timeLRU = cache[i]->accessTime;
         }
     }
-    // capacity reached
-    if (next_location >= cache_size) {
-        size_t timeLRU = queries;
-        int idx = 0;
-        // evict element which is LRU
-        for (int i = 0; i < cache_size; i++) {
-            if (cache[i]->accessTime < timeLRU) {
-                idx = i;
-                timeLRU = cache[i]->accessTime;
-            }
+    evicted++;
+    prefetch_wasted += cache[idx]->prefetched;
+    cache[idx]->prefetched = 0;
+    unindexSGCacheLine(idx);
+    return idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : slotSGCache
+// Description  : Find the home slot of a block in the cache index
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+// Outputs      : the slot
+
+size_t slotSGCache( SG_Node_ID nde, SG_Block_ID blk ) {
+    uint64_t key = (blk ^ ((nde << 32) | (nde >> 32))) * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (key >> 32) & (SG_CACHE_INDEX_SIZE - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findSGCacheLine
+// Description  : Find the cache line holding a block through the index
+//
+// Inputs       : nde - node ID to find
+//                blk - block ID to find
+// Outputs      : the index of the line, -1 if not found
+
+int findSGCacheLine( SG_Node_ID nde, SG_Block_ID blk ) {
+    size_t slot = slotSGCache(nde, blk);
+    int line;
+
+    // probe from the home slot up to the first free one
+    while ((line = cache_index[slot]) != -1) {
+        if (nde == cache[line]->nodeID && blk == cache[line]->blockID) {
+            return line;
         }
-        cache[idx]->accessTime = queries;
-        cache[idx]->blockID = blk;
-        cache[idx]->nodeID = nde;
-        memcpy(cache[idx]->block, block, SG_BLOCK_SIZE); 
-    } else {
-        // map cache element into new location
-        cache[next_location]->accessTime = queries;
-        cache[next_location]->blockID = blk;
-        cache[next_location]->nodeID = nde;
-        memcpy(cache[next_location]->block, block, SG_BLOCK_SIZE); 
-        next_location += 1;
+        slot = (slot + 1) & (SG_CACHE_INDEX_SIZE - 1);
     }
+    return -1;
+}
 
-    // Return successfully
-    return 0;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : indexSGCacheLine
+// Description  : Add a cache line to the index, under its block
+//
+// Inputs       : line - the cache line
+// Outputs      : none
+
+void indexSGCacheLine( int line ) {
+    size_t slot = slotSGCache(cache[line]->nodeID, cache[line]->blockID);
+
+    while (cache_index[slot] != -1) {
+        slot = (slot + 1) & (SG_CACHE_INDEX_SIZE - 1);
+    }
+    cache_index[slot] = line;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unindexSGCacheLine
+// Description  : Remove a cache line from the index, moving back the lines
+//                probed past its slot so that no probe stops early
+//
+// Inputs       : line - the cache line (still holding its block)
+// Outputs      : none
+
+void unindexSGCacheLine( int line ) {
+    size_t slot = slotSGCache(cache[line]->nodeID, cache[line]->blockID), next, home;
+
+    while (cache_index[slot] != line) {
+        slot = (slot + 1) & (SG_CACHE_INDEX_SIZE - 1);
+    }
+    for (next = (slot + 1) & (SG_CACHE_INDEX_SIZE - 1); cache_index[next] != -1; next = (next + 1) & (SG_CACHE_INDEX_SIZE - 1)) {
+        // a line can fill the hole if its home slot is not between the hole and it
+        home = slotSGCache(cache[cache_index[next]]->nodeID, cache[cache_index[next]]->blockID);
+        if (((next - home) & (SG_CACHE_INDEX_SIZE - 1)) >= ((next - slot) & (SG_CACHE_INDEX_SIZE - 1))) {
+            cache_index[slot] = cache_index[next];
+            slot = next;
+        }
+    }
+    cache_index[slot] = -1;
 }
@@ -17,11 +17,13 @@
 //
 // Defines
 #define SG_MAX_CACHE_ELEMENTS 128
+#define SG_CACHE_INDEX_SIZE (SG_MAX_CACHE_ELEMENTS * 4) // slots of the block index (power of two)
+#define SG_CACHE_PIN_SHARE 2 // at most 1/SG_CACHE_PIN_SHARE of the lines pinned, the rest stay for the LRU
 
 // 
 // Cache functions
 
-int initSGCache( uint16_t maxElements );
+int initSGCache( uint16_t maxElements, size_t blockSize );
     // Initialize the cache of block elements
 
 int closeSGCache( void );
@@ -30,7 +32,37 @@ int closeSGCache( void );
 char *getSGDataBlock( SG_Node_ID nde, SG_Block_ID blk );
     // Get the data block from the block cache
 
+char *peekSGDataBlock( SG_Node_ID nde, SG_Block_ID blk );
+    // Look a block up without counting a query or making it recently used
+
+char *getSGColdDataBlock( SG_Node_ID nde, SG_Block_ID blk );
+    // Get the data block from the block cache, leaving its place in the LRU order
+
 int putSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, char *block );
     // Get the data block from the block cache
 
+int putSGColdDataBlock( SG_Node_ID nde, SG_Block_ID blk, char *block );
+    // Put a data block in the block cache at the cold end (the next evicted)
+
+int putSGPrefetchBlock( SG_Node_ID nde, SG_Block_ID blk, char *block );
+    // Put a prefetched data block in the block cache (most recently used)
+
+int dropSGDataBlock( SG_Node_ID nde, SG_Block_ID blk );
+    // Evict a data block from the block cache, pinned or not
+
+int pinSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, int pin );
+    // Pin a cached data block so it is never evicted (or unpin it)
+
+int patchSGDataBlock( SG_Node_ID nde, SG_Block_ID blk, size_t off, char *data, size_t len );
+    // Update a byte range of a block, if it is in the block cache
+
+int getSGCacheStats( size_t *lookups, size_t *hits, size_t *evictions );
+    // Get the number of cache lookups, hits and evictions since the cache was opened
+
+int getSGPrefetchStats( size_t *used, size_t *wasted );
+    // Get the number of prefetched blocks used and wasted since the cache was opened
+
+int getSGCachePinned( void );
+    // Get the number of pinned cache lines
+
 #endif
\ No newline at end of file
@@ -0,0 +1,667 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_cachesim.c
+//  Description    : This is the offline cache simulator for the ScatterGather
+//                   driver.  It turns a workload into the block cache access
+//                   stream the driver would produce (the same gets, puts and
+//                   patches as sg_driver.c, with blocks numbered as they are
+//                   created), then replays that stream against many cache
+//                   capacities and replacement policies at once, one
+//                   configuration per thread, and prints the hit rate curves.
+//                   No service is involved, so a sweep takes seconds.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_workload.h>
+
+// Project Includes
+#include <sg_defs.h>
+#include <sg_cache.h>
+#include <sg_wlbin.h>
+
+// Defines
+#define CACHESIM_ARGUMENTS "hrB:c:p:j:"
+#define CACHESIM_MAX_CONFIGS 256 // capacities times policies
+#define USAGE \
+	"USAGE: sg_cachesim [-h] [-r] [-B <size>] [-c <capacities>] [-p <policies>] [-j <threads>]\n" \
+	"                   <workload>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -r - the service takes range updates (partial writes patch the\n" \
+	"         cached block instead of reading it first), as with sg_sim -s\n" \
+	"    -B - blocks of <size> bytes (default 1024)\n" \
+	"    -c - comma separated cache capacities in blocks (default powers\n" \
+	"         of two from 8 up to the number of blocks; the driver has %d)\n" \
+	"    -p - comma separated policies (default all): lru (as sg_cache.c),\n" \
+	"         fifo, clock, random, opt (Belady, the best any policy can do)\n" \
+	"    -j - threads to run the configurations on (default all cores)\n" \
+	"and\n" \
+	"    workload - is the name of the workload file (text, or compiled\n" \
+	"               with sg_wlcomp)\n" \
+	"\n" \
+
+// Cache accesses, the block number is shifted above the type
+#define CS_GET   0 // read lookup, the block is fetched and put on a miss
+#define CS_PUT   1 // a written block is put (a hit if already cached)
+#define CS_PATCH 2 // range update, refreshes the block only if cached
+#define CS_TYPE_BITS 2
+
+// Replacement policies
+typedef enum {
+	CS_LRU    = 0, // least recently used, ties to the lowest slot (sg_cache.c)
+	CS_FIFO   = 1, // first in first out
+	CS_CLOCK  = 2, // second chance
+	CS_RANDOM = 3, // random victim
+	CS_OPT    = 4, // victim used furthest in the future (Belady)
+	CS_POLICIES
+} csPolicy;
+
+// Type definitions
+typedef struct {
+	uint64_t  *stream;            // the accesses, block << CS_TYPE_BITS | type
+	uint64_t  *next;              // index of the next access to the same block (opt)
+	uint64_t   length;            // number of accesses
+	uint64_t   blocks;            // number of blocks created
+	uint64_t   reads;             // block reads (holes excluded)
+} csStream;
+
+typedef struct {
+	uint32_t   capacity;          // cache lines
+	csPolicy   policy;            // replacement policy
+	uint64_t   queries;           // lookups, counted as sg_cache.c does
+	uint64_t   hits;              // hits
+	uint64_t   fetches;           // read misses, each a service round trip
+} csConfig;
+
+typedef struct {
+	int32_t   *slotOf;            // cache slot of each block, -1 if not cached
+	uint64_t  *slotBlock;         // block in each slot
+	uint64_t  *prio;              // priority of each slot (lru, opt)
+	uint32_t  *heap;              // slots ordered by priority (lru, opt)
+	uint32_t  *heapPos;           // heap position of each slot
+	uint32_t   heapSize;          // slots in the heap (those in use)
+	uint8_t   *ref;               // reference bits (clock)
+} csCache;
+
+//
+// Global Data
+unsigned long SGServiceLevel; // Service log level
+unsigned long SGDriverLevel; // Controller log level
+unsigned long SGSimulatorLevel; // Simulation log level
+const char *csPolicyNames[CS_POLICIES] = { "lru", "fifo", "clock", "random", "opt" };
+csStream csAccesses; // The access stream of the workload
+csConfig csConfigs[CACHESIM_MAX_CONFIGS]; // The configurations simulated
+int csNumConfigs = 0; // Number of configurations
+int csNextConfig = 0; // Next configuration to simulate
+pthread_mutex_t csLock = PTHREAD_MUTEX_INITIALIZER; // Protects the next configuration
+
+//
+// Functional Prototypes
+
+int extractAccesses( char *wload, size_t blockSize, int ranges ); // Workload to access stream
+int addAccess( uint64_t block, int type ); // Append an access
+void * simulateConfigs( void *arg ); // Worker thread, simulates configurations
+void simulateCache( csConfig *cfg, csCache *cache ); // Replay the stream on one configuration
+void csHeapUpdate( csCache *cache, uint32_t slot, uint64_t prio ); // Reorder a slot in the heap
+int parseList( char *list, const char **names, int count, uint32_t *values, int max ); // Option lists
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the cache simulator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	uint32_t capacities[CACHESIM_MAX_CONFIGS], policies[CS_POLICIES];
+	int ch, i, j, ranges = 0, numCaps = 0, numPolicies = 0, threads = sysconf( _SC_NPROCESSORS_ONLN );
+	size_t blockSize = SG_BLOCK_SIZE;
+	char *capList = NULL, *policyList = NULL;
+	pthread_t *workers;
+	struct timespec start, end;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CACHESIM_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE, SG_MAX_CACHE_ELEMENTS );
+			return( -1 );
+
+		case 'r': // Range updates
+			ranges = 1;
+			break;
+
+		case 'B': // Block size
+			blockSize = atoi( optarg );
+			if ( (blockSize == 0) || (blockSize > SG_MAX_BLOCK_SIZE) ) {
+				fprintf( stderr, "Bad block size (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'c': // Capacities
+			capList = optarg;
+			break;
+
+		case 'p': // Policies
+			policyList = optarg;
+			break;
+
+		case 'j': // Threads
+			if ( (threads = atoi(optarg)) < 1 ) {
+				fprintf( stderr, "Bad thread count (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	if ( argc - optind != 1 ) {
+		fprintf( stderr, "Missing workload file, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Setup the log (the workload library logs errors)
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	SGServiceLevel = registerLogLevel("SG_SERVICE", 0); // Service log level
+	SGDriverLevel = registerLogLevel("SG_DRIVER", 0); // Controller log level
+	SGSimulatorLevel = registerLogLevel("SG_SIMULATOR", 0); // Simulation log level
+
+	// Get the access stream, then the configurations to try
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	if ( extractAccesses(argv[optind], blockSize, ranges) ) {
+		return( -1 );
+	}
+	if ( capList ) {
+		if ( (numCaps = parseList(capList, NULL, 0, capacities, CACHESIM_MAX_CONFIGS)) < 0 ) {
+			return( -1 );
+		}
+	} else {
+		for ( i = 8; (numCaps < CACHESIM_MAX_CONFIGS) && ((numCaps == 0) || (capacities[numCaps - 1] < csAccesses.blocks)); i *= 2 ) {
+			capacities[numCaps++] = i;
+		}
+	}
+	if ( policyList ) {
+		if ( (numPolicies = parseList(policyList, csPolicyNames, CS_POLICIES, policies, CS_POLICIES)) < 0 ) {
+			return( -1 );
+		}
+	} else {
+		for ( numPolicies = 0; numPolicies < CS_POLICIES; numPolicies++ ) {
+			policies[numPolicies] = numPolicies;
+		}
+	}
+	if ( numCaps * numPolicies > CACHESIM_MAX_CONFIGS ) {
+		fprintf( stderr, "Too many configurations (max %d), aborting.\n", CACHESIM_MAX_CONFIGS );
+		return( -1 );
+	}
+	for ( i = 0; i < numCaps; i++ ) {
+		for ( j = 0; j < numPolicies; j++ ) {
+			csConfigs[csNumConfigs].capacity = capacities[i];
+			csConfigs[csNumConfigs++].policy = policies[j];
+		}
+	}
+
+	// Simulate the configurations on the worker threads
+	threads = (threads > csNumConfigs) ? csNumConfigs : threads;
+	workers = malloc( threads * sizeof(pthread_t) );
+	for ( i = 0; i < threads; i++ ) {
+		if ( pthread_create(&workers[i], NULL, simulateConfigs, NULL) ) {
+			fprintf( stderr, "Failed starting worker thread, aborting.\n" );
+			return( -1 );
+		}
+	}
+	for ( i = 0; i < threads; i++ ) {
+		pthread_join( workers[i], NULL );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	// Print the hit rate curves, one column per policy
+	printf( "%s: %lu cache accesses, %lu block reads, %lu blocks, %d configurations on %d threads in %.2f s\n",
+		argv[optind], csAccesses.length, csAccesses.reads, csAccesses.blocks, csNumConfigs, threads,
+		(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9 );
+	printf( "%10s", "capacity" );
+	for ( j = 0; j < numPolicies; j++ ) {
+		printf( " %9s", csPolicyNames[policies[j]] );
+	}
+	printf( " %12s\n", "fetches" );
+	for ( i = 0; i < numCaps; i++ ) {
+		printf( "%10u", capacities[i] );
+		for ( j = 0; j < numPolicies; j++ ) {
+			csConfig *cfg = &csConfigs[i * numPolicies + j];
+			printf( " %8.2f%%", cfg->queries ? cfg->hits * 100.0 / cfg->queries : 0.0 );
+		}
+		printf( " %12lu\n", csConfigs[i * numPolicies].fetches );
+	}
+	printf( "(hit rates as sg_cache.c counts them, fetches are the service reads of the %s policy)\n",
+		csPolicyNames[policies[0]] );
+
+	// Clean up, return successfully
+	free( workers );
+	free( csAccesses.stream );
+	free( csAccesses.next );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : extractAccesses
+// Description  : Walk the workload as the driver would and record its block
+//                cache accesses: a read of a stored block is a get (and a put
+//                on a miss), a write creating a block is a put, and a write
+//                to a stored block reads it (get) then puts it back, or with
+//                range updates patches it when shorter than a block.  Holes
+//                (never written, or all-zero writes) are not cached.
+//
+// Inputs       : wload - the workload file (text or compiled)
+//                blockSize - the block size
+//                ranges - the service takes range updates
+// Outputs      : 0 if successful, -1 if failure
+
+int extractAccesses( char *wload, size_t blockSize, int ranges ) {
+
+	// Local variables
+	workload_state state;
+	workload_operation operation;
+	SG_Wlbin_Builder bld;
+	SG_Wlbin_Header *hdr = NULL;
+	SG_Wlbin_Op *ops, *op;
+	struct stat st;
+	char *base = NULL, *heap, magic[SG_WLBIN_MAGIC_SIZE];
+	uint64_t **files, *fileBlocks, numOps, *last, i, blk, k;
+	uint32_t numObjects;
+	int fd, data, zero;
+
+	// Compiled workloads are mapped, text ones compiled in memory
+	if ( (fd = open(wload, O_RDONLY)) == -1 ) {
+		fprintf( stderr, "Failed opening workload [%s], aborting.\n", wload );
+		return( -1 );
+	}
+	if ( (read(fd, magic, SG_WLBIN_MAGIC_SIZE) == SG_WLBIN_MAGIC_SIZE) &&
+			(memcmp(magic, SG_WLBIN_MAGIC, SG_WLBIN_MAGIC_SIZE) == 0) ) {
+		if ( fstat(fd, &st) || (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED ) {
+			fprintf( stderr, "Failed mapping workload [%s], aborting.\n", wload );
+			close( fd );
+			return( -1 );
+		}
+		hdr = (SG_Wlbin_Header *)base;
+		if ( (st.st_size < sizeof(*hdr)) || (hdr->version != SG_WLBIN_VERSION) ||
+				(hdr->opsOffset + hdr->numOps * sizeof(SG_Wlbin_Op) > hdr->heapOffset) ||
+				(hdr->heapOffset + hdr->heapSize > st.st_size) ) {
+			fprintf( stderr, "Bad compiled workload [%s], aborting.\n", wload );
+			munmap( base, st.st_size );
+			close( fd );
+			return( -1 );
+		}
+		ops = (SG_Wlbin_Op *)(base + hdr->opsOffset);
+		numOps = hdr->numOps;
+		numObjects = hdr->numObjects;
+		heap = base + hdr->heapOffset;
+	} else {
+		initWlbinBuilder( &bld, 0 );
+		if ( openCmpsc311Workload(&state, wload) ) {
+			fprintf( stderr, "Failed opening workload [%s], aborting.\n", wload );
+			close( fd );
+			return( -1 );
+		}
+		do {
+			if ( readCmpsc311Workload(&state, &operation) ) {
+				fprintf( stderr, "Workload parse failed at line %d, aborting.\n", state.lineno );
+				close( fd );
+				return( -1 );
+			}
+			data = (operation.op == WL_READ) || (operation.op == WL_WRITE);
+			if ( addWlbinOp(&bld, (operation.op != WL_EOF) ? operation.objname : NULL, operation.op,
+					operation.pos, operation.size, data ? operation.data : NULL, 0) ) {
+				fprintf( stderr, "Workload load failed at line %d, aborting.\n", state.lineno );
+				close( fd );
+				return( -1 );
+			}
+		} while ( operation.op < WL_EOF );
+		closeCmpsc311Workload( &state );
+		ops = bld.ops;
+		numOps = bld.numOps;
+		numObjects = bld.names.used;
+		heap = bld.heap.data;
+	}
+	close( fd );
+
+	// The blocks of each object (0 for a hole), kept across closes as the driver does
+	files = calloc( numObjects, sizeof(uint64_t *) );
+	fileBlocks = calloc( numObjects, sizeof(uint64_t) );
+	for ( i = 0; i < numOps; i++ ) {
+		op = &ops[i];
+		if ( (op->op != WL_READ) && (op->op != WL_WRITE) ) {
+			continue;
+		}
+		if ( (op->pos % blockSize) + op->size > blockSize ) {
+			fprintf( stderr, "Operation %lu crosses a block boundary (block size %lu), aborting.\n", i, blockSize );
+			return( -1 );
+		}
+		blk = op->pos / blockSize;
+		if ( blk >= fileBlocks[op->object] ) {
+			files[op->object] = realloc( files[op->object], (blk + 1) * 2 * sizeof(uint64_t) );
+			memset( &files[op->object][fileBlocks[op->object]], 0,
+				((blk + 1) * 2 - fileBlocks[op->object]) * sizeof(uint64_t) );
+			fileBlocks[op->object] = (blk + 1) * 2;
+		}
+		k = files[op->object][blk];
+
+		if ( op->op == WL_READ ) {
+			if ( k ) {
+				addAccess( k, CS_GET );
+				csAccesses.reads++;
+			}
+		} else if ( k == 0 ) {
+			for ( zero = 1, data = 0; zero && (data < op->size); data++ ) {
+				zero = (heap[op->data + data] == 0);
+			}
+			if ( !zero ) {
+				k = files[op->object][blk] = ++csAccesses.blocks;
+				addAccess( k, CS_PUT );
+			}
+		} else if ( ranges && (op->size < blockSize) ) {
+			addAccess( k, CS_PATCH );
+		} else {
+			addAccess( k, CS_GET );
+			addAccess( k, CS_PUT );
+			csAccesses.reads++;
+		}
+	}
+
+	// The next use of every access, for the optimal policy
+	csAccesses.next = malloc( (csAccesses.length + 1) * sizeof(uint64_t) );
+	last = malloc( (csAccesses.blocks + 1) * sizeof(uint64_t) );
+	for ( k = 0; k <= csAccesses.blocks; k++ ) {
+		last[k] = UINT64_MAX;
+	}
+	for ( i = csAccesses.length; i-- > 0; ) {
+		k = csAccesses.stream[i] >> CS_TYPE_BITS;
+		csAccesses.next[i] = last[k];
+		last[k] = i;
+	}
+
+	// Clean up, return successfully
+	for ( i = 0; i < numObjects; i++ ) {
+		free( files[i] );
+	}
+	free( files );
+	free( fileBlocks );
+	free( last );
+	if ( hdr ) {
+		munmap( base, st.st_size );
+	} else {
+		freeWlbinBuilder( &bld );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addAccess
+// Description  : Append an access to the stream
+//
+// Inputs       : block - the block (numbered from 1)
+//                type - the access type (CS_GET, CS_PUT, CS_PATCH)
+// Outputs      : 0 if successful, -1 if failure
+
+int addAccess( uint64_t block, int type ) {
+	static uint64_t alloc = 0;
+
+	if ( csAccesses.length == alloc ) {
+		alloc = alloc ? alloc * 2 : 65536;
+		if ( (csAccesses.stream = realloc(csAccesses.stream, alloc * sizeof(uint64_t))) == NULL ) {
+			fprintf( stderr, "Out of memory for the access stream, aborting.\n" );
+			exit( -1 );
+		}
+	}
+	csAccesses.stream[csAccesses.length++] = (block << CS_TYPE_BITS) | type;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulateConfigs
+// Description  : Worker thread, simulates configurations until none is left
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+void * simulateConfigs( void *arg ) {
+
+	// Local variables
+	csCache cache;
+	uint32_t maxCap = 0;
+	int i;
+
+	// Size the cache for the largest configuration
+	for ( i = 0; i < csNumConfigs; i++ ) {
+		maxCap = (csConfigs[i].capacity > maxCap) ? csConfigs[i].capacity : maxCap;
+	}
+	cache.slotOf = malloc( (csAccesses.blocks + 1) * sizeof(int32_t) );
+	cache.slotBlock = malloc( maxCap * sizeof(uint64_t) );
+	cache.prio = malloc( maxCap * sizeof(uint64_t) );
+	cache.heap = malloc( maxCap * sizeof(uint32_t) );
+	cache.heapPos = malloc( maxCap * sizeof(uint32_t) );
+	cache.ref = malloc( maxCap );
+
+	while ( 1 ) {
+		pthread_mutex_lock( &csLock );
+		i = csNextConfig++;
+		pthread_mutex_unlock( &csLock );
+		if ( i >= csNumConfigs ) {
+			break;
+		}
+		simulateCache( &csConfigs[i], &cache );
+	}
+
+	// Clean up, return
+	free( cache.slotOf );
+	free( cache.slotBlock );
+	free( cache.prio );
+	free( cache.heap );
+	free( cache.heapPos );
+	free( cache.ref );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulateCache
+// Description  : Replay the access stream on one configuration.  Lookups and
+//                hits are counted as sg_cache.c does: every get is a lookup,
+//                and a put or patch of a cached block is a lookup and a hit.
+//                Lines fill slot by slot until the cache is full.
+//
+// Inputs       : cfg - the configuration (results filled in)
+//                cache - the cache state to use
+// Outputs      : none
+
+void simulateCache( csConfig *cfg, csCache *cache ) {
+
+	// Local variables
+	uint64_t i, k, rnd = 88172645463325252ULL;
+	uint32_t used = 0, hand = 0, slot;
+	int32_t s;
+	int type;
+
+	memset( cache->slotOf, 0xff, (csAccesses.blocks + 1) * sizeof(int32_t) );
+	cache->heapSize = 0;
+	cfg->queries = cfg->hits = cfg->fetches = 0;
+	for ( i = 0; i < csAccesses.length; i++ ) {
+		k = csAccesses.stream[i] >> CS_TYPE_BITS;
+		type = csAccesses.stream[i] & ((1 << CS_TYPE_BITS) - 1);
+		s = cache->slotOf[k];
+		if ( type == CS_GET ) {
+			cfg->queries++;
+		}
+
+		// A hit refreshes the line (a patch miss leaves the cache alone)
+		if ( s >= 0 ) {
+			if ( type != CS_GET ) {
+				cfg->queries++;
+			}
+			cfg->hits++;
+			if ( cfg->policy == CS_LRU ) {
+				csHeapUpdate( cache, s, cfg->queries );
+			} else if ( cfg->policy == CS_OPT ) {
+				csHeapUpdate( cache, s, UINT64_MAX - csAccesses.next[i] );
+			} else if ( cfg->policy == CS_CLOCK ) {
+				cache->ref[s] = 1;
+			}
+			continue;
+		}
+		if ( type == CS_PATCH ) {
+			continue;
+		}
+		cfg->fetches += (type == CS_GET);
+
+		// A miss fills the next free slot, or replaces the policy's victim
+		if ( used < cfg->capacity ) {
+			slot = used++;
+			cache->heapSize = used;
+			cache->heap[slot] = slot;
+			cache->heapPos[slot] = slot;
+			cache->prio[slot] = 0;
+		} else {
+			switch ( cfg->policy ) {
+			case CS_LRU:
+			case CS_OPT:
+				slot = cache->heap[0];
+				break;
+			case CS_FIFO:
+				slot = hand;
+				hand = (hand + 1) % cfg->capacity;
+				break;
+			case CS_CLOCK:
+				while ( cache->ref[hand] ) {
+					cache->ref[hand] = 0;
+					hand = (hand + 1) % cfg->capacity;
+				}
+				slot = hand;
+				hand = (hand + 1) % cfg->capacity;
+				break;
+			default:
+				rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+				slot = rnd % cfg->capacity;
+				break;
+			}
+			cache->slotOf[cache->slotBlock[slot]] = -1;
+		}
+		cache->slotOf[k] = slot;
+		cache->slotBlock[slot] = k;
+		cache->ref[slot] = 0;
+		if ( cfg->policy == CS_LRU ) {
+			csHeapUpdate( cache, slot, cfg->queries );
+		} else if ( cfg->policy == CS_OPT ) {
+			csHeapUpdate( cache, slot, UINT64_MAX - csAccesses.next[i] );
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : csHeapUpdate
+// Description  : Set the priority of a slot and restore the heap order
+//                (smallest priority first, ties to the lowest slot, which is
+//                the victim sg_cache.c picks for lru)
+//
+// Inputs       : cache - the cache state
+//                slot - the slot
+//                prio - its new priority
+// Outputs      : none
+
+void csHeapUpdate( csCache *cache, uint32_t slot, uint64_t prio ) {
+
+	// Local variables
+	uint32_t pos = cache->heapPos[slot], child, other;
+
+	cache->prio[slot] = prio;
+
+#define CS_BEFORE(a, b) ((cache->prio[a] < cache->prio[b]) || ((cache->prio[a] == cache->prio[b]) && ((a) < (b))))
+
+	// Up while before the parent
+	while ( (pos > 0) && CS_BEFORE(slot, cache->heap[(pos - 1) / 2]) ) {
+		cache->heap[pos] = cache->heap[(pos - 1) / 2];
+		cache->heapPos[cache->heap[pos]] = pos;
+		pos = (pos - 1) / 2;
+	}
+
+	// Down while after a child
+	while ( (child = 2 * pos + 1) < cache->heapSize ) {
+		other = child + 1;
+		if ( (other < cache->heapSize) && CS_BEFORE(cache->heap[other], cache->heap[child]) ) {
+			child = other;
+		}
+		if ( !CS_BEFORE(cache->heap[child], slot) ) {
+			break;
+		}
+		cache->heap[pos] = cache->heap[child];
+		cache->heapPos[cache->heap[pos]] = pos;
+		pos = child;
+	}
+	cache->heap[pos] = slot;
+	cache->heapPos[slot] = pos;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parseList
+// Description  : Parse a comma separated option list, of names or of numbers
+//
+// Inputs       : list - the list (modified)
+//                names - the names allowed, NULL for numbers
+//                count - the number of names
+//                values - the values parsed (name index or number)
+//                max - the most values allowed
+// Outputs      : the number of values, -1 if failure
+
+int parseList( char *list, const char **names, int count, uint32_t *values, int max ) {
+
+	// Local variables
+	char *item, *save = NULL;
+	int num = 0, i;
+
+	for ( item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save) ) {
+		if ( num == max ) {
+			fprintf( stderr, "Too many values in list (max %d), aborting.\n", max );
+			return( -1 );
+		}
+		if ( names ) {
+			for ( i = 0; (i < count) && strcmp(item, names[i]); i++ );
+			if ( i == count ) {
+				fprintf( stderr, "Unknown name [%s], aborting.\n", item );
+				return( -1 );
+			}
+			values[num++] = i;
+		} else if ( (values[num++] = strtoul(item, NULL, 10)) == 0 ) {
+			fprintf( stderr, "Bad number [%s], aborting.\n", item );
+			return( -1 );
+		}
+	}
+	return( num );
+}
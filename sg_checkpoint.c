@@ -0,0 +1,402 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_checkpoint.c
+//  Description    : This file contains the on-disk metadata checkpoint of the
+//                   ScatterGather driver, the mapping and checking of the
+//                   snapshot and the journal records.  The driver builds the
+//                   snapshot and applies the records (sg_driver.c).
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_checkpoint.h>
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sumSGCheckpoint
+// Description  : Extend a checksum (crc32) over a buffer
+//
+// Inputs       : sum - the checksum so far (0 to start)
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the checksum
+
+uint32_t sumSGCheckpoint( uint32_t sum, const void *buf, size_t len ) {
+    const Bytef *bytes = (const Bytef *) buf;
+    uInt step;
+
+    while (len > 0) {
+        step = (len > (1U << 30)) ? (1U << 30) : (uInt) len;
+        sum = crc32(sum, bytes, step);
+        bytes += step;
+        len -= step;
+    }
+    return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : openSGSnapshot
+// Description  : Map a snapshot privately (the path index is updated in
+//                place) and check its header, node table and shared blocks.  The files and
+//                index chunks are checked when first used, so the cost does
+//                not grow with the number of files.
+//
+// Inputs       : path - the snapshot file
+//                snap - the mapped snapshot
+// Outputs      : 0 if successful, 1 if there is no snapshot, -1 if failure
+
+int openSGSnapshot( const char *path, SG_Snapshot *snap ) {
+    SG_Snapshot_Header *hdr, copy;
+    struct stat st;
+    uint64_t chunks;
+    int fd;
+
+    memset(snap, 0, sizeof(SG_Snapshot));
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: failed opening [%s]", path);
+        return -1;
+    }
+    if (fstat(fd, &st) || (st.st_size < sizeof(SG_Snapshot_Header))) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: snapshot [%s] is truncated", path);
+        close(fd);
+        return -1;
+    }
+    snap->size = st.st_size;
+    snap->base = mmap(NULL, snap->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snap->base == MAP_FAILED) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: failed mapping [%s]", path);
+        snap->base = NULL;
+        return -1;
+    }
+
+    // the header, then the sections it places must lie within the file
+    hdr = snap->header = (SG_Snapshot_Header *) snap->base;
+    copy = *hdr;
+    copy.headerSum = 0;
+    if ((hdr->magic != SG_SNAPSHOT_MAGIC) || (hdr->version != SG_CHECKPOINT_VERSION) ||
+            (hdr->headerSum != sumSGCheckpoint(0, &copy, sizeof(copy)))) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: bad snapshot header in [%s]", path);
+        closeSGSnapshot(snap);
+        return -1;
+    }
+    chunks = (hdr->indexSize + SG_SNAPSHOT_INDEX_CHUNK - 1) / SG_SNAPSHOT_INDEX_CHUNK;
+    if ((hdr->size != snap->size) || (hdr->indexSize == 0) || (hdr->indexSize & (hdr->indexSize - 1)) || (hdr->indexSize < 2 * hdr->files) ||
+            (hdr->nodesOffset + hdr->nodes * sizeof(SG_Snapshot_Node) > hdr->sharedOffset) ||
+            (hdr->sharedOffset + hdr->shared * sizeof(SG_Snapshot_Shared) > hdr->filesOffset) ||
+            (hdr->filesOffset + hdr->files * sizeof(SG_Snapshot_File) > hdr->indexOffset) ||
+            (hdr->indexOffset + hdr->indexSize * sizeof(int32_t) > hdr->indexSumsOffset) ||
+            (hdr->indexSumsOffset + chunks * sizeof(uint32_t) > hdr->blocksOffset) ||
+            (hdr->blocksOffset + hdr->blockEntries * sizeof(SG_Snapshot_Block) > hdr->pathsOffset) ||
+            (hdr->pathsOffset + hdr->pathBytes > hdr->size) || (hdr->nodesOffset < sizeof(SG_Snapshot_Header))) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: bad snapshot layout in [%s]", path);
+        closeSGSnapshot(snap);
+        return -1;
+    }
+    snap->nodes = (SG_Snapshot_Node *) (snap->base + hdr->nodesOffset);
+    snap->shared = (SG_Snapshot_Shared *) (snap->base + hdr->sharedOffset);
+    snap->files = (SG_Snapshot_File *) (snap->base + hdr->filesOffset);
+    snap->index = (int32_t *) (snap->base + hdr->indexOffset);
+    snap->indexSums = (uint32_t *) (snap->base + hdr->indexSumsOffset);
+    snap->blocks = (SG_Snapshot_Block *) (snap->base + hdr->blocksOffset);
+    snap->paths = snap->base + hdr->pathsOffset;
+    if (hdr->nodesSum != sumSGCheckpoint(0, snap->nodes, hdr->nodes * sizeof(SG_Snapshot_Node))) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: bad node table in [%s]", path);
+        closeSGSnapshot(snap);
+        return -1;
+    }
+    if (hdr->sharedSum != sumSGCheckpoint(0, snap->shared, hdr->shared * sizeof(SG_Snapshot_Shared))) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: bad shared block table in [%s]", path);
+        closeSGSnapshot(snap);
+        return -1;
+    }
+    if ((snap->indexChecked = (uint8_t *) calloc(chunks ? chunks : 1, 1)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "openSGSnapshot: out of memory");
+        closeSGSnapshot(snap);
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkSGSnapshotFile
+// Description  : Check the record of a file of the snapshot, with its path
+//                and block entries
+//
+// Inputs       : snap - the snapshot
+//                fh - the file handle
+// Outputs      : 0 if the file is intact, -1 if not
+
+int checkSGSnapshotFile( SG_Snapshot *snap, uint64_t fh ) {
+    SG_Snapshot_Header *hdr = snap->header;
+    SG_Snapshot_File rec;
+    uint64_t count;
+    uint32_t sum;
+
+    if (fh >= hdr->files) {
+        return -1;
+    }
+    rec = snap->files[fh];
+    count = rec.fSize / hdr->blockSize;
+    if ((rec.fSize % hdr->blockSize) || (rec.path >= hdr->pathBytes) || (rec.pathLength >= hdr->pathBytes - rec.path) ||
+            (snap->paths[rec.path + rec.pathLength] != '\0') || (rec.blocks > hdr->blockEntries) ||
+            (count > hdr->blockEntries - rec.blocks)) {
+        logMessage(LOG_ERROR_LEVEL, "checkSGSnapshotFile: bad record of file [%lu]", fh);
+        return -1;
+    }
+    sum = rec.sum;
+    rec.sum = 0;
+    if (sum != sumSGCheckpoint(sumSGCheckpoint(sumSGCheckpoint(0, &rec, sizeof(rec)), snap->paths + rec.path, rec.pathLength),
+                               &snap->blocks[rec.blocks], count * sizeof(SG_Snapshot_Block))) {
+        logMessage(LOG_ERROR_LEVEL, "checkSGSnapshotFile: bad checksum of file [%lu]", fh);
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkSGSnapshotIndex
+// Description  : Check the chunk of the path index holding a slot, the first
+//                time it is used (before it is written to)
+//
+// Inputs       : snap - the snapshot
+//                slot - the index slot
+// Outputs      : 0 if the chunk is intact, -1 if not
+
+int checkSGSnapshotIndex( SG_Snapshot *snap, uint64_t slot ) {
+    uint64_t chunk = slot / SG_SNAPSHOT_INDEX_CHUNK, first = chunk * SG_SNAPSHOT_INDEX_CHUNK, i, count;
+
+    if (snap->indexChecked[chunk]) {
+        return 0;
+    }
+    count = snap->header->indexSize - first;
+    count = (count > SG_SNAPSHOT_INDEX_CHUNK) ? SG_SNAPSHOT_INDEX_CHUNK : count;
+    if (snap->indexSums[chunk] != sumSGCheckpoint(0, &snap->index[first], count * sizeof(int32_t))) {
+        logMessage(LOG_ERROR_LEVEL, "checkSGSnapshotIndex: bad checksum of path index chunk [%lu]", chunk);
+        return -1;
+    }
+    for (i = first; i < first + count; i++) {
+        if ((snap->index[i] < -1) || (snap->index[i] >= (int64_t) snap->header->files)) {
+            logMessage(LOG_ERROR_LEVEL, "checkSGSnapshotIndex: bad handle in path index slot [%lu]", i);
+            return -1;
+        }
+    }
+    snap->indexChecked[chunk] = 1;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : closeSGSnapshot
+// Description  : Unmap the snapshot
+//
+// Inputs       : snap - the snapshot
+// Outputs      : none
+
+void closeSGSnapshot( SG_Snapshot *snap ) {
+    if (snap->base) {
+        munmap(snap->base, snap->size);
+    }
+    free(snap->indexChecked);
+    memset(snap, 0, sizeof(SG_Snapshot));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replaySGJournal
+// Description  : Apply the records of a journal in order.  A record that is
+//                short or fails its checksum is the torn tail of a write cut
+//                off by a crash; the journal is truncated there.
+//
+// Inputs       : path - the journal file
+//                generation - the generation of the snapshot loaded
+//                apply - applies a record
+// Outputs      : 0 if replayed, 1 if there is no journal for the snapshot,
+//                -1 if failure
+
+int replaySGJournal( const char *path, uint64_t generation, SG_Journal_Apply apply ) {
+    SG_Journal_Header hdr;
+    SG_Journal_Record rec;
+    char payload[65536];
+    uint64_t records = 0;
+    off_t valid;
+    uint32_t sum;
+    FILE *in;
+
+    if ((in = fopen(path, "r+")) == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        logMessage(LOG_ERROR_LEVEL, "replaySGJournal: failed opening [%s]", path);
+        return -1;
+    }
+    setvbuf(in, NULL, _IOFBF, SG_JOURNAL_BUFFER);
+    if ((fread(&hdr, sizeof(hdr), 1, in) != 1) || (hdr.magic != SG_JOURNAL_MAGIC) ||
+            (hdr.version != SG_CHECKPOINT_VERSION) || (hdr.generation != generation)) {
+        // a journal of an older snapshot is already in the snapshot
+        logMessage(LOG_WARNING_LEVEL, "replaySGJournal: journal [%s] does not follow the snapshot, ignored", path);
+        fclose(in);
+        return 1;
+    }
+    valid = sizeof(hdr);
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        if (fread(payload, 1, rec.length, in) != rec.length) {
+            break;
+        }
+        sum = rec.sum;
+        rec.sum = 0;
+        if (sum != sumSGCheckpoint(sumSGCheckpoint(0, &rec, sizeof(rec)), payload, rec.length)) {
+            break;
+        }
+        if (apply(rec.type, payload, rec.length)) {
+            logMessage(LOG_ERROR_LEVEL, "replaySGJournal: failed applying record [%lu] of [%s]", records, path);
+            fclose(in);
+            return -1;
+        }
+        valid += sizeof(rec) + rec.length;
+        records++;
+    }
+    if ((lseek(fileno(in), 0, SEEK_END) != valid) && ftruncate(fileno(in), valid)) {
+        logMessage(LOG_ERROR_LEVEL, "replaySGJournal: failed cutting the torn tail of [%s]", path);
+        fclose(in);
+        return -1;
+    }
+    fclose(in);
+    logMessage(LOG_INFO_LEVEL, "replaySGJournal: applied %lu records of [%s]", records, path);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : startSGJournal
+// Description  : Open a journal for appending
+//
+// Inputs       : journal - the journal
+//                path - the journal file
+//                generation - the generation of the snapshot it follows
+//                truncate - start an empty journal (otherwise append)
+// Outputs      : 0 if successful, -1 if failure
+
+int startSGJournal( SG_Journal *journal, const char *path, uint64_t generation, int truncate ) {
+    SG_Journal_Header hdr = { SG_JOURNAL_MAGIC, SG_CHECKPOINT_VERSION, generation };
+
+    journal->used = 0;
+    journal->generation = generation;
+    if ((journal->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644)) == -1) {
+        logMessage(LOG_ERROR_LEVEL, "startSGJournal: failed opening [%s]", path);
+        return -1;
+    }
+    if (truncate && (write(journal->fd, &hdr, sizeof(hdr)) != sizeof(hdr))) {
+        logMessage(LOG_ERROR_LEVEL, "startSGJournal: failed writing [%s]", path);
+        close(journal->fd);
+        journal->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : appendSGJournal
+// Description  : Add a record to the journal buffer, writing the buffer out
+//                first if the record does not fit
+//
+// Inputs       : journal - the journal
+//                type - the record type
+//                payload - the record payload
+//                length - its length
+//                more - more payload (the path of a file, NULL if none)
+//                moreLength - its length
+// Outputs      : 0 if successful, -1 if failure
+
+int appendSGJournal( SG_Journal *journal, int type, const void *payload, size_t length, const void *more, size_t moreLength ) {
+    SG_Journal_Record rec;
+    size_t need = sizeof(rec) + length + moreLength;
+    char *out;
+
+    if (length + moreLength > UINT16_MAX) {
+        logMessage(LOG_ERROR_LEVEL, "appendSGJournal: record too long [%lu]", length + moreLength);
+        return -1;
+    }
+    if ((journal->used + need > SG_JOURNAL_BUFFER) && flushSGJournal(journal)) {
+        return -1;
+    }
+    rec.sum = 0;
+    rec.length = length + moreLength;
+    rec.type = type;
+    rec.unused = 0;
+    out = journal->buffer + journal->used;
+    memcpy(out + sizeof(rec), payload, length);
+    if (moreLength) {
+        memcpy(out + sizeof(rec) + length, more, moreLength);
+    }
+    rec.sum = sumSGCheckpoint(sumSGCheckpoint(0, &rec, sizeof(rec)), out + sizeof(rec), length + moreLength);
+    memcpy(out, &rec, sizeof(rec));
+    journal->used += need;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flushSGJournal
+// Description  : Write the buffered records to the journal file
+//
+// Inputs       : journal - the journal
+// Outputs      : 0 if successful, -1 if failure
+
+int flushSGJournal( SG_Journal *journal ) {
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < journal->used) {
+        if ((ret = write(journal->fd, journal->buffer + done, journal->used - done)) <= 0) {
+            if ((ret == -1) && (errno == EINTR)) {
+                continue;
+            }
+            logMessage(LOG_ERROR_LEVEL, "flushSGJournal: failed writing the journal");
+            return -1;
+        }
+        done += ret;
+    }
+    journal->used = 0;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stopSGJournal
+// Description  : Flush and close the journal
+//
+// Inputs       : journal - the journal
+// Outputs      : none
+
+void stopSGJournal( SG_Journal *journal ) {
+    if (journal->fd != -1) {
+        flushSGJournal(journal);
+        close(journal->fd);
+        journal->fd = -1;
+    }
+}
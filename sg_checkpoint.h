@@ -0,0 +1,189 @@
+#ifndef SG_CHECKPOINT_INCLUDED
+#define SG_CHECKPOINT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_checkpoint.h
+//  Description    : This is the declaration of the on-disk metadata
+//                   checkpoint of the ScatterGather driver: a snapshot of
+//                   the file map (paths, sizes, block maps, path index) and
+//                   the remote sequence table and the shared block counts,
+//                   and an append-only journal of
+//                   the changes made since.  The snapshot is used in place
+//                   through a private mapping, its parts checksummed
+//                   separately so that each is checked when first used
+//                   rather than all at load.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+#include <sg_defs.h>
+
+//
+// Defines
+#define SG_SNAPSHOT_MAGIC 0x53474350         // "SGCP"
+#define SG_JOURNAL_MAGIC 0x53474a4c          // "SGJL"
+#define SG_CHECKPOINT_VERSION 2
+#define SG_SNAPSHOT_INDEX_CHUNK 1024         // path index slots per checksum
+#define SG_JOURNAL_BUFFER (64 * 1024)        // journal bytes buffered before a write
+
+// Journal record types
+#define SG_JOURNAL_FILE  1 // a file was created (SG_Journal_File, then the path)
+#define SG_JOURNAL_SIZE  2 // a file grew, or was emptied (SG_Journal_Size)
+#define SG_JOURNAL_BLOCK 3 // a block of a file was mapped (SG_Journal_Block)
+#define SG_JOURNAL_NODE  4 // the sequence number of a remote node (SG_Journal_Node)
+#define SG_JOURNAL_CLONE 5 // a file created just before took the blocks of another (SG_Journal_Clone)
+
+// Type definitions (all little endian, as written by the machine)
+typedef struct {
+    uint32_t magic;           // SG_SNAPSHOT_MAGIC
+    uint32_t version;         // SG_CHECKPOINT_VERSION
+    uint64_t generation;      // pairs the snapshot with its journal
+    uint64_t blockSize;       // block size of the block maps
+    uint64_t files;           // number of files (handles 0 to files - 1)
+    uint64_t nodes;           // number of remote nodes
+    uint64_t shared;          // number of shared blocks
+    uint64_t indexSize;       // slots in the path index (power of two)
+    uint64_t blockEntries;    // number of block entries
+    uint64_t pathBytes;       // bytes of paths
+    uint64_t nodesOffset;     // offset of the node table (SG_Snapshot_Node)
+    uint64_t sharedOffset;    // offset of the shared blocks (SG_Snapshot_Shared)
+    uint64_t filesOffset;     // offset of the file records (SG_Snapshot_File)
+    uint64_t indexOffset;     // offset of the path index (int32_t handles, -1 free)
+    uint64_t indexSumsOffset; // offset of the index checksums (one per chunk)
+    uint64_t blocksOffset;    // offset of the block entries (SG_Snapshot_Block)
+    uint64_t pathsOffset;     // offset of the paths (packed, nul terminated)
+    uint64_t size;            // size of the snapshot
+    uint32_t nodesSum;        // checksum of the node table
+    uint32_t sharedSum;       // checksum of the shared blocks
+    uint32_t headerSum;       // checksum of the header (this field zero)
+    uint32_t unused;
+} SG_Snapshot_Header;
+
+typedef struct {
+    uint64_t nodeID;          // the remote node
+    uint64_t seqNum;          // its last sequence number
+} SG_Snapshot_Node;
+
+typedef struct {
+    uint64_t nodeID;          // the remote node holding the block
+    uint64_t blockID;         // the remote block (SG_BLOCK_UNKNOWN if a hole)
+} SG_Snapshot_Block;
+
+typedef struct {
+    uint64_t nodeID;          // the remote node holding the block
+    uint64_t blockID;         // the remote block
+    uint64_t refs;            // number of block entries holding it (more than one)
+} SG_Snapshot_Shared;
+
+typedef struct {
+    uint64_t fSize;           // file size (blocks times the block size)
+    uint64_t path;            // offset of the path in the paths
+    uint64_t blocks;          // first block entry (fSize / block size of them)
+    uint32_t pathLength;      // length of the path (without the nul)
+    uint32_t sum;             // checksum of the record (this field zero), path and blocks
+} SG_Snapshot_File;
+
+typedef struct {
+    uint32_t magic;           // SG_JOURNAL_MAGIC
+    uint32_t version;         // SG_CHECKPOINT_VERSION
+    uint64_t generation;      // generation of the snapshot the journal follows
+} SG_Journal_Header;
+
+typedef struct {
+    uint32_t sum;             // checksum of the record (this field zero) and payload
+    uint16_t length;          // bytes of payload
+    uint8_t  type;            // SG_JOURNAL_*
+    uint8_t  unused;
+} SG_Journal_Record;
+
+typedef struct {
+    int32_t  fh;              // the file handle
+    uint32_t pathLength;      // the path follows
+} SG_Journal_File;
+
+typedef struct {
+    int32_t  fh;              // the file handle
+    uint32_t unused;
+    uint64_t fSize;           // the new size
+} SG_Journal_Size;
+
+typedef struct {
+    int32_t  src;             // the file cloned
+    int32_t  fh;              // the file handle of the clone
+} SG_Journal_Clone;
+
+typedef struct {
+    int32_t  fh;              // the file handle
+    uint32_t unused;
+    uint64_t index;           // the block index in the file
+    SG_Snapshot_Block entry;  // where the block is
+} SG_Journal_Block;
+
+typedef struct {
+    uint64_t nodeID;          // the remote node
+    uint64_t seqNum;          // its last sequence number
+} SG_Journal_Node;
+
+typedef struct {
+    char *base;               // the mapping (NULL if there is no snapshot)
+    size_t size;              // size of the mapping
+    SG_Snapshot_Header *header;
+    SG_Snapshot_Node *nodes;
+    SG_Snapshot_Shared *shared;
+    SG_Snapshot_File *files;
+    int32_t *index;           // path index, written to in place (private mapping)
+    uint32_t *indexSums;
+    SG_Snapshot_Block *blocks;
+    char *paths;
+    uint8_t *indexChecked;    // index chunks checked so far
+} SG_Snapshot;
+
+typedef struct {
+    int fd;                   // the journal file, -1 if not journaling
+    uint64_t generation;      // generation of the snapshot it follows
+    size_t used;              // bytes buffered
+    char buffer[SG_JOURNAL_BUFFER];
+} SG_Journal;
+
+// Applies a journal record during replay, 0 if successful
+typedef int (*SG_Journal_Apply)( int type, const void *payload, size_t length );
+
+//
+// Checkpoint functions
+
+uint32_t sumSGCheckpoint( uint32_t sum, const void *buf, size_t len );
+    // Extend a checksum (crc32) over buf, start with 0
+
+int openSGSnapshot( const char *path, SG_Snapshot *snap );
+    // Map a snapshot and check its header, node table and shared blocks, 1 if there is none
+
+int checkSGSnapshotFile( SG_Snapshot *snap, uint64_t fh );
+    // Check the record of a file, its path and its blocks
+
+int checkSGSnapshotIndex( SG_Snapshot *snap, uint64_t slot );
+    // Check the chunk of the path index holding slot (once)
+
+void closeSGSnapshot( SG_Snapshot *snap );
+    // Unmap the snapshot
+
+int replaySGJournal( const char *path, uint64_t generation, SG_Journal_Apply apply );
+    // Apply the intact records of a journal, cut off a torn tail
+
+int startSGJournal( SG_Journal *journal, const char *path, uint64_t generation, int truncate );
+    // Open a journal for appending, empty it first if truncate
+
+int appendSGJournal( SG_Journal *journal, int type, const void *payload, size_t length, const void *more, size_t moreLength );
+    // Add a record (payload then more) to the journal buffer
+
+int flushSGJournal( SG_Journal *journal );
+    // Write the buffered records to the journal file
+
+void stopSGJournal( SG_Journal *journal );
+    // Flush and close the journal
+
+#endif
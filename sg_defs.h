@@ -16,6 +16,8 @@
 
 // Defines 
 #define SG_BLOCK_SIZE 1024
+#define SG_MIN_BLOCK_SIZE 1024
+#define SG_MAX_BLOCK_SIZE 65536
 #define SG_MAX_BLOCKS_PER_FILE 264
 #define SG_MAGIC_VALUE (uint32_t)0xfefe
 #define SG_BLOCK_UNKNOWN ((uint32_t)-1)
@@ -36,6 +38,22 @@
 // The basic ScatterGather packet size WITH block
 #define SG_DATA_PACKET_SIZE (SG_BASE_PACKET_SIZE + SG_BLOCK_SIZE)
 
+// The ScatterGather packet size WITH a block of a negotiated size
+#define SG_BLOCK_PACKET_SIZE(bsz) (SG_BASE_PACKET_SIZE + (bsz))
+#define SG_MAX_PACKET_SIZE SG_BLOCK_PACKET_SIZE(SG_MAX_BLOCK_SIZE)
+
+// The ScatterGather packet size WITH a byte range of a block
+#define SG_RANGE_PACKET_SIZE(len) (\
+        SG_BASE_PACKET_SIZE +     /* base packet */ \
+        (sizeof(uint16_t)*2) +    /* range off/len */ \
+        (len)                     /* range bytes */ )
+
+// The ScatterGather packet size WITH a compressed block
+#define SG_COMPRESSED_PACKET_SIZE(clen) (\
+        SG_BASE_PACKET_SIZE +     /* base packet */ \
+        sizeof(uint16_t) +        /* compressed len */ \
+        (clen)                    /* compressed bytes */ )
+
 // Type definitions
 typedef int32_t SgFHandle;
 typedef uint64_t SG_Node_ID;   // The type for node identifiers
@@ -13,50 +13,191 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <zlib.h>
+#include <cmpsc311_workload.h>
 
 // Project Includes
 #include <sg_driver.h>
 #include <sg_service.h>
 #include <sg_cache.h>
+#include <sg_block.h>
+#include <sg_blockmap.h>
+#include <sg_blockref.h>
+#include <sg_wlbin.h>
+#include <sg_log.h>
+#include <sg_span.h>
+#include <sg_stats.h>
+#include <sg_flight.h>
+#include <sg_arena.h>
+#include <sg_checkpoint.h>
+#include <sg_prefetch.h>
 
 // define
+#define SG_HOLE_BLOCK SG_BLOCK_UNKNOWN // block map entry of a hole (reads as zeros, never sent)
+#define SG_FILE_SLAB_BITS 10           // files per slab (log2)
+#define SG_FILE_SLAB (1 << SG_FILE_SLAB_BITS)
+#define SG_FILE_INDEX_SLOTS 1024       // initial path index slots (power of two)
+#define SG_NODE_TABLE_ENTRIES 16       // initial node-sequence pairs
+#define SG_TRANSFER_CHUNK (1 << 20)    // local file bytes per read-ahead drop or write (import/export)
+
+// The file of a handle, in its slab
+#define SG_FILE(fh) (&sgFileMap.slabs[(fh) >> SG_FILE_SLAB_BITS][(fh) & (SG_FILE_SLAB - 1)])
 
 // Type definitions
 typedef struct{
-    SgFHandle fHandle;
-    int fPointer;
-    int fSize;
-    int numBlocks;
+    char * path;             // file name (interned in the metadata arena)
+    uint64_t fPointer;       // current position in the file
+    uint64_t fSize;          // file size (always a multiple of the block size)
     int open;  
-    SG_Block_ID * blockID;
-    SG_Node_ID * remNodeID;
+    int advice;              // cache policy of the file (SG_ADVICE_NORMAL, SEQUENTIAL, RANDOM or NOREUSE)
+    SG_Block_Map blocks;     // block index -> remote (node, block)
 } SG_File;
 
 typedef struct{
-    char ** fPaths;          // store file names
-    SG_File ** files;        // store files
+    SG_File ** slabs;        // store files, SG_FILE_SLAB per slab
+    int slabCount;           // number of slabs the directory has room for
+    SgFHandle * index;       // path hash table (open addressing), -1 if the slot is free
+    size_t indexSize;        // number of slots (power of two, at most half used)
+    SG_File * restored;      // slabs of the files of the snapshot (anonymous mapping)
+    size_t restoredSize;     // bytes mapped
 } SG_File_Map;
 
+typedef struct{
+    SG_Node_ID nodeID;       // remote node
+    SG_SeqNum seqNum;        // last remote sequence number of the node
+    uint8_t dirty;           // changed since the last journal commit
+} SG_Node_Entry;
+
 // Global Data
+SG_Arena sgMetaArena;        // driver metadata: file slabs, paths, node table
 SG_File_Map sgFileMap;
 SgFHandle nextFHandle = 0;   // index of next file handle to assign
-int fileSize;                // total allocated number of files
+SG_Block_Refs sgBlockRefs;   // blocks shared by cloned files, with their number of holders
 
-SG_Node_ID * remNodeIDs;
-SG_SeqNum * remSeqNums;
+SG_Node_Entry * remNodes;    // node-sequence pairs
 int length;                  // total allocated number of node-sequence pairs
 int next = 0;                // index of next node-sequence pair to assign
 // Driver file entry
 
 // Global data
 int sgDriverInitialized = 0; // The flag indicating the driver initialized
+pthread_mutex_t sgDriverLock = PTHREAD_MUTEX_INITIALIZER; // Serializes the file system calls
 SG_Block_ID sgLocalNodeId;   // The local node identifier
+size_t sgBlockSize = SG_BLOCK_SIZE; // The block size agreed with the service
 SG_SeqNum sgLocalSeqno;      // The local sequence number
+SG_Endpoint_Config sgConfig = { sgServicePost, 0, SG_BLOCK_SIZE }; // The endpoint configuration
+uint32_t sgFeatures = 0;     // The protocol extensions granted by the service
+SG_Codec sgCodec = { SG_BLOCK_SIZE }; // The block size and compression state of the endpoint
+
+// Wire traffic counters
+size_t sgPostCount = 0;      // number of packets posted to the service
+size_t sgBytesSent = 0;      // bytes sent to the service
+size_t sgBytesRecv = 0;      // bytes received from the service
+size_t sgWriteCount = 0;     // number of sgwrite calls
+size_t sgWriteBytes = 0;     // bytes on the wire (both ways) during sgwrite calls
+size_t sgHoleReads = 0;      // reads served from holes (no packet)
+size_t sgHoleWrites = 0;     // all-zero blocks kept as holes (no SG_CREATE_BLOCK)
+size_t sgElidedWrites = 0;   // writes that left the block unchanged (no update sent)
+size_t sgCopiedBlocks = 0;   // shared blocks copied on a write (SG_CREATE_BLOCK)
+size_t sgImportBytes = 0;    // bytes of local files imported
+size_t sgExportBytes = 0;    // bytes of files exported to local files
+size_t sgPostOps[SG_MAXVAL_EXT_OP];        // packets posted per operation
+SG_Histogram sgCallLatency[SG_CALL_TYPES]; // latency of the driver calls
+SG_Histogram sgPostLatency[SG_MAXVAL_EXT_OP]; // latency of the service posts per operation
+
+// flight recorder
+SG_Flight_Entry sgFlightScratch;           // entry filled outside of a driver call
+SG_Flight_Entry *sgFlight = &sgFlightScratch; // entry of the call in progress
+char *sgFlightPath = NULL;                 // where the dumps go, NULL if not configured
+uint64_t sgFlightThreshold = 0;            // call latency (ns) that triggers a dump, 0 never
+uint64_t sgFlightLastDump = 0;             // time of the last triggered dump
+volatile sig_atomic_t sgFlightRequested = 0; // a dump was requested by a signal
+
+// Metadata checkpoint (see sgCheckpointConfigure)
+char *sgCheckpointPath = NULL;  // the snapshot file, NULL if not checkpointing
+char *sgJournalPath = NULL;     // the journal of the changes since the snapshot
+SG_Snapshot sgSnapshot;         // the snapshot the metadata was restored from (mapped)
+SG_Journal sgJournal = { -1 };  // the journal being written, fd -1 if none
+uint64_t sgRestoreTime = 0;     // time the metadata restore took (ns)
+
+// Block prefetcher (see sgPrefetchConfigure)
+SG_Prefetcher sgPrefetcher;     // successors learned, no table if off
+size_t sgPrefetchIssued = 0;    // blocks fetched by the prefetcher
+
+// Request scheduler: demand posts are made by the client call, the
+// background ones are queued and posted while no client waits
+SG_Scheduler sgScheduler;       // the background requests queued
+SG_Post_Class sgPostClass = SG_CLASS_WRITE; // class of the posts being made
+pthread_t sgSchedThread;        // posts the queued requests (see sgSchedWorker)
+pthread_cond_t sgSchedWake = PTHREAD_COND_INITIALIZER; // wakes it, with the driver lock
+int sgSchedRunning = 0;         // the thread is running
+int sgSchedWaiting = 0;         // client calls waiting for the driver lock (atomic)
+size_t sgClassPosts[SG_POST_CLASSES]; // packets posted per class
+size_t sgSchedQueued = 0;       // background requests queued
+size_t sgSchedPromoted = 0;     // queued requests a demand read posted first
+size_t sgSchedDropped = 0;      // background requests dropped (queue full or shutdown)
+
+// Trace capture (see sgTraceStart)
+char * sgTracePath = NULL;   // where the trace is written, NULL if not tracing
+SG_Wlbin_Builder sgTrace;    // the operations traced so far
+uint64_t sgTraceBegin;       // time the trace started (ns)
 
 // Driver support functions
 int sgInitEndpoint( void ); // Initialize the endpoint
 
+int sgPostPacket( char *packet, size_t *len, char *rpacket, size_t *rlen ); // Post a packet to the service
+
+int sgUpdateBlockRange( SG_Node_ID rem, SG_Block_ID blk, size_t off, char *buf, size_t len ); // Update part of a block
+
+SG_Block_Entry * sgStoreBlock( SgFHandle fh, uint64_t idx, char *block ); // Store a new block of a file
+
+int sgFetchBlock( SG_Node_ID rem, SG_Block_ID blk, char *block ); // Fetch a block from the service
+
+int sgWriteLocal( int fd, char *buf, size_t len ); // Write all of a buffer to a local file
+
+void sgPrefetchNext( SgFHandle fh, uint64_t idx ); // Prefetch the block predicted to follow a read
+
+int sgSchedule( SG_Post_Class cls, SG_Node_ID rem, SG_Block_ID blk ); // Queue a background fetch
+
+void * sgSchedWorker( void *arg ); // Post the queued requests while no client waits
+
+void sgSchedIssue( SG_Sched_Request *req ); // Post a queued request
+
+void sgSchedStop( void ); // Stop the scheduler thread
+
+int sgBlockUnchanged( SG_Block_Entry *entry, size_t off, char *buf, size_t len ); // Would a write leave the block as it is
+
+uint64_t sgTraceTime( void ); // Monotonic time for the trace
+
+void sgTraceOp( int op, const char *name, uint64_t pos, char *data, size_t len, uint64_t time ); // Trace an operation
+
+int sgTraceStopLocked( void ); // Write the trace, stop tracing
+void sgLockDriver( void ); // Take the driver lock (traced)
+void sgResetStats( void ); // Clear the driver statistics
+void sgFlightBegin( SG_Driver_Call call, SgFHandle fh, uint64_t off, size_t len, uint64_t start ); // Start a flight entry
+void sgRecordCall( SG_Driver_Call call, uint64_t start, int64_t ret ); // Record the latency of a driver call
+int sgFlightDumpLocked( const char *path, const char *reason ); // Dump the flight recorder
+int sgCheckpointLocked( void ); // Write the metadata snapshot, start a new journal
+int sgLoadCheckpoint( void ); // Restore the metadata from the snapshot and journal
+int sgJournalApply( int type, const void *payload, size_t length ); // Replay a journal record
+void sgJournalCommit( void ); // Write the journal records of the call
+SG_Snapshot_Block fileBlock( SgFHandle fh, uint64_t idx ); // A block entry of a loaded or snapshot file
+void sgFlightSignal( int signo ); // Signal handler, requests a dump
+
+SG_Packet_Status sgSerializeBlock( SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, SG_System_OP op, 
+        SG_SeqNum sseq, SG_SeqNum rseq, char *data, char *packet, size_t *plen ); // Serialize a block packet
+
 // Functions
 SG_SeqNum find(SG_Node_ID remNodeID);
 
@@ -64,9 +205,44 @@ int put(SG_Node_ID remNodeID, SG_SeqNum remSeqNum);
 
 int update(SG_Node_ID remNodeID, SG_SeqNum remSeqNum);
 
-int mallocBlockPerFile(SgFHandle fh);
+int extendFile(SgFHandle fh, uint64_t blocks);
+int truncateFile(SgFHandle fh);
+
+size_t findFileSlot(const char *path);
+
+SgFHandle addFile(const char *path);
+
+int cloneFile(SgFHandle src, SgFHandle fh);
+
+int loadFile(SgFHandle fh);
+
+const char * filePath(SgFHandle fh);
+
+// File system implementation (called with the driver lock held)
+SgFHandle sgFindFile(const char *path, int create);
+
+SgFHandle sgOpenLocked(const char *path);
+
+int sgReadLocked(SgFHandle fh, char *buf, size_t len);
+
+int sgWriteLocked(SgFHandle fh, char *buf, size_t len);
+
+int64_t sgSeekLocked(SgFHandle fh, uint64_t off);
+
+int sgCloseLocked(SgFHandle fh);
+
+SgFHandle sgCloneLocked(SgFHandle fh, const char *path);
+
+int64_t sgImportLocked(const char *localpath, const char *path);
+
+int64_t sgExportLocked(const char *path, const char *localpath);
 
-// File system interface implementation
+int sgAdviseLocked(SgFHandle fh, uint64_t off, uint64_t len, SG_Advice advice);
+
+int sgShutdownLocked(void);
+
+// File system interface implementation, each call holds the driver lock
+// so that concurrent clients see the driver, cache and service in turn
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -77,6 +253,264 @@ int mallocBlockPerFile(SgFHandle fh);
 // Outputs      : file handle if successful test, -1 if failure
 
 SgFHandle sgopen(const char *path) {
+    SG_SPAN("sgopen");
+    uint64_t start = getSGTimeNS();
+    uint64_t time = sgTracePath ? sgTraceTime() : 0;
+    SgFHandle ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_OPEN, -1, 0, 0, start);
+    ret = sgOpenLocked(path);
+    sgJournalCommit();
+    sgRecordCall(SG_CALL_OPEN, start, ret);
+    if (sgTracePath && ret != -1) {
+        sgTraceOp(WL_OPEN, path, 0, NULL, 0, time);
+    }
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgread
+// Description  : Read data from the file
+//
+// Inputs       : fh - file handle for the file to read from
+//                buf - place to put the data
+//                len - the length of the read
+// Outputs      : number of bytes read, -1 if failure
+
+int sgread(SgFHandle fh, char *buf, size_t len) {
+    SG_SPAN("sgread");
+    uint64_t start = getSGTimeNS();
+    uint64_t time = sgTracePath ? sgTraceTime() : 0;
+    int ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_READ, fh, 0, len, start);
+    ret = sgReadLocked(fh, buf, len);
+    if (sgPrefetcher.table && (ret > 0)) {
+        sgPrefetchNext(fh, (SG_FILE(fh)->fPointer - 1) / sgBlockSize);
+    }
+    sgJournalCommit();
+    sgRecordCall(SG_CALL_READ, start, ret);
+    if (sgTracePath && ret == len) {
+        sgTraceOp(WL_READ, SG_FILE(fh)->path, SG_FILE(fh)->fPointer - len, buf, len, time);
+    }
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgwrite
+// Description  : write data to the file
+//
+// Inputs       : fh - file handle for the file to write to
+//                buf - pointer to data to write
+//                len - the length of the write
+// Outputs      : number of bytes written if successful test, -1 if failure
+
+int sgwrite(SgFHandle fh, char *buf, size_t len) {
+    SG_SPAN("sgwrite");
+    uint64_t start = getSGTimeNS();
+    uint64_t time = sgTracePath ? sgTraceTime() : 0;
+    int ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_WRITE, fh, 0, len, start);
+    ret = sgWriteLocked(fh, buf, len);
+    sgJournalCommit();
+    sgRecordCall(SG_CALL_WRITE, start, ret);
+    if (sgTracePath && ret == len) {
+        sgTraceOp(WL_WRITE, SG_FILE(fh)->path, SG_FILE(fh)->fPointer - len, buf, len, time);
+    }
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgseek
+// Description  : Seek to a specific place in the file
+//
+// Inputs       : fh - the file handle of the file to seek in
+//                off - offset within the file to seek to
+// Outputs      : new position if successful, -1 if failure
+
+int64_t sgseek(SgFHandle fh, uint64_t off) {
+    SG_SPAN("sgseek");
+    uint64_t start = getSGTimeNS();
+    int64_t ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_SEEK, fh, off, 0, start);
+    ret = sgSeekLocked(fh, off);
+    sgRecordCall(SG_CALL_SEEK, start, ret);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgclose
+// Description  : Close the file
+//
+// Inputs       : fh - the file handle of the file to close
+// Outputs      : 0 if successful test, -1 if failure
+
+int sgclose(SgFHandle fh) {
+    SG_SPAN("sgclose");
+    uint64_t start = getSGTimeNS();
+    uint64_t time = sgTracePath ? sgTraceTime() : 0;
+    int ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_CLOSE, fh, 0, 0, start);
+    ret = sgCloseLocked(fh);
+    sgRecordCall(SG_CALL_CLOSE, start, ret);
+    if (sgTracePath && ret == 0) {
+        sgTraceOp(WL_CLOSE, SG_FILE(fh)->path, 0, NULL, 0, time);
+    }
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgclone
+// Description  : Clone a file to a new file, which shares the blocks of the
+//                file until either is written (not traced, a workload has
+//                no clone operation)
+//
+// Inputs       : fh - the file handle of the file to clone
+//                path - the path/filename of the clone
+// Outputs      : file handle of the clone (open) if successful, -1 if failure
+
+SgFHandle sgclone(SgFHandle fh, const char *path) {
+    SG_SPAN("sgclone");
+    uint64_t start = getSGTimeNS();
+    SgFHandle ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_CLONE, fh, 0, 0, start);
+    ret = sgCloneLocked(fh, path);
+    sgJournalCommit();
+    sgRecordCall(SG_CALL_CLONE, start, ret);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgimport
+// Description  : Copy a local file into a file, a whole block at a time in
+//                one driver call (not traced, a workload has no import)
+//
+// Inputs       : localpath - the local file to copy
+//                path - the path/filename of the file (created if new)
+// Outputs      : number of bytes imported if successful, -1 if failure
+
+int64_t sgimport(const char *localpath, const char *path) {
+    SG_SPAN("sgimport");
+    uint64_t start = getSGTimeNS();
+    int64_t ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_IMPORT, -1, 0, 0, start);
+    ret = sgImportLocked(localpath, path);
+    sgJournalCommit();
+    sgRecordCall(SG_CALL_IMPORT, start, ret);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgexport
+// Description  : Copy a file out to a local file, a whole block at a time in
+//                one driver call (not traced, a workload has no export)
+//
+// Inputs       : path - the path/filename of the file to copy
+//                localpath - the local file (replaced if it exists)
+// Outputs      : number of bytes exported if successful, -1 if failure
+
+int64_t sgexport(const char *path, const char *localpath) {
+    SG_SPAN("sgexport");
+    uint64_t start = getSGTimeNS();
+    int64_t ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_EXPORT, -1, 0, 0, start);
+    ret = sgExportLocked(path, localpath);
+    sgRecordCall(SG_CALL_EXPORT, start, ret);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgadvise
+// Description  : Tell the driver how a file will be used, so the cache keeps
+//                what will be read again (not traced, a workload has no
+//                advice)
+//
+// Inputs       : fh - the file handle
+//                off - start of the range
+//                len - length of the range, 0 to the end of the file
+//                advice - the expected use (SG_ADVICE_*)
+// Outputs      : 0 if successful, -1 if failure; for WILLNEED the number of
+//                blocks of the range left out (past a cache full)
+
+int sgadvise(SgFHandle fh, uint64_t off, uint64_t len, SG_Advice advice) {
+    SG_SPAN("sgadvise");
+    uint64_t start = getSGTimeNS();
+    int ret;
+
+    sgLockDriver();
+    sgFlightBegin(SG_CALL_ADVISE, fh, off, len, start);
+    ret = sgAdviseLocked(fh, off, len, advice);
+    sgRecordCall(SG_CALL_ADVISE, start, ret);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgshutdown
+// Description  : Shut down the filesystem
+//
+// Inputs       : none
+// Outputs      : 0 if successful test, -1 if failure
+
+int sgshutdown(void) {
+    int ret;
+
+    // last statistics dump, the dump thread takes the driver lock (so does the scheduler)
+    stopSGStatsDump();
+    sgSchedStop();
+    sgLockDriver();
+    if (sgTracePath) {
+        sgTraceStopLocked();
+    }
+    ret = sgShutdownLocked();
+    dumpSGSpans();
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFindFile
+// Description  : Find a file by its path (driver lock held), initializing
+//                the endpoint first if needed, the file is loaded from the
+//                snapshot if it was not yet
+//
+// Inputs       : path - the path/filename of the file
+//                create - create the file if there is none
+// Outputs      : file handle if successful, -1 if failure
+
+SgFHandle sgFindFile(const char *path, int create) {
 
     // First check to see if we have been initialized
     if (!sgDriverInitialized) {
@@ -90,36 +524,41 @@ SgFHandle sgopen(const char *path) {
         // Set to initialized
         sgDriverInitialized = 1;
     }
-    SgFHandle fHandle = -1;
-    // check if file exist
-    int i = 0;
-    for (i = 0; i < nextFHandle; i++) {
-        if (strcmp(sgFileMap.fPaths[i], path) == 0) {
-            fHandle = i;
-            break;
-        }
+    // find the file by its path, create it if new (or load it from the snapshot)
+    size_t slot = findFileSlot(path);
+    if (slot == SIZE_MAX) {
+        return( -1 );
+    }
+    SgFHandle fHandle = sgFileMap.index[slot];
+    if ((fHandle == -1) && !create) {
+        logMessage(LOG_ERROR_LEVEL, "sgFindFile: no file [%s]", path);
+        return( -1 );
+    }
+    if ((fHandle == -1) && ((fHandle = addFile(path)) == -1)) {
+        return( -1 );
+    }
+    if (loadFile(fHandle)) {
+        return( -1 );
     }
+    return fHandle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgOpenLocked
+// Description  : Open the file for for reading and writing (driver lock held)
+//
+// Inputs       : path - the path/filename of the file to be read
+// Outputs      : file handle if successful test, -1 if failure
+
+SgFHandle sgOpenLocked(const char *path) {
+    SgFHandle fHandle = sgFindFile(path, 1);
+
     if (fHandle == -1) {
-        if (nextFHandle >= fileSize) {
-            fileSize = fileSize * 2;
-            // malloc total files 
-            sgFileMap.files = (SG_File **) realloc(sgFileMap.files, fileSize * sizeof(SG_File *));
-            sgFileMap.fPaths = (char **) realloc(sgFileMap.fPaths, fileSize * sizeof(char *));
-            logMessage(LOG_INFO_LEVEL, "resize file map: %d to %d", fileSize / 2, fileSize);
-        }
-        // create a new file
-        fHandle = nextFHandle;
-        sgFileMap.fPaths[fHandle] = (char *) malloc(strlen(path) + 1);
-        strcpy(sgFileMap.fPaths[fHandle], path);
-        sgFileMap.files[fHandle] = (SG_File *) malloc(sizeof(SG_File));
-        sgFileMap.files[fHandle]->fHandle = fHandle;
-        sgFileMap.files[fHandle]->fSize = 0;
-        sgFileMap.files[fHandle]->numBlocks = 0;
-        nextFHandle++;
-    }
-
-    sgFileMap.files[fHandle]->fPointer = 0;
-    sgFileMap.files[fHandle]->open = 1;
+        return( -1 );
+    }
+    SG_FILE(fHandle)->fPointer = 0;
+    SG_FILE(fHandle)->open = 1;
  
     // Return the file handle 
     return fHandle;
@@ -127,226 +566,189 @@ SgFHandle sgopen(const char *path) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : sgread
-// Description  : Read data from the file
+// Function     : sgReadLocked
+// Description  : Read data from the file (driver lock held)
 //
 // Inputs       : fh - file handle for the file to read from
 //                buf - place to put the data
 //                len - the length of the read
 // Outputs      : number of bytes read, -1 if failure
 
-int sgread(SgFHandle fh, char *buf, size_t len) {
+int sgReadLocked(SgFHandle fh, char *buf, size_t len) {
     if (fh < 0 || fh >= nextFHandle) {
         return -1;
-    } else if (sgFileMap.files[fh]->open == 0) {
+    } else if (SG_FILE(fh)->open == 0) {
         return -1;
     }
-    int position = sgFileMap.files[fh]->fPointer;
-    if (position >= sgFileMap.files[fh]->fSize) {
+    uint64_t position = SG_FILE(fh)->fPointer;
+    sgFlight->offset = position;
+    if (position >= SG_FILE(fh)->fSize) {
         logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: pointer is set to the end of the file.");
         return -1;
     }
     // Local variables
-    SGDataBlock block = {[0 ... 1023] = 0};
+    char block[SG_MAX_BLOCK_SIZE];
     char * indicator;
-    SG_Block_ID blockID = sgFileMap.files[fh]->blockID[position / SG_BLOCK_SIZE];
-    SG_Node_ID sgRemoteNodeId = sgFileMap.files[fh]->remNodeID[position / SG_BLOCK_SIZE];
-    SG_SeqNum sgRemoteSeqNum = find(sgRemoteNodeId);    
-
-    // check if block is in cache
-    if ((indicator = getSGDataBlock(sgRemoteNodeId, blockID)) != NULL) {
-        memcpy(block, indicator, SG_BLOCK_SIZE);
+    SG_Block_Entry * entry = lookupBlockMap(&SG_FILE(fh)->blocks, position / sgBlockSize);
+    SG_Block_ID blockID = entry ? entry->blockID : SG_HOLE_BLOCK;
+    SG_Node_ID sgRemoteNodeId = entry ? entry->nodeID : SG_NODE_UNKNOWN;
+    // a file read once leaves the hot blocks where they are in the cache
+    int cold = (SG_FILE(fh)->advice == SG_ADVICE_SEQUENTIAL) || (SG_FILE(fh)->advice == SG_ADVICE_NOREUSE);
+    sgFlight->node = sgRemoteNodeId;
+    sgFlight->block = blockID;
+
+    // holes read as zeros, nothing to fetch; otherwise check if block is in cache
+    if (blockID == SG_HOLE_BLOCK) {
+        sgZeroBlock(block, sgBlockSize);
+        sgHoleReads++;
+        sgFlight->cache = SG_FLIGHT_CACHE_HOLE;
+    } else if ((indicator = cold ? getSGColdDataBlock(sgRemoteNodeId, blockID) : getSGDataBlock(sgRemoteNodeId, blockID)) != NULL) {
+        sgCopyBlock(block, indicator, sgBlockSize);
+        sgFlight->cache = SG_FLIGHT_CACHE_HIT;
     } else {
-        // block is not in cache
-        char initPacket[SG_BASE_PACKET_SIZE], recvPacket[SG_DATA_PACKET_SIZE];
-        size_t pktlen, rpktlen;
-        SG_Node_ID loc, rem;
-        SG_Block_ID blkid;
-        SG_SeqNum sloc, srem;
-        SG_System_OP op;
-        SG_Packet_Status status;
-
-        pktlen = SG_BASE_PACKET_SIZE;
-        // Setup the packet
-        if ((status = serialize_sg_packet(sgLocalNodeId,  // Local ID
-                                        sgRemoteNodeId,   // Remote ID
-                                        blockID,          // Block ID
-                                        SG_OBTAIN_BLOCK,  // Operation
-                                        sgLocalSeqno,     // Sender sequence number
-                                        ++sgRemoteSeqNum, // Receiver sequence number
-                                        NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
-            logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed serialization of packet [%d].", status);
-            return( -1 );
+        sgFlight->cache = SG_FLIGHT_CACHE_MISS;
+        // a prefetch still queued for the block is posted now, as the demand read
+        if (sgScheduler.used && cancelSGRequest(&sgScheduler, sgRemoteNodeId, blockID)) {
+            sgSchedPromoted++;
         }
-        sgLocalSeqno++;
-        // Send the packet
-        rpktlen = SG_DATA_PACKET_SIZE;
-        if (sgServicePost(initPacket, &pktlen, recvPacket, &rpktlen)) {
-            logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed packet post" );
+        // block is not in cache, fetch it and put block data into cache
+        if (sgFetchBlock(sgRemoteNodeId, blockID, block)) {
             return( -1 );
         }
-        // Unpack the recieived data
-        if ((status = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, block, recvPacket, rpktlen)) != SG_PACKT_OK) {
-            logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed deserialization of packet [%d]", status);
-            return( -1 );
+        if (cold) {
+            putSGColdDataBlock(sgRemoteNodeId, blockID, block);
+        } else {
+            putSGDataBlock(sgRemoteNodeId, blockID, block);
         }
-        update(sgRemoteNodeId, srem);
-
-        // put block data into cache
-        putSGDataBlock(sgRemoteNodeId, blockID, block);
     }
     // copy len size data into buffer based on file pointer
-    if (len == SG_BLOCK_SIZE) {
-        memcpy(buf, block, len);
+    SG_SPAN("copy out");
+    if (len == sgBlockSize) {
+        sgCopyBlock(buf, block, sgBlockSize);
+    } else if (position % sgBlockSize + len <= sgBlockSize) {
+        memcpy(buf, block + position % sgBlockSize, len);
     } else {
-        switch (position % SG_BLOCK_SIZE) {
-            case (0):
-                memcpy(buf, block, len);
-                break;
-            case (256):
-                memcpy(buf, block + 256, len);
-                break;
-            case (512):
-                memcpy(buf, block + 512, len);
-                break;
-            case (768):
-                memcpy(buf, block + 768, len);
-                break;
-            default:
-                logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: pointer is not set correctly");
-                break;
-        }
+        logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: read crosses the end of the block");
+        return -1;
     }
     // update file position
-    sgFileMap.files[fh]->fPointer += len;
+    SG_FILE(fh)->fPointer += len;
     // Return the bytes processed
     return len;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : sgwrite
-// Description  : write data to the file
+// Function     : sgWriteLocked
+// Description  : write data to the file (driver lock held)
 //
 // Inputs       : fh - file handle for the file to write to
 //                buf - pointer to data to write
 //                len - the length of the write
 // Outputs      : number of bytes written if successful test, -1 if failure
 
-int sgwrite(SgFHandle fh, char *buf, size_t len) {
+int sgWriteLocked(SgFHandle fh, char *buf, size_t len) {
     if (fh < 0 || fh >= nextFHandle) {
         return -1;
-    } else if (sgFileMap.files[fh]->open == 0) {
+    } else if (SG_FILE(fh)->open == 0) {
         return -1;
     }
     // local variables
-    int position = sgFileMap.files[fh]->fPointer;
-    char initPacket[SG_DATA_PACKET_SIZE], recvPacket[SG_BASE_PACKET_SIZE];
-    SGDataBlock block = {[0 ... 1023] = 0};
+    uint64_t position = SG_FILE(fh)->fPointer;
+    SG_Block_Entry * entry;
+    size_t wireBytes = sgBytesSent + sgBytesRecv;
+    char initPacket[SG_MAX_PACKET_SIZE], recvPacket[SG_BASE_PACKET_SIZE];
+    char block[SG_MAX_BLOCK_SIZE];
+    size_t off = position % sgBlockSize;
     size_t pktlen, rpktlen;
     SG_Node_ID loc, rem;
     SG_Block_ID blkid;
     SG_SeqNum sloc, srem;
     SG_System_OP op;
     SG_Packet_Status status;
-    if (position > sgFileMap.files[fh]->fSize) {
-        logMessage( LOG_ERROR_LEVEL, "sgCreateBlock: pointer is not at the end of the file.");
-        return -1;
-    }
-    // check if file pointer is at the end
-    if (position == sgFileMap.files[fh]->fSize) {
-        // write a new block
-        pktlen = SG_DATA_PACKET_SIZE;       
-        memcpy(block, buf, len);
-        // set up the packet
-        if((status = serialize_sg_packet(sgLocalNodeId, 
-                                        SG_NODE_UNKNOWN, 
-                                        SG_BLOCK_UNKNOWN,
-                                        SG_CREATE_BLOCK,
-                                        sgLocalSeqno,
-                                        SG_SEQNO_UNKNOWN,
-                                        block, initPacket, &pktlen)) != SG_PACKT_OK) {
-            logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed serialization of packet [%d].", status);
-            return -1;
+    sgFlight->offset = position;
+    if (off + len > sgBlockSize) {
+        logMessage( LOG_ERROR_LEVEL, "sgCreateBlock: write crosses the end of the block.");
+        return -1;
+    }
+    // writing past the end of the file leaves holes up to (and including) the block
+    if (position >= SG_FILE(fh)->fSize) {
+        extendFile(fh, position / sgBlockSize + 1);
+    }
+    // check if file pointer is in a hole (possibly just created at the end)
+    entry = lookupBlockMap(&SG_FILE(fh)->blocks, position / sgBlockSize);
+    if (entry == NULL || entry->blockID == SG_HOLE_BLOCK) {
+        // write a new block, zeros apart from the written bytes
+        sgZeroBlock(block, sgBlockSize);
+        memcpy(block + off, buf, len);
+        if (sgBlockIsZero(block, sgBlockSize)) {
+            // nothing worth storing remotely, the block stays a hole
+            sgHoleWrites++;
+            SG_FILE(fh)->fPointer += len;
+            return len;
         }
-        sgLocalSeqno++;
-        // send the packet
-        rpktlen = SG_BASE_PACKET_SIZE;
-        if (sgServicePost(initPacket, &pktlen, recvPacket, &rpktlen)) {
-            logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed packet post" );
+        if ((entry = sgStoreBlock(fh, position / sgBlockSize, block)) == NULL) {
             return -1;
         }
-        // unpack the received data
-        if ((status = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK) {
-            logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed deserialization of packet [%d]", status);
-            return -1;
+    } else if (sgBlockUnchanged(entry, off, buf, len)) {
+        // the block already holds these bytes, no update to send
+        sgElidedWrites++;
+    } else if (countBlockRefs(&sgBlockRefs, entry->nodeID, entry->blockID) > 1) {
+        // the block is shared with a clone, the file gets a copy of its own
+        SG_Node_ID sharedNode = entry->nodeID;
+        SG_Block_ID sharedBlock = entry->blockID;
+
+        if (len < sgBlockSize) {
+            SG_FILE(fh)->fPointer -= off;
+            if (sgReadLocked(fh, block, sgBlockSize) != sgBlockSize) {
+                SG_FILE(fh)->fPointer = position;
+                return -1;
+            }
+            SG_FILE(fh)->fPointer = position;
         }
-        // malloc total blocks per file
-        if (position / SG_BLOCK_SIZE >= sgFileMap.files[fh]->numBlocks) {
-            mallocBlockPerFile(fh);
+        memcpy(block + off, buf, len);
+        if ((entry = sgStoreBlock(fh, position / sgBlockSize, block)) == NULL) {
+            return -1;
         }
-        // save node/block IDs as the current block in the file
-        sgFileMap.files[fh]->blockID[position / SG_BLOCK_SIZE] = blkid;
-        sgFileMap.files[fh]->remNodeID[position / SG_BLOCK_SIZE] = rem;
-        SG_SeqNum sgRemoteSeqNum = find(rem);
-        if (sgRemoteSeqNum == 0) {
-            put(rem, srem);
-        } else {
-            update(rem, srem);
+        dropBlockRef(&sgBlockRefs, sharedNode, sharedBlock);
+        sgCopiedBlocks++;
+    } else if ((sgFeatures & SG_FEATURE_RANGE_UPDATE) && (len < sgBlockSize)) {
+        // update only the written bytes of the file block (no read needed)
+        if (sgUpdateBlockRange(entry->nodeID, entry->blockID, off, buf, len)) {
+            return -1;
         }
-        sgFileMap.files[fh]->fSize += SG_BLOCK_SIZE;
-        putSGDataBlock(rem, blkid, block);
     } else {
         // update file block
-        SG_Block_ID blockID = sgFileMap.files[fh]->blockID[position / SG_BLOCK_SIZE];
-        SG_Node_ID sgRemoteNodeId = sgFileMap.files[fh]->remNodeID[position / SG_BLOCK_SIZE];
-
-        pktlen = SG_DATA_PACKET_SIZE;
-        // obtain old block data
-        switch (position % SG_BLOCK_SIZE) {
-            case (0):
-                sgread(fh, block, SG_BLOCK_SIZE);
-                memcpy(block, buf, len);
-                sgFileMap.files[fh]->fPointer -= SG_BLOCK_SIZE;
-                break;
-            case (256):
-                sgFileMap.files[fh]->fPointer -= 256;
-                sgread(fh, block, SG_BLOCK_SIZE);
-                memcpy(block + 256, buf, len);
-                sgFileMap.files[fh]->fPointer -= 768;
-                break;
-            case (512):
-                sgFileMap.files[fh]->fPointer -= 512;
-                sgread(fh, block, SG_BLOCK_SIZE);
-                memcpy(block + 512, buf, len);
-                sgFileMap.files[fh]->fPointer -= 512;
-                break;
-            case (768):
-                sgFileMap.files[fh]->fPointer -= 768;
-                sgread(fh, block, SG_BLOCK_SIZE);
-                memcpy(block + 768, buf, len);
-                sgFileMap.files[fh]->fPointer -= 256;
-                break;
-            default:
-                logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: pointer is not set correctly");
-                break;
+        SG_Block_ID blockID = entry->blockID;
+        SG_Node_ID sgRemoteNodeId = entry->nodeID;
+
+        pktlen = SG_BLOCK_PACKET_SIZE(sgBlockSize);
+        // obtain old block data (read the whole block from its start, then move back)
+        if (len < sgBlockSize) {
+            SG_FILE(fh)->fPointer -= off;
+            if (sgReadLocked(fh, block, sgBlockSize) != sgBlockSize) {
+                SG_FILE(fh)->fPointer = position;
+                return -1;
+            }
+            SG_FILE(fh)->fPointer = position;
         }
+        memcpy(block + off, buf, len);
         SG_SeqNum sgRemoteSeqNum = find(sgRemoteNodeId);
         // Setup the packet
-        if ((status = serialize_sg_packet(sgLocalNodeId,    // Local ID
+        if ((status = sgSerializeBlock(sgLocalNodeId,       // Local ID
                                           sgRemoteNodeId,   // Remote ID
                                           blockID,          // Block ID
                                           SG_UPDATE_BLOCK,  // Operation
                                           sgLocalSeqno,     // Sender sequence number
-                                          ++sgRemoteSeqNum, // Receiver sequence number
+                                          SG_NEXT_SEQNO(sgRemoteSeqNum), // Receiver sequence number
                                           block, initPacket, &pktlen)) != SG_PACKT_OK) {
             logMessage(LOG_ERROR_LEVEL, "sgUpdateBlock: failed serialization of packet [%d].", status);
             return( -1 );
         }
-        sgLocalSeqno++;
+        sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
         // Send the packet
         rpktlen = SG_BASE_PACKET_SIZE;
-        if (sgServicePost(initPacket, &pktlen, recvPacket, &rpktlen)) {
+        if (sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen)) {
             logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed packet post" );
             return( -1 );
         }
@@ -358,10 +760,19 @@ int sgwrite(SgFHandle fh, char *buf, size_t len) {
         update(sgRemoteNodeId, srem);
 
         // put block data into cache
-        putSGDataBlock(rem, blkid, block);
+        if (SG_FILE(fh)->advice == SG_ADVICE_NOREUSE) {
+            putSGColdDataBlock(rem, blkid, block);
+        } else {
+            putSGDataBlock(rem, blkid, block);
+        }
     }
-    // increase the file pointer
-    sgFileMap.files[fh]->fPointer += len;
+    // increase the file pointer (the flight entry was moved by a read-modify-write)
+    sgFlight->offset = position;
+    sgFlight->node = entry->nodeID;
+    sgFlight->block = entry->blockID;
+    SG_FILE(fh)->fPointer += len;
+    sgWriteCount++;
+    sgWriteBytes += sgBytesSent + sgBytesRecv - wireBytes;
 
     // Log the write, return bytes written
     return len;
@@ -369,24 +780,22 @@ int sgwrite(SgFHandle fh, char *buf, size_t len) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : sgseek
-// Description  : Seek to a specific place in the file
+// Function     : sgSeekLocked
+// Description  : Seek to a specific place in the file (driver lock held)
 //
 // Inputs       : fh - the file handle of the file to seek in
 //                off - offset within the file to seek to
 // Outputs      : new position if successful, -1 if failure
 
-int sgseek(SgFHandle fh, size_t off) {
+int64_t sgSeekLocked(SgFHandle fh, uint64_t off) {
     // error checking
     if (fh < 0 || fh >= nextFHandle) {
         return -1;
-    } else if (sgFileMap.files[fh]->open == 0) {
-        return -1;
-    } else if (off >= sgFileMap.files[fh]->fSize) {
-        logMessage(LOG_ERROR_LEVEL, "sgseek: offset exceed the file size");      
+    } else if (SG_FILE(fh)->open == 0) {
         return -1;
     }
-    sgFileMap.files[fh]->fPointer = off;
+    // seeking past the end is allowed, a later write leaves a hole behind
+    SG_FILE(fh)->fPointer = off;
 
     // Return new position
     return off;
@@ -394,19 +803,19 @@ int sgseek(SgFHandle fh, size_t off) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : sgclose
-// Description  : Close the file
+// Function     : sgCloseLocked
+// Description  : Close the file (driver lock held)
 //
 // Inputs       : fh - the file handle of the file to close
 // Outputs      : 0 if successful test, -1 if failure
 
-int sgclose(SgFHandle fh) {
+int sgCloseLocked(SgFHandle fh) {
     if (fh < 0 || fh >= nextFHandle) {
         return -1;
-    } else if (sgFileMap.files[fh]->open == 0) {
+    } else if (SG_FILE(fh)->open == 0) {
         return -1;
     } 
-    sgFileMap.files[fh]->open = 0;
+    SG_FILE(fh)->open = 0;
 
     // Return successfully
     return 0;
@@ -414,133 +823,677 @@ int sgclose(SgFHandle fh) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : sgshutdown
-// Description  : Shut down the filesystem
+// Function     : sgCloneLocked
+// Description  : Clone a file to a new file (driver lock held), copying the
+//                block map only: each block gains a holder, and the first
+//                write to a shared block gives the writer a copy of its own
 //
-// Inputs       : none
-// Outputs      : 0 if successful test, -1 if failure
-
-int sgshutdown(void) {
-    // Local variables
-    char initPacket[SG_BASE_PACKET_SIZE], recvPacket[SG_DATA_PACKET_SIZE];
-    size_t pktlen, rpktlen;
-    SG_Node_ID loc, rem;
-    SG_Block_ID blkid;
-    SG_SeqNum sloc, srem;
-    SG_System_OP op;
-    SG_Packet_Status status;
+// Inputs       : fh - the file handle of the file to clone
+//                path - the path/filename of the clone (must not exist)
+// Outputs      : file handle of the clone if successful, -1 if failure
 
-    // free file data and data paths
-    for (int fh = 0; fh < nextFHandle; fh++) {
-        if (sgFileMap.files[fh]) {
-            free(sgFileMap.files[fh]->blockID);
-            free(sgFileMap.files[fh]->remNodeID);
-            // logMessage(LOG_INFO_LEVEL, "Closed file %d, deleting %d items out of %d items", fh, sgFileMap.files[fh]->fSize / SG_BLOCK_SIZE, sgFileMap.files[fh]->numBlocks);
-            free(sgFileMap.files[fh]);
-            free(sgFileMap.fPaths[fh]);
-            sgFileMap.files[fh] = NULL;
-            sgFileMap.fPaths[fh] = NULL;
-        }
+SgFHandle sgCloneLocked(SgFHandle fh, const char *path) {
+    if (fh < 0 || fh >= nextFHandle) {
+        return -1;
+    } else if (SG_FILE(fh)->open == 0) {
+        return -1;
     }
-
-    // free node-sequence map
-    free(remNodeIDs);
-    free(remSeqNums); 
-    logMessage(LOG_INFO_LEVEL, "Closed Node-Sequence Map, deleting %d items out of %d items", next - 1, length);
-
-    // free file map
-    free(sgFileMap.files);
-    free(sgFileMap.fPaths);
-    logMessage(LOG_INFO_LEVEL, "Closed File Map, deleting %d items out of %d items", nextFHandle, fileSize);
-
-    pktlen = SG_BASE_PACKET_SIZE;
-    // Setup the packet
-    if ((status = serialize_sg_packet(sgLocalNodeId,     // Local ID
-                                      SG_NODE_UNKNOWN,   // Remote ID
-                                      SG_BLOCK_UNKNOWN,  // Block ID
-                                      SG_STOP_ENDPOINT,  // Operation
-                                      sgLocalSeqno,      // Sender sequence number
-                                      SG_SEQNO_UNKNOWN,  // Receiver sequence number
-                                      NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
-        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed serialization of packet [%d].", status);
-        return( -1 );
+    size_t slot = findFileSlot(path);
+    if (slot == SIZE_MAX) {
+        return -1;
     }
-    sgLocalSeqno++;
-    // Send the packet
-    rpktlen = SG_BASE_PACKET_SIZE;
-    if (sgServicePost(initPacket, &pktlen, recvPacket, &rpktlen)) {
-        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed packet post");
-        return( -1 );
+    if (sgFileMap.index[slot] != -1) {
+        logMessage(LOG_ERROR_LEVEL, "sgclone: [%s] already exists", path);
+        return -1;
     }
-    // Unpack the recieived data
-    if ((status = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK) {
-        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed deserialization of packet [%d]", status);
-        return( -1 );
+    SgFHandle clone = addFile(path);
+    if ((clone == -1) || cloneFile(fh, clone)) {
+        return -1;
     }
-    // close cache
-    closeSGCache();
+    if (sgJournal.fd != -1) {
+        SG_Journal_Clone record = { fh, clone };
+        appendSGJournal(&sgJournal, SG_JOURNAL_CLONE, &record, sizeof(record), NULL, 0);
+    }
+    SG_FILE(clone)->fPointer = 0;
+    SG_FILE(clone)->open = 1;
 
-    // Log, return successfully
-    logMessage(LOG_INFO_LEVEL, "Shut down Scatter/Gather driver.");
-    return( 0 );
+    // Return the file handle of the clone
+    return clone;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : serialize_sg_packet
-// Description  : Serialize a ScatterGather packet (create packet)
+// Function     : sgImportLocked
+// Description  : Copy a local file into a file (driver lock held).  The
+//                file is emptied first, then the local file is mapped and
+//                read ahead sequentially, each block written as by sgwrite
+//                from the start of the file, and the pages sent dropped as
+//                it goes so that a large file does not fill memory.  Files
+//                hold whole blocks, so a last partial block is padded with
+//                zeros.
 //
-// Inputs       : loc - the local node identifier
-//                rem - the remote node identifier
-//                blk - the block identifier
-//                op - the operation performed/to be performed on block
-//                sseq - the sender sequence number
-//                rseq - the receiver sequence number
-//                data - the data block (of size SG_BLOCK_SIZE) or NULL
-//                packet - the buffer to place the data
-//                plen - the packet length (int bytes)
-// Outputs      : 0 if successfully created, -1 if failure
+// Inputs       : localpath - the local file to copy
+//                path - the path/filename of the file (created if new)
+// Outputs      : number of bytes imported if successful, -1 if failure
+
+int64_t sgImportLocked(const char *localpath, const char *path) {
+    struct stat st;
+    char * data = NULL;
+    uint64_t pos, dropped = 0, fPointer;
+    size_t len;
+    int fd, wasOpen;
+    int64_t ret = 0;
+    SgFHandle fh;
+
+    // map the local file
+    if ((fd = open(localpath, O_RDONLY)) == -1) {
+        logMessage(LOG_ERROR_LEVEL, "sgimport: failed to open [%s]", localpath);
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        logMessage(LOG_ERROR_LEVEL, "sgimport: failed to stat [%s]", localpath);
+        close(fd);
+        return -1;
+    }
+    if ((st.st_size > 0) &&
+            ((data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+        logMessage(LOG_ERROR_LEVEL, "sgimport: failed to map [%s]", localpath);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if (data) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
 
-SG_Packet_Status serialize_sg_packet(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
-        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, 
-        char *packet, size_t *plen) {
-    // define local variable
-    SG_Magic magic_num;
-    SG_Packet_Status status;
-    SG_DataIndicator indicator;
-    magic_num = SG_MAGIC_VALUE; 
-    // initial data validity checking and error returning
-    if (packet) {
-        status = check_serialize_sg_Data(loc, rem, blk, op, sseq, rseq);
-    } else {
-        status = SG_PACKT_PDATA_BAD;
+    // replace the contents of the file, its handle is left as it was
+    if (((fh = sgFindFile(path, 1)) == -1) || truncateFile(fh)) {
+        if (data) {
+            munmap(data, st.st_size);
+        }
+        return -1;
     }
-    if (status != SG_PACKT_OK) {
-        print_sg_packet_log_message(SG_SERIALIZE, status);
-        return status;
+    sgFlight->fh = fh;
+    wasOpen = SG_FILE(fh)->open;
+    fPointer = SG_FILE(fh)->fPointer;
+    SG_FILE(fh)->open = 1;
+    for (pos = 0; pos < (uint64_t) st.st_size; pos += len) {
+        len = ((uint64_t) st.st_size - pos < sgBlockSize) ? st.st_size - pos : sgBlockSize;
+        SG_FILE(fh)->fPointer = pos;
+        if (sgWriteLocked(fh, data + pos, len) != len) {
+            logMessage(LOG_ERROR_LEVEL, "sgimport: failed writing [%s] at %lu", path, pos);
+            ret = -1;
+            break;
+        }
+        if (pos + len - dropped >= SG_TRANSFER_CHUNK) {
+            madvise(data + dropped, SG_TRANSFER_CHUNK, MADV_DONTNEED);
+            dropped += SG_TRANSFER_CHUNK;
+        }
     }
-    // check if data is Null and assign data indicator
+    SG_FILE(fh)->open = wasOpen;
+    SG_FILE(fh)->fPointer = fPointer;
     if (data) {
-        indicator = 1;
-        *plen = SG_DATA_PACKET_SIZE;
+        munmap(data, st.st_size);
+    }
+    if (ret == 0) {
+        sgImportBytes += st.st_size;
+        ret = st.st_size;
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgExportLocked
+// Description  : Copy a file out to a local file (driver lock held).  The
+//                blocks are gathered into large chunks, each written to the
+//                local file in one go.  Cached blocks are copied without
+//                touching the cache order and fetched blocks are not cached,
+//                so a bulk copy does not push the working set out.  Files
+//                hold whole blocks, so the local file is too: one imported
+//                from a file of another length comes back zero padded.
+//
+// Inputs       : path - the path/filename of the file to copy
+//                localpath - the local file (replaced if it exists)
+// Outputs      : number of bytes exported if successful, -1 if failure
+
+int64_t sgExportLocked(const char *path, const char *localpath) {
+    SG_Block_Entry * entry;
+    char * chunk, * cached;
+    uint64_t idx, blocks;
+    size_t used = 0;
+    int fd, ret = 0;
+    SgFHandle fh;
+
+    if ((fh = sgFindFile(path, 0)) == -1) {
+        return -1;
+    }
+    sgFlight->fh = fh;
+    if ((chunk = (char *) malloc(SG_TRANSFER_CHUNK)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgexport: out of memory");
+        return -1;
+    }
+    if ((fd = open(localpath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        logMessage(LOG_ERROR_LEVEL, "sgexport: failed to open [%s]", localpath);
+        free(chunk);
+        return -1;
+    }
+    blocks = SG_FILE(fh)->fSize / sgBlockSize;
+    for (idx = 0; (idx < blocks) && (ret == 0); idx++) {
+        entry = lookupBlockMap(&SG_FILE(fh)->blocks, idx);
+        if ((entry == NULL) || (entry->blockID == SG_HOLE_BLOCK)) {
+            sgZeroBlock(chunk + used, sgBlockSize);
+            sgHoleReads++;
+        } else if ((cached = peekSGDataBlock(entry->nodeID, entry->blockID)) != NULL) {
+            sgCopyBlock(chunk + used, cached, sgBlockSize);
+        } else if (sgFetchBlock(entry->nodeID, entry->blockID, chunk + used)) {
+            ret = -1;
+            break;
+        }
+        used += sgBlockSize;
+
+        // the chunk is full (block sizes divide it) or the file is done
+        if ((used == SG_TRANSFER_CHUNK) || (idx + 1 == blocks)) {
+            ret = sgWriteLocal(fd, chunk, used);
+            used = 0;
+        }
+    }
+    free(chunk);
+    if (close(fd) || ret) {
+        logMessage(LOG_ERROR_LEVEL, "sgexport: failed writing [%s]", localpath);
+        return -1;
+    }
+    sgExportBytes += SG_FILE(fh)->fSize;
+    return SG_FILE(fh)->fSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgAdviseLocked
+// Description  : Take the advice on how a file will be used (driver lock
+//                held).  SEQUENTIAL, RANDOM, NORMAL and NOREUSE set the
+//                cache policy of the whole file, as Linux does with the
+//                first three; WILLNEED, DONTNEED and PIN act on the blocks
+//                the range holds now (holes have nothing to cache), and
+//                NORMAL unpins them.  WILLNEED queues the fetches for the
+//                scheduler while its queue has room and fetches the rest
+//                now, a cache full at most (more would evict what it
+//                fetched); PIN fetches before it pins.
+//
+// Inputs       : fh - the file handle
+//                off - start of the range
+//                len - length of the range, 0 to the end of the file
+//                advice - the expected use (SG_ADVICE_*)
+// Outputs      : 0 if successful, -1 if failure; for WILLNEED the number of
+//                blocks of the range left out (past a cache full)
+
+int sgAdviseLocked(SgFHandle fh, uint64_t off, uint64_t len, SG_Advice advice) {
+    char block[SG_MAX_BLOCK_SIZE];
+    SG_Block_Entry * entry;
+    uint64_t idx, last, taken = 0;
+    int left = 0;
+
+    if (fh < 0 || fh >= nextFHandle) {
+        return -1;
+    } else if (SG_FILE(fh)->open == 0) {
+        return -1;
+    }
+    switch (advice) {
+    case SG_ADVICE_NORMAL:
+    case SG_ADVICE_SEQUENTIAL:
+    case SG_ADVICE_RANDOM:
+    case SG_ADVICE_NOREUSE:
+        SG_FILE(fh)->advice = advice;
+        if (advice != SG_ADVICE_NORMAL) {
+            return 0;
+        }
+        break;
+    case SG_ADVICE_WILLNEED:
+    case SG_ADVICE_DONTNEED:
+    case SG_ADVICE_PIN:
+        break;
+    default:
+        logMessage(LOG_ERROR_LEVEL, "sgadvise: unknown advice [%d]", advice);
+        return -1;
+    }
+
+    // the blocks of the range, up to the end of the file
+    last = SG_FILE(fh)->fSize / sgBlockSize;
+    if ((len > 0) && (off + len < SG_FILE(fh)->fSize)) {
+        last = (off + len + sgBlockSize - 1) / sgBlockSize;
+    }
+    for (idx = off / sgBlockSize; idx < last; idx++) {
+        entry = lookupBlockMap(&SG_FILE(fh)->blocks, idx);
+        if ((entry == NULL) || (entry->blockID == SG_HOLE_BLOCK)) {
+            continue;
+        }
+        if (advice == SG_ADVICE_NORMAL) {
+            pinSGDataBlock(entry->nodeID, entry->blockID, 0);
+        } else if (advice == SG_ADVICE_DONTNEED) {
+            dropSGDataBlock(entry->nodeID, entry->blockID);
+        } else {
+            // WILLNEED and PIN fetch the blocks not cached
+            if (peekSGDataBlock(entry->nodeID, entry->blockID) == NULL) {
+                if (advice == SG_ADVICE_WILLNEED) {
+                    if (taken == SG_MAX_CACHE_ELEMENTS) {
+                        left++;
+                        continue;
+                    }
+                    taken++;
+                    // queued while the scheduler has room, the overflow is fetched now
+                    if ((sgScheduler.used < SG_SCHED_QUEUE) &&
+                        (sgSchedule(SG_CLASS_PREFETCH, entry->nodeID, entry->blockID) == 0)) {
+                        continue;
+                    }
+                }
+                if (sgFetchBlock(entry->nodeID, entry->blockID, block)) {
+                    return -1;
+                }
+                putSGDataBlock(entry->nodeID, entry->blockID, block);
+            }
+            if ((advice == SG_ADVICE_PIN) && pinSGDataBlock(entry->nodeID, entry->blockID, 1)) {
+                logMessage(LOG_ERROR_LEVEL, "sgadvise: too many pinned blocks (%d)", getSGCachePinned());
+                return -1;
+            }
+        }
+    }
+    return left;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgShutdownLocked
+// Description  : Shut down the filesystem (driver lock held)
+//
+// Inputs       : none
+// Outputs      : 0 if successful test, -1 if failure
+
+int sgShutdownLocked(void) {
+    // Local variables
+    char initPacket[SG_BASE_PACKET_SIZE], recvPacket[SG_DATA_PACKET_SIZE];
+    size_t pktlen, rpktlen;
+    SG_Node_ID loc, rem;
+    SG_Block_ID blkid;
+    SG_SeqNum sloc, srem;
+    SG_System_OP op;
+    SG_Packet_Status status;
+    size_t used, wasted, lookups, hits, evictions;
+
+    // keep the metadata in a snapshot (the journal starts over, empty)
+    if (sgCheckpointPath && sgCheckpointLocked()) {
+        logMessage(LOG_ERROR_LEVEL, "sgShutdown: failed writing the metadata snapshot, the journal is kept");
+    }
+    stopSGJournal(&sgJournal);
+
+    // free the block maps of the files that have blocks
+    for (int fh = 0; fh < nextFHandle; fh++) {
+        if (SG_FILE(fh)->blocks.root) {
+            freeBlockMap(&SG_FILE(fh)->blocks);
+        }
+    }
+
+    // free file map, paths and node-sequence map (the metadata arena)
+    SG_LOG(LOG_INFO_LEVEL, "Closed Node-Sequence Map, deleting %d items out of %d items", next, length);
+    SG_LOG(LOG_INFO_LEVEL, "Closed File Map, deleting %d items, %lu bytes of metadata in %lu chunks", nextFHandle,
+           sgMetaArena.used, sgMetaArena.chunkCount);
+    if (sgFileMap.index != sgSnapshot.index) {
+        free(sgFileMap.index);
+    }
+    if (sgFileMap.restored) {
+        munmap(sgFileMap.restored, sgFileMap.restoredSize);
+    }
+    freeSGArena(&sgMetaArena);
+    memset(&sgFileMap, 0, sizeof(sgFileMap));
+    remNodes = NULL;
+    closeSGSnapshot(&sgSnapshot);
+
+    pktlen = SG_BASE_PACKET_SIZE;
+    // Setup the packet
+    if ((status = serialize_sg_packet(sgLocalNodeId,     // Local ID
+                                      SG_NODE_UNKNOWN,   // Remote ID
+                                      SG_BLOCK_UNKNOWN,  // Block ID
+                                      SG_STOP_ENDPOINT,  // Operation
+                                      sgLocalSeqno,      // Sender sequence number
+                                      SG_SEQNO_UNKNOWN,  // Receiver sequence number
+                                      NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed serialization of packet [%d].", status);
+        return( -1 );
+    }
+    sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
+    // Send the packet
+    rpktlen = SG_BASE_PACKET_SIZE;
+    if (sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen)) {
+        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed packet post");
+        return( -1 );
+    }
+    // Unpack the recieived data
+    if ((status = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgStopEndPoint: failed deserialization of packet [%d]", status);
+        return( -1 );
+    }
+    // close cache, the prefetches are judged first
+    getSGPrefetchStats(&used, &wasted);
+    getSGCacheStats(&lookups, &hits, &evictions);
+    closeSGCache();
+    SG_LOG(SGDriverLevel, "Wire traffic: %lu packets, %lu bytes sent, %lu bytes received.", sgPostCount, sgBytesSent, sgBytesRecv);
+    if (sgWriteCount) {
+        SG_LOG(SGDriverLevel, "Wire traffic: %lu writes, %lu bytes (%.1f bytes/write).", sgWriteCount, sgWriteBytes, (float) sgWriteBytes / sgWriteCount);
+    }
+    SG_LOG(SGDriverLevel, "Sparse files: %lu hole reads, %lu zero blocks kept as holes.", sgHoleReads, sgHoleWrites);
+    SG_LOG(SGDriverLevel, "Write elision: %lu writes left their block unchanged, no update sent.", sgElidedWrites);
+    SG_LOG(SGDriverLevel, "Clones: %lu blocks shared, %lu shared blocks copied on a write.", sgBlockRefs.used, sgCopiedBlocks);
+    SG_LOG(SGDriverLevel, "Local files: %lu bytes imported, %lu bytes exported.", sgImportBytes, sgExportBytes);
+    if (sgPrefetcher.table) {
+        SG_LOG(SGDriverLevel, "Prefetch: %lu issued, %lu used, %lu wasted (%.2f%% accuracy, %.2f%% coverage), threshold %d%%.",
+               sgPrefetchIssued, used, wasted, used + wasted ? (float) used * 100 / (used + wasted) : 0.0,
+               used + lookups - hits ? (float) used * 100 / (used + lookups - hits) : 0.0, sgPrefetcher.threshold);
+        resetSGPrefetcher(&sgPrefetcher);
+    }
+    sgSchedDropped += sgScheduler.used;
+    if (sgSchedQueued) {
+        SG_LOG(SGDriverLevel, "Scheduler: %lu background requests queued, %lu promoted by a demand read, %lu dropped.",
+               sgSchedQueued, sgSchedPromoted, sgSchedDropped);
+    }
+    SG_LOG(SGDriverLevel, "Posts by class: %lu read, %lu write, %lu prefetch, %lu flush.", sgClassPosts[SG_CLASS_READ],
+           sgClassPosts[SG_CLASS_WRITE], sgClassPosts[SG_CLASS_PREFETCH], sgClassPosts[SG_CLASS_FLUSH]);
+    initSGScheduler(&sgScheduler);
+
+    // reset the driver state, a later sgopen initializes the endpoint again
+    sgDriverInitialized = 0;
+    closeSGCodec(&sgCodec);
+    nextFHandle = 0;
+    next = 0;
+    sgPostCount = sgBytesSent = sgBytesRecv = 0;
+    sgWriteCount = sgWriteBytes = 0;
+    sgHoleReads = sgHoleWrites = 0;
+    sgElidedWrites = 0;
+    sgCopiedBlocks = 0;
+    sgImportBytes = sgExportBytes = 0;
+    sgPrefetchIssued = 0;
+    sgSchedQueued = sgSchedPromoted = sgSchedDropped = 0;
+    memset(sgClassPosts, 0, sizeof(sgClassPosts));
+    freeBlockRefs(&sgBlockRefs);
+
+    // Log, return successfully
+    SG_LOG(LOG_INFO_LEVEL, "Shut down Scatter/Gather driver.");
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgConfigureEndpoint
+// Description  : Configure the endpoint (before the first sgopen)
+//
+// Inputs       : config - the service and protocol extensions to use
+// Outputs      : 0 if successful, -1 if failure
+
+int sgConfigureEndpoint(SG_Endpoint_Config *config) {
+    if (sgDriverInitialized) {
+        logMessage(LOG_ERROR_LEVEL, "sgConfigureEndpoint: endpoint is already initialized.");
+        return -1;
+    }
+    sgConfig = *config;
+    if (sgConfig.service == NULL) {
+        sgConfig.service = sgServicePost;
+    }
+
+    // Return successfully
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgTraceStart
+// Description  : Record the file system calls (opens, reads, writes and
+//                closes) with their issue times, as a compiled workload that
+//                sg_sim can replay at the recorded rate
+//
+// Inputs       : path - the file to write the trace to
+// Outputs      : 0 if successful, -1 if failure
+
+int sgTraceStart(const char *path) {
+    int ret = -1;
+
+    sgLockDriver();
+    if (sgTracePath) {
+        logMessage(LOG_ERROR_LEVEL, "sgTraceStart: already tracing to [%s].", sgTracePath);
     } else {
-        indicator = 0;
-        *plen = SG_BASE_PACKET_SIZE;
+        initWlbinBuilder(&sgTrace, 1);
+        sgTracePath = strdup(path);
+        sgTraceBegin = sgTraceTime();
+        ret = 0;
     }
-    SG_Packet_Buffer buffer;
-    // pass value into packet buffer, and serialize buffer with data block (if any) into packet
-    construct_sg_packet_buffer(&buffer, magic_num, loc, rem, blk, op, sseq, rseq, indicator);
-    memcpy(packet, &buffer, sizeof(SG_Packet_Buffer));
-    if (indicator == 1) {
-        memcpy(packet + sizeof(SG_Packet_Buffer), data, SG_BLOCK_SIZE);
-        memcpy(packet + sizeof(SG_Packet_Buffer) + SG_BLOCK_SIZE, &magic_num, sizeof(SG_Magic));
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgTraceStop
+// Description  : Stop recording and write the trace (sgshutdown does this
+//                for a trace still running)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgTraceStop(void) {
+    int ret;
+
+    sgLockDriver();
+    ret = sgTraceStopLocked();
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgGetStats
+// Description  : Get the driver statistics since the endpoint was initialized
+//                (a consistent snapshot, taken under the driver lock)
+//
+// Inputs       : stats - place to put the statistics
+// Outputs      : 0 if successful, -1 if failure
+
+int sgGetStats(SG_Driver_Stats *stats) {
+    int i;
+
+    memset(stats, 0, sizeof(SG_Driver_Stats));
+    pthread_mutex_lock(&sgDriverLock);
+    if (!sgDriverInitialized) {
+        pthread_mutex_unlock(&sgDriverLock);
+        for (i = 0; i < SG_CALL_TYPES; i++) {
+            initSGHistogram(&stats->calls[i]);
+        }
+        for (i = 0; i < SG_MAXVAL_EXT_OP; i++) {
+            initSGHistogram(&stats->postLatency[i]);
+        }
+        return 0;
+    }
+    memcpy(stats->posts, sgPostOps, sizeof(sgPostOps));
+    stats->bytesSent = sgBytesSent;
+    stats->bytesRecv = sgBytesRecv;
+    getSGCacheStats(&stats->cacheLookups, &stats->cacheHits, &stats->cacheEvictions);
+    stats->cacheMisses = stats->cacheLookups - stats->cacheHits;
+    for (i = 0; i < nextFHandle; i++) {
+        stats->openFiles += SG_FILE(i)->open ? 1 : 0;
+    }
+    stats->holeReads = sgHoleReads;
+    stats->holeWrites = sgHoleWrites;
+    stats->elidedWrites = sgElidedWrites;
+    stats->sharedBlocks = sgBlockRefs.used;
+    stats->copiedBlocks = sgCopiedBlocks;
+    stats->importBytes = sgImportBytes;
+    stats->exportBytes = sgExportBytes;
+    stats->pinnedBlocks = getSGCachePinned();
+    stats->prefetchIssued = sgPrefetchIssued;
+    getSGPrefetchStats(&stats->prefetchUsed, &stats->prefetchWasted);
+    stats->prefetchThreshold = sgPrefetcher.table ? sgPrefetcher.threshold : 0;
+    memcpy(stats->classPosts, sgClassPosts, sizeof(sgClassPosts));
+    stats->schedQueued = sgSchedQueued;
+    stats->schedPromoted = sgSchedPromoted;
+    stats->schedDropped = sgSchedDropped;
+    stats->logDropped = sgLogDropped();
+    stats->restoreTime = sgRestoreTime;
+    memcpy(stats->calls, sgCallLatency, sizeof(sgCallLatency));
+    memcpy(stats->postLatency, sgPostLatency, sizeof(sgPostLatency));
+    pthread_mutex_unlock(&sgDriverLock);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFlightConfigure
+// Description  : Configure the flight recorder dumps (recording is always on)
+//
+// Inputs       : path - the file dumps are appended to
+//                threshold - a call slower than this (ns) triggers a dump, 0 never
+//                signo - a signal that requests a dump, 0 none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgFlightConfigure(const char *path, uint64_t threshold, int signo) {
+    struct sigaction act;
+    char *copy;
+
+    if ((copy = strdup(path)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgFlightConfigure: out of memory");
+        return -1;
+    }
+    pthread_mutex_lock(&sgDriverLock);
+    free(sgFlightPath);
+    sgFlightPath = copy;
+    sgFlightThreshold = threshold;
+    pthread_mutex_unlock(&sgDriverLock);
+    if (signo) {
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = sgFlightSignal;
+        sigemptyset(&act.sa_mask);
+        act.sa_flags = SA_RESTART;
+        if (sigaction(signo, &act, NULL)) {
+            logMessage(LOG_ERROR_LEVEL, "sgFlightConfigure: failed to install the handler of signal %d", signo);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFlightDump
+// Description  : Dump the flight recorder now
+//
+// Inputs       : path - the file to append to, NULL for the configured one
+// Outputs      : 0 if successful, -1 if failure
+
+int sgFlightDump(const char *path) {
+    int ret;
+
+    pthread_mutex_lock(&sgDriverLock);
+    ret = sgFlightDumpLocked(path, "on demand");
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgCheckpointConfigure
+// Description  : Keep the driver metadata (files, block maps and remote
+//                sequence numbers) on disk: a snapshot written at shutdown
+//                (or by sgCheckpoint) and a journal of the changes since,
+//                both restored when the endpoint is initialized
+//
+// Inputs       : path - the snapshot file (the journal is path.journal),
+//                       NULL to stop keeping the metadata
+// Outputs      : 0 if successful, -1 if failure
+
+int sgCheckpointConfigure(const char *path) {
+    char *copy = NULL, *journal = NULL;
+
+    if (sgDriverInitialized) {
+        logMessage(LOG_ERROR_LEVEL, "sgCheckpointConfigure: endpoint is already initialized.");
+        return -1;
+    }
+    if (path != NULL) {
+        copy = strdup(path);
+        journal = (char *) malloc(strlen(path) + sizeof(".journal"));
+        if ((copy == NULL) || (journal == NULL)) {
+            logMessage(LOG_ERROR_LEVEL, "sgCheckpointConfigure: out of memory");
+            free(copy);
+            free(journal);
+            return -1;
+        }
+        sprintf(journal, "%s.journal", path);
+    }
+    free(sgCheckpointPath);
+    free(sgJournalPath);
+    sgCheckpointPath = copy;
+    sgJournalPath = journal;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgPrefetchConfigure
+// Description  : Prefetch blocks: each read teaches which block of the file
+//                is read after which, and the block most often read next is
+//                fetched into the cache once it is threshold percent likely
+//                (more while the prefetches go unused)
+//
+// Inputs       : entries - blocks the successor table holds (rounded down to
+//                          a power of two), 0 to stop prefetching
+//                threshold - the confidence (percent) a prefetch needs
+// Outputs      : 0 if successful, -1 if failure
+
+int sgPrefetchConfigure(size_t entries, int threshold) {
+    int ret;
+
+    sgLockDriver();
+    ret = initSGPrefetcher(&sgPrefetcher, entries, threshold);
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgCheckpoint
+// Description  : Write the metadata snapshot now, emptying the journal
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgCheckpoint(void) {
+    int ret = -1;
+
+    sgLockDriver();
+    if (!sgDriverInitialized || (sgCheckpointPath == NULL)) {
+        logMessage(LOG_ERROR_LEVEL, "sgCheckpoint: no metadata checkpoint configured, or endpoint not initialized.");
     } else {
-        memcpy(packet + sizeof(SG_Packet_Buffer), &magic_num, sizeof(SG_Magic));
+        ret = sgCheckpointLocked();
     }
-    // print log message indicating a success processing
-    // logMessage( LOG_INFO_LEVEL, "sg_packet proccessing worked correctly (single packet)." );
-    
-    return status; 
+    pthread_mutex_unlock(&sgDriverLock);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : serialize_sg_packet
+// Description  : Serialize a ScatterGather packet (create packet)
+//
+// Inputs       : loc - the local node identifier
+//                rem - the remote node identifier
+//                blk - the block identifier
+//                op - the operation performed/to be performed on block
+//                sseq - the sender sequence number
+//                rseq - the receiver sequence number
+//                data - the data block (of size sgBlockSize) or NULL
+//                packet - the buffer to place the data
+//                plen - the packet length (int bytes)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status serialize_sg_packet(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, 
+        char *packet, size_t *plen) {
+    // no endpoint codec, a plain block of the driver's block size and the reference ops only
+    return serialize_sg_compressed_packet(NULL, loc, rem, blk, op, sseq, rseq, data, packet, plen);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -554,7 +1507,7 @@ SG_Packet_Status serialize_sg_packet(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID
 //                op - the operation performed/to be performed on block
 //                sseq - the sender sequence number
 //                rseq - the receiver sequence number
-//                data - the data block (of size SG_BLOCK_SIZE) or NULL
+//                data - the data block (of size sgBlockSize) or NULL
 //                packet - the buffer to place the data
 //                plen - the packet length (int bytes)
 // Outputs      : 0 if successfully created, -1 if failure
@@ -562,27 +1515,69 @@ SG_Packet_Status serialize_sg_packet(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID
 SG_Packet_Status deserialize_sg_packet( SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk, 
         SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, char *data, 
         char *packet, size_t plen ) {
+    // a compressed block needs the inflate stream of an endpoint, refused here (as are the extension ops)
+    return deserialize_sg_compressed_packet(NULL, loc, rem, blk, op, sseq, rseq, data, packet, plen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deserialize_sg_compressed_packet
+// Description  : De-serialize a ScatterGather packet, its data block
+//                compressed or not
+//
+// Inputs       : codec - the codec of the endpoint (NULL for a plain block of sgBlockSize)
+//                loc - the local node identifier
+//                rem - the remote node identifier
+//                blk - the block identifier
+//                op - the operation performed/to be performed on block
+//                sseq - the sender sequence number
+//                rseq - the receiver sequence number
+//                data - the data block (of the codec's block size) or NULL
+//                packet - the buffer to place the data
+//                plen - the packet length (int bytes)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status deserialize_sg_compressed_packet( SG_Codec *codec, SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk, 
+        SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, char *data, 
+        char *packet, size_t plen ) {
+    SG_SPAN("deserialize");
     // define local variables
     SG_Packet_Buffer buffer;
     SG_Packet_Status status;
-    SGDataBlock block;
+    size_t bsz = (codec) ? codec->blockSize : sgBlockSize;
     // copy packet information to packet buffer (except *data and the last magic number)
     if (packet) {
         memcpy(&buffer, packet, sizeof(SG_Packet_Buffer));
-        // check data validity in packet and check if input variable pointer is Null
-        status = check_deserialize_sg_Data(buffer, loc, rem, blk, op, sseq, rseq);
+        // check data validity in packet (the extension ops only with an endpoint codec)
+        status = check_deserialize_sg_Data(buffer, loc, rem, blk, op, sseq, rseq, SG_CODEC_MAXVAL_OP(codec));
     } else {
         status = SG_PACKT_PDATA_BAD;
     }
     if (status == SG_PACKT_OK) {
         SG_Magic magic;
+        uint16_t clen;
         // checking plen, data block, and the last magic value (the last part of validity checking)
-        if (buffer.indicator == 1) {
-            memcpy(block, packet + sizeof(buffer), SG_BLOCK_SIZE);
-            if (plen != SG_DATA_PACKET_SIZE) {
+        if (buffer.indicator == (SG_DATA_BLOCK | SG_DATA_COMPRESSED)) {
+            // the compressed length is only there if the packet is long enough to hold it
+            clen = 0;
+            if (plen >= SG_COMPRESSED_PACKET_SIZE(0)) {
+                memcpy(&clen, packet + sizeof(buffer), sizeof(uint16_t));
+            }
+            if (plen < SG_COMPRESSED_PACKET_SIZE(0) || plen != SG_COMPRESSED_PACKET_SIZE(clen)) {
+                status = SG_PACKT_BLKLN_BAD;
+            } else if (codec == NULL || data == NULL || decompress_sg_block(codec, packet + sizeof(buffer) + sizeof(uint16_t), clen, data)) {
+                status = SG_PACKT_BLKDT_BAD;
+            } else {
+                memcpy(&magic, packet + sizeof(buffer) + sizeof(uint16_t) + clen, sizeof(SG_Magic));
+                if (magic != SG_MAGIC_VALUE) {
+                    status = SG_PACKT_PDATA_BAD;
+                }
+            }
+        } else if (buffer.indicator == 1) {
+            if (plen != SG_BLOCK_PACKET_SIZE(bsz)) {
                 status = SG_PACKT_BLKLN_BAD;
             } else if (data) {
-                memcpy(&magic, packet + sizeof(buffer) + SG_BLOCK_SIZE, sizeof(SG_Magic));
+                memcpy(&magic, packet + sizeof(buffer) + bsz, sizeof(SG_Magic));
                 if (magic != SG_MAGIC_VALUE) {
                     status = SG_PACKT_PDATA_BAD;
                 }
@@ -610,8 +1605,9 @@ SG_Packet_Status deserialize_sg_packet( SG_Node_ID *loc, SG_Node_ID *rem, SG_Blo
     memcpy(op, &(buffer.operation), sizeof(SG_System_OP));
     memcpy(sseq, &(buffer.sendSeqNo), sizeof(SG_SeqNum));
     memcpy(rseq, &(buffer.recvSeqNo), sizeof(SG_SeqNum));
-    if (buffer.indicator == 1) {
-        memcpy(data, block, SG_BLOCK_SIZE);  
+    // (compressed blocks were inflated into data while checking the packet)
+    if (buffer.indicator == SG_DATA_BLOCK) {
+        sgCopyBlock(data, packet + sizeof(buffer), bsz);
     }
   
     return status;
@@ -619,8 +1615,202 @@ SG_Packet_Status deserialize_sg_packet( SG_Node_ID *loc, SG_Node_ID *rem, SG_Blo
            
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : check_serialize_sg_Data
-// Description  : check if input data from serialized function is valid
+// Function     : serialize_sg_compressed_packet
+// Description  : Serialize a ScatterGather packet of an endpoint, compressing
+//                the data block if the endpoint agreed to it and it shrinks
+//
+// Inputs       : codec - the codec of the endpoint (NULL for a plain block of sgBlockSize)
+//                loc - the local node identifier
+//                rem - the remote node identifier
+//                blk - the block identifier
+//                op - the operation performed/to be performed on block
+//                sseq - the sender sequence number
+//                rseq - the receiver sequence number
+//                data - the data block (of the codec's block size) or NULL
+//                packet - the buffer to place the data
+//                plen - the packet length (int bytes)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status serialize_sg_compressed_packet(SG_Codec *codec, SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, 
+        char *packet, size_t *plen) {
+    SG_SPAN("serialize");
+    // define local variable
+    SG_Magic magic_num = SG_MAGIC_VALUE;
+    SG_Packet_Status status;
+    SG_Packet_Buffer buffer;
+    SG_DataIndicator indicator;
+    size_t bsz = (codec) ? codec->blockSize : sgBlockSize;
+    uint16_t clen = 0;
+    // initial data validity checking and error returning
+    if (packet) {
+        status = check_serialize_sg_Data(loc, rem, blk, op, sseq, rseq, SG_CODEC_MAXVAL_OP(codec));
+    } else {
+        status = SG_PACKT_PDATA_BAD;
+    }
+    if (status != SG_PACKT_OK) {
+        print_sg_packet_log_message(SG_SERIALIZE, status);
+        return status;
+    }
+    // compress straight into the packet, send the plain block if it does not shrink
+    if (data && codec && codec->compress) {
+        clen = compress_sg_block(codec, data, packet + sizeof(SG_Packet_Buffer) + sizeof(uint16_t), 
+                                 bsz - sizeof(uint16_t) - 1);
+    }
+    if (clen) {
+        indicator = SG_DATA_BLOCK | SG_DATA_COMPRESSED;
+        *plen = SG_COMPRESSED_PACKET_SIZE(clen);
+    } else if (data) {
+        indicator = SG_DATA_BLOCK;
+        *plen = SG_BLOCK_PACKET_SIZE(bsz);
+    } else {
+        indicator = SG_DATA_NONE;
+        *plen = SG_BASE_PACKET_SIZE;
+    }
+    // pass value into packet buffer, and serialize buffer with data block (if any) into packet
+    construct_sg_packet_buffer(&buffer, magic_num, loc, rem, blk, op, sseq, rseq, indicator);
+    memcpy(packet, &buffer, sizeof(SG_Packet_Buffer));
+    if (indicator == (SG_DATA_BLOCK | SG_DATA_COMPRESSED)) {
+        memcpy(packet + sizeof(SG_Packet_Buffer), &clen, sizeof(uint16_t));
+        memcpy(packet + sizeof(SG_Packet_Buffer) + sizeof(uint16_t) + clen, &magic_num, sizeof(SG_Magic));
+    } else if (indicator == SG_DATA_BLOCK) {
+        sgCopyBlock(packet + sizeof(SG_Packet_Buffer), data, bsz);
+        memcpy(packet + sizeof(SG_Packet_Buffer) + bsz, &magic_num, sizeof(SG_Magic));
+    } else {
+        memcpy(packet + sizeof(SG_Packet_Buffer), &magic_num, sizeof(SG_Magic));
+    }
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : serialize_sg_range_packet
+// Description  : Serialize a ScatterGather packet carrying a byte range of a block
+//
+// Inputs       : loc - the local node identifier
+//                rem - the remote node identifier
+//                blk - the block identifier
+//                op - the operation performed/to be performed on block
+//                sseq - the sender sequence number
+//                rseq - the receiver sequence number
+//                off - the offset of the range within the block
+//                len - the length of the range (in bytes)
+//                data - the bytes of the range
+//                packet - the buffer to place the data
+//                plen - the packet length (int bytes)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status serialize_sg_range_packet(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, uint16_t off, uint16_t len, char *data, 
+        char *packet, size_t *plen) {
+    SG_SPAN("serialize");
+    // define local variable
+    SG_Magic magic_num = SG_MAGIC_VALUE;
+    SG_Packet_Status status;
+    SG_Packet_Buffer buffer;
+    // initial data validity checking and error returning
+    if (packet == NULL) {
+        status = SG_PACKT_PDATA_BAD;
+    } else if (data == NULL) {
+        status = SG_PACKT_BLKDT_BAD;
+    } else if (len == 0 || off + len > sgBlockSize) {
+        status = SG_PACKT_BLKLN_BAD;
+    } else {
+        status = check_serialize_sg_Data(loc, rem, blk, op, sseq, rseq, SG_MAXVAL_EXT_OP);
+    }
+    if (status != SG_PACKT_OK) {
+        print_sg_packet_log_message(SG_SERIALIZE, status);
+        return status;
+    }
+    // serialize buffer, range offset/length, range bytes and trailing magic into packet
+    construct_sg_packet_buffer(&buffer, magic_num, loc, rem, blk, op, sseq, rseq, SG_DATA_RANGE);
+    memcpy(packet, &buffer, sizeof(SG_Packet_Buffer));
+    memcpy(packet + sizeof(SG_Packet_Buffer), &off, sizeof(uint16_t));
+    memcpy(packet + sizeof(SG_Packet_Buffer) + sizeof(uint16_t), &len, sizeof(uint16_t));
+    memcpy(packet + sizeof(SG_Packet_Buffer) + sizeof(uint16_t) * 2, data, len);
+    memcpy(packet + sizeof(SG_Packet_Buffer) + sizeof(uint16_t) * 2 + len, &magic_num, sizeof(SG_Magic));
+    *plen = SG_RANGE_PACKET_SIZE(len);
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deserialize_sg_range_packet
+// Description  : De-serialize a ScatterGather packet carrying a byte range of a block
+//
+// Inputs       : codec - the codec of the endpoint (NULL for blocks of sgBlockSize)
+//                loc - the local node identifier
+//                rem - the remote node identifier
+//                blk - the block identifier
+//                op - the operation performed/to be performed on block
+//                sseq - the sender sequence number
+//                rseq - the receiver sequence number
+//                off - the offset of the range within the block
+//                len - the length of the range (in bytes)
+//                data - the place to put the range bytes (at least len bytes)
+//                packet - the buffer to place the data
+//                plen - the packet length (int bytes)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status deserialize_sg_range_packet(SG_Codec *codec, SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk, 
+        SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, uint16_t *off, uint16_t *len, char *data, 
+        char *packet, size_t plen) {
+    SG_SPAN("deserialize");
+    // define local variables
+    SG_Packet_Buffer buffer;
+    SG_Packet_Status status;
+    SG_Magic magic;
+    uint16_t roff = 0, rlen = 0;
+    size_t bsz = (codec) ? codec->blockSize : sgBlockSize;
+    // copy packet header and check it
+    if (packet == NULL || plen < SG_RANGE_PACKET_SIZE(0)) {
+        status = SG_PACKT_PDATA_BAD;
+    } else {
+        memcpy(&buffer, packet, sizeof(SG_Packet_Buffer));
+        status = check_deserialize_sg_Data(buffer, loc, rem, blk, op, sseq, rseq, SG_MAXVAL_EXT_OP);
+    }
+    // checking range, data pointer and the last magic value
+    if (status == SG_PACKT_OK) {
+        memcpy(&roff, packet + sizeof(buffer), sizeof(uint16_t));
+        memcpy(&rlen, packet + sizeof(buffer) + sizeof(uint16_t), sizeof(uint16_t));
+        if (buffer.indicator != SG_DATA_RANGE) {
+            status = SG_PACKT_PDATA_BAD;
+        } else if (rlen == 0 || roff + rlen > bsz || plen != SG_RANGE_PACKET_SIZE(rlen)) {
+            status = SG_PACKT_BLKLN_BAD;
+        } else if (data == NULL) {
+            status = SG_PACKT_BLKDT_BAD;
+        } else {
+            memcpy(&magic, packet + sizeof(buffer) + sizeof(uint16_t) * 2 + rlen, sizeof(SG_Magic));
+            if (magic != SG_MAGIC_VALUE) {
+                status = SG_PACKT_PDATA_BAD;
+            }
+        }
+    }
+    // reporting error message if status indicates bad data
+    if (status != SG_PACKT_OK) {
+        print_sg_packet_log_message(SG_DESERIALIZE, status);
+        return status;
+    }
+    // deserialize packet into input pointers
+    *loc = buffer.sendNodeId;
+    *rem = buffer.recvNodeId;
+    *blk = buffer.blockID;
+    *op = buffer.operation;
+    *sseq = buffer.sendSeqNo;
+    *rseq = buffer.recvSeqNo;
+    *off = roff;
+    *len = rlen;
+    memcpy(data, packet + sizeof(buffer) + sizeof(uint16_t) * 2, rlen);
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : check_serialize_sg_Data
+// Description  : check if input data from serialized function is valid
 //
 // Inputs       : loc - the local node identifier
 //                rem - the remote node identifier
@@ -628,10 +1818,11 @@ SG_Packet_Status deserialize_sg_packet( SG_Node_ID *loc, SG_Node_ID *rem, SG_Blo
 //                op - the operation performed/to be performed on block
 //                sseq - the sender sequence number
 //                rseq - the receiver sequence number
+//                maxop - one past the highest operation accepted
 // Outputs      : status - packet status that identify bad data or OK
 
 SG_Packet_Status check_serialize_sg_Data(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
-        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq) {
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, SG_System_OP maxop) {
     SG_Packet_Status status;
     // identify, if any, incorrectly formulated input data, and set corresponding status 
     if (loc <= 0) {
@@ -640,7 +1831,7 @@ SG_Packet_Status check_serialize_sg_Data(SG_Node_ID loc, SG_Node_ID rem, SG_Bloc
         status = SG_PACKT_REMID_BAD;
     } else if (blk <= 0) {
         status = SG_PACKT_BLKID_BAD;
-    } else if (op >= SG_MAXVAL_OP || op < SG_INIT_ENDPOINT) {
+    } else if (op >= maxop || op < SG_INIT_ENDPOINT) {
         status = SG_PACKT_OPERN_BAD;
     } else if (sseq <= 0) {
         status = SG_PACKT_SNDSQ_BAD;
@@ -665,17 +1856,18 @@ SG_Packet_Status check_serialize_sg_Data(SG_Node_ID loc, SG_Node_ID rem, SG_Bloc
 //                op - the operation performed/to be performed on block
 //                sseq - the sender sequence number
 //                rseq - the receiver sequence number
+//                maxop - one past the highest operation accepted
 // Outputs      : status - packet status that identify bad data or OK
 
 SG_Packet_Status check_deserialize_sg_Data(SG_Packet_Buffer buffer, SG_Node_ID *loc, SG_Node_ID *rem, 
-        SG_Block_ID *blk, SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq) {
+        SG_Block_ID *blk, SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, SG_System_OP maxop) {
     SG_Packet_Status status;
     // check packet data and if input parameters is Null
     if (buffer.magic != SG_MAGIC_VALUE) {
         status = SG_PACKT_PDATA_BAD;
     } else {
         status = check_serialize_sg_Data(buffer.sendNodeId, buffer.recvNodeId, buffer.blockID, 
-        buffer.operation, buffer.sendSeqNo, buffer.recvSeqNo);
+        buffer.operation, buffer.sendSeqNo, buffer.recvSeqNo, maxop);
     }
     // if ((status = check_input_sg_Data(loc, rem, blk, op, sseq, rseq)) == SG_PACKT_OK) 
     return status;
@@ -768,6 +1960,92 @@ int print_sg_packet_log_message(SG_Process process, SG_Packet_Status status) {
     return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_sg_block
+// Description  : Compress a data block (raw deflate), giving up once the output
+//                would not fit
+//
+// Inputs       : codec - the codec of the endpoint
+//                block - the data block (of the codec's block size)
+//                out - the buffer to place the compressed bytes
+//                max - the most compressed bytes worth sending
+// Outputs      : the compressed length, 0 if the block does not shrink to max
+
+size_t compress_sg_block(SG_Codec *codec, char *block, char *out, size_t max) {
+    SG_SPAN("compress");
+    // keep the endpoint's deflate stream around, (re)initializing it costs more than a block
+    if (!codec->deflating) {
+        memset(&codec->deflater, 0, sizeof(z_stream));
+        if (deflateInit2(&codec->deflater, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return 0;
+        }
+        codec->deflating = 1;
+    } else {
+        deflateReset(&codec->deflater);
+    }
+    codec->deflater.next_in = (Bytef *) block;
+    codec->deflater.avail_in = codec->blockSize;
+    codec->deflater.next_out = (Bytef *) out;
+    codec->deflater.avail_out = max;
+    if (deflate(&codec->deflater, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+    return max - codec->deflater.avail_out;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : decompress_sg_block
+// Description  : Decompress a data block compressed with compress_sg_block
+//
+// Inputs       : codec - the codec of the endpoint
+//                in - the compressed bytes
+//                clen - the number of compressed bytes
+//                block - the place to put the data block (of the codec's block size)
+// Outputs      : 0 if successful, -1 if the data is not a valid block
+
+int decompress_sg_block(SG_Codec *codec, char *in, size_t clen, char *block) {
+    SG_SPAN("decompress");
+    if (!codec->inflating) {
+        memset(&codec->inflater, 0, sizeof(z_stream));
+        if (inflateInit2(&codec->inflater, -MAX_WBITS) != Z_OK) {
+            return -1;
+        }
+        codec->inflating = 1;
+    } else {
+        inflateReset(&codec->inflater);
+    }
+    codec->inflater.next_in = (Bytef *) in;
+    codec->inflater.avail_in = clen;
+    codec->inflater.next_out = (Bytef *) block;
+    codec->inflater.avail_out = codec->blockSize;
+    if (inflate(&codec->inflater, Z_FINISH) != Z_STREAM_END || codec->inflater.avail_out != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : closeSGCodec
+// Description  : Release the compression streams of an endpoint, they are set
+//                up again when next used
+//
+// Inputs       : codec - the codec of the endpoint
+// Outputs      : none
+
+void closeSGCodec(SG_Codec *codec) {
+    if (codec->deflating) {
+        deflateEnd(&codec->deflater);
+        codec->deflating = 0;
+    }
+    if (codec->inflating) {
+        inflateEnd(&codec->inflater);
+        codec->inflating = 0;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : find
@@ -778,8 +2056,8 @@ int print_sg_packet_log_message(SG_Process process, SG_Packet_Status status) {
 
 SG_SeqNum find(SG_Node_ID remNodeID) {
     for (int i = 0; i < next; i++) {
-        if (remNodeIDs[i] == remNodeID) {
-            return remSeqNums[i];
+        if (remNodes[i].nodeID == remNodeID) {
+            return remNodes[i].seqNum;
         }
     }
     return 0;
@@ -789,22 +2067,29 @@ SG_SeqNum find(SG_Node_ID remNodeID) {
 //
 // Function     : put
 // Description  : The function used to insert a new remote node together with its remote sequence number. 
-//                Re-allocate node-sequence map if needed.
+//                Move the node-sequence map to a table twice the size if full
+//                (the old table stays in the metadata arena until shutdown).
 //
 // Inputs       : remNodeID - remote node ID
 //                remSeqNum - remote sequence number
-// Outputs      : return 0 always
+// Outputs      : return 0 if successful, -1 if failure
 
 int put(SG_Node_ID remNodeID, SG_SeqNum remSeqNum) {
-    remNodeIDs[next] = remNodeID;
-    remSeqNums[next] = remSeqNum;
-    next++;
+    SG_Node_Entry * table;
+
     if (next >= length) {
+        if ((table = (SG_Node_Entry *) allocSGArena(&sgMetaArena, length * 2 * sizeof(SG_Node_Entry))) == NULL) {
+            return -1;
+        }
+        memcpy(table, remNodes, length * sizeof(SG_Node_Entry));
+        remNodes = table;
         length = length * 2;
-        remNodeIDs = (SG_Node_ID *) realloc(remNodeIDs, length * sizeof(SG_Node_ID));
-        remSeqNums = (SG_SeqNum *) realloc(remSeqNums, length * sizeof(SG_SeqNum));
+        SG_LOG(LOG_INFO_LEVEL, "resize node-sequence map: %d to %d", length / 2, length);
     }
-    logMessage(LOG_INFO_LEVEL, "resize node-sequence map: %d to %d", length / 2, length);
+    remNodes[next].nodeID = remNodeID;
+    remNodes[next].seqNum = remSeqNum;
+    remNodes[next].dirty = 1;
+    next++;
 
     return 0;
 }
@@ -820,8 +2105,9 @@ int put(SG_Node_ID remNodeID, SG_SeqNum remSeqNum) {
 
 int update(SG_Node_ID remNodeID, SG_SeqNum remSeqNum) {
     for (int i = 0; i < next; i++) {
-        if (remNodeIDs[i] == remNodeID) {
-            remSeqNums[i] = remSeqNum;
+        if (remNodes[i].nodeID == remNodeID) {
+            remNodes[i].seqNum = remSeqNum;
+            remNodes[i].dirty = 1;
             break;
         }
     }
@@ -830,28 +2116,258 @@ int update(SG_Node_ID remNodeID, SG_SeqNum remSeqNum) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : mallocBlockPerFile
-// Description  : The function used to dynamically allocate blocks per file. 
+// Function     : extendFile
+// Description  : The function used to grow a file to a number of blocks, the 
+//                new blocks are holes (absent from the block map until 
+//                written), so growing costs nothing.
 //
 // Inputs       : fh - file handle
+//                blocks - the new number of blocks in the file
 // Outputs      : return 0 always
 
-int mallocBlockPerFile(SgFHandle fh) {
-    if (sgFileMap.files[fh]->numBlocks == 0) {
-        sgFileMap.files[fh]->blockID = (SG_Block_ID *) malloc(sizeof(SG_Block_ID));
-        sgFileMap.files[fh]->remNodeID = (SG_Node_ID *) malloc(sizeof(SG_Node_ID));
-        sgFileMap.files[fh]->numBlocks = 1;
-        logMessage(LOG_INFO_LEVEL, "resize number of blocks per file on file handle %d: %d to %d", fh, 0, 1);
-    } else {
-        sgFileMap.files[fh]->numBlocks *= 2;
-        sgFileMap.files[fh]->blockID = (SG_Block_ID *) realloc(sgFileMap.files[fh]->blockID, sgFileMap.files[fh]->numBlocks * sizeof(SG_Block_ID));
-        sgFileMap.files[fh]->remNodeID = (SG_Node_ID *) realloc(sgFileMap.files[fh]->remNodeID, sgFileMap.files[fh]->numBlocks * sizeof(SG_Node_ID));
-        logMessage(LOG_INFO_LEVEL, "resize number of blocks per file on file handle %d: %d to %d", fh, sgFileMap.files[fh]->numBlocks / 2, sgFileMap.files[fh]->numBlocks);
+int extendFile(SgFHandle fh, uint64_t blocks) {
+    if (blocks * sgBlockSize > SG_FILE(fh)->fSize) {
+        SG_FILE(fh)->fSize = blocks * sgBlockSize;
+        if (sgJournal.fd != -1) {
+            SG_Journal_Size record = { fh, 0, SG_FILE(fh)->fSize };
+            appendSGJournal(&sgJournal, SG_JOURNAL_SIZE, &record, sizeof(record), NULL, 0);
+        }
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : truncateFile
+// Description  : The function used to empty a file: its block map entries
+//                are dropped (each shared block counting one holder fewer,
+//                the remote blocks left to the service as at shutdown) and
+//                its size goes back to 0.
+//
+// Inputs       : fh - file handle (loaded)
+// Outputs      : return 0 if successful, -1 if failure
+
+int truncateFile(SgFHandle fh) {
+    SG_Block_Entry *entry;
+    uint64_t i;
+
+    for (i = 0; i < SG_FILE(fh)->fSize / sgBlockSize; i++) {
+        entry = lookupBlockMap(&SG_FILE(fh)->blocks, i);
+        if ((entry != NULL) && (entry->blockID != SG_HOLE_BLOCK) &&
+                dropBlockRef(&sgBlockRefs, entry->nodeID, entry->blockID)) {
+            return -1;
+        }
+    }
+    freeBlockMap(&SG_FILE(fh)->blocks);
+    SG_FILE(fh)->fSize = 0;
+    if (sgJournal.fd != -1) {
+        SG_Journal_Size record = { fh, 0, 0 };
+        appendSGJournal(&sgJournal, SG_JOURNAL_SIZE, &record, sizeof(record), NULL, 0);
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findFileSlot
+// Description  : The function used to find the slot of a path in the path
+//                index (FNV-1a hash, linear probing).  The chunks of an index
+//                still in the snapshot are checked as the probes reach them.
+//
+// Inputs       : path - the path/filename of the file
+// Outputs      : the slot holding the file of the path, or the free slot it
+//                would go in, SIZE_MAX if the index is damaged
+
+size_t findFileSlot(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *c;
+    size_t slot, mask = sgFileMap.indexSize - 1;
+
+    for (c = (const unsigned char *) path; *c; c++) {
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+    }
+    for (slot = hash & mask; ; slot = (slot + 1) & mask) {
+        if ((sgFileMap.index == sgSnapshot.index) && checkSGSnapshotIndex(&sgSnapshot, slot)) {
+            return SIZE_MAX;
+        }
+        if ((sgFileMap.index[slot] == -1) || (strcmp(filePath(sgFileMap.index[slot]), path) == 0)) {
+            return slot;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addFile
+// Description  : The function used to create a new (empty) file, in the next
+//                slab entry, with its path interned and indexed.  The path
+//                index doubles when half full, the slab directory doubles in
+//                the metadata arena when full.
+//
+// Inputs       : path - the path/filename of the file
+// Outputs      : the file handle if successful, -1 if failure
+
+SgFHandle addFile(const char *path) {
+    SgFHandle fHandle = nextFHandle, *index, *old;
+    SG_File ** slabs;
+    size_t i, oldSize, slot;
+
+    // room for the file in the slabs
+    if ((fHandle >> SG_FILE_SLAB_BITS) >= sgFileMap.slabCount) {
+        if ((slabs = (SG_File **) allocSGArena(&sgMetaArena, sgFileMap.slabCount * 2 * sizeof(SG_File *))) == NULL) {
+            return -1;
+        }
+        memcpy(slabs, sgFileMap.slabs, sgFileMap.slabCount * sizeof(SG_File *));
+        sgFileMap.slabs = slabs;
+        sgFileMap.slabCount *= 2;
+    }
+    if ((fHandle & (SG_FILE_SLAB - 1)) == 0) {
+        if ((sgFileMap.slabs[fHandle >> SG_FILE_SLAB_BITS] =
+                (SG_File *) allocSGArena(&sgMetaArena, SG_FILE_SLAB * sizeof(SG_File))) == NULL) {
+            return -1;
+        }
+    }
+
+    // room in the path index, rehash the paths into one twice the size
+    if ((size_t) (fHandle + 1) * 2 > sgFileMap.indexSize) {
+        if ((index = (SgFHandle *) malloc(sgFileMap.indexSize * 2 * sizeof(SgFHandle))) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "sgopen: out of memory for the path index");
+            return -1;
+        }
+        memset(index, 0xff, sgFileMap.indexSize * 2 * sizeof(SgFHandle));
+        old = sgFileMap.index;
+        oldSize = sgFileMap.indexSize;
+        sgFileMap.index = index;
+        sgFileMap.indexSize *= 2;
+        for (i = 0; i < oldSize; i++) {
+            if ((old == sgSnapshot.index) && checkSGSnapshotIndex(&sgSnapshot, i)) {
+                return -1;
+            }
+            if (old[i] != -1) {
+                sgFileMap.index[findFileSlot(filePath(old[i]))] = old[i];
+            }
+        }
+        if (old != sgSnapshot.index) {
+            free(old);
+        }
+        SG_LOG(LOG_INFO_LEVEL, "resize path index: %lu to %lu", oldSize, sgFileMap.indexSize);
+    }
+
+    // create the file, its entry in the slab is zeroed (the arena is)
+    if ((SG_FILE(fHandle)->path = internSGArena(&sgMetaArena, path)) == NULL) {
+        return -1;
+    }
+    initBlockMap(&SG_FILE(fHandle)->blocks);
+    if ((slot = findFileSlot(path)) == SIZE_MAX) {
+        return -1;
+    }
+    sgFileMap.index[slot] = fHandle;
+    nextFHandle++;
+    if (sgJournal.fd != -1) {
+        SG_Journal_File record = { fHandle, strlen(path) };
+        appendSGJournal(&sgJournal, SG_JOURNAL_FILE, &record, sizeof(record), path, record.pathLength);
+    }
+    return fHandle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cloneFile
+// Description  : The function used to give a new file the blocks of another,
+//                entry by entry (holes stay holes), each block counting one
+//                more holder.  No block is sent or fetched.
+//
+// Inputs       : src - file handle of the file cloned (loaded)
+//                fh - file handle of the new file
+// Outputs      : return 0 if successful, -1 if failure
+
+int cloneFile(SgFHandle src, SgFHandle fh) {
+    SG_Block_Entry *from, *to;
+    uint64_t i;
+
+    for (i = 0; i < SG_FILE(src)->fSize / sgBlockSize; i++) {
+        from = lookupBlockMap(&SG_FILE(src)->blocks, i);
+        if ((from == NULL) || (from->blockID == SG_HOLE_BLOCK)) {
+            continue;
+        }
+        if (((to = insertBlockMap(&SG_FILE(fh)->blocks, i)) == NULL) ||
+                addBlockRef(&sgBlockRefs, from->nodeID, from->blockID)) {
+            logMessage(LOG_ERROR_LEVEL, "sgclone: failed to grow the block map");
+            return -1;
+        }
+        *to = *from;
     }
+    SG_FILE(fh)->fSize = SG_FILE(src)->fSize;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : loadFile
+// Description  : The function used to load a file of the snapshot the first
+//                time it is opened: its record is checked, its path used in
+//                place and its blocks put in the block map.  Files created
+//                since, or loaded already, are left alone.
+//
+// Inputs       : fh - file handle
+// Outputs      : return 0 if successful, -1 if failure
+
+int loadFile(SgFHandle fh) {
+    SG_Snapshot_File * record;
+    SG_Block_Entry * entry;
+    uint64_t i;
 
+    if (SG_FILE(fh)->path != NULL) {
+        return 0;
+    }
+    if (checkSGSnapshotFile(&sgSnapshot, fh)) {
+        return -1;
+    }
+    record = &sgSnapshot.files[fh];
+    initBlockMap(&SG_FILE(fh)->blocks);
+    for (i = 0; i < record->fSize / sgBlockSize; i++) {
+        if (sgSnapshot.blocks[record->blocks + i].blockID == SG_HOLE_BLOCK) {
+            continue;
+        }
+        if ((entry = insertBlockMap(&SG_FILE(fh)->blocks, i)) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "sgopen: failed to grow the block map");
+            return -1;
+        }
+        entry->nodeID = sgSnapshot.blocks[record->blocks + i].nodeID;
+        entry->blockID = sgSnapshot.blocks[record->blocks + i].blockID;
+    }
+    SG_FILE(fh)->fSize = record->fSize;
+    SG_FILE(fh)->path = sgSnapshot.paths + record->path;
     return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : filePath
+// Description  : The function used to get the path of a file, from the
+//                snapshot if it is not loaded (not checked yet, so a damaged
+//                path matches nothing)
+//
+// Inputs       : fh - file handle
+// Outputs      : the path
+
+const char * filePath(SgFHandle fh) {
+    SG_Snapshot_File * record;
+
+    if (SG_FILE(fh)->path != NULL) {
+        return SG_FILE(fh)->path;
+    }
+    record = &sgSnapshot.files[fh];
+    if ((record->path >= sgSnapshot.header->pathBytes) ||
+            (record->pathLength >= sgSnapshot.header->pathBytes - record->path) ||
+            (sgSnapshot.paths[record->path + record->pathLength] != '\0')) {
+        return "";
+    }
+    return sgSnapshot.paths + record->path;
+}
+
 
 //
 // Driver support functions
@@ -867,7 +2383,9 @@ int mallocBlockPerFile(SgFHandle fh) {
 int sgInitEndpoint( void ) {
 
     // Local variables
-    char initPacket[SG_BASE_PACKET_SIZE], recvPacket[SG_BASE_PACKET_SIZE];
+    char initPacket[SG_DATA_PACKET_SIZE], recvPacket[SG_DATA_PACKET_SIZE];
+    SGDataBlock capBlock;
+    SG_Endpoint_Caps caps;
     size_t pktlen, rpktlen;
     SG_Node_ID loc, rem;
     SG_Block_ID blkid;
@@ -876,11 +2394,19 @@ int sgInitEndpoint( void ) {
     SG_Packet_Status ret;
 
     // Local and do some initial setup
-    logMessage( LOG_INFO_LEVEL, "Initializing local endpoint ..." );
+    SG_LOG( LOG_INFO_LEVEL, "Initializing local endpoint ..." );
+    sgResetStats();
     sgLocalSeqno = SG_INITIAL_SEQNO;
+    sgBlockSize = SG_BLOCK_SIZE;
+    sgCodec.blockSize = SG_BLOCK_SIZE;
+    sgCodec.compress = 0;
 
-    // initialize cache
-    initSGCache(SG_MAX_CACHE_ELEMENTS);
+    // Request protocol extensions (if any) in the data block
+    memset(capBlock, 0, SG_BLOCK_SIZE);
+    caps.magic = SG_MAGIC_VALUE;
+    caps.features = sgConfig.features;
+    caps.blockSize = (sgConfig.features & SG_FEATURE_BLOCK_SIZE) ? sgConfig.blockSize : SG_BLOCK_SIZE;
+    memcpy(capBlock, &caps, sizeof(SG_Endpoint_Caps));
 
     // Setup the packet
     pktlen = SG_BASE_PACKET_SIZE;
@@ -890,20 +2416,21 @@ int sgInitEndpoint( void ) {
                                     SG_INIT_ENDPOINT,  // Operation
                                     sgLocalSeqno,      // Sender sequence number
                                     SG_SEQNO_UNKNOWN,  // Receiver sequence number
-                                    NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
+                                    (sgConfig.features) ? capBlock : NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
         logMessage( LOG_ERROR_LEVEL, "sgInitEndpoint: failed serialization of packet [%d].", ret );
         return( -1 );
     }
-    sgLocalSeqno++;
+    sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
     // Send the packet
-    rpktlen = SG_BASE_PACKET_SIZE;
-    if ( sgServicePost(initPacket, &pktlen, recvPacket, &rpktlen) ) {
+    rpktlen = SG_DATA_PACKET_SIZE;
+    if ( sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen) ) {
         logMessage( LOG_ERROR_LEVEL, "sgInitEndpoint: failed packet post" );
         return( -1 );
     }
 
     // Unpack the recieived data
-    if ( (ret = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK ) {
+    memset(capBlock, 0, SG_BLOCK_SIZE);
+    if ( (ret = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, capBlock, recvPacket, rpktlen)) != SG_PACKT_OK ) {
         logMessage( LOG_ERROR_LEVEL, "sgInitEndpoint: failed deserialization of packet [%d]", ret );
         return( -1 );
     }
@@ -914,18 +2441,1043 @@ int sgInitEndpoint( void ) {
         return( -1 );
     }
 
-    // intialize node-sequence map
-    remNodeIDs = (SG_Node_ID *) malloc(sizeof(SG_Node_ID));
-    remSeqNums = (SG_SeqNum *) malloc(sizeof(SG_SeqNum));
-    length = 1;
+    // Keep the extensions granted by the service (none if it sent no capabilities)
+    memcpy(&caps, capBlock, sizeof(SG_Endpoint_Caps));
+    sgFeatures = (caps.magic == SG_MAGIC_VALUE) ? (caps.features & sgConfig.features) : 0;
+    if (sgFeatures != sgConfig.features) {
+        logMessage( LOG_WARNING_LEVEL, "sgInitEndpoint: service granted features 0x%x of requested 0x%x", sgFeatures, sgConfig.features );
+    }
+    if ((sgFeatures & SG_FEATURE_BLOCK_SIZE) && sgValidBlockSize(caps.blockSize)) {
+        sgBlockSize = caps.blockSize;
+    } else {
+        sgFeatures &= ~SG_FEATURE_BLOCK_SIZE;
+    }
+    sgCodec.blockSize = sgBlockSize;
+    sgCodec.compress = (sgFeatures & SG_FEATURE_COMPRESSION) != 0;
+
+    // initialize cache, lines sized to the agreed block size
+    initSGCache(SG_MAX_CACHE_ELEMENTS, sgBlockSize);
+
+    // intialize node-sequence map and file map, in the metadata arena (the path index apart)
+    initSGArena(&sgMetaArena);
+    remNodes = (SG_Node_Entry *) allocSGArena(&sgMetaArena, SG_NODE_TABLE_ENTRIES * sizeof(SG_Node_Entry));
+    length = SG_NODE_TABLE_ENTRIES;
+    sgFileMap.slabs = (SG_File **) allocSGArena(&sgMetaArena, sizeof(SG_File *));
+    sgFileMap.slabCount = 1;
+    sgFileMap.index = (SgFHandle *) malloc(SG_FILE_INDEX_SLOTS * sizeof(SgFHandle));
+    sgFileMap.indexSize = SG_FILE_INDEX_SLOTS;
+    if ((remNodes == NULL) || (sgFileMap.slabs == NULL) || (sgFileMap.index == NULL)) {
+        logMessage( LOG_ERROR_LEVEL, "sgInitEndpoint: out of memory for the file map" );
+        return( -1 );
+    }
+    memset(sgFileMap.index, 0xff, SG_FILE_INDEX_SLOTS * sizeof(SgFHandle));
 
-    // initialize file map
-    sgFileMap.files = (SG_File **) malloc(sizeof(SG_File *));
-    sgFileMap.fPaths = (char **) malloc(sizeof(char *));
-    fileSize = 1;
+    // restore the metadata kept at the last run
+    if (sgCheckpointPath && sgLoadCheckpoint()) {
+        logMessage( LOG_ERROR_LEVEL, "sgInitEndpoint: failed restoring the metadata from [%s]", sgCheckpointPath );
+        return( -1 );
+    }
 
     // Set the local node ID, log and return successfully
     sgLocalNodeId = loc;
-    logMessage( LOG_INFO_LEVEL, "Completed initialization of node (local node ID %lu", sgLocalNodeId );
+    SG_LOG( LOG_INFO_LEVEL, "Completed initialization of node (local node ID %lu, block size %lu)", sgLocalNodeId, sgBlockSize );
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgPostPacket
+// Description  : Post a packet to the configured service, count wire traffic
+//
+// Inputs       : packet - the request packet
+//                len - the length of the request packet
+//                rpacket - the buffer to place the response packet
+//                rlen - the size of the response buffer (in), response length (out)
+// Outputs      : 0 if successful, -1 if failure
+
+int sgPostPacket( char *packet, size_t *len, char *rpacket, size_t *rlen ) {
+    SG_SPAN("service post");
+    SG_System_OP op;
+    uint64_t start, elapsed;
+
+    memcpy(&op, packet + offsetof(SG_Packet_Buffer, operation), sizeof(SG_System_OP));
+    memcpy(&sgFlight->sendSeq, packet + offsetof(SG_Packet_Buffer, sendSeqNo), sizeof(SG_SeqNum));
+    memcpy(&sgFlight->recvSeq, packet + offsetof(SG_Packet_Buffer, recvSeqNo), sizeof(SG_SeqNum));
+    sgFlight->posts += (sgFlight->posts < UINT8_MAX) ? 1 : 0;
+    op = (op < SG_MAXVAL_EXT_OP) ? op : SG_INIT_ENDPOINT;
+    sgPostCount++;
+    sgPostOps[op]++;
+    sgClassPosts[sgPostClass]++;
+    sgBytesSent += *len;
+    start = getSGTimeNS();
+    if ( sgConfig.service(packet, len, rpacket, rlen) ) {
+        return( -1 );
+    }
+    elapsed = getSGTimeNS() - start;
+    recordSGHistogram(&sgPostLatency[op], elapsed);
+    sgFlight->service += elapsed;
+    sgBytesRecv += *rlen;
     return( 0 );
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgBlockUnchanged
+// Description  : Check whether a write would leave a block as it is, by
+//                comparing the written range with the cached block; a block
+//                not in the cache is never known to be unchanged
+//
+// Inputs       : entry - the block map entry of the block
+//                off - offset of the write within the block
+//                buf - the bytes written
+//                len - the length of the write
+// Outputs      : 1 if the block already holds the bytes, 0 if not (or unknown)
+
+int sgBlockUnchanged( SG_Block_Entry *entry, size_t off, char *buf, size_t len ) {
+    SG_SPAN("elision check");
+    char * cached = peekSGDataBlock(entry->nodeID, entry->blockID);
+
+    if ((cached == NULL) || (memcmp(cached + off, buf, len) != 0)) {
+        return 0;
+    }
+    // the block was used all the same, keep it as recently used as an update would
+    getSGDataBlock(entry->nodeID, entry->blockID);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgUpdateBlockRange
+// Description  : Update a byte range of a remote block (SG_UPDATE_RANGE)
+//
+// Inputs       : rem - the remote node holding the block
+//                blk - the block identifier
+//                off - the offset of the range within the block
+//                buf - the bytes to write
+//                len - the length of the range
+// Outputs      : 0 if successful, -1 if failure
+
+int sgUpdateBlockRange( SG_Node_ID rem, SG_Block_ID blk, size_t off, char *buf, size_t len ) {
+    // Local variables
+    char initPacket[SG_MAX_PACKET_SIZE], recvPacket[SG_BASE_PACKET_SIZE];
+    size_t pktlen, rpktlen;
+    SG_Node_ID rloc, rrem;
+    SG_Block_ID rblk;
+    SG_SeqNum sloc, srem;
+    SG_System_OP op;
+    SG_Packet_Status status;
+    SG_SeqNum sgRemoteSeqNum = find(rem);
+
+    // Setup the packet
+    if ((status = serialize_sg_range_packet(sgLocalNodeId,    // Local ID
+                                            rem,              // Remote ID
+                                            blk,              // Block ID
+                                            SG_UPDATE_RANGE,  // Operation
+                                            sgLocalSeqno,     // Sender sequence number
+                                            SG_NEXT_SEQNO(sgRemoteSeqNum), // Receiver sequence number
+                                            off, len, buf, initPacket, &pktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgUpdateRange: failed serialization of packet [%d].", status);
+        return( -1 );
+    }
+    sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
+    // Send the packet
+    rpktlen = SG_BASE_PACKET_SIZE;
+    if (sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen)) {
+        logMessage(LOG_ERROR_LEVEL, "sgUpdateRange: failed packet post" );
+        return( -1 );
+    }
+    // Unpack the recieived data
+    if ((status = deserialize_sg_compressed_packet(&sgCodec, &rloc, &rrem, &rblk, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgUpdateRange: failed deserialization of packet [%d]", status);
+        return( -1 );
+    }
+    update(rem, srem);
+
+    // keep a cached copy of the block current (no need to fetch it otherwise)
+    patchSGDataBlock(rem, blk, off, buf, len);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgStoreBlock
+// Description  : Store a new block (SG_CREATE_BLOCK) as a block of a file,
+//                the one it replaces (if any) is left to the caller
+//
+// Inputs       : fh - file handle
+//                idx - the block index in the file
+//                block - the block contents
+// Outputs      : the block map entry of the block, NULL if failure
+
+SG_Block_Entry * sgStoreBlock( SgFHandle fh, uint64_t idx, char *block ) {
+    // Local variables
+    char initPacket[SG_MAX_PACKET_SIZE], recvPacket[SG_BASE_PACKET_SIZE];
+    size_t pktlen = SG_BLOCK_PACKET_SIZE(sgBlockSize), rpktlen;
+    SG_Block_Entry * entry;
+    SG_Node_ID loc, rem;
+    SG_Block_ID blkid;
+    SG_SeqNum sloc, srem;
+    SG_System_OP op;
+    SG_Packet_Status status;
+
+    // set up the packet
+    if ((status = sgSerializeBlock(sgLocalNodeId,
+                                   SG_NODE_UNKNOWN,
+                                   SG_BLOCK_UNKNOWN,
+                                   SG_CREATE_BLOCK,
+                                   sgLocalSeqno,
+                                   SG_SEQNO_UNKNOWN,
+                                   block, initPacket, &pktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed serialization of packet [%d].", status);
+        return NULL;
+    }
+    sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
+    // send the packet
+    rpktlen = SG_BASE_PACKET_SIZE;
+    if (sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen)) {
+        logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed packet post" );
+        return NULL;
+    }
+    // unpack the received data
+    if ((status = deserialize_sg_packet(&loc, &rem, &blkid, &op, &sloc, &srem, NULL, recvPacket, rpktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed deserialization of packet [%d]", status);
+        return NULL;
+    }
+    // save node/block IDs as the current block in the file
+    if ((entry = insertBlockMap(&SG_FILE(fh)->blocks, idx)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed to grow the block map");
+        return NULL;
+    }
+    entry->blockID = blkid;
+    entry->nodeID = rem;
+    if (sgJournal.fd != -1) {
+        SG_Journal_Block record = { fh, 0, idx, { entry->nodeID, entry->blockID } };
+        appendSGJournal(&sgJournal, SG_JOURNAL_BLOCK, &record, sizeof(record), NULL, 0);
+    }
+    if (find(rem) == 0) {
+        if (put(rem, srem)) {
+            logMessage(LOG_ERROR_LEVEL, "sgCreateBlock: failed to grow the node-sequence map");
+            return NULL;
+        }
+    } else {
+        update(rem, srem);
+    }
+    if (SG_FILE(fh)->advice == SG_ADVICE_NOREUSE) {
+        putSGColdDataBlock(rem, blkid, block);
+    } else {
+        putSGDataBlock(rem, blkid, block);
+    }
+    return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFetchBlock
+// Description  : Fetch a block from the service (SG_OBTAIN_BLOCK), the
+//                caller decides whether it is cached
+//
+// Inputs       : rem - the remote node holding the block
+//                blk - the remote block
+//                block - place to put the block
+// Outputs      : 0 if successful, -1 if failure
+
+int sgFetchBlock( SG_Node_ID rem, SG_Block_ID blk, char *block ) {
+    // Local variables
+    char initPacket[SG_BASE_PACKET_SIZE], recvPacket[SG_MAX_PACKET_SIZE];
+    size_t pktlen = SG_BASE_PACKET_SIZE, rpktlen;
+    SG_Node_ID loc, srcNode;
+    SG_Block_ID blkid;
+    SG_SeqNum sloc, srem;
+    SG_System_OP op;
+    SG_Packet_Status status;
+
+    // Setup the packet
+    if ((status = serialize_sg_packet(sgLocalNodeId,  // Local ID
+                                      rem,            // Remote ID
+                                      blk,            // Block ID
+                                      SG_OBTAIN_BLOCK, // Operation
+                                      sgLocalSeqno,   // Sender sequence number
+                                      SG_NEXT_SEQNO(find(rem)), // Receiver sequence number
+                                      NULL, initPacket, &pktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed serialization of packet [%d].", status);
+        return( -1 );
+    }
+    sgLocalSeqno = SG_NEXT_SEQNO(sgLocalSeqno);
+    // Send the packet
+    rpktlen = SG_BLOCK_PACKET_SIZE(sgBlockSize);
+    if (sgPostPacket(initPacket, &pktlen, recvPacket, &rpktlen)) {
+        logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed packet post" );
+        return( -1 );
+    }
+    // Unpack the recieived data
+    if ((status = deserialize_sg_compressed_packet(&sgCodec, &loc, &srcNode, &blkid, &op, &sloc, &srem, block, recvPacket, rpktlen)) != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgObtainBlock: failed deserialization of packet [%d]", status);
+        return( -1 );
+    }
+    update(rem, srem);
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgPrefetchNext
+// Description  : Learn a read of a block and queue a fetch of the block
+//                predicted to be read next, unless it is a hole, past the
+//                end or cached (driver lock held, prefetcher on)
+//
+// Inputs       : fh - the file read
+//                idx - the index of the block read
+// Outputs      : none
+
+void sgPrefetchNext( SgFHandle fh, uint64_t idx ) {
+    SG_SPAN("prefetch");
+    SG_Block_Entry *entry;
+    size_t used, wasted;
+    uint64_t next;
+
+    getSGPrefetchStats(&used, &wasted);
+    judgeSGPrefetch(&sgPrefetcher, used, wasted);
+    if ((SG_FILE(fh)->advice == SG_ADVICE_RANDOM) || !learnSGPrefetch(&sgPrefetcher, fh, idx, &next)) {
+        return;
+    }
+    if ((next >= SG_FILE(fh)->fSize / sgBlockSize) ||
+        ((entry = lookupBlockMap(&SG_FILE(fh)->blocks, next)) == NULL) || (entry->blockID == SG_HOLE_BLOCK) ||
+        peekSGDataBlock(entry->nodeID, entry->blockID)) {
+        return;
+    }
+    sgSchedule(SG_CLASS_PREFETCH, entry->nodeID, entry->blockID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgSchedule
+// Description  : Queue a background fetch of a block into the cache,
+//                starting the scheduler thread if it is not running (driver
+//                lock held)
+//
+// Inputs       : cls - the class of the request (a background one)
+//                rem - the remote node of the block
+//                blk - the remote block
+// Outputs      : 0 if queued (or already), -1 if dropped
+
+int sgSchedule( SG_Post_Class cls, SG_Node_ID rem, SG_Block_ID blk ) {
+    int ret;
+
+    if (!sgSchedRunning) {
+        if (pthread_create(&sgSchedThread, NULL, sgSchedWorker, NULL)) {
+            logMessage(LOG_ERROR_LEVEL, "sgSchedule: failed starting the scheduler thread");
+            sgSchedDropped++;
+            return -1;
+        }
+        sgSchedRunning = 1;
+    }
+    if ((ret = queueSGRequest(&sgScheduler, cls, rem, blk)) == -1) {
+        sgSchedDropped++;
+        return -1;
+    }
+    sgSchedQueued += (ret == 0) ? 1 : 0;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgSchedWorker
+// Description  : The scheduler thread: while requests are queued and no
+//                client call waits for the driver lock, post up to
+//                SG_SCHED_BATCH of them, then let the clients in; a client
+//                call wakes it when it is done (sgRecordCall)
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+void * sgSchedWorker( void *arg ) {
+    SG_Sched_Request req;
+    struct timespec due;
+    int posts;
+
+    pthread_mutex_lock(&sgDriverLock);
+    while (sgSchedRunning) {
+        if (sgScheduler.used == 0) {
+            pthread_cond_wait(&sgSchedWake, &sgDriverLock);
+            continue;
+        }
+        if (__atomic_load_n(&sgSchedWaiting, __ATOMIC_ACQUIRE)) {
+            // a client goes first, look again after its call (or a while)
+            clock_gettime(CLOCK_REALTIME, &due);
+            due.tv_nsec += SG_SCHED_IDLE_MS * 1000000L;
+            due.tv_sec += due.tv_nsec / 1000000000L;
+            due.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&sgSchedWake, &sgDriverLock, &due);
+            continue;
+        }
+        for (posts = 0; (posts < SG_SCHED_BATCH) && !__atomic_load_n(&sgSchedWaiting, __ATOMIC_ACQUIRE) &&
+                        takeSGRequest(&sgScheduler, &req); posts++) {
+            sgSchedIssue(&req);
+        }
+        if (posts == SG_SCHED_BATCH) {
+            pthread_mutex_unlock(&sgDriverLock);
+            sched_yield();
+            pthread_mutex_lock(&sgDriverLock);
+        }
+    }
+    pthread_mutex_unlock(&sgDriverLock);
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgSchedIssue
+// Description  : Post a queued request, a fetch of a block into the cache
+//                unless it got there meanwhile; a failed prefetch only logs
+//                (driver lock held)
+//
+// Inputs       : req - the request
+// Outputs      : none
+
+void sgSchedIssue( SG_Sched_Request *req ) {
+    SG_SPAN("background post");
+    char block[SG_MAX_BLOCK_SIZE];
+    SG_Post_Class cls = sgPostClass;
+
+    if (!sgDriverInitialized || peekSGDataBlock(req->nodeID, req->blockID)) {
+        return;
+    }
+    sgPostClass = req->cls;
+    if (sgFetchBlock(req->nodeID, req->blockID, block)) {
+        logMessage(LOG_ERROR_LEVEL, "sgSchedIssue: failed prefetching block %lu of node %lu.", req->blockID, req->nodeID);
+    } else {
+        putSGPrefetchBlock(req->nodeID, req->blockID, block);
+        sgPrefetchIssued++;
+    }
+    sgPostClass = cls;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgSchedStop
+// Description  : Stop the scheduler thread, the requests stay queued
+//                (driver lock not held)
+//
+// Inputs       : none
+// Outputs      : none
+
+void sgSchedStop( void ) {
+    pthread_mutex_lock(&sgDriverLock);
+    if (!sgSchedRunning) {
+        pthread_mutex_unlock(&sgDriverLock);
+        return;
+    }
+    sgSchedRunning = 0;
+    pthread_cond_signal(&sgSchedWake);
+    pthread_mutex_unlock(&sgDriverLock);
+    pthread_join(sgSchedThread, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgWriteLocal
+// Description  : Write all of a buffer to a local file
+//
+// Inputs       : fd - the local file
+//                buf - the bytes to write
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+int sgWriteLocal( int fd, char *buf, size_t len ) {
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < len) {
+        if ((ret = write(fd, buf + done, len - done)) <= 0) {
+            if ((ret == -1) && (errno == EINTR)) {
+                continue;
+            }
+            return( -1 );
+        }
+        done += ret;
+    }
+    return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgSerializeBlock
+// Description  : Serialize a packet carrying a data block, compressed if the
+//                service agreed to it
+//
+// Inputs       : (see serialize_sg_packet)
+// Outputs      : 0 if successfully created, -1 if failure
+
+SG_Packet_Status sgSerializeBlock( SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, SG_System_OP op, 
+        SG_SeqNum sseq, SG_SeqNum rseq, char *data, char *packet, size_t *plen ) {
+    return serialize_sg_compressed_packet(&sgCodec, loc, rem, blk, op, sseq, rseq, data, packet, plen);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgTraceTime
+// Description  : Get a monotonic timestamp for the trace
+//
+// Inputs       : none
+// Outputs      : the time in ns
+
+uint64_t sgTraceTime( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgTraceOp
+// Description  : Add an operation to the trace (driver lock held), a failure
+//                stops tracing rather than failing the caller
+//
+// Inputs       : op - the operation (workload_operations_type)
+//                name - the file path
+//                pos - the position of the read/write
+//                data - the data read/written (NULL for opens and closes)
+//                len - the length of the read/write
+//                time - the time the call was issued
+// Outputs      : none
+
+void sgTraceOp( int op, const char *name, uint64_t pos, char *data, size_t len, uint64_t time ) {
+    if (addWlbinOp(&sgTrace, name, op, pos, len, data, time - sgTraceBegin)) {
+        logMessage(LOG_ERROR_LEVEL, "sgTraceOp: failed tracing, trace [%s] abandoned.", sgTracePath);
+        freeWlbinBuilder(&sgTrace);
+        free(sgTracePath);
+        sgTracePath = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgTraceStopLocked
+// Description  : Write the trace and stop tracing (driver lock held)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgTraceStopLocked( void ) {
+    int ret;
+
+    if (sgTracePath == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgTraceStop: not tracing.");
+        return -1;
+    }
+    ret = addWlbinOp(&sgTrace, NULL, WL_EOF, 0, 0, NULL, sgTraceTime() - sgTraceBegin);
+    if (ret == 0) {
+        ret = writeWlbinFile(&sgTrace, sgTracePath);
+    }
+    SG_LOG(LOG_INFO_LEVEL, "Wrote trace [%s], %lu operations.", sgTracePath, sgTrace.numOps);
+    freeWlbinBuilder(&sgTrace);
+    free(sgTracePath);
+    sgTracePath = NULL;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLockDriver
+// Description  : Take the driver lock, the wait shows up as a span
+//
+// Inputs       : none
+// Outputs      : none
+
+void sgLockDriver( void ) {
+    SG_SPAN("lock wait");
+    __atomic_add_fetch(&sgSchedWaiting, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&sgDriverLock);
+    __atomic_sub_fetch(&sgSchedWaiting, 1, __ATOMIC_ACQ_REL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgResetStats
+// Description  : Clear the driver statistics (at endpoint initialization)
+//
+// Inputs       : none
+// Outputs      : none
+
+void sgResetStats( void ) {
+    int i;
+
+    memset(sgPostOps, 0, sizeof(sgPostOps));
+    sgRestoreTime = 0;
+    for (i = 0; i < SG_CALL_TYPES; i++) {
+        initSGHistogram(&sgCallLatency[i]);
+    }
+    for (i = 0; i < SG_MAXVAL_EXT_OP; i++) {
+        initSGHistogram(&sgPostLatency[i]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgRecordCall
+// Description  : Record the latency of a driver call, lock wait included,
+//                and publish its flight entry; a slow call (at most one a
+//                second) or a signal dumps the flight recorder (driver
+//                lock held)
+//
+// Inputs       : call - the driver call
+//                start - the time the call was made (getSGTimeNS)
+//                ret - the value returned by the call
+// Outputs      : none
+
+void sgRecordCall( SG_Driver_Call call, uint64_t start, int64_t ret ) {
+    uint64_t end = getSGTimeNS();
+    char reason[64];
+
+    if (sgDriverInitialized) {
+        recordSGHistogram(&sgCallLatency[call], end - start);
+    }
+    sgFlight->total = end - start;
+    sgFlight->failed = (ret < 0);
+    if (call == SG_CALL_OPEN) {
+        sgFlight->fh = ret;
+    }
+    commitSGFlight();
+    sgFlight = &sgFlightScratch;
+    if (sgScheduler.used) {
+        pthread_cond_signal(&sgSchedWake);
+    }
+
+    if (sgFlightRequested) {
+        sgFlightRequested = 0;
+        sgFlightDumpLocked(NULL, "signal");
+    } else if (sgFlightThreshold && (end - start > sgFlightThreshold) &&
+               (end - sgFlightLastDump > 1000000000ULL)) {
+        sgFlightLastDump = end;
+        snprintf(reason, sizeof(reason), "%s took %lu ns", sgFlightCalls[call], end - start);
+        sgFlightDumpLocked(NULL, reason);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFlightBegin
+// Description  : Start the flight entry of a driver call (driver lock held)
+//
+// Inputs       : call - the driver call
+//                fh - the file handle
+//                off - the offset (seeks, the read/write paths set theirs)
+//                len - the length of the read or write
+//                start - the time the call was made (getSGTimeNS)
+// Outputs      : none
+
+void sgFlightBegin( SG_Driver_Call call, SgFHandle fh, uint64_t off, size_t len, uint64_t start ) {
+    sgFlight = beginSGFlight();
+    sgFlight->start = start;
+    sgFlight->lockWait = getSGTimeNS() - start;
+    sgFlight->call = call;
+    sgFlight->fh = fh;
+    sgFlight->offset = off;
+    sgFlight->length = len;
+    sgPostClass = ((call == SG_CALL_READ) || (call == SG_CALL_EXPORT) || (call == SG_CALL_ADVISE)) ? SG_CLASS_READ : SG_CLASS_WRITE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFlightDumpLocked
+// Description  : Append the flight recorder to a file (driver lock held)
+//
+// Inputs       : path - the file, NULL for the configured one
+//                reason - why the dump was taken
+// Outputs      : 0 if successful, -1 if failure
+
+int sgFlightDumpLocked( const char *path, const char *reason ) {
+    FILE *out;
+    int ret;
+
+    if ((path = path ? path : sgFlightPath) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgFlightDump: no flight recorder file configured");
+        return -1;
+    }
+    if ((out = fopen(path, "a")) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgFlightDump: failed opening [%s]", path);
+        return -1;
+    }
+    ret = writeSGFlight(out, reason);
+    if (fclose(out) || ret) {
+        logMessage(LOG_ERROR_LEVEL, "sgFlightDump: failed writing [%s]", path);
+        return -1;
+    }
+    SG_LOG(LOG_INFO_LEVEL, "Dumped flight recorder to [%s] (%s).", path, reason);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgFlightSignal
+// Description  : Signal handler, requests a dump at the end of the next call
+//                (nothing else is async-signal-safe here)
+//
+// Inputs       : signo - the signal
+// Outputs      : none
+
+void sgFlightSignal( int signo ) {
+    sgFlightRequested = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLoadCheckpoint
+// Description  : Restore the metadata from the snapshot and its journal.  The
+//                snapshot is used in place: the node table is copied, the
+//                files get slab entries in an anonymous mapping (zero, so
+//                not loaded, until first opened) and
+//                the path index is the mapped one, so the time taken does not
+//                grow with the number of files.  The journal is replayed on
+//                top, then appended to.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgLoadCheckpoint( void ) {
+    SG_Snapshot_Header *hdr;
+    uint64_t generation = 0, i, start = getSGTimeNS();
+    int ret;
+
+    if ((ret = openSGSnapshot(sgCheckpointPath, &sgSnapshot)) == -1) {
+        return -1;
+    }
+    if (ret == 0) {
+        hdr = sgSnapshot.header;
+        if ((hdr->blockSize != sgBlockSize) || (hdr->files > INT32_MAX)) {
+            logMessage(LOG_ERROR_LEVEL, "sgLoadCheckpoint: snapshot of %lu files of %lu byte blocks, endpoint uses %lu byte blocks",
+                       hdr->files, hdr->blockSize, sgBlockSize);
+            return -1;
+        }
+        for (i = 0; i < hdr->nodes; i++) {
+            if (put(sgSnapshot.nodes[i].nodeID, sgSnapshot.nodes[i].seqNum)) {
+                return -1;
+            }
+        }
+        for (i = 0; i < hdr->shared; i++) {
+            if (setBlockRefs(&sgBlockRefs, sgSnapshot.shared[i].nodeID, sgSnapshot.shared[i].blockID, sgSnapshot.shared[i].refs)) {
+                return -1;
+            }
+        }
+        while ((uint64_t) sgFileMap.slabCount * SG_FILE_SLAB < hdr->files) {
+            sgFileMap.slabCount *= 2;
+        }
+        if ((sgFileMap.slabs = (SG_File **) allocSGArena(&sgMetaArena, sgFileMap.slabCount * sizeof(SG_File *))) == NULL) {
+            return -1;
+        }
+        sgFileMap.restoredSize = ((hdr->files + SG_FILE_SLAB - 1) / SG_FILE_SLAB) * SG_FILE_SLAB * sizeof(SG_File);
+        if ((sgFileMap.restoredSize > 0) && ((sgFileMap.restored = (SG_File *) mmap(NULL, sgFileMap.restoredSize,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)) {
+            logMessage(LOG_ERROR_LEVEL, "sgLoadCheckpoint: out of memory for %lu files", hdr->files);
+            sgFileMap.restored = NULL;
+            sgFileMap.restoredSize = 0;
+            return -1;
+        }
+        for (i = 0; i * SG_FILE_SLAB < hdr->files; i++) {
+            sgFileMap.slabs[i] = &sgFileMap.restored[i * SG_FILE_SLAB];
+        }
+        free(sgFileMap.index);
+        sgFileMap.index = sgSnapshot.index;
+        sgFileMap.indexSize = hdr->indexSize;
+        nextFHandle = hdr->files;
+        generation = hdr->generation;
+    }
+
+    // the changes made after the snapshot (the journal of an older one is stale)
+    if ((ret = replaySGJournal(sgJournalPath, generation, sgJournalApply)) == -1) {
+        return -1;
+    }
+    for (i = 0; i < next; i++) {
+        remNodes[i].dirty = 0;
+    }
+    ret = startSGJournal(&sgJournal, sgJournalPath, generation, ret);
+    sgRestoreTime = getSGTimeNS() - start;
+    SG_LOG(LOG_INFO_LEVEL, "Restored metadata from [%s]: %d files, %d nodes (generation %lu) in %lu ns.", sgCheckpointPath,
+           nextFHandle, next, generation, sgRestoreTime);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgJournalApply
+// Description  : Apply a journal record to the metadata during replay (the
+//                journal is not written meanwhile)
+//
+// Inputs       : type - the record type
+//                payload - the record payload
+//                length - its length
+// Outputs      : 0 if successful, -1 if failure
+
+int sgJournalApply( int type, const void *payload, size_t length ) {
+    SG_Journal_File file;
+    SG_Journal_Size size;
+    SG_Journal_Block block;
+    SG_Journal_Node node;
+    SG_Journal_Clone clone;
+    SG_Block_Entry * entry;
+    char path[UINT16_MAX + 1];
+    size_t slot;
+
+    switch (type) {
+        case SG_JOURNAL_FILE:
+            memcpy(&file, payload, (length < sizeof(file)) ? length : sizeof(file));
+            if ((length < sizeof(file)) || (file.fh != nextFHandle) || (file.pathLength != length - sizeof(file))) {
+                return -1;
+            }
+            memcpy(path, (const char *) payload + sizeof(file), file.pathLength);
+            path[file.pathLength] = '\0';
+            if (((slot = findFileSlot(path)) == SIZE_MAX) || (sgFileMap.index[slot] != -1)) {
+                return -1;
+            }
+            return (addFile(path) == -1) ? -1 : 0;
+
+        case SG_JOURNAL_SIZE:
+            memcpy(&size, payload, (length < sizeof(size)) ? length : sizeof(size));
+            if ((length != sizeof(size)) || (size.fh < 0) || (size.fh >= nextFHandle) || (size.fSize % sgBlockSize) ||
+                    loadFile(size.fh)) {
+                return -1;
+            }
+            // a size of 0 empties the file (an import replaced it)
+            if (size.fSize == 0) {
+                return truncateFile(size.fh);
+            }
+            SG_FILE(size.fh)->fSize = size.fSize;
+            return 0;
+
+        case SG_JOURNAL_BLOCK:
+            memcpy(&block, payload, (length < sizeof(block)) ? length : sizeof(block));
+            if ((length != sizeof(block)) || (block.fh < 0) || (block.fh >= nextFHandle) || loadFile(block.fh) ||
+                    ((entry = insertBlockMap(&SG_FILE(block.fh)->blocks, block.index)) == NULL)) {
+                return -1;
+            }
+            // a block replacing another was a copy of a shared one
+            if ((entry->blockID != SG_HOLE_BLOCK) && dropBlockRef(&sgBlockRefs, entry->nodeID, entry->blockID)) {
+                return -1;
+            }
+            entry->nodeID = block.entry.nodeID;
+            entry->blockID = block.entry.blockID;
+            return 0;
+
+        case SG_JOURNAL_CLONE:
+            memcpy(&clone, payload, (length < sizeof(clone)) ? length : sizeof(clone));
+            if ((length != sizeof(clone)) || (clone.src < 0) || (clone.src >= nextFHandle) ||
+                    (clone.fh != nextFHandle - 1) || (clone.src == clone.fh) || loadFile(clone.src)) {
+                return -1;
+            }
+            return cloneFile(clone.src, clone.fh);
+
+        case SG_JOURNAL_NODE:
+            memcpy(&node, payload, (length < sizeof(node)) ? length : sizeof(node));
+            if (length != sizeof(node)) {
+                return -1;
+            }
+            if (find(node.nodeID) == 0) {
+                return put(node.nodeID, node.seqNum);
+            }
+            return update(node.nodeID, node.seqNum);
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgJournalCommit
+// Description  : Write the journal records of a driver call (the remote
+//                sequence numbers it changed last), one write per call
+//
+// Inputs       : none
+// Outputs      : none
+
+void sgJournalCommit( void ) {
+    SG_Journal_Node record;
+
+    if (sgJournal.fd == -1) {
+        return;
+    }
+    for (int i = 0; i < next; i++) {
+        if (remNodes[i].dirty) {
+            record.nodeID = remNodes[i].nodeID;
+            record.seqNum = remNodes[i].seqNum;
+            appendSGJournal(&sgJournal, SG_JOURNAL_NODE, &record, sizeof(record), NULL, 0);
+            remNodes[i].dirty = 0;
+        }
+    }
+    if (sgJournal.used) {
+        flushSGJournal(&sgJournal);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fileBlock
+// Description  : The entry of a block of a file, loaded or still in the
+//                snapshot (holes as SG_HOLE_BLOCK on no node)
+//
+// Inputs       : fh - file handle
+//                idx - the block index within the file
+// Outputs      : the entry
+
+SG_Snapshot_Block fileBlock( SgFHandle fh, uint64_t idx ) {
+    SG_Snapshot_Block block = { 0, SG_HOLE_BLOCK };
+    SG_Block_Entry * entry;
+
+    if (SG_FILE(fh)->path == NULL) {
+        block = sgSnapshot.blocks[sgSnapshot.files[fh].blocks + idx];
+    } else if ((entry = lookupBlockMap(&SG_FILE(fh)->blocks, idx)) != NULL) {
+        block.nodeID = entry->nodeID;
+        block.blockID = entry->blockID;
+    }
+    if (block.blockID == SG_HOLE_BLOCK) {
+        block.nodeID = 0;
+    }
+    return block;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgCheckpointLocked
+// Description  : Write the metadata snapshot (driver lock held): to a new
+//                file, synced, then renamed over the old one.  The journal
+//                then starts over with the generation of the snapshot, so a
+//                crash in between leaves a snapshot and a stale journal that
+//                is ignored.  Files not loaded are copied from the old
+//                snapshot (still mapped, the paths of the loaded ones point
+//                into it).
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgCheckpointLocked( void ) {
+    static const char pad[8];
+    SG_Snapshot_Header hdr;
+    SG_Snapshot_Node node;
+    SG_Snapshot_Shared shared;
+    SG_Snapshot_File record;
+    SG_Snapshot_Block entry;
+    char tmp[strlen(sgCheckpointPath) + sizeof(".tmp")];
+    uint64_t chunks, chunk, count, i, blocks = 0, paths = 0;
+    const char *path;
+    uint32_t sum;
+    SgFHandle fh;
+    FILE *out;
+    int failed;
+
+    // the layout: header, nodes, shared blocks, files, path index and its checksums, blocks (aligned), paths
+    memset(&hdr, 0, sizeof(hdr));
+    for (fh = 0; fh < nextFHandle; fh++) {
+        if ((SG_FILE(fh)->path == NULL) && checkSGSnapshotFile(&sgSnapshot, fh)) {
+            return -1;
+        }
+        hdr.blockEntries += (SG_FILE(fh)->path ? SG_FILE(fh)->fSize : sgSnapshot.files[fh].fSize) / sgBlockSize;
+        hdr.pathBytes += strlen(filePath(fh)) + 1;
+    }
+    for (i = 0; (sgFileMap.index == sgSnapshot.index) && (i < sgFileMap.indexSize); i += SG_SNAPSHOT_INDEX_CHUNK) {
+        if (checkSGSnapshotIndex(&sgSnapshot, i)) {
+            return -1;
+        }
+    }
+    hdr.magic = SG_SNAPSHOT_MAGIC;
+    hdr.version = SG_CHECKPOINT_VERSION;
+    hdr.generation = sgJournal.generation + 1;
+    hdr.blockSize = sgBlockSize;
+    hdr.files = nextFHandle;
+    hdr.nodes = next;
+    hdr.shared = sgBlockRefs.used;
+    hdr.indexSize = sgFileMap.indexSize;
+    chunks = (hdr.indexSize + SG_SNAPSHOT_INDEX_CHUNK - 1) / SG_SNAPSHOT_INDEX_CHUNK;
+    hdr.nodesOffset = sizeof(hdr);
+    hdr.sharedOffset = hdr.nodesOffset + hdr.nodes * sizeof(SG_Snapshot_Node);
+    hdr.filesOffset = hdr.sharedOffset + hdr.shared * sizeof(SG_Snapshot_Shared);
+    hdr.indexOffset = hdr.filesOffset + hdr.files * sizeof(SG_Snapshot_File);
+    hdr.indexSumsOffset = hdr.indexOffset + hdr.indexSize * sizeof(int32_t);
+    hdr.blocksOffset = (hdr.indexSumsOffset + chunks * sizeof(uint32_t) + sizeof(pad) - 1) & ~(sizeof(pad) - 1);
+    hdr.pathsOffset = hdr.blocksOffset + hdr.blockEntries * sizeof(SG_Snapshot_Block);
+    hdr.size = hdr.pathsOffset + hdr.pathBytes;
+
+    sprintf(tmp, "%s.tmp", sgCheckpointPath);
+    if ((out = fopen(tmp, "w")) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "sgCheckpoint: failed opening [%s]", tmp);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    // node table, shared blocks, file records (checksummed with their paths and blocks), path index
+    for (i = 0; i < next; i++) {
+        node.nodeID = remNodes[i].nodeID;
+        node.seqNum = remNodes[i].seqNum;
+        hdr.nodesSum = sumSGCheckpoint(hdr.nodesSum, &node, sizeof(node));
+        fwrite(&node, sizeof(node), 1, out);
+        remNodes[i].dirty = 0;
+    }
+    for (i = 0; i < sgBlockRefs.size; i++) {
+        if (sgBlockRefs.slots[i].refs) {
+            shared.nodeID = sgBlockRefs.slots[i].nodeID;
+            shared.blockID = sgBlockRefs.slots[i].blockID;
+            shared.refs = sgBlockRefs.slots[i].refs;
+            hdr.sharedSum = sumSGCheckpoint(hdr.sharedSum, &shared, sizeof(shared));
+            fwrite(&shared, sizeof(shared), 1, out);
+        }
+    }
+    for (fh = 0; fh < nextFHandle; fh++) {
+        path = filePath(fh);
+        record.fSize = SG_FILE(fh)->path ? SG_FILE(fh)->fSize : sgSnapshot.files[fh].fSize;
+        record.path = paths;
+        record.blocks = blocks;
+        record.pathLength = strlen(path);
+        record.sum = 0;
+        sum = sumSGCheckpoint(sumSGCheckpoint(0, &record, sizeof(record)), path, record.pathLength);
+        for (i = 0; i < record.fSize / sgBlockSize; i++) {
+            entry = fileBlock(fh, i);
+            sum = sumSGCheckpoint(sum, &entry, sizeof(entry));
+        }
+        record.sum = sum;
+        fwrite(&record, sizeof(record), 1, out);
+        paths += record.pathLength + 1;
+        blocks += record.fSize / sgBlockSize;
+    }
+    fwrite(sgFileMap.index, sizeof(SgFHandle), sgFileMap.indexSize, out);
+    for (chunk = 0; chunk < chunks; chunk++) {
+        count = hdr.indexSize - chunk * SG_SNAPSHOT_INDEX_CHUNK;
+        count = (count > SG_SNAPSHOT_INDEX_CHUNK) ? SG_SNAPSHOT_INDEX_CHUNK : count;
+        sum = sumSGCheckpoint(0, &sgFileMap.index[chunk * SG_SNAPSHOT_INDEX_CHUNK], count * sizeof(SgFHandle));
+        fwrite(&sum, sizeof(sum), 1, out);
+    }
+    fwrite(pad, 1, hdr.blocksOffset - (hdr.indexSumsOffset + chunks * sizeof(uint32_t)), out);
+
+    // the block entries and paths, in file order
+    for (fh = 0; fh < nextFHandle; fh++) {
+        count = (SG_FILE(fh)->path ? SG_FILE(fh)->fSize : sgSnapshot.files[fh].fSize) / sgBlockSize;
+        for (i = 0; i < count; i++) {
+            entry = fileBlock(fh, i);
+            fwrite(&entry, sizeof(entry), 1, out);
+        }
+    }
+    for (fh = 0; fh < nextFHandle; fh++) {
+        path = filePath(fh);
+        fwrite(path, 1, strlen(path) + 1, out);
+    }
+
+    // the header last, then make it the snapshot
+    hdr.headerSum = sumSGCheckpoint(0, &hdr, sizeof(hdr));
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    failed = (fflush(out) != 0) || ferror(out) || fsync(fileno(out));
+    if ((fclose(out) != 0) || failed) {
+        logMessage(LOG_ERROR_LEVEL, "sgCheckpoint: failed writing [%s]", tmp);
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, sgCheckpointPath)) {
+        logMessage(LOG_ERROR_LEVEL, "sgCheckpoint: failed renaming [%s] to [%s]", tmp, sgCheckpointPath);
+        unlink(tmp);
+        return -1;
+    }
+    stopSGJournal(&sgJournal);
+    if (startSGJournal(&sgJournal, sgJournalPath, hdr.generation, 1)) {
+        return -1;
+    }
+    SG_LOG(LOG_INFO_LEVEL, "Wrote metadata snapshot [%s]: %d files, %lu blocks, %lu bytes (generation %lu).",
+           sgCheckpointPath, nextFHandle, hdr.blockEntries, hdr.size, hdr.generation);
+    return 0;
+}
@@ -12,15 +12,54 @@
 //
 
 // Includes
+#include <zlib.h>
 #include <sg_defs.h>
+#include <sg_histogram.h>
+#include <sg_sched.h>
 
 // Defines 
 
+// Data indicator values (what follows the packet header)
+#define SG_DATA_NONE  0         // No data, header only
+#define SG_DATA_BLOCK 1         // A full data block
+#define SG_DATA_RANGE 2         // A byte range (offset, length, bytes) of a block
+#define SG_DATA_COMPRESSED 0x40 // Flag: the data block is compressed (length, bytes)
+
+// The sequence number following s (wraps around, skipping 0 and SG_SEQNO_UNKNOWN)
+#define SG_NEXT_SEQNO(s) ((SG_SeqNum) ((s) + 1) == SG_SEQNO_UNKNOWN ? 1 : (SG_SeqNum) ((s) + 1))
+
+// Protocol extensions negotiated at endpoint initialization
+#define SG_FEATURE_RANGE_UPDATE 0x1   // Service accepts SG_UPDATE_RANGE
+#define SG_FEATURE_COMPRESSION  0x2   // Data blocks may be sent compressed
+#define SG_FEATURE_BLOCK_SIZE   0x4   // Blocks use the negotiated block size
+
+// Operations of the protocol extensions, past the ones shared with the reference
+// service (sg_defs.h), sent only once the service granted the extension
+#define SG_UPDATE_RANGE ((SG_System_OP) SG_MAXVAL_OP) // Update a byte range within a block (SG_FEATURE_RANGE_UPDATE)
+#define SG_MAXVAL_EXT_OP (SG_MAXVAL_OP + 1)            // Maximum value of the opcode, extensions included
+#define SG_CODEC_MAXVAL_OP(codec) ((codec) ? SG_MAXVAL_EXT_OP : SG_MAXVAL_OP) // Extensions need a negotiated codec
+
 // Type definitions
 typedef uint32_t SG_Magic;      // Magic value type
 
 typedef char SG_DataIndicator;  // Data indicator type
 
+typedef int (*SG_Service_Post)( char *packet, size_t *len, char *rpacket, size_t *rlen );
+    // The function used to post packets to a ScatterGather service
+
+typedef struct {
+    SG_Service_Post service;    // The service to post packets to
+    uint32_t features;          // Protocol extensions to request (SG_FEATURE_*)
+    uint32_t blockSize;         // Block size to request (SG_FEATURE_BLOCK_SIZE)
+} SG_Endpoint_Config;
+
+struct SG_Endpoint_Caps_t {
+    SG_Magic magic;             // Magic number (marks a capability block)
+    uint32_t features;          // Protocol extensions requested/granted
+    uint32_t blockSize;         // Block size requested/granted
+} __attribute__((packed));      // Carried in the data block of SG_INIT_ENDPOINT
+typedef struct SG_Endpoint_Caps_t SG_Endpoint_Caps;
+
 struct SG_Packet_Buffer_t{
     SG_Magic magic;             // Magic number 1
     SG_Node_ID sendNodeId;      // The local node ID
@@ -33,12 +72,84 @@ struct SG_Packet_Buffer_t{
 } __attribute__((packed));      // Avoid c automatic padding to retain data size
 typedef struct SG_Packet_Buffer_t SG_Packet_Buffer;
 
+typedef struct {
+    size_t blockSize;           // Block size of the endpoint's data blocks
+    int compress;               // Data blocks are sent compressed (if they shrink)
+    z_stream deflater;          // Deflate stream, kept between blocks (set up on first use)
+    z_stream inflater;          // Inflate stream, kept between blocks (set up on first use)
+    int deflating;              // The deflate stream is set up
+    int inflating;              // The inflate stream is set up
+} SG_Codec;                     // The packet format of one endpoint
+
+// The driver calls (latency statistics)
+typedef enum {
+    SG_CALL_OPEN  = 0,          // sgopen
+    SG_CALL_READ  = 1,          // sgread
+    SG_CALL_WRITE = 2,          // sgwrite
+    SG_CALL_SEEK  = 3,          // sgseek
+    SG_CALL_CLOSE = 4,          // sgclose
+    SG_CALL_CLONE = 5,          // sgclone
+    SG_CALL_IMPORT = 6,         // sgimport
+    SG_CALL_EXPORT = 7,         // sgexport
+    SG_CALL_ADVISE = 8,         // sgadvise
+    SG_CALL_TYPES = 9           // Number of driver calls
+} SG_Driver_Call;
+
+// Access pattern advice (sgadvise), modeled on posix_fadvise: the first
+// three and NOREUSE set the cache policy of the whole file, the others act
+// on the blocks of the range
+typedef enum {
+    SG_ADVICE_NORMAL     = 0,   // Default policy, the range is unpinned
+    SG_ADVICE_SEQUENTIAL = 1,   // Read once in order: reads leave the LRU order alone
+    SG_ADVICE_RANDOM     = 2,   // Read in no order: the default policy, and no prefetching
+    SG_ADVICE_WILLNEED   = 3,   // Read soon: queue the range for prefetching
+    SG_ADVICE_DONTNEED   = 4,   // Not read again: evict the range from the cache
+    SG_ADVICE_NOREUSE    = 5,   // Used once: read and written blocks go in at the cold end
+    SG_ADVICE_PIN        = 6,   // Hot: fetch the range and never evict it
+} SG_Advice;
+
+// The driver statistics (since the endpoint was initialized)
+typedef struct {
+    size_t posts[SG_MAXVAL_EXT_OP];         // Packets posted per operation
+    size_t bytesSent;                       // Bytes sent to the service
+    size_t bytesRecv;                       // Bytes received from the service
+    size_t cacheLookups;                    // Block cache lookups
+    size_t cacheHits;                       // Block cache hits
+    size_t cacheMisses;                     // Block cache lookups that missed
+    size_t cacheEvictions;                  // Blocks evicted from the cache
+    size_t openFiles;                       // Files currently open
+    size_t holeReads;                       // Reads served from holes (no packet)
+    size_t holeWrites;                      // All-zero blocks kept as holes
+    size_t elidedWrites;                    // Writes that left their block unchanged (no update sent)
+    size_t sharedBlocks;                    // Blocks shared by cloned files
+    size_t copiedBlocks;                    // Shared blocks copied on a write (SG_CREATE_BLOCK)
+    size_t importBytes;                     // Bytes of local files imported
+    size_t exportBytes;                     // Bytes of files exported to local files
+    size_t pinnedBlocks;                    // Cached blocks pinned by sgadvise
+    size_t prefetchIssued;                  // Blocks fetched by the prefetcher
+    size_t prefetchUsed;                    // Prefetched blocks read before eviction
+    size_t prefetchWasted;                  // Prefetched blocks evicted or replaced unread
+    int prefetchThreshold;                  // Confidence (percent) the prefetcher asks for now
+    size_t classPosts[SG_POST_CLASSES];     // Packets posted per priority class
+    size_t schedQueued;                     // Background requests queued
+    size_t schedPromoted;                   // Queued requests a demand read posted first
+    size_t schedDropped;                    // Background requests dropped (queue full or shutdown)
+    size_t logDropped;                      // Async log records dropped on a full ring (all endpoints)
+    uint64_t restoreTime;                   // Time to restore the metadata checkpoint (ns)
+    SG_Histogram calls[SG_CALL_TYPES];      // Latency of the driver calls (ns)
+    SG_Histogram postLatency[SG_MAXVAL_EXT_OP]; // Latency of the service posts per operation (ns)
+} SG_Driver_Stats;
+
 typedef enum {
     SG_SERIALIZE    = 0,        // Processing serialized function
     SG_DESERIALIZE  = 1,        // Processing deserialized function
 } SG_Process;
 
 // Global interface definitions
+extern size_t sgBlockSize;      // The block size agreed with the service (packets, cache)
+extern size_t sgPostCount;      // Packets posted to the service
+extern size_t sgBytesSent;      // Bytes sent to the service
+extern size_t sgBytesRecv;      // Bytes received from the service
 
 // File system interface definitions
 
@@ -51,28 +162,80 @@ int sgread( SgFHandle fh, char *buf, size_t len );
 int sgwrite( SgFHandle fh, char *buf, size_t len );
     // Write data to the file
 
-int sgseek( SgFHandle fh, size_t off );
+int64_t sgseek( SgFHandle fh, uint64_t off );
     // Seek to a specific place in the file
 
 int sgclose( SgFHandle fh );
     // Close the file
 
+SgFHandle sgclone( SgFHandle fh, const char *path );
+    // Clone the file to a new file at path, sharing its blocks until written
+
+int64_t sgimport( const char *localpath, const char *path );
+    // Copy a local file into the file at path (created if new, emptied if not),
+    // the last block padded with zeros
+
+int64_t sgexport( const char *path, const char *localpath );
+    // Copy the file at path out to a local file (replaced if it exists), in
+    // whole blocks: a file imported from a partial last block exports padded
+
+int sgadvise( SgFHandle fh, uint64_t off, uint64_t len, SG_Advice advice );
+    // Tell the driver how a file (or its range, len 0 to the end) will be used,
+    // for WILLNEED the number of blocks left out (past a cache full)
+
 int sgshutdown( void );
     // Shut down the filesystem
 
+int sgConfigureEndpoint( SG_Endpoint_Config *config );
+    // Configure the endpoint (before the first sgopen)
+
+int sgTraceStart( const char *path );
+    // Record the file system calls, with issue times, as a compiled workload
+
+int sgTraceStop( void );
+    // Stop recording and write the trace (sgshutdown does this too)
+
+int sgGetStats( SG_Driver_Stats *stats );
+    // Get the driver statistics (counters and latency histograms)
+
+int sgFlightConfigure( const char *path, uint64_t threshold, int signo );
+    // Append flight recorder dumps to path, on calls slower than threshold ns
+    // (0 never) and on signal signo (0 none)
+
+int sgFlightDump( const char *path );
+    // Dump the flight recorder now (NULL for the configured file)
+
+int sgCheckpointConfigure( const char *path );
+    // Keep the metadata in a snapshot at path and a journal at path.journal,
+    // restored at initialization (before the first sgopen)
+
+int sgCheckpoint( void );
+    // Write the metadata snapshot now (sgshutdown does this too)
+
+int sgPrefetchConfigure( size_t entries, int threshold );
+    // Prefetch the block predicted to be read next, learned in a table of
+    // entries blocks (0 turns prefetching off) once threshold percent likely
+
 //
 // Helper Functions
 SG_Packet_Status check_serialize_sg_Data(SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
-        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq);
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, SG_System_OP maxop);
 
 SG_Packet_Status check_deserialize_sg_Data(SG_Packet_Buffer buffer, SG_Node_ID *loc, SG_Node_ID *rem, 
-        SG_Block_ID *blk, SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq);
+        SG_Block_ID *blk, SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, SG_System_OP maxop);
 
 int construct_sg_packet_buffer(SG_Packet_Buffer *buffer, SG_Magic magic_num, SG_Node_ID loc, SG_Node_ID rem, 
         SG_Block_ID blk, SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, SG_DataIndicator indicator);
 
 int print_sg_packet_log_message(SG_Process process, SG_Packet_Status status);
 
+size_t compress_sg_block(SG_Codec *codec, char *block, char *out, size_t max);
+
+int decompress_sg_block(SG_Codec *codec, char *in, size_t clen, char *block);
+
+void closeSGCodec(SG_Codec *codec);
+    // Release the compression streams of an endpoint
+
 SG_Packet_Status serialize_sg_packet( SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
         SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, char *packet, size_t *plen );
     // Serialize a ScatterGather packet (create packet)
@@ -81,4 +244,22 @@ SG_Packet_Status deserialize_sg_packet( SG_Node_ID *loc, SG_Node_ID *rem, SG_Blo
         SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, char *data, char *packet, size_t plen );
     // De-serialize a ScatterGather packet (unpack packet)
 
+SG_Packet_Status serialize_sg_compressed_packet( SG_Codec *codec, SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, char *data, char *packet, size_t *plen );
+    // Serialize a ScatterGather packet of an endpoint, compressing the data block if agreed
+
+SG_Packet_Status deserialize_sg_compressed_packet( SG_Codec *codec, SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk, 
+        SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, char *data, char *packet, size_t plen );
+    // De-serialize a ScatterGather packet, its data block compressed or not
+
+SG_Packet_Status serialize_sg_range_packet( SG_Node_ID loc, SG_Node_ID rem, SG_Block_ID blk, 
+        SG_System_OP op, SG_SeqNum sseq, SG_SeqNum rseq, uint16_t off, uint16_t len, char *data, 
+        char *packet, size_t *plen );
+    // Serialize a ScatterGather packet carrying a byte range of a block
+
+SG_Packet_Status deserialize_sg_range_packet( SG_Codec *codec, SG_Node_ID *loc, SG_Node_ID *rem, SG_Block_ID *blk, 
+        SG_System_OP *op, SG_SeqNum *sseq, SG_SeqNum *rseq, uint16_t *off, uint16_t *len, char *data, 
+        char *packet, size_t plen );
+    // De-serialize a ScatterGather packet carrying a byte range of a block
+
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_flight.c
+//  Description    : This file contains the flight recorder of the
+//                   ScatterGather driver, the ring of the last driver calls
+//                   and its text dump.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdio.h>
+#include <time.h>
+
+// Project Includes
+#include <sg_flight.h>
+
+//
+// Global data
+
+SG_Flight_Entry sgFlightRing[SG_FLIGHT_ENTRIES]; // the recorded calls
+uint64_t sgFlightHead = 0; // calls recorded so far
+
+// Names of the driver calls and cache outcomes
+const char *sgFlightCalls[] = { "open", "read", "write", "seek", "close", "clone", "import", "export", "advise" };
+const char *sgFlightCache[] = { "-", "hit", "miss", "hole" };
+#define SG_FLIGHT_CALL_NAMES (sizeof(sgFlightCalls) / sizeof(sgFlightCalls[0]))
+#define SG_FLIGHT_CACHE_NAMES (sizeof(sgFlightCache) / sizeof(sgFlightCache[0]))
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeSGFlight
+// Description  : Write the recorded calls, oldest first, one per line
+//
+// Inputs       : out - the file to write to
+//                reason - why the dump was taken
+// Outputs      : 0 if successful, -1 if failure
+
+int writeSGFlight( FILE *out, const char *reason ) {
+    uint64_t head = __atomic_load_n(&sgFlightHead, __ATOMIC_ACQUIRE), i;
+    uint64_t first = (head > SG_FLIGHT_ENTRIES) ? head - SG_FLIGHT_ENTRIES : 0;
+    SG_Flight_Entry *e;
+    time_t now = time(NULL);
+    char when[32];
+
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(out, "# flight recorder dump at %s (%s), calls %lu to %lu\n", when, reason, first, head);
+    fprintf(out, "# %8s %14s %5s %4s %10s %6s %20s %20s %5s %5s %5s %5s %10s %10s %10s %s\n", "seq", "start_ns",
+            "call", "fh", "offset", "len", "node", "block", "sseq", "rseq", "cache", "posts", "lock_ns",
+            "service_ns", "total_ns", "status");
+    for (i = first; i < head; i++) {
+        e = &sgFlightRing[i & (SG_FLIGHT_ENTRIES - 1)];
+        fprintf(out, "%10lu %14lu %5s %4d %10lu %6u %20lu %20lu %5u %5u %5s %5u %10lu %10lu %10lu %s\n", e->seq,
+                e->start, (e->call < SG_FLIGHT_CALL_NAMES) ? sgFlightCalls[e->call] : "?", e->fh, e->offset,
+                e->length, e->node, e->block, e->sendSeq, e->recvSeq,
+                (e->cache < SG_FLIGHT_CACHE_NAMES) ? sgFlightCache[e->cache] : "?", e->posts, e->lockWait,
+                e->service, e->total, e->failed ? "failed" : "ok");
+    }
+    fprintf(out, "\n");
+    return ferror(out) ? -1 : 0;
+}
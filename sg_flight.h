@@ -0,0 +1,79 @@
+#ifndef SG_FLIGHT_INCLUDED
+#define SG_FLIGHT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_flight.h
+//  Description    : This is the declaration of the flight recorder of the
+//                   ScatterGather driver, an always-on ring of the last
+//                   SG_FLIGHT_ENTRIES driver calls.  The driver fills the
+//                   current entry in place as a call goes through its stages
+//                   and publishes it at the end, so recording is a handful
+//                   of stores per call.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+#include <sg_defs.h>
+
+//
+// Defines
+#define SG_FLIGHT_ENTRIES 4096 // calls kept (power of two)
+
+// Cache outcome of a call
+#define SG_FLIGHT_CACHE_NONE 0 // no cache lookup (or not a read)
+#define SG_FLIGHT_CACHE_HIT  1 // block found in the cache
+#define SG_FLIGHT_CACHE_MISS 2 // block fetched from the service
+#define SG_FLIGHT_CACHE_HOLE 3 // block is a hole, nothing to look up
+
+// Type definitions
+typedef struct {
+    uint64_t    seq;      // call number
+    uint64_t    start;    // time the call was made (ns, monotonic)
+    uint64_t    lockWait; // time waiting for the driver lock (ns)
+    uint64_t    service;  // time in service posts (ns)
+    uint64_t    total;    // latency of the call (ns)
+    uint64_t    offset;   // file offset
+    SG_Node_ID  node;     // node of the block
+    SG_Block_ID block;    // block
+    uint32_t    length;   // bytes read or written
+    int32_t     fh;       // file handle
+    SG_SeqNum   sendSeq;  // sender sequence number (last post)
+    SG_SeqNum   recvSeq;  // receiver sequence number (last post)
+    uint8_t     call;     // the driver call (SG_Driver_Call)
+    uint8_t     cache;    // the cache outcome (SG_FLIGHT_CACHE_*)
+    uint8_t     posts;    // packets posted
+    uint8_t     failed;   // the call failed
+} SG_Flight_Entry;
+
+//
+// Global data
+extern SG_Flight_Entry sgFlightRing[SG_FLIGHT_ENTRIES]; // the recorded calls
+extern uint64_t sgFlightHead; // calls recorded so far
+extern const char *sgFlightCalls[]; // names of the driver calls
+
+//
+// Flight recorder functions
+
+int writeSGFlight( FILE *out, const char *reason );
+    // Write the recorded calls, oldest first
+
+// Start the entry of the next call, in place in the ring
+static inline SG_Flight_Entry * beginSGFlight( void ) {
+    SG_Flight_Entry *entry = &sgFlightRing[sgFlightHead & (SG_FLIGHT_ENTRIES - 1)];
+
+    memset(entry, 0, sizeof(SG_Flight_Entry));
+    entry->seq = sgFlightHead;
+    return entry;
+}
+
+// Publish the entry started by beginSGFlight
+static inline void commitSGFlight( void ) {
+    __atomic_store_n(&sgFlightHead, sgFlightHead + 1, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_histogram.c
+//  Description    : This file contains the latency histogram used by the
+//                   simulator and benchmarks.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <string.h>
+#include <time.h>
+
+// Project Includes
+#include <sg_histogram.h>
+
+// Functional Prototypes
+int getSGHistogramBucket( uint64_t value );
+uint64_t getSGHistogramBucketTop( int bucket );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initSGHistogram
+// Description  : Initialize an empty histogram
+//
+// Inputs       : hist - the histogram
+// Outputs      : none
+
+void initSGHistogram( SG_Histogram *hist ) {
+    memset(hist, 0, sizeof(SG_Histogram));
+    hist->min = UINT64_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : recordSGHistogram
+// Description  : Record a value in the histogram
+//
+// Inputs       : hist - the histogram
+//                value - the value to record (e.g., a latency in ns)
+// Outputs      : none
+
+void recordSGHistogram( SG_Histogram *hist, uint64_t value ) {
+    hist->counts[getSGHistogramBucket(value)]++;
+    hist->count++;
+    hist->total += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mergeSGHistogram
+// Description  : Add the values recorded in another histogram
+//
+// Inputs       : hist - the histogram to add to
+//                other - the histogram to add
+// Outputs      : none
+
+void mergeSGHistogram( SG_Histogram *hist, SG_Histogram *other ) {
+    for (int i = 0; i < SG_HISTOGRAM_BUCKETS; i++) {
+        hist->counts[i] += other->counts[i];
+    }
+    hist->count += other->count;
+    hist->total += other->total;
+    if (other->min < hist->min) {
+        hist->min = other->min;
+    }
+    if (other->max > hist->max) {
+        hist->max = other->max;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGHistogramPercentile
+// Description  : Get the value at a percentile of the recorded values, this
+//                is the top of the bucket holding it (never above the max)
+//
+// Inputs       : hist - the histogram
+//                pct - the percentile, 0 to 100
+// Outputs      : the value at the percentile, 0 if the histogram is empty
+
+uint64_t getSGHistogramPercentile( SG_Histogram *hist, double pct ) {
+    uint64_t rank, seen = 0, top;
+    int i;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    // the rank of the value wanted, counting from 1
+    rank = (uint64_t) (pct / 100.0 * hist->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > hist->count) {
+        rank = hist->count;
+    }
+    for (i = 0; i < SG_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            top = getSGHistogramBucketTop(i);
+            return (top > hist->max) ? hist->max : top;
+        }
+    }
+    return hist->max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGHistogramCountBelow
+// Description  : Get the number of recorded values at or below a value,
+//                counting the buckets whose top is at or below it (so values
+//                in the bucket straddling it are left out)
+//
+// Inputs       : hist - the histogram
+//                value - the value
+// Outputs      : the number of values
+
+uint64_t getSGHistogramCountBelow( SG_Histogram *hist, uint64_t value ) {
+    uint64_t seen = 0;
+    int i;
+
+    if (value >= hist->max) {
+        return hist->count;
+    }
+    for (i = 0; (i < SG_HISTOGRAM_BUCKETS) && (getSGHistogramBucketTop(i) <= value); i++) {
+        seen += hist->counts[i];
+    }
+    return seen;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGTimeNS
+// Description  : Get a monotonic timestamp in nanoseconds
+//
+// Inputs       : none
+// Outputs      : the timestamp
+
+uint64_t getSGTimeNS( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGHistogramBucket
+// Description  : Find the bucket of a value, small values have a bucket each
+//                and larger ones SG_HISTOGRAM_SUB buckets per power of two
+//
+// Inputs       : value - the value
+// Outputs      : the bucket index
+
+int getSGHistogramBucket( uint64_t value ) {
+    int exp;
+
+    if (value < SG_HISTOGRAM_SUB) {
+        return (int) value;
+    }
+    exp = 63 - __builtin_clzll(value);
+    return (exp - SG_HISTOGRAM_SUB_BITS + 1) * SG_HISTOGRAM_SUB +
+           (int) ((value >> (exp - SG_HISTOGRAM_SUB_BITS)) & (SG_HISTOGRAM_SUB - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getSGHistogramBucketTop
+// Description  : Get the largest value that falls in a bucket
+//
+// Inputs       : bucket - the bucket index
+// Outputs      : the largest value of the bucket
+
+uint64_t getSGHistogramBucketTop( int bucket ) {
+    int exp, sub;
+
+    if (bucket < SG_HISTOGRAM_SUB) {
+        return (uint64_t) bucket;
+    }
+    exp = bucket / SG_HISTOGRAM_SUB + SG_HISTOGRAM_SUB_BITS - 1;
+    sub = bucket % SG_HISTOGRAM_SUB;
+    if (exp == 63 && sub == SG_HISTOGRAM_SUB - 1) {
+        return UINT64_MAX;
+    }
+    return ((uint64_t) (SG_HISTOGRAM_SUB + sub + 1) << (exp - SG_HISTOGRAM_SUB_BITS)) - 1;
+}
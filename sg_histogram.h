@@ -0,0 +1,56 @@
+#ifndef SG_HISTOGRAM_INCLUDED
+#define SG_HISTOGRAM_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_histogram.h
+//  Description    : This is the declaration of the latency histogram used by
+//                   the simulator and benchmarks.  Values are bucketed
+//                   log-linearly (16 buckets per power of two), so any
+//                   percentile is reported within about 6% of the true value
+//                   over the full 64-bit range, in constant space.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+
+//
+// Defines
+#define SG_HISTOGRAM_SUB_BITS 4                            // log2(buckets per power of two)
+#define SG_HISTOGRAM_SUB (1 << SG_HISTOGRAM_SUB_BITS)
+#define SG_HISTOGRAM_BUCKETS ((64 - SG_HISTOGRAM_SUB_BITS + 1) * SG_HISTOGRAM_SUB)
+
+// Type definitions
+typedef struct {
+    uint64_t counts[SG_HISTOGRAM_BUCKETS]; // values per bucket
+    uint64_t count;                        // number of values recorded
+    uint64_t total;                        // sum of the values recorded
+    uint64_t min;                          // smallest value recorded
+    uint64_t max;                          // largest value recorded
+} SG_Histogram;
+
+//
+// Histogram functions
+
+void initSGHistogram( SG_Histogram *hist );
+    // Initialize an empty histogram
+
+void recordSGHistogram( SG_Histogram *hist, uint64_t value );
+    // Record a value in the histogram
+
+void mergeSGHistogram( SG_Histogram *hist, SG_Histogram *other );
+    // Add the values recorded in another histogram
+
+uint64_t getSGHistogramPercentile( SG_Histogram *hist, double pct );
+    // Get the value at a percentile (0-100) of the recorded values
+
+uint64_t getSGHistogramCountBelow( SG_Histogram *hist, uint64_t value );
+    // Get the number of recorded values at or below a value
+
+uint64_t getSGTimeNS( void );
+    // Get a monotonic timestamp in nanoseconds
+
+#endif
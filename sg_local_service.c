@@ -0,0 +1,344 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_local_service.c
+//  Description    : This file contains a local (in-process) stand-in for the
+//                   ScatterGather service.  It keeps the remote blocks in
+//                   memory and understands the protocol extensions the
+//                   reference service does not (e.g., SG_UPDATE_RANGE).
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <string.h>
+#include <stdlib.h>
+
+// Project Includes
+#include <sg_driver.h>
+#include <sg_service.h>
+#include <sg_block.h>
+
+// Defines
+#define SG_LOCAL_SERVICE_NODES 8        // number of remote nodes simulated
+#define SG_LOCAL_SERVICE_BUCKETS (1 << 20) // number of block store hash buckets
+#define SG_LOCAL_SERVICE_FEATURES (SG_FEATURE_RANGE_UPDATE | SG_FEATURE_COMPRESSION | SG_FEATURE_BLOCK_SIZE)
+
+// Type definitions
+typedef struct SG_Local_Block_t {
+    SG_Node_ID nodeID;                  // node the block lives on
+    SG_Block_ID blockID;                // the block identifier
+    struct SG_Local_Block_t * next;     // next block in the hash bucket
+    char data[];                        // the block contents (block size bytes)
+} SG_Local_Block;
+
+typedef struct {
+    SG_Node_ID nodeID;                  // the remote node identifier
+    SG_SeqNum seqNum;                   // the last sequence number used by node
+} SG_Local_Node;
+
+// Global Data
+int sgLocalServiceInitialized = 0;     // The flag indicating the service is initialized
+SG_Node_ID sgLocalServiceClient;        // The node ID assigned to the client endpoint
+SG_SeqNum sgLocalServiceSeqno;          // The next expected client sequence number
+uint32_t sgLocalServiceFeatures = 0;    // The protocol extensions granted to the client
+size_t sgLocalServiceBlockSize = SG_BLOCK_SIZE; // The block size agreed with the client
+SG_Local_Node sgLocalNodes[SG_LOCAL_SERVICE_NODES];
+SG_Local_Block * sgLocalBlocks[SG_LOCAL_SERVICE_BUCKETS];
+int sgLocalNextNode = 0;                // round robin placement of new blocks
+int sgLocalServiceKeep = 0;             // keep the nodes and blocks across endpoint restarts
+uint64_t sgLocalRandom = 0x9e3779b97f4a7c15ULL;
+SG_Codec sgLocalServiceCodec = { SG_BLOCK_SIZE }; // The packet format of the service end
+
+// Functions
+uint64_t localServiceID(void);
+
+SG_Local_Block * localServiceFind(SG_Node_ID nde, SG_Block_ID blk);
+
+SG_Local_Node * localServiceNode(SG_Node_ID nde);
+
+void localServiceFree(void);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLocalServicePost
+// Description  : Post a packet to the local (in-process) stand-in service
+//
+// Inputs       : packet - the request packet
+//                len - the length of the request packet
+//                rpacket - the buffer to place the response packet
+//                rlen - the size of the response buffer (in), response length (out)
+// Outputs      : 0 if successful, -1 if failure
+
+int sgLocalServicePost(char *packet, size_t *len, char *rpacket, size_t *rlen) {
+    // Local variables
+    SG_Packet_Buffer header;
+    SG_Node_ID loc, rem;
+    SG_Block_ID blk;
+    SG_System_OP op;
+    SG_SeqNum sseq, rseq;
+    SG_Packet_Status status;
+    char data[SG_MAX_BLOCK_SIZE];
+    uint16_t off = 0, rlength = 0;
+    SG_Local_Block * block = NULL;
+    SG_Local_Node * node = NULL;
+    char * rdata = NULL;
+    size_t need;
+
+    if (packet == NULL || *len < sizeof(SG_Packet_Buffer)) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: short or missing packet.");
+        return -1;
+    }
+    // an endpoint initializing talks in plain blocks of the base size until the extensions are agreed
+    memcpy(&header, packet, sizeof(SG_Packet_Buffer));
+    if (header.operation == SG_INIT_ENDPOINT) {
+        sgLocalServiceBlockSize = SG_BLOCK_SIZE;
+        sgLocalServiceCodec.blockSize = SG_BLOCK_SIZE;
+        sgLocalServiceCodec.compress = 0;
+    }
+    // unpack the request, based on what follows the header
+    memset(data, 0, sgLocalServiceBlockSize);
+    if (header.indicator == SG_DATA_RANGE) {
+        status = deserialize_sg_range_packet(&sgLocalServiceCodec, &loc, &rem, &blk, &op, &sseq, &rseq, &off, &rlength, data, packet, *len);
+    } else {
+        status = deserialize_sg_compressed_packet(&sgLocalServiceCodec, &loc, &rem, &blk, &op, &sseq, &rseq, data, packet, *len);
+    }
+    if (status != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: bad request packet [%d].", status);
+        return -1;
+    }
+
+    // check the sender sequence number (initialization resets it)
+    if (op == SG_INIT_ENDPOINT) {
+        sgLocalServiceSeqno = sseq;
+    } else if (!sgLocalServiceInitialized || loc != sgLocalServiceClient) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: request from unknown endpoint [%lu].", loc);
+        return -1;
+    } else if (sseq != sgLocalServiceSeqno) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: out of sequence request, loc seq=%d, expected=%d", sseq, sgLocalServiceSeqno);
+        return -1;
+    }
+    sgLocalServiceSeqno = SG_NEXT_SEQNO(sseq);
+
+    // locate the remote node and block for the block operations
+    if (op == SG_UPDATE_BLOCK || op == SG_OBTAIN_BLOCK || op == SG_DELETE_BLOCK || op == SG_UPDATE_RANGE) {
+        if ((node = localServiceNode(rem)) == NULL || (block = localServiceFind(rem, blk)) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: unknown block [%lu] on node [%lu].", blk, rem);
+            return -1;
+        }
+        if (rseq != SG_NEXT_SEQNO(node->seqNum)) {
+            logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: out of sequence request, rem seq=%d, expected=%d", rseq, SG_NEXT_SEQNO(node->seqNum));
+            return -1;
+        }
+        node->seqNum = rseq;
+    }
+
+    // perform the operation
+    switch (op) {
+        case (SG_INIT_ENDPOINT):
+            // grant any requested extensions we support (a kept store keeps its nodes)
+            if (!sgLocalServiceKeep || (sgLocalNodes[0].nodeID == 0)) {
+                localServiceFree();
+                for (int i = 0; i < SG_LOCAL_SERVICE_NODES; i++) {
+                    sgLocalNodes[i].nodeID = localServiceID();
+                    sgLocalNodes[i].seqNum = SG_INITIAL_SEQNO;
+                }
+            }
+            sgLocalServiceClient = localServiceID();
+            sgLocalServiceInitialized = 1;
+            sgLocalServiceFeatures = 0;
+            loc = sgLocalServiceClient;
+            if (header.indicator & SG_DATA_BLOCK) {
+                SG_Endpoint_Caps caps;
+                memcpy(&caps, data, sizeof(SG_Endpoint_Caps));
+                if (caps.magic == SG_MAGIC_VALUE) {
+                    caps.features &= SG_LOCAL_SERVICE_FEATURES;
+                    if ((caps.features & SG_FEATURE_BLOCK_SIZE) && sgValidBlockSize(caps.blockSize)) {
+                        sgLocalServiceBlockSize = caps.blockSize;
+                    } else {
+                        caps.features &= ~SG_FEATURE_BLOCK_SIZE;
+                        caps.blockSize = SG_BLOCK_SIZE;
+                    }
+                    sgLocalServiceFeatures = caps.features;
+                    memset(data, 0, sgLocalServiceBlockSize);
+                    memcpy(data, &caps, sizeof(SG_Endpoint_Caps));
+                    rdata = data;
+                }
+            }
+            logMessage(SGServiceLevel, "sgLocalServicePost: Assigned new node ID [%lu] to local node.", loc);
+            break;
+
+        case (SG_STOP_ENDPOINT):
+            if (!sgLocalServiceKeep) {
+                localServiceFree();
+            }
+            closeSGCodec(&sgLocalServiceCodec);
+            sgLocalServiceInitialized = 0;
+            break;
+
+        case (SG_CREATE_BLOCK):
+            // place the block on the next node, round robin
+            if (!(header.indicator & SG_DATA_BLOCK)) {
+                logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: create block without data.");
+                return -1;
+            }
+            if ((block = (SG_Local_Block *) malloc(sizeof(SG_Local_Block) + sgLocalServiceBlockSize)) == NULL) {
+                logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: out of memory for a new block.");
+                return -1;
+            }
+            node = &sgLocalNodes[sgLocalNextNode];
+            sgLocalNextNode = (sgLocalNextNode + 1) % SG_LOCAL_SERVICE_NODES;
+            block->nodeID = node->nodeID;
+            block->blockID = localServiceID();
+            sgCopyBlock(block->data, data, sgLocalServiceBlockSize);
+            block->next = sgLocalBlocks[block->blockID % SG_LOCAL_SERVICE_BUCKETS];
+            sgLocalBlocks[block->blockID % SG_LOCAL_SERVICE_BUCKETS] = block;
+            node->seqNum = SG_NEXT_SEQNO(node->seqNum);
+            rem = node->nodeID;
+            blk = block->blockID;
+            break;
+
+        case (SG_UPDATE_BLOCK):
+            if (!(header.indicator & SG_DATA_BLOCK)) {
+                logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: update block without data.");
+                return -1;
+            }
+            sgCopyBlock(block->data, data, sgLocalServiceBlockSize);
+            break;
+
+        case (SG_UPDATE_RANGE):
+            if (header.indicator != SG_DATA_RANGE) {
+                logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: update range without range data.");
+                return -1;
+            }
+            memcpy(block->data + off, data, rlength);
+            break;
+
+        case (SG_OBTAIN_BLOCK):
+            rdata = block->data;
+            break;
+
+        case (SG_DELETE_BLOCK): {
+            SG_Local_Block ** link = &sgLocalBlocks[blk % SG_LOCAL_SERVICE_BUCKETS];
+            while (*link != block) {
+                link = &(*link)->next;
+            }
+            *link = block->next;
+            free(block);
+            break;
+        }
+
+        default:
+            logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: bad operation [%d].", op);
+            return -1;
+    }
+
+    // create the response packet
+    need = (rdata) ? SG_BLOCK_PACKET_SIZE(sgLocalServiceCodec.blockSize) : SG_BASE_PACKET_SIZE;
+    if (rpacket == NULL || *rlen < need) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: response buffer too small [%lu < %lu].", *rlen, need);
+        return -1;
+    }
+    status = serialize_sg_compressed_packet(&sgLocalServiceCodec, loc, rem, blk, op, sseq,
+                                            (node) ? node->seqNum : SG_SEQNO_UNKNOWN, rdata, rpacket, rlen);
+    if (status != SG_PACKT_OK) {
+        logMessage(LOG_ERROR_LEVEL, "sgLocalServicePost: failed serialization of response [%d].", status);
+        return -1;
+    }
+
+    // later packets use the agreed block size, compressed if agreed
+    if (op == SG_INIT_ENDPOINT) {
+        sgLocalServiceCodec.blockSize = sgLocalServiceBlockSize;
+        sgLocalServiceCodec.compress = (sgLocalServiceFeatures & SG_FEATURE_COMPRESSION) != 0;
+    }
+
+    // Return successfully
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLocalServiceKeepBlocks
+// Description  : Keep the remote nodes (and their sequence numbers) and blocks
+//                when the endpoint stops and initializes again, as a real
+//                service does, so that a driver restarting from its metadata
+//                checkpoint finds its blocks
+//
+// Inputs       : keep - keep the blocks (otherwise each initialization starts empty)
+// Outputs      : none
+
+void sgLocalServiceKeepBlocks(int keep) {
+    sgLocalServiceKeep = keep;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : localServiceID
+// Description  : Generate a new (non-zero, non-unknown) node or block identifier
+//
+// Inputs       : none
+// Outputs      : the new identifier
+
+uint64_t localServiceID(void) {
+    uint64_t id;
+    do {
+        // xorshift64, deterministic across runs
+        sgLocalRandom ^= sgLocalRandom << 13;
+        sgLocalRandom ^= sgLocalRandom >> 7;
+        sgLocalRandom ^= sgLocalRandom << 17;
+        id = sgLocalRandom >> 1;
+    } while (id == 0 || id == SG_NODE_UNKNOWN);
+    return id;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : localServiceFind
+// Description  : Find a block in the local block store
+//
+// Inputs       : nde - node ID of the block
+//                blk - block ID of the block
+// Outputs      : pointer to the block, NULL if not found
+
+SG_Local_Block * localServiceFind(SG_Node_ID nde, SG_Block_ID blk) {
+    SG_Local_Block * block = sgLocalBlocks[blk % SG_LOCAL_SERVICE_BUCKETS];
+    while (block && (block->blockID != blk || block->nodeID != nde)) {
+        block = block->next;
+    }
+    return block;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : localServiceNode
+// Description  : Find a remote node of the local service
+//
+// Inputs       : nde - node ID to find
+// Outputs      : pointer to the node, NULL if not found
+
+SG_Local_Node * localServiceNode(SG_Node_ID nde) {
+    for (int i = 0; i < SG_LOCAL_SERVICE_NODES; i++) {
+        if (sgLocalNodes[i].nodeID == nde) {
+            return &sgLocalNodes[i];
+        }
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : localServiceFree
+// Description  : Release all blocks held by the local service
+//
+// Inputs       : none
+// Outputs      : none
+
+void localServiceFree(void) {
+    for (int i = 0; i < SG_LOCAL_SERVICE_BUCKETS; i++) {
+        while (sgLocalBlocks[i]) {
+            SG_Local_Block * block = sgLocalBlocks[i];
+            sgLocalBlocks[i] = block->next;
+            free(block);
+        }
+    }
+}
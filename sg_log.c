@@ -0,0 +1,596 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_log.c
+//  Description    : This file contains the low overhead logging used on the
+//                   ScatterGather hot paths.  In asynchronous mode a message
+//                   is not formatted by the caller: the format pointer and
+//                   the raw arguments (strings copied) are packed into a
+//                   record in the calling thread's ring, and a background
+//                   thread formats the records and writes them to the log.
+//                   The thread waits while the rings are quiet and is woken
+//                   when one fills past its high-water mark.  A full ring
+//                   drops the record rather than block, and the drops are
+//                   counted (sgLogDropped).
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <time.h>
+
+// Project Includes
+#include <sg_log.h>
+
+//
+// Type definitions
+
+// A thread's ring of records (single producer, the logger thread consumes)
+typedef struct SG_Log_Ring {
+    _Atomic uint64_t    head;                   // bytes written by the owning thread
+    _Atomic uint64_t    tail;                   // bytes consumed by the logger thread
+    _Atomic uint64_t    dropped;                // records dropped on a full ring
+    struct SG_Log_Ring *next;                   // next registered ring
+    char                data[SG_LOG_RING_SIZE]; // the records
+} SG_Log_Ring;
+
+// A record header, followed by the arguments in 8 byte slots
+typedef struct {
+    uint32_t      size;  // bytes in the record (8 byte multiple)
+    uint32_t      specs; // conversions whose arguments were packed
+    unsigned long lvl;   // the log level
+    const char   *fmt;   // the format (NULL for ring wrap filler)
+} SG_Log_Record;
+
+// A parsed conversion specification of a format
+typedef struct {
+    const char *start;    // the '%'
+    const char *end;      // one past the conversion character
+    int         flagsLen; // bytes of flags after the '%'
+    const char *width;    // literal width, NULL if none or '*'
+    int         widthLen; // bytes of the literal width
+    int         widthArg; // width is an argument ('*')
+    const char *prec;     // literal precision digits, NULL if none or '*'
+    int         precLen;  // bytes of the literal precision
+    int         precArg;  // precision is an argument ('.*')
+    int         hasPrec;  // a precision was given
+    char        length[3];// the length modifier
+    char        conv;     // the conversion character
+} SG_Log_Spec;
+
+//
+// Global data
+
+_Atomic unsigned sgLogAsync = 0; // generation of the async logger, 0 if synchronous
+unsigned sgLogGeneration = 0; // last generation started
+_Atomic int sgLogRunning = 0; // logger thread keeps draining
+pthread_t sgLogThread; // the logger thread
+SG_Log_Ring *sgLogRings = NULL; // rings of the threads that logged
+pthread_mutex_t sgLogRingsLock = PTHREAD_MUTEX_INITIALIZER; // protects the ring list
+uint64_t sgLogDroppedTotal = 0; // records dropped by the rings already released
+pthread_mutex_t sgLogWakeLock = PTHREAD_MUTEX_INITIALIZER; // protects the wakeup count
+pthread_cond_t sgLogWakeCond = PTHREAD_COND_INITIALIZER; // signalled on a wakeup
+uint64_t sgLogWakeups = 0; // wakeups asked of the logger thread
+__thread SG_Log_Ring *sgLogLocal = NULL; // this thread's ring
+__thread unsigned sgLogLocalGen = 0; // generation this thread's ring belongs to
+
+//
+// Functional Prototypes
+
+int sgLogQueue( unsigned gen, unsigned long lvl, const char *fmt, va_list args );
+uint32_t sgLogPack( char *rec, unsigned long lvl, const char *fmt, va_list args );
+int sgLogFormat( const char *rec, char *out, size_t size );
+const char * sgLogNextSpec( const char *p, SG_Log_Spec *spec );
+void sgLogWake( void );
+void * sgLogWorker( void *arg );
+int sgLogDrain( void );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogMessage
+// Description  : Log a "printf"-style message, directly if the logger is
+//                synchronous or as a record in the thread's ring if it is
+//                asynchronous
+//
+// Inputs       : lvl - the log level
+//                fmt - the format (must outlive the logger, e.g. a literal)
+// Outputs      : 0 if successful, -1 if failure (or dropped)
+
+int sgLogMessage( unsigned long lvl, const char *fmt, ... ) {
+    unsigned gen = atomic_load_explicit(&sgLogAsync, memory_order_acquire);
+    va_list args;
+    int ret;
+
+    va_start(args, fmt);
+    ret = gen ? sgLogQueue(gen, lvl, fmt, args) : vlogMessage(lvl, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogAsyncStart
+// Description  : Start the asynchronous logger.  From now on SG_LOG messages
+//                are formatted on the logger thread; logMessage calls (the
+//                errors) stay synchronous and may overtake queued records.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgLogAsyncStart( void ) {
+    if (atomic_load(&sgLogAsync)) {
+        return 0;
+    }
+    atomic_store(&sgLogRunning, 1);
+    if (pthread_create(&sgLogThread, NULL, sgLogWorker, NULL)) {
+        logMessage(LOG_ERROR_LEVEL, "sgLogAsyncStart: failed to start the logger thread");
+        return -1;
+    }
+    atomic_store_explicit(&sgLogAsync, ++sgLogGeneration, memory_order_release);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogAsyncStop
+// Description  : Stop the asynchronous logger, writing out the queued
+//                records.  No other thread may be logging at this point.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int sgLogAsyncStop( void ) {
+    SG_Log_Ring *ring;
+    uint64_t dropped = 0;
+
+    if (atomic_load(&sgLogAsync) == 0) {
+        return 0;
+    }
+    atomic_store(&sgLogAsync, 0);
+    atomic_store(&sgLogRunning, 0);
+    sgLogWake();
+    pthread_join(sgLogThread, NULL);
+
+    // release the rings, the threads register new ones on the next start
+    pthread_mutex_lock(&sgLogRingsLock);
+    while ((ring = sgLogRings) != NULL) {
+        sgLogRings = ring->next;
+        dropped += atomic_load(&ring->dropped);
+        free(ring);
+    }
+    sgLogDroppedTotal += dropped;
+    pthread_mutex_unlock(&sgLogRingsLock);
+    if (dropped) {
+        logMessage(LOG_WARNING_LEVEL, "sgLogAsyncStop: %lu log records dropped (ring full)", dropped);
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogQueue
+// Description  : Pack a message into the calling thread's ring
+//
+// Inputs       : gen - the logger generation
+//                lvl - the log level
+//                fmt - the format
+//                args - the arguments
+// Outputs      : 0 if successful, -1 if dropped
+
+int sgLogQueue( unsigned gen, unsigned long lvl, const char *fmt, va_list args ) {
+    _Alignas(8) char rec[SG_LOG_MAX_RECORD];
+    SG_Log_Record *filler;
+    SG_Log_Ring *ring;
+    uint64_t head, tail, off, skip;
+    uint32_t size;
+
+    // first message of this thread (this generation), register a ring
+    if (sgLogLocalGen != gen) {
+        if ((ring = calloc(1, sizeof(SG_Log_Ring))) == NULL) {
+            return vlogMessage(lvl, fmt, args);
+        }
+        pthread_mutex_lock(&sgLogRingsLock);
+        ring->next = sgLogRings;
+        sgLogRings = ring;
+        pthread_mutex_unlock(&sgLogRingsLock);
+        sgLogLocal = ring;
+        sgLogLocalGen = gen;
+    }
+    ring = sgLogLocal;
+
+    // records are contiguous, skip the end of the ring if this one would wrap
+    size = sgLogPack(rec, lvl, fmt, args);
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    off = head & (SG_LOG_RING_SIZE - 1);
+    skip = (off + size > SG_LOG_RING_SIZE) ? SG_LOG_RING_SIZE - off : 0;
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head + skip + size - tail > SG_LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        sgLogWake();
+        return -1;
+    }
+    if (skip >= sizeof(SG_Log_Record)) {
+        filler = (SG_Log_Record *) &ring->data[off];
+        filler->size = skip;
+        filler->fmt = NULL;
+    }
+    memcpy(&ring->data[(head + skip) & (SG_LOG_RING_SIZE - 1)], rec, size);
+    atomic_store_explicit(&ring->head, head + skip + size, memory_order_release);
+
+    // wake the logger thread as the ring passes its high-water mark
+    if ((head - tail < SG_LOG_HIGH_WATER) && (head + skip + size - tail >= SG_LOG_HIGH_WATER)) {
+        sgLogWake();
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogPack
+// Description  : Pack a message into a record, one 8 byte slot per argument
+//                (strings as a length slot and the bytes, padded to 8)
+//
+// Inputs       : rec - the record buffer (SG_LOG_MAX_RECORD bytes, aligned)
+//                lvl - the log level
+//                fmt - the format
+//                args - the arguments
+// Outputs      : the size of the record
+
+uint32_t sgLogPack( char *rec, unsigned long lvl, const char *fmt, va_list args ) {
+    SG_Log_Record *hdr = (SG_Log_Record *) rec;
+    size_t used = sizeof(SG_Log_Record), len, room;
+    SG_Log_Spec spec;
+    const char *p = fmt, *str;
+    int64_t *slot;
+    int prec;
+
+    hdr->lvl = lvl;
+    hdr->fmt = fmt;
+    hdr->specs = 0;
+    while ((p = sgLogNextSpec(p, &spec)) != NULL) {
+        // room for the star arguments and the value (strings are truncated)
+        if (used + 3 * sizeof(int64_t) > SG_LOG_MAX_RECORD) {
+            break;
+        }
+        if (spec.widthArg) {
+            *(int64_t *) (rec + used) = va_arg(args, int);
+            used += sizeof(int64_t);
+        }
+        prec = (spec.hasPrec && !spec.precArg) ? atoi(spec.prec) : -1;
+        if (spec.precArg) {
+            *(int64_t *) (rec + used) = prec = va_arg(args, int);
+            used += sizeof(int64_t);
+        }
+        slot = (int64_t *) (rec + used);
+        used += sizeof(int64_t);
+        switch (spec.conv) {
+            case 'd': case 'i':
+                if (!strcmp(spec.length, "hh")) *slot = (signed char) va_arg(args, int);
+                else if (!strcmp(spec.length, "h")) *slot = (short) va_arg(args, int);
+                else if (!strcmp(spec.length, "l")) *slot = va_arg(args, long);
+                else if (!strcmp(spec.length, "ll") || !strcmp(spec.length, "q")) *slot = va_arg(args, long long);
+                else if (!strcmp(spec.length, "j")) *slot = va_arg(args, intmax_t);
+                else if (!strcmp(spec.length, "z")) *slot = va_arg(args, ssize_t);
+                else if (!strcmp(spec.length, "t")) *slot = va_arg(args, ptrdiff_t);
+                else *slot = va_arg(args, int);
+                break;
+
+            case 'u': case 'o': case 'x': case 'X':
+                if (!strcmp(spec.length, "hh")) *slot = (unsigned char) va_arg(args, unsigned);
+                else if (!strcmp(spec.length, "h")) *slot = (unsigned short) va_arg(args, unsigned);
+                else if (!strcmp(spec.length, "l")) *slot = va_arg(args, unsigned long);
+                else if (!strcmp(spec.length, "ll") || !strcmp(spec.length, "q")) *slot = va_arg(args, unsigned long long);
+                else if (!strcmp(spec.length, "j")) *slot = va_arg(args, uintmax_t);
+                else if (!strcmp(spec.length, "z")) *slot = va_arg(args, size_t);
+                else if (!strcmp(spec.length, "t")) *slot = va_arg(args, ptrdiff_t);
+                else *slot = va_arg(args, unsigned);
+                break;
+
+            case 'c':
+                *slot = va_arg(args, int);
+                break;
+
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                *(double *) slot = !strcmp(spec.length, "L") ? (double) va_arg(args, long double) : va_arg(args, double);
+                break;
+
+            case 'p':
+                *(void **) slot = va_arg(args, void *);
+                break;
+
+            case 's':
+                // copy the string now, it may change before it is formatted
+                if ((str = va_arg(args, const char *)) == NULL) {
+                    str = "(null)";
+                }
+                room = (used + 1 + 8 * sizeof(int64_t) < SG_LOG_MAX_RECORD) ?
+                       SG_LOG_MAX_RECORD - used - 1 - 8 * sizeof(int64_t) : 0;
+                len = strnlen(str, ((prec >= 0) && ((size_t) prec < room)) ? (size_t) prec : room);
+                *slot = len;
+                memcpy(rec + used, str, len);
+                rec[used + len] = 0;
+                used += (len + 1 + 7) & ~7UL;
+                break;
+        }
+        hdr->specs++;
+    }
+    hdr->size = used;
+    return used;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogFormat
+// Description  : Format a packed record
+//
+// Inputs       : rec - the record
+//                out - the buffer for the message
+//                size - the size of the buffer
+// Outputs      : 0 if successful, -1 if failure
+
+int sgLogFormat( const char *rec, char *out, size_t size ) {
+    const SG_Log_Record *hdr = (const SG_Log_Record *) rec;
+    size_t used = sizeof(SG_Log_Record), n = 0;
+    const char *p = hdr->fmt, *next;
+    char spec[64], *s;
+    SG_Log_Spec cur;
+    uint32_t i = 0;
+    int64_t width = 0, prec = -1, slot;
+
+    out[0] = 0;
+    while (n < size - 1) {
+        // copy the text up to the next conversion ("%%" is text)
+        next = sgLogNextSpec(p, &cur);
+        for (; *p && (p != (next ? cur.start : NULL)) && (n < size - 1); p++) {
+            out[n++] = *p;
+            if ((p[0] == '%') && (p[1] == '%')) {
+                p++;
+            }
+        }
+        out[n] = 0;
+        if ((next == NULL) || (i++ == hdr->specs) || (n >= size - 1)) {
+            break;
+        }
+
+        // rebuild the conversion, star values inlined and integers widened
+        if (cur.widthArg) {
+            memcpy(&width, rec + used, sizeof(int64_t));
+            used += sizeof(int64_t);
+        }
+        if (cur.precArg) {
+            memcpy(&prec, rec + used, sizeof(int64_t));
+            used += sizeof(int64_t);
+        }
+        s = spec;
+        s += sprintf(s, "%%%.*s", (cur.flagsLen > 8) ? 8 : cur.flagsLen, cur.start + 1);
+        if (cur.widthArg) {
+            s += sprintf(s, "%ld", width);
+        } else if (cur.width != NULL) {
+            s += sprintf(s, "%.*s", (cur.widthLen > 20) ? 20 : cur.widthLen, cur.width);
+        }
+        if (cur.precArg && (prec >= 0)) {
+            s += sprintf(s, ".%ld", prec);
+        } else if (cur.hasPrec && !cur.precArg) {
+            s += sprintf(s, ".%.*s", (cur.precLen > 20) ? 20 : cur.precLen, cur.prec);
+        }
+        memcpy(&slot, rec + used, sizeof(int64_t));
+        used += sizeof(int64_t);
+        switch (cur.conv) {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+                sprintf(s, "ll%c", cur.conv);
+                snprintf(out + n, size - n, spec, slot);
+                break;
+
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                sprintf(s, "%c", cur.conv);
+                snprintf(out + n, size - n, spec, *(double *) (rec + used - sizeof(int64_t)));
+                break;
+
+            case 'c':
+                sprintf(s, "c");
+                snprintf(out + n, size - n, spec, (int) slot);
+                break;
+
+            case 'p':
+                sprintf(s, "p");
+                snprintf(out + n, size - n, spec, *(void **) (rec + used - sizeof(int64_t)));
+                break;
+
+            case 's':
+                sprintf(s, "s");
+                snprintf(out + n, size - n, spec, rec + used);
+                used += (slot + 1 + 7) & ~7UL;
+                break;
+        }
+        n += strlen(out + n);
+        p = cur.end;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogNextSpec
+// Description  : Find and parse the next conversion of a format.  Parsing
+//                stops at a conversion that cannot be packed (e.g. "%n").
+//
+// Inputs       : p - the format text to search
+//                spec - the parsed conversion
+// Outputs      : the text after the conversion, NULL if there is none
+
+const char * sgLogNextSpec( const char *p, SG_Log_Spec *spec ) {
+    const char *q;
+
+    for (; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        memset(spec, 0, sizeof(SG_Log_Spec));
+        spec->start = p;
+        q = p + 1;
+        spec->flagsLen = strspn(q, "-+ #0");
+        q += spec->flagsLen;
+        if (*q == '*') {
+            spec->widthArg = 1;
+            q++;
+        } else if ((spec->widthLen = strspn(q, "0123456789")) > 0) {
+            spec->width = q;
+            q += spec->widthLen;
+        }
+        if (*q == '.') {
+            spec->hasPrec = 1;
+            q++;
+            if (*q == '*') {
+                spec->precArg = 1;
+                q++;
+            } else {
+                spec->prec = q;
+                spec->precLen = strspn(q, "0123456789");
+                q += spec->precLen;
+            }
+        }
+        if (strspn(q, "hlLqjzt") > 2) {
+            return NULL;
+        }
+        memcpy(spec->length, q, strspn(q, "hlLqjzt"));
+        q += strlen(spec->length);
+        if ((*q == 0) || (strchr("diuoxXceEfFgGaAps", *q) == NULL)) {
+            return NULL;
+        }
+        spec->conv = *q;
+        spec->end = q + 1;
+        return spec->end;
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogDropped
+// Description  : Get the number of records dropped on a full ring since the
+//                program started
+//
+// Inputs       : none
+// Outputs      : the number of records dropped
+
+uint64_t sgLogDropped( void ) {
+    SG_Log_Ring *ring;
+    uint64_t dropped;
+
+    pthread_mutex_lock(&sgLogRingsLock);
+    dropped = sgLogDroppedTotal;
+    for (ring = sgLogRings; ring != NULL; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&sgLogRingsLock);
+    return dropped;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogWake
+// Description  : Wake the logger thread (a ring is filling, or stopping)
+//
+// Inputs       : none
+// Outputs      : none
+
+void sgLogWake( void ) {
+    pthread_mutex_lock(&sgLogWakeLock);
+    sgLogWakeups++;
+    pthread_cond_signal(&sgLogWakeCond);
+    pthread_mutex_unlock(&sgLogWakeLock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogWorker
+// Description  : The logger thread, drains the rings until stopped.  With
+//                nothing to write it waits SG_LOG_IDLE_NS, or until a ring
+//                passes its high-water mark.
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+void * sgLogWorker( void *arg ) {
+    struct timespec until;
+    uint64_t seen;
+
+    while (atomic_load(&sgLogRunning)) {
+        pthread_mutex_lock(&sgLogWakeLock);
+        seen = sgLogWakeups;
+        pthread_mutex_unlock(&sgLogWakeLock);
+        if (sgLogDrain() > 0) {
+            continue;
+        }
+
+        // a wakeup since the drain started means there is more to write
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += SG_LOG_IDLE_NS;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+        pthread_mutex_lock(&sgLogWakeLock);
+        if ((sgLogWakeups == seen) && atomic_load(&sgLogRunning)) {
+            pthread_cond_timedwait(&sgLogWakeCond, &sgLogWakeLock, &until);
+        }
+        pthread_mutex_unlock(&sgLogWakeLock);
+    }
+    sgLogDrain();
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgLogDrain
+// Description  : Format and write the records queued in all rings
+//
+// Inputs       : none
+// Outputs      : the number of records written
+
+int sgLogDrain( void ) {
+    char msg[MAX_LOG_MESSAGE_SIZE];
+    const SG_Log_Record *hdr;
+    SG_Log_Ring *ring;
+    uint64_t head, tail, off;
+    int count = 0;
+
+    // rings are only added at the front, and only freed once this thread is done
+    pthread_mutex_lock(&sgLogRingsLock);
+    ring = sgLogRings;
+    pthread_mutex_unlock(&sgLogRingsLock);
+    for (; ring != NULL; ring = ring->next) {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (tail < head) {
+            off = tail & (SG_LOG_RING_SIZE - 1);
+            if (SG_LOG_RING_SIZE - off < sizeof(SG_Log_Record)) {
+                tail += SG_LOG_RING_SIZE - off;
+                continue;
+            }
+            hdr = (const SG_Log_Record *) &ring->data[off];
+            if (hdr->fmt != NULL) {
+                sgLogFormat((const char *) hdr, msg, sizeof(msg));
+                logMessage(hdr->lvl, "%s", msg);
+                count++;
+            }
+            tail += hdr->size;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return count;
+}
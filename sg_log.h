@@ -0,0 +1,54 @@
+#ifndef SG_LOG_INCLUDED
+#define SG_LOG_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_log.h
+//  Description    : This is the declaration of the low overhead logging used
+//                   on the ScatterGather hot paths.  The macros test the log
+//                   level before any argument is evaluated, and the optional
+//                   asynchronous logger copies the arguments into a per
+//                   thread ring that a background thread formats and writes.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+#include <cmpsc311_log.h>
+
+//
+// Defines
+#define SG_LOG_RING_SIZE (4 * 1024 * 1024) // bytes in each thread's ring (power of two)
+#define SG_LOG_MAX_RECORD 2048         // largest record, longer strings are truncated
+#define SG_LOG_HIGH_WATER (SG_LOG_RING_SIZE / 4) // queued bytes at which a thread wakes the logger
+#define SG_LOG_IDLE_NS 10000000        // longest the logger thread waits with nothing queued
+
+// Log a message if its level is enabled, the arguments are only evaluated then
+#define SG_LOG(lvl, ...) \
+    do { if (levelEnabled(lvl)) sgLogMessage((lvl), __VA_ARGS__); } while (0)
+
+// Per-operation (trace) messages, compiled out with -DSG_LOG_NO_TRACE
+#ifdef SG_LOG_NO_TRACE
+#define SG_LOG_TRACE(lvl, ...) do { } while (0)
+#else
+#define SG_LOG_TRACE(lvl, ...) SG_LOG(lvl, __VA_ARGS__)
+#endif
+
+//
+// Logging functions
+
+int sgLogMessage( unsigned long lvl, const char *fmt, ... );
+    // Log a "printf"-style message, through the ring if the logger is async
+
+int sgLogAsyncStart( void );
+    // Start the asynchronous logger (background formatting thread)
+
+int sgLogAsyncStop( void );
+    // Stop the asynchronous logger, writing out the records still queued
+
+uint64_t sgLogDropped( void );
+    // Get the number of records dropped on a full ring since the program started
+
+#endif
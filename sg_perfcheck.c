@@ -0,0 +1,582 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_perfcheck.c
+//  Description    : This is the performance regression check of the
+//                   ScatterGather simulator (make perf).  It reads the csv
+//                   results of several runs of one workload (sg_sim -b csv),
+//                   takes the median of each measure over the runs and its
+//                   spread (range over median), and compares them with a
+//                   committed baseline.  The packet count and cache hit rate
+//                   are deterministic: they may not get worse at all, and
+//                   fail the check if they do.  The timing measures are noisy
+//                   on a shared host: they are flagged slower only when the
+//                   median moves by more than the tolerance plus the spread
+//                   of the baseline and current runs, and fail the check only
+//                   with -s.  With -w it writes the medians and spreads as
+//                   the new baseline instead.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+// Defines
+#define PERFCHECK_ARGUMENTS "ht:l:sw"
+#define PC_MAX_COLUMNS 32 // columns of a results file
+#define PC_MAX_RUNS 32 // runs combined at most
+#define PC_MAX_ROWS 16 // operation rows of a results file (all streams)
+#define PC_MAX_FIELD 256 // length of a field
+#define PC_MAX_LINE (PC_MAX_COLUMNS * PC_MAX_FIELD)
+#define USAGE \
+	"USAGE: sg_perfcheck [-h] [-t <percent>] [-l <percent>] [-s] [-w] <baseline> <results> ...\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -t - throughput and counter tolerance in percent (default %d)\n" \
+	"    -l - p99 latency tolerance in percent (default %d)\n" \
+	"    -s - strict, timing measures slower than the noise allows fail too\n" \
+	"    -w - write the medians of the results as the baseline, do not check\n" \
+	"and\n" \
+	"    baseline - is the baseline file (sg_sim -b csv, or written by -w)\n" \
+	"    results - are the results of runs of the same workload (sg_sim -b csv)\n" \
+	"\n" \
+
+#define PC_DEFAULT_TOLERANCE 15 // throughput and counters (percent)
+#define PC_DEFAULT_LATENCY 25 // p99 latency (percent)
+
+// How a measure is allowed to move
+typedef enum {
+	PC_THROUGHPUT = 0, // within the throughput tolerance and the spread of the runs
+	PC_LATENCY    = 1, // within the latency tolerance and the spread of the runs
+	PC_EXACT      = 2, // deterministic, may not get worse
+} pcTolerance;
+
+// Type definitions
+typedef struct {
+	char    names[PC_MAX_COLUMNS][PC_MAX_FIELD]; // column names
+	int     columns;                             // number of columns
+	char    fields[PC_MAX_ROWS][PC_MAX_COLUMNS][PC_MAX_FIELD]; // the all streams rows, as read (medians once combined)
+	int     rows;                                // number of rows
+	int     runs;                                // runs combined into the results
+	double  values[PC_MAX_RUNS][PC_MAX_ROWS][PC_MAX_COLUMNS]; // the value of each run, NAN if empty
+	double  spread[PC_MAX_ROWS][PC_MAX_COLUMNS]; // range over median of the runs
+} pcResults;
+
+typedef struct {
+	const char *column;       // the measure
+	int         perOp;        // checked on each operation row, otherwise run-wide
+	int         higher;       // higher is better
+	pcTolerance tolerance;    // how far it may move
+} pcMeasure;
+
+//
+// Global Data
+
+// The operations checked (the others are too short to time reliably)
+const char *pcOps[] = { "read", "write" };
+#define PC_OPS (sizeof(pcOps) / sizeof(char *))
+
+// The measures checked
+const pcMeasure pcMeasures[] = {
+	{ "ops_per_sec",    1, 1, PC_THROUGHPUT },
+	{ "p99_ns",         1, 0, PC_LATENCY },
+	{ "service_posts",  0, 0, PC_EXACT },
+	{ "cache_hit_rate", 0, 1, PC_EXACT },
+	{ "task_clock",     0, 0, PC_THROUGHPUT },
+	{ "instructions",   0, 0, PC_THROUGHPUT },
+	{ "cycles",         0, 0, PC_THROUGHPUT },
+};
+#define PC_MEASURES (sizeof(pcMeasures) / sizeof(pcMeasure))
+
+// Columns describing the run rather than measuring it, kept from the first run
+const char *pcKeys[] = { "workload", "block_size", "stream", "op", "count", "bytes" };
+#define PC_KEYS (sizeof(pcKeys) / sizeof(char *))
+
+//
+// Functional Prototypes
+
+int readResults( const char *path, pcResults *res ); // Read a results file
+int addResults( pcResults *all, pcResults *run ); // Add the results of a run
+void medianResults( pcResults *all ); // Reduce the runs to their medians and spreads
+int compareValues( const void *a, const void *b ); // Order values for the median
+int writeResults( const char *path, pcResults *res ); // Write a baseline
+int checkResults( pcResults *base, pcResults *cur, double tolerance, double latency, int strict ); // Compare with the baseline
+int findColumn( pcResults *res, const char *name ); // Column index by name
+int findRow( pcResults *res, const char *op ); // Row index by operation
+int isListed( const char *name, const char **list, int count ); // Name lookup
+int splitFields( char *line, char fields[][PC_MAX_FIELD] ); // Split a csv line
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the performance check
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful (no regression), -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	double tolerance = PC_DEFAULT_TOLERANCE, latency = PC_DEFAULT_LATENCY;
+	pcResults *base, *cur, *run;
+	int ch, i, write = 0, strict = 0, ret;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, PERFCHECK_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE, PC_DEFAULT_TOLERANCE, PC_DEFAULT_LATENCY );
+			return( -1 );
+
+		case 't': // Throughput tolerance
+			if ( (tolerance = atof(optarg)) <= 0 ) {
+				fprintf( stderr, "Bad tolerance (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'l': // Latency tolerance
+			if ( (latency = atof(optarg)) <= 0 ) {
+				fprintf( stderr, "Bad latency tolerance (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 's': // Timing measures gate too
+			strict = 1;
+			break;
+
+		case 'w': // Write the baseline
+			write = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	if ( argc - optind < 2 ) {
+		fprintf( stderr, "Missing baseline or results file, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Take the medians of the runs
+	base = malloc( sizeof(pcResults) );
+	cur = malloc( sizeof(pcResults) );
+	run = malloc( sizeof(pcResults) );
+	if ( (base == NULL) || (cur == NULL) || (run == NULL) ) {
+		fprintf( stderr, "Out of memory, aborting.\n" );
+		return( -1 );
+	}
+	if ( readResults(argv[optind + 1], cur) ) {
+		return( -1 );
+	}
+	for ( i = optind + 2; i < argc; i++ ) {
+		if ( readResults(argv[i], run) || addResults(cur, run) ) {
+			return( -1 );
+		}
+	}
+	medianResults( cur );
+
+	// Write the baseline, or check against it
+	if ( write ) {
+		ret = writeResults( argv[optind], cur );
+		if ( ret == 0 ) {
+			printf( "%s: baseline written (median of %d runs)\n", argv[optind], cur->runs );
+		}
+	} else {
+		if ( readResults(argv[optind], base) ) {
+			return( -1 );
+		}
+		printf( "%s: median of %d runs against the baseline\n", argv[optind], cur->runs );
+		ret = checkResults( base, cur, tolerance / 100, latency / 100, strict );
+	}
+	free( base );
+	free( cur );
+	free( run );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readResults
+// Description  : Read the all streams rows of a results file
+//
+// Inputs       : path - the file to read
+//                res - the results read
+// Outputs      : 0 if successful, -1 if failure
+
+int readResults( const char *path, pcResults *res ) {
+
+	// Local variables
+	char line[PC_MAX_LINE];
+	int stream, fields, c;
+	FILE *in;
+
+	if ( (in = fopen(path, "r")) == NULL ) {
+		fprintf( stderr, "Failed opening results file [%s], aborting.\n", path );
+		return( -1 );
+	}
+	memset( res, 0, sizeof(pcResults) );
+	res->runs = 1;
+	if ( fgets(line, sizeof(line), in) == NULL ) {
+		fprintf( stderr, "Empty results file [%s], aborting.\n", path );
+		fclose( in );
+		return( -1 );
+	}
+	res->columns = splitFields( line, res->names );
+	if ( ((stream = findColumn(res, "stream")) == -1) || (findColumn(res, "op") == -1) ) {
+		fprintf( stderr, "Results file [%s] is not sg_sim csv output, aborting.\n", path );
+		fclose( in );
+		return( -1 );
+	}
+	while ( fgets(line, sizeof(line), in) != NULL ) {
+		if ( res->rows == PC_MAX_ROWS ) {
+			break;
+		}
+		fields = splitFields( line, res->fields[res->rows] );
+		if ( fields != res->columns ) {
+			fprintf( stderr, "Bad line in results file [%s] (%d fields, expected %d), aborting.\n", path, fields,
+				res->columns );
+			fclose( in );
+			return( -1 );
+		}
+		if ( strcmp(res->fields[res->rows][stream], "all") == 0 ) {
+			for ( c = 0; c < res->columns; c++ ) {
+				res->values[0][res->rows][c] = (res->fields[res->rows][c][0] == '\0') ? NAN :
+					atof( res->fields[res->rows][c] );
+			}
+			res->rows++;
+		}
+	}
+	fclose( in );
+	if ( res->rows == 0 ) {
+		fprintf( stderr, "No results in file [%s], aborting.\n", path );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addResults
+// Description  : Add the values of a run to the results of the others
+//
+// Inputs       : all - the results of the runs so far
+//                run - the results of the run
+// Outputs      : 0 if successful, -1 if failure
+
+int addResults( pcResults *all, pcResults *run ) {
+
+	// Local variables
+	int r, c, row, col;
+
+	if ( all->runs == PC_MAX_RUNS ) {
+		fprintf( stderr, "More than %d runs, aborting.\n", PC_MAX_RUNS );
+		return( -1 );
+	}
+	for ( r = 0; r < all->rows; r++ ) {
+		if ( (row = findRow(run, all->fields[r][findColumn(all, "op")])) == -1 ) {
+			fprintf( stderr, "Results of the runs have different operations, aborting.\n" );
+			return( -1 );
+		}
+		for ( c = 0; c < all->columns; c++ ) {
+			col = findColumn( run, all->names[c] );
+			all->values[all->runs][r][c] = (col == -1) ? NAN : run->values[0][row][col];
+		}
+	}
+	all->runs++;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : medianResults
+// Description  : Reduce the runs to the median of each measure, and its
+//                spread (the range of the runs over the median)
+//
+// Inputs       : all - the results of the runs
+// Outputs      : none
+
+void medianResults( pcResults *all ) {
+
+	// Local variables
+	double sorted[PC_MAX_RUNS], median;
+	int r, c, i, n;
+
+	for ( r = 0; r < all->rows; r++ ) {
+		for ( c = 0; c < all->columns; c++ ) {
+			all->spread[r][c] = 0.0;
+			if ( isListed(all->names[c], pcKeys, PC_KEYS) ) {
+				continue;
+			}
+			for ( i = 0, n = 0; i < all->runs; i++ ) {
+				if ( !isnan(all->values[i][r][c]) ) {
+					sorted[n++] = all->values[i][r][c];
+				}
+			}
+			if ( n < 2 ) {
+				continue;
+			}
+			qsort( sorted, n, sizeof(double), compareValues );
+			median = (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+			all->spread[r][c] = median ? (sorted[n - 1] - sorted[0]) / fabs(median) : 0.0;
+			if ( median == floor(median) ) {
+				snprintf( all->fields[r][c], PC_MAX_FIELD, "%.0f", median );
+			} else {
+				snprintf( all->fields[r][c], PC_MAX_FIELD, (fabs(median) < 10) ? "%.4f" : "%.1f", median );
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compareValues
+// Description  : Order two values (qsort)
+//
+// Inputs       : a - the first value
+//                b - the second value
+// Outputs      : -1, 0 or 1 as a is below, equal to or above b
+
+int compareValues( const void *a, const void *b ) {
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return( (x > y) - (x < y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeResults
+// Description  : Write results as a baseline file (the all streams rows),
+//                followed by the spread of each timing measure
+//
+// Inputs       : path - the file to write
+//                res - the results
+// Outputs      : 0 if successful, -1 if failure
+
+int writeResults( const char *path, pcResults *res ) {
+
+	// Local variables
+	FILE *out;
+	int r, c, m;
+
+	if ( (out = fopen(path, "w")) == NULL ) {
+		fprintf( stderr, "Failed opening baseline file [%s], aborting.\n", path );
+		return( -1 );
+	}
+	for ( c = 0; c < res->columns; c++ ) {
+		fprintf( out, "%s%s", c ? "," : "", res->names[c] );
+	}
+	for ( m = 0; m < PC_MEASURES; m++ ) {
+		if ( (pcMeasures[m].tolerance != PC_EXACT) && (findColumn(res, pcMeasures[m].column) != -1) ) {
+			fprintf( out, ",%s_spread", pcMeasures[m].column );
+		}
+	}
+	fprintf( out, "\n" );
+	for ( r = 0; r < res->rows; r++ ) {
+		for ( c = 0; c < res->columns; c++ ) {
+			fprintf( out, "%s%s", c ? "," : "", res->fields[r][c] );
+		}
+		for ( m = 0; m < PC_MEASURES; m++ ) {
+			if ( (pcMeasures[m].tolerance != PC_EXACT) && ((c = findColumn(res, pcMeasures[m].column)) != -1) ) {
+				if ( res->fields[r][c][0] == '\0' ) {
+					fprintf( out, "," );
+				} else {
+					fprintf( out, ",%.4f", res->spread[r][c] );
+				}
+			}
+		}
+		fprintf( out, "\n" );
+	}
+	if ( fclose(out) ) {
+		fprintf( stderr, "Failed writing baseline file [%s], aborting.\n", path );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkResults
+// Description  : Compare results with the baseline, print the comparison
+//
+// Inputs       : base - the baseline
+//                cur - the results to check
+//                tolerance - throughput and counter tolerance (fraction)
+//                latency - latency tolerance (fraction)
+//                strict - timing measures slower than the noise allows fail too
+// Outputs      : 0 if there is no regression, -1 otherwise
+
+int checkResults( pcResults *base, pcResults *cur, double tolerance, double latency, int strict ) {
+
+	// Local variables
+	int m, o, bRow, cRow, bCol, cCol, sCol, worse, regressions = 0, slower = 0;
+	const pcMeasure *meas;
+	double was, now, allowed;
+	const char *status;
+	char name[64], spread[64];
+
+	// The runs must be of the same workload as the baseline
+	for ( o = 0; o < PC_OPS; o++ ) {
+		bRow = findRow( base, pcOps[o] );
+		cRow = findRow( cur, pcOps[o] );
+		if ( (bRow == -1) || (cRow == -1) || ((bCol = findColumn(base, "count")) == -1) ||
+				((cCol = findColumn(cur, "count")) == -1) ||
+				strcmp(base->fields[bRow][bCol], cur->fields[cRow][cCol]) ) {
+			printf( "  %s count differs from the baseline, the workload changed (rewrite the baseline)\nFAIL\n", pcOps[o] );
+			return( -1 );
+		}
+	}
+
+	printf( "  %-26s %16s %16s %9s  %s\n", "measure", "baseline", "current", "change", "status" );
+	for ( m = 0; m < PC_MEASURES; m++ ) {
+		meas = &pcMeasures[m];
+		for ( o = 0; o < (meas->perOp ? PC_OPS : 1); o++ ) {
+
+			// Run-wide measures are repeated on every row, take the first
+			bRow = meas->perOp ? findRow( base, pcOps[o] ) : 0;
+			cRow = meas->perOp ? findRow( cur, pcOps[o] ) : 0;
+			snprintf( name, sizeof(name), "%s%s%s", meas->perOp ? pcOps[o] : "", meas->perOp ? " " : "", meas->column );
+			bCol = findColumn( base, meas->column );
+			cCol = findColumn( cur, meas->column );
+			if ( (bCol == -1) || (cCol == -1) || (base->fields[bRow][bCol][0] == '\0') ||
+					(cur->fields[cRow][cCol][0] == '\0') ) {
+				printf( "  %-26s %16s %16s %9s  %s\n", name, "-", "-", "-", "not available" );
+				continue;
+			}
+			was = atof( base->fields[bRow][bCol] );
+			now = atof( cur->fields[cRow][cCol] );
+
+			// How much worse it may get, a timing measure also by the spread of both sets of runs
+			allowed = (meas->tolerance == PC_THROUGHPUT) ? tolerance : (meas->tolerance == PC_LATENCY) ? latency : 0.0;
+			if ( meas->tolerance != PC_EXACT ) {
+				snprintf( spread, sizeof(spread), "%s_spread", meas->column );
+				sCol = findColumn( base, spread );
+				allowed += cur->spread[cRow][cCol] + ((sCol == -1) ? 0.0 : atof(base->fields[bRow][sCol]));
+			}
+			if ( meas->higher ) {
+				worse = (now < was * (1.0 - allowed) - 1e-9);
+			} else {
+				worse = (now > was * (1.0 + allowed) + 1e-9);
+			}
+			if ( worse && ((meas->tolerance == PC_EXACT) || strict) ) {
+				status = "REGRESSION";
+				regressions++;
+			} else if ( worse ) {
+				status = "slower";
+				slower++;
+			} else if ( (meas->higher ? (now > was) : (now < was)) && (fabs(now - was) > was * allowed) ) {
+				status = "improved";
+			} else {
+				status = "ok";
+			}
+			printf( "  %-26s %16.*f %16.*f %+8.1f%%  %s\n", name, (was < 10) ? 4 : 1, was, (now < 10) ? 4 : 1, now,
+				was ? (now - was) * 100 / was : 0.0, status );
+		}
+	}
+
+	if ( regressions ) {
+		printf( "FAIL (%d regressions)\n", regressions );
+		return( -1 );
+	}
+	if ( slower ) {
+		printf( "PASS (%d timing measures slower than the noise allows, not gated without -s)\n", slower );
+	} else {
+		printf( "PASS\n" );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findColumn
+// Description  : Find a column of the results by name
+//
+// Inputs       : res - the results
+//                name - the column name
+// Outputs      : the column index, -1 if there is no such column
+
+int findColumn( pcResults *res, const char *name ) {
+	int c;
+
+	for ( c = 0; c < res->columns; c++ ) {
+		if ( strcmp(res->names[c], name) == 0 ) {
+			return( c );
+		}
+	}
+	return( -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findRow
+// Description  : Find the row of an operation in the results
+//
+// Inputs       : res - the results
+//                op - the operation name
+// Outputs      : the row index, -1 if there is no such row
+
+int findRow( pcResults *res, const char *op ) {
+	int r, c = findColumn( res, "op" );
+
+	for ( r = 0; r < res->rows; r++ ) {
+		if ( strcmp(res->fields[r][c], op) == 0 ) {
+			return( r );
+		}
+	}
+	return( -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : isListed
+// Description  : Check if a name is in a list of names
+//
+// Inputs       : name - the name
+//                list - the names
+//                count - number of names in the list
+// Outputs      : 1 if the name is listed, 0 otherwise
+
+int isListed( const char *name, const char **list, int count ) {
+	int i;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( strcmp(name, list[i]) == 0 ) {
+			return( 1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : splitFields
+// Description  : Split a csv line (no quoting, as sg_sim writes it), empty
+//                fields kept
+//
+// Inputs       : line - the line, modified
+//                fields - the fields (at most PC_MAX_COLUMNS)
+// Outputs      : the number of fields
+
+int splitFields( char *line, char fields[][PC_MAX_FIELD] ) {
+	char *field, *rest = line;
+	int count = 0;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	while ( ((field = strsep(&rest, ",")) != NULL) && (count < PC_MAX_COLUMNS) ) {
+		snprintf( fields[count++], PC_MAX_FIELD, "%s", field );
+	}
+	return( count );
+}
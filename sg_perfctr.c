@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_perfctr.c
+//  Description    : This file contains the hardware performance counters
+//                   read around a simulation, opened with perf_event_open.
+//                   Each counter is opened on its own (no group), so one the
+//                   CPU does not have does not take the others with it.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_perfctr.h>
+
+//
+// Global data
+
+// Names of the counters, as perf stat calls them
+const char *sgPerfCtrNames[SG_PERFCTR_COUNT] = { "task_clock", "instructions", "cycles", "cache_misses",
+                                                 "branch_misses" };
+
+// The perf events behind the counters
+const uint32_t sgPerfCtrTypes[SG_PERFCTR_COUNT] = { PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+const uint64_t sgPerfCtrEvents[SG_PERFCTR_COUNT] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES,
+                                                     PERF_COUNT_HW_BRANCH_MISSES };
+
+int sgPerfCtrFds[SG_PERFCTR_COUNT] = { -1, -1, -1, -1, -1 }; // counter descriptors, -1 if not open
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : startSGPerfCounters
+// Description  : Open and start the counters for the process; threads created
+//                afterwards are counted too
+//
+// Inputs       : none
+// Outputs      : 0 if at least one counter started, -1 if none is available
+
+int startSGPerfCounters( void ) {
+    struct perf_event_attr attr;
+    int i, started = 0;
+
+    for (i = 0; i < SG_PERFCTR_COUNT; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = sgPerfCtrTypes[i];
+        attr.config = sgPerfCtrEvents[i];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        sgPerfCtrFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (sgPerfCtrFds[i] != -1) {
+            ioctl(sgPerfCtrFds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(sgPerfCtrFds[i], PERF_EVENT_IOC_ENABLE, 0);
+            started++;
+        }
+    }
+    if (started == 0) {
+        logMessage(LOG_INFO_LEVEL, "startSGPerfCounters: performance counters not available");
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readSGPerfCounters
+// Description  : Read the current values of the counters
+//
+// Inputs       : values - the values read (SG_PERFCTR_COUNT), -1 for each
+//                         counter not available
+// Outputs      : 0 if successful, -1 if no counter is available
+
+int readSGPerfCounters( int64_t *values ) {
+    uint64_t value;
+    int i, count = 0;
+
+    for (i = 0; i < SG_PERFCTR_COUNT; i++) {
+        values[i] = -1;
+        if ((sgPerfCtrFds[i] != -1) && (sizeof(value) == (size_t)read(sgPerfCtrFds[i], &value, sizeof(value)))) {
+            values[i] = (int64_t)value;
+            count++;
+        }
+    }
+    return count ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stopSGPerfCounters
+// Description  : Stop and close the counters
+//
+// Inputs       : none
+// Outputs      : none
+
+void stopSGPerfCounters( void ) {
+    int i;
+
+    for (i = 0; i < SG_PERFCTR_COUNT; i++) {
+        if (sgPerfCtrFds[i] != -1) {
+            close(sgPerfCtrFds[i]);
+            sgPerfCtrFds[i] = -1;
+        }
+    }
+}
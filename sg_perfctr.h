@@ -0,0 +1,51 @@
+#ifndef SG_PERFCTR_INCLUDED
+#define SG_PERFCTR_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_perfctr.h
+//  Description    : This is the declaration of the hardware performance
+//                   counters read around a simulation (the perf stat
+//                   counters, through perf_event_open).  Only user space is
+//                   counted, so the counters work without privileges on
+//                   most systems; the hardware ones are missing on virtual
+//                   machines without a PMU, those are reported as not
+//                   available and the run goes on.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+
+//
+// Defines
+#define SG_PERFCTR_COUNT 5 // counters read
+
+// The counters
+typedef enum {
+    SG_PERFCTR_TASK_CLOCK    = 0, // CPU time of the process (ns, software)
+    SG_PERFCTR_INSTRUCTIONS  = 1, // instructions retired
+    SG_PERFCTR_CYCLES        = 2, // CPU cycles
+    SG_PERFCTR_CACHE_MISSES  = 3, // last level cache misses
+    SG_PERFCTR_BRANCH_MISSES = 4, // mispredicted branches
+} SG_PerfCtr;
+
+//
+// Global data
+extern const char *sgPerfCtrNames[SG_PERFCTR_COUNT]; // names of the counters
+
+//
+// Performance counter functions
+
+int startSGPerfCounters( void );
+    // Open and start the counters for the process (its threads included)
+
+int readSGPerfCounters( int64_t *values );
+    // Read the counters, -1 for each one not available
+
+void stopSGPerfCounters( void );
+    // Stop and close the counters
+
+#endif
@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_prefetch.c
+//  Description    : This file contains the block prefetcher of the driver, a
+//                   set associative table from a (file, block) pair to the
+//                   blocks read right after it, with how often.  A new pair
+//                   takes the least seen entry of its set, so the table
+//                   never grows past its configured size.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_prefetch.h>
+
+// Functional Prototypes
+SG_Prefetch_Entry * findSGPrefetch( SG_Prefetcher *pf, int32_t fh, uint64_t block, int create );
+void recordSGPrefetch( SG_Prefetch_Entry *entry, uint64_t block );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initSGPrefetcher
+// Description  : Set up a prefetcher, its table the largest power of two
+//                entries that fits the budget (at least a set)
+//
+// Inputs       : pf - the prefetcher
+//                entries - the most table entries to use, 0 turns it off
+//                threshold - the confidence (percent) a prediction needs
+// Outputs      : 0 if successful, -1 if failure
+
+int initSGPrefetcher( SG_Prefetcher *pf, size_t entries, int threshold ) {
+    size_t size = SG_PREFETCH_SET;
+
+    freeSGPrefetcher(pf);
+    if (entries == 0) {
+        return 0;
+    }
+    while (size * 2 <= entries) {
+        size *= 2;
+    }
+    if ((pf->table = (SG_Prefetch_Entry *) malloc(size * sizeof(SG_Prefetch_Entry))) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "initSGPrefetcher: out of memory (%lu entries)", size);
+        return -1;
+    }
+    pf->size = size;
+    pf->minThreshold = (threshold < 1) ? 1 : (threshold > SG_PREFETCH_MAX_THRESHOLD) ? SG_PREFETCH_MAX_THRESHOLD : threshold;
+    resetSGPrefetcher(pf);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : resetSGPrefetcher
+// Description  : Forget the successors and last blocks learned, the
+//                confidence goes back to the configured one
+//
+// Inputs       : pf - the prefetcher
+// Outputs      : none
+
+void resetSGPrefetcher( SG_Prefetcher *pf ) {
+    size_t i;
+
+    memset(pf->table, 0, pf->size * sizeof(SG_Prefetch_Entry));
+    for (i = 0; i < pf->size; i++) {
+        pf->table[i].fh = -1;
+    }
+    for (i = 0; i < SG_PREFETCH_FILES; i++) {
+        pf->last[i].fh = -1;
+    }
+    pf->threshold = pf->minThreshold;
+    pf->judged = 0;
+    pf->used = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeSGPrefetcher
+// Description  : Release the table, turning the prefetcher off
+//
+// Inputs       : pf - the prefetcher
+// Outputs      : none
+
+void freeSGPrefetcher( SG_Prefetcher *pf ) {
+    free(pf->table);
+    pf->table = NULL;
+    pf->size = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : learnSGPrefetch
+// Description  : Learn a read of a block: it followed the last block read
+//                in the file, and the block most often read after it is
+//                predicted if it was seen enough and is likely enough
+//
+// Inputs       : pf - the prefetcher (on)
+//                fh - the file
+//                block - the block read (index in the file)
+//                next - place to put the predicted block
+// Outputs      : 1 if a block is predicted, 0 if not
+
+int learnSGPrefetch( SG_Prefetcher *pf, int32_t fh, uint64_t block, uint64_t *next ) {
+    SG_Prefetch_Last *last = &pf->last[(uint32_t) fh & (SG_PREFETCH_FILES - 1)];
+    SG_Prefetch_Entry *entry;
+    int best;
+
+    // more reads within the same block teach nothing
+    if ((last->fh == fh) && (last->block == block)) {
+        return 0;
+    }
+    if (last->fh == fh) {
+        recordSGPrefetch(findSGPrefetch(pf, fh, last->block, 1), block);
+    }
+    last->fh = fh;
+    last->block = block;
+
+    // predict the successor of the block just read
+    entry = findSGPrefetch(pf, fh, block, 0);
+    if ((entry == NULL) || (entry->seen < SG_PREFETCH_MIN_SEEN)) {
+        return 0;
+    }
+    best = (entry->count[1] > entry->count[0]) ? 1 : 0;
+    if (entry->count[best] * 100 < pf->threshold * entry->seen) {
+        return 0;
+    }
+    *next = entry->next[best];
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : judgeSGPrefetch
+// Description  : Adjust the confidence asked for once a window of
+//                prefetches was judged: up while too few are used, back
+//                down to the configured one while most are
+//
+// Inputs       : pf - the prefetcher (on)
+//                used - prefetched blocks read so far
+//                wasted - prefetched blocks evicted or replaced unread so far
+// Outputs      : none
+
+void judgeSGPrefetch( SG_Prefetcher *pf, size_t used, size_t wasted ) {
+    size_t judged, accuracy;
+
+    // the counts started over (the cache was closed)
+    if (used + wasted < pf->judged) {
+        pf->judged = pf->used = 0;
+    }
+    if ((judged = used + wasted - pf->judged) < SG_PREFETCH_WINDOW) {
+        return;
+    }
+    accuracy = (used - pf->used) * 100 / judged;
+    if (accuracy < SG_PREFETCH_LOW_ACCURACY) {
+        pf->threshold += 10;
+        pf->threshold = (pf->threshold > SG_PREFETCH_MAX_THRESHOLD) ? SG_PREFETCH_MAX_THRESHOLD : pf->threshold;
+    } else if (accuracy >= SG_PREFETCH_HIGH_ACCURACY) {
+        pf->threshold -= 5;
+        pf->threshold = (pf->threshold < pf->minThreshold) ? pf->minThreshold : pf->threshold;
+    }
+    pf->judged = used + wasted;
+    pf->used = used;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findSGPrefetch
+// Description  : Find the entry of a (file, block) pair in its set, or
+//                take the least seen entry of the set for it
+//
+// Inputs       : pf - the prefetcher
+//                fh - the file
+//                block - the block
+//                create - take an entry if the pair has none
+// Outputs      : the entry, NULL if none (and not create)
+
+SG_Prefetch_Entry * findSGPrefetch( SG_Prefetcher *pf, int32_t fh, uint64_t block, int create ) {
+    uint64_t key = (block ^ ((uint64_t) fh << 40)) * 0x9e3779b97f4a7c15ULL;
+    SG_Prefetch_Entry *set = &pf->table[((size_t) (key >> 32) * SG_PREFETCH_SET) & (pf->size - 1)], *victim = set;
+    int way;
+
+    for (way = 0; way < SG_PREFETCH_SET; way++) {
+        if ((set[way].fh == fh) && (set[way].block == block)) {
+            return &set[way];
+        }
+        if (set[way].seen < victim->seen) {
+            victim = &set[way];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    memset(victim, 0, sizeof(SG_Prefetch_Entry));
+    victim->fh = fh;
+    victim->block = block;
+    return victim;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : recordSGPrefetch
+// Description  : Count a successor of a block, taking the way of the least
+//                seen one if it is new; the counts are halved when the block
+//                was followed SG_PREFETCH_MAX_SEEN times
+//
+// Inputs       : entry - the entry of the block
+//                block - the block that followed it
+// Outputs      : none
+
+void recordSGPrefetch( SG_Prefetch_Entry *entry, uint64_t block ) {
+    int way, weak = 0;
+
+    for (way = 0; way < SG_PREFETCH_WAYS; way++) {
+        if (entry->count[way] && (entry->next[way] == block)) {
+            break;
+        }
+        if (entry->count[way] < entry->count[weak]) {
+            weak = way;
+        }
+    }
+    if (way == SG_PREFETCH_WAYS) {
+        way = weak;
+        entry->next[way] = block;
+        entry->count[way] = 0;
+    }
+    entry->count[way]++;
+    if (++entry->seen >= SG_PREFETCH_MAX_SEEN) {
+        entry->seen /= 2;
+        for (way = 0; way < SG_PREFETCH_WAYS; way++) {
+            entry->count[way] /= 2;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SG_PREFETCH_INCLUDED
+#define SG_PREFETCH_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_prefetch.h
+//  Description    : This is the declaration of the block prefetcher of the
+//                   driver.  It learns, per file, which block is read after
+//                   which (a Markov table of block successors, in a fixed
+//                   number of entries) and predicts the next block once one
+//                   successor is likely enough.  The confidence needed
+//                   rises while the prefetches go unused and falls back to
+//                   the configured one while they are used.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Defines
+#define SG_PREFETCH_WAYS 2             // successors kept per block
+#define SG_PREFETCH_SET 4              // entries a block can take (power of two)
+#define SG_PREFETCH_FILES 256          // files whose last read block is kept (hashed, power of two)
+#define SG_PREFETCH_MIN_SEEN 2         // times a block was followed before it is predicted from
+#define SG_PREFETCH_MAX_SEEN 64        // counts are halved here, so older reads weigh less
+#define SG_PREFETCH_WINDOW 64          // prefetches judged (used or wasted) per threshold change
+#define SG_PREFETCH_LOW_ACCURACY 50    // accuracy (percent) under which the threshold rises
+#define SG_PREFETCH_HIGH_ACCURACY 80   // accuracy (percent) over which it falls
+#define SG_PREFETCH_MAX_THRESHOLD 95   // highest confidence (percent) asked for
+
+// Type definitions
+typedef struct {
+    int32_t  fh;                       // file of the block, -1 if the entry is free
+    uint16_t seen;                     // times the block was followed by another
+    uint16_t count[SG_PREFETCH_WAYS];  // times by each successor kept
+    uint64_t block;                    // the block (index in the file)
+    uint64_t next[SG_PREFETCH_WAYS];   // the successors kept
+} SG_Prefetch_Entry;
+
+typedef struct {
+    int32_t  fh;                       // the file, -1 if none
+    uint64_t block;                    // the last block read in it
+} SG_Prefetch_Last;
+
+typedef struct {
+    SG_Prefetch_Entry * table;         // successor table (SG_PREFETCH_SET way sets), NULL if off
+    size_t   size;                     // entries of the table (power of two)
+    int      minThreshold;             // configured confidence (percent)
+    int      threshold;                // confidence asked for now (percent)
+    size_t   judged;                   // prefetches judged at the last threshold change
+    size_t   used;                     // of which were used
+    SG_Prefetch_Last last[SG_PREFETCH_FILES];
+} SG_Prefetcher;
+
+//
+// Prefetcher functions
+
+int initSGPrefetcher( SG_Prefetcher *pf, size_t entries, int threshold );
+    // Set up a prefetcher of up to entries table entries (0 turns it off)
+
+void resetSGPrefetcher( SG_Prefetcher *pf );
+    // Forget what was learned, keeping the configuration
+
+void freeSGPrefetcher( SG_Prefetcher *pf );
+    // Release the table, turning the prefetcher off
+
+int learnSGPrefetch( SG_Prefetcher *pf, int32_t fh, uint64_t block, uint64_t *next );
+    // Learn a read of a block, 1 if a next block is predicted (in next)
+
+void judgeSGPrefetch( SG_Prefetcher *pf, size_t used, size_t wasted );
+    // Adjust the confidence to the prefetches used and wasted so far
+
+#endif
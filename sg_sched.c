@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_sched.c
+//  Description    : This file contains the background request queue of the
+//                   driver.  Each request is tagged one past the later of
+//                   the last tag served and the last tag of its node, so a
+//                   node with many requests queued waits its turn behind
+//                   the others instead of holding the service.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <string.h>
+
+// Project Includes
+#include <cmpsc311_log.h>
+#include <sg_sched.h>
+
+// Functional Prototypes
+int findSGRequest( SG_Scheduler *sched, SG_Node_ID nde, SG_Block_ID blk );
+void removeSGRequest( SG_Scheduler *sched, int i );
+int checkSGSchedOrder( SG_Scheduler *sched, const char *name, const SG_Block_ID *order, int count );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initSGScheduler
+// Description  : Empty the queue and forget the nodes
+//
+// Inputs       : sched - the scheduler
+// Outputs      : none
+
+void initSGScheduler( SG_Scheduler *sched ) {
+    memset(sched, 0, sizeof(SG_Scheduler));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queueSGRequest
+// Description  : Queue a background request for a block, tagged after the
+//                last request of its node; the node least recently tagged
+//                gives up its place when no other is free
+//
+// Inputs       : sched - the scheduler
+//                cls - the class of the request (a background one)
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : 0 if queued, 1 if already queued, -1 if the queue is full
+
+int queueSGRequest( SG_Scheduler *sched, SG_Post_Class cls, SG_Node_ID nde, SG_Block_ID blk ) {
+    SG_Sched_Request *req;
+    SG_Sched_Node *node = NULL;
+    int i;
+
+    if (findSGRequest(sched, nde, blk) != -1) {
+        return 1;
+    }
+    if (sched->used == SG_SCHED_QUEUE) {
+        return -1;
+    }
+    for (i = 0; i < sched->nodeCount; i++) {
+        if (sched->nodes[i].nodeID == nde) {
+            node = &sched->nodes[i];
+            break;
+        }
+    }
+    if (node == NULL) {
+        if (sched->nodeCount < SG_SCHED_NODES) {
+            node = &sched->nodes[sched->nodeCount++];
+        } else {
+            for (node = &sched->nodes[0], i = 1; i < SG_SCHED_NODES; i++) {
+                node = (sched->nodes[i].tag < node->tag) ? &sched->nodes[i] : node;
+            }
+        }
+        node->nodeID = nde;
+        node->tag = 0;
+    }
+    node->tag = ((node->tag > sched->vtime) ? node->tag : sched->vtime) + 1;
+
+    req = &sched->queue[sched->used++];
+    req->nodeID = nde;
+    req->blockID = blk;
+    req->cls = cls;
+    req->tag = node->tag;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : takeSGRequest
+// Description  : Take the next request to post: of the first class queued,
+//                the lowest tag (the earliest queued of equal tags)
+//
+// Inputs       : sched - the scheduler
+//                req - place to put the request
+// Outputs      : 1 if a request was taken, 0 if the queue is empty
+
+int takeSGRequest( SG_Scheduler *sched, SG_Sched_Request *req ) {
+    int i, best = -1;
+
+    for (i = 0; i < sched->used; i++) {
+        if ((best == -1) || (sched->queue[i].cls < sched->queue[best].cls) ||
+            ((sched->queue[i].cls == sched->queue[best].cls) && (sched->queue[i].tag < sched->queue[best].tag))) {
+            best = i;
+        }
+    }
+    if (best == -1) {
+        return 0;
+    }
+    *req = sched->queue[best];
+    sched->vtime = (req->tag > sched->vtime) ? req->tag : sched->vtime;
+    removeSGRequest(sched, best);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cancelSGRequest
+// Description  : Take the request for a block out of the queue, the demand
+//                read that wants it now posts it itself
+//
+// Inputs       : sched - the scheduler
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : 1 if the block had a request queued, 0 if not
+
+int cancelSGRequest( SG_Scheduler *sched, SG_Node_ID nde, SG_Block_ID blk ) {
+    int i = findSGRequest(sched, nde, blk);
+
+    if (i == -1) {
+        return 0;
+    }
+    removeSGRequest(sched, i);
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findSGRequest
+// Description  : Find the queued request for a block
+//
+// Inputs       : sched - the scheduler
+//                nde - the remote node of the block
+//                blk - the remote block
+// Outputs      : its place in the queue, -1 if not queued
+
+int findSGRequest( SG_Scheduler *sched, SG_Node_ID nde, SG_Block_ID blk ) {
+    int i;
+
+    for (i = 0; i < sched->used; i++) {
+        if ((sched->queue[i].nodeID == nde) && (sched->queue[i].blockID == blk)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : removeSGRequest
+// Description  : Remove a request, the later ones keep their order
+//
+// Inputs       : sched - the scheduler
+//                i - the place of the request in the queue
+// Outputs      : none
+
+void removeSGRequest( SG_Scheduler *sched, int i ) {
+    memmove(&sched->queue[i], &sched->queue[i + 1], (sched->used - i - 1) * sizeof(SG_Sched_Request));
+    sched->used--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : schedUnitTest
+// Description  : Check the order requests are taken in: the prefetches
+//                before the flushes, the nodes served in turn within a
+//                class, a node that comes late queued at the current
+//                virtual time, and the node table full (SG_SCHED_NODES)
+//                giving up the node least recently tagged, not the busiest
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int schedUnitTest( void ) {
+    // the expected orders, by block (blocks of node n are n * 100 + i)
+    const SG_Block_ID classes[] = {201, 104, 101, 301};
+    const SG_Block_ID turns[] = {101, 201, 102, 202, 103, 203, 104, 204};
+    const SG_Block_ID late[] = {102, 202, 301, 103, 203, 302};
+    SG_Block_ID evict[SG_SCHED_NODES + 5];
+    SG_Sched_Request req;
+    SG_Scheduler sched;
+    int i, n = 0;
+
+    // class priority, and equal tags taken in the order queued
+    initSGScheduler(&sched);
+    queueSGRequest(&sched, SG_CLASS_FLUSH, 1, 101);
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 2, 201);
+    queueSGRequest(&sched, SG_CLASS_FLUSH, 3, 301);
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 1, 104);
+    if ((queueSGRequest(&sched, SG_CLASS_PREFETCH, 2, 201) != 1) ||
+            checkSGSchedOrder(&sched, "class", classes, 4)) {
+        logMessage(LOG_ERROR_LEVEL, "schedUnitTest: class priority failed");
+        return -1;
+    }
+
+    // two nodes queued one after the other are served in turn
+    initSGScheduler(&sched);
+    for (i = 1; i <= 4; i++) {
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, 1, 100 + i);
+    }
+    for (i = 1; i <= 4; i++) {
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, 2, 200 + i);
+    }
+    if (checkSGSchedOrder(&sched, "turns", turns, 8)) {
+        return -1;
+    }
+
+    // a node coming late takes its turn from the current time, no earlier
+    initSGScheduler(&sched);
+    for (i = 1; i <= 3; i++) {
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, 1, 100 + i);
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, 2, 200 + i);
+    }
+    if ((takeSGRequest(&sched, &req) != 1) || (req.blockID != 101) ||
+            (takeSGRequest(&sched, &req) != 1) || (req.blockID != 201)) {
+        logMessage(LOG_ERROR_LEVEL, "schedUnitTest: late node setup failed");
+        return -1;
+    }
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 3, 301);
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 3, 302);
+    if (checkSGSchedOrder(&sched, "late", late, 6)) {
+        return -1;
+    }
+
+    // a full node table gives up node 2 (tag 1), not the busy node 1 (tag 3)
+    initSGScheduler(&sched);
+    for (i = 1; i <= 3; i++) {
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, 1, 100 + i);
+    }
+    for (i = 2; i <= SG_SCHED_NODES; i++) {
+        queueSGRequest(&sched, SG_CLASS_PREFETCH, i, i * 100 + 1);
+    }
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, SG_SCHED_NODES + 1, (SG_SCHED_NODES + 1) * 100 + 1);
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 1, 104);
+    queueSGRequest(&sched, SG_CLASS_PREFETCH, 2, 202);
+    if ((sched.nodeCount != SG_SCHED_NODES) || (sched.nodes[0].nodeID != 1) || (sched.nodes[0].tag != 4)) {
+        logMessage(LOG_ERROR_LEVEL, "schedUnitTest: node table kept the wrong nodes");
+        return -1;
+    }
+
+    // all tag 1 in the order queued (node 2 again fresh), then node 1's later ones
+    evict[n++] = 101;
+    for (i = 2; i <= SG_SCHED_NODES + 1; i++) {
+        evict[n++] = i * 100 + 1;
+    }
+    evict[n++] = 202;
+    evict[n++] = 102;
+    evict[n++] = 103;
+    evict[n++] = 104;
+    if (checkSGSchedOrder(&sched, "evict", evict, n)) {
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkSGSchedOrder
+// Description  : Take every queued request, checking they come in order
+//
+// Inputs       : sched - the scheduler
+//                name - the name of the check (for the log)
+//                order - the blocks in the order they should be taken
+//                count - the number of blocks
+// Outputs      : 0 if taken in order and then empty, -1 if not
+
+int checkSGSchedOrder( SG_Scheduler *sched, const char *name, const SG_Block_ID *order, int count ) {
+    SG_Sched_Request req;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (takeSGRequest(sched, &req) != 1) {
+            logMessage(LOG_ERROR_LEVEL, "schedUnitTest: %s queue empty at %d, expected block %lu", name, i, order[i]);
+            return -1;
+        }
+        if (req.blockID != order[i]) {
+            logMessage(LOG_ERROR_LEVEL, "schedUnitTest: %s took block %lu at %d, expected %lu", name, req.blockID, i, order[i]);
+            return -1;
+        }
+    }
+    if (takeSGRequest(sched, &req) != 0) {
+        logMessage(LOG_ERROR_LEVEL, "schedUnitTest: %s left block %lu queued", name, req.blockID);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef SG_SCHED_INCLUDED
+#define SG_SCHED_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_sched.h
+//  Description    : This is the declaration of the request scheduler of the
+//                   driver.  The service posts are tagged with a priority
+//                   class; the demand classes are posted by the client call
+//                   at once, the background ones queue here until the
+//                   driver has no client waiting.  The queue is served a
+//                   class at a time, fairly between the remote nodes (start
+//                   time fair queuing, every request the same cost).
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+#include <sg_defs.h>
+
+//
+// Defines
+#define SG_SCHED_QUEUE 64     // background requests queued at most (more are dropped)
+#define SG_SCHED_NODES 16     // remote nodes whose fair queuing tag is kept
+#define SG_SCHED_BATCH 4      // background posts per hold of the driver lock
+#define SG_SCHED_IDLE_MS 1    // longest wait for the driver to go idle with requests queued
+
+// Type definitions
+typedef enum {
+    SG_CLASS_READ     = 0,    // Demand read, a client waits for the block
+    SG_CLASS_WRITE    = 1,    // Demand write, and the other client calls
+    SG_CLASS_PREFETCH = 2,    // Prefetch (queued)
+    SG_CLASS_FLUSH    = 3,    // Background write back (queued after the prefetches)
+} SG_Post_Class;
+
+#define SG_POST_CLASSES 4
+
+typedef struct {
+    SG_Node_ID nodeID;        // the remote node of the block
+    SG_Block_ID blockID;      // the remote block
+    SG_Post_Class cls;        // its class (a background one)
+    uint64_t tag;             // fair queuing tag, served lowest first within a class
+} SG_Sched_Request;
+
+typedef struct {
+    SG_Node_ID nodeID;        // the remote node
+    uint64_t tag;             // tag of its last request queued
+} SG_Sched_Node;
+
+typedef struct {
+    SG_Sched_Request queue[SG_SCHED_QUEUE]; // the requests, in arrival order
+    int used;                 // requests queued
+    uint64_t vtime;           // tag of the last request served
+    SG_Sched_Node nodes[SG_SCHED_NODES];    // the tags of the nodes seen lately
+    int nodeCount;            // nodes in use
+} SG_Scheduler;
+
+//
+// Scheduler functions
+
+void initSGScheduler( SG_Scheduler *sched );
+    // Empty the queue and forget the nodes
+
+int queueSGRequest( SG_Scheduler *sched, SG_Post_Class cls, SG_Node_ID nde, SG_Block_ID blk );
+    // Queue a background request, 1 if it already was, -1 if the queue is full
+
+int takeSGRequest( SG_Scheduler *sched, SG_Sched_Request *req );
+    // Take the next request to post, 0 if none
+
+int cancelSGRequest( SG_Scheduler *sched, SG_Node_ID nde, SG_Block_ID blk );
+    // Take a block's request out of the queue, 1 if it was queued
+
+int schedUnitTest( void );
+    // Check the order requests are taken in (run by sg_sim -u), 0 if right
+
+#endif
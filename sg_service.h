@@ -23,4 +23,10 @@
 int sgServicePost( char *packet, size_t *len, char *rpacket, size_t *rlen );
     // Post a packet to the ScatterGather service
 
+int sgLocalServicePost( char *packet, size_t *len, char *rpacket, size_t *rlen );
+    // Post a packet to the local (in-process) stand-in ScatterGather service
+
+void sgLocalServiceKeepBlocks( int keep );
+    // Keep the local service nodes and blocks across endpoint restarts
+
 #endif
\ No newline at end of file
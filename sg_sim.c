@@ -13,6 +13,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <pthread.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_assocarr.h>
 #include <cmpsc311_workload.h>
@@ -20,25 +25,101 @@
 // Project Includes 
 #include <sg_defs.h>
 #include <sg_driver.h>
+#include <sg_service.h>
+#include <sg_cache.h>
+#include <sg_histogram.h>
+#include <sg_wlbin.h>
+#include <sg_log.h>
+#include <sg_span.h>
+#include <sg_stats.h>
+#include <sg_perfctr.h>
 
 // Defines
-#define SG_ARGUMENTS "hvul:"
+#define SG_ARGUMENTS "hvuszal:B:b:p:t:r:R:P:m:F:f:"
 #define USAGE \
-	"USAGE: sg_sim [-h] [-v] [-l <logfile>] <workload>\n" \
+	"USAGE: sg_sim [-h] [-v] [-s] [-z] [-a] [-B <size>] [-b <format>] [-p <streams>] [-t <trace>]\n" \
+	"              [-r <factor> | -R <rate>] [-P <spans>] [-m <metrics>[:<ms>]]\n" \
+	"              [-F <flight>[:<us>]] [-f <entries>[:<pct>]] [-l <logfile>]\n" \
+	"              <workload> [<workload> ...]\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -v - verbose output\n" \
 	"    -u - perform the unit tests\n" \
+	"    -s - use the local stand-in service (with protocol extensions)\n" \
+	"    -z - compress block payloads (if the service supports it)\n" \
+	"    -a - asynchronous logging, messages are formatted on a background\n" \
+	"         thread instead of the caller's\n" \
+	"    -B - use blocks of <size> bytes (if the service supports it)\n" \
+	"    -b - benchmark mode, print operation latencies and throughput\n" \
+	"         to stdout in <format> (json or csv)\n" \
+	"    -p - replay the workload as <streams> parallel clients, each\n" \
+	"         owning a share of the objects (several workload files run\n" \
+	"         as one client each instead)\n" \
+	"    -t - capture a trace of the driver calls, with their issue times,\n" \
+	"         to <trace> (a compiled workload)\n" \
+	"    -r - open loop replay of a trace at the recorded times, sped up\n" \
+	"         by <factor> (1 is the recorded rate)\n" \
+	"    -R - open loop replay of a compiled workload at <rate> ops/sec\n" \
+	"    -P - record the time spent in each driver stage (cache, serialize,\n" \
+	"         service post, ...) and write it to <spans> as a Chrome trace\n" \
+	"         (open it in Perfetto or chrome://tracing)\n" \
+	"    -m - write the driver statistics to <metrics> in the Prometheus\n" \
+	"         text format every <ms> milliseconds (default 1000)\n" \
+	"    -F - append the flight recorder (the last driver calls) to\n" \
+	"         <flight> when a call takes more than <us> microseconds\n" \
+	"         (never if not given) and on SIGUSR1\n" \
+	"    -f - prefetch the block each read predicts is read next, learning\n" \
+	"         the blocks read after each other in a table of <entries>\n" \
+	"         blocks, once <pct> percent likely (default 60)\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
 	"and\n" \
-	"    workload - is the name of the workload file.  Not that this\n" \
-	"               file is not needed when running the unit tests.\n" \
+	"    workload - is the name of the workload file (text, or compiled\n" \
+	"               with sg_wlcomp).  Not that this file is not needed\n" \
+	"               when running the unit tests.\n" \
 	"\n" \
 
+#define SIM_OP_SEEK WL_EOF // Statistics slot for seeks (after the workload ops)
+#define SIM_OP_DELAY (SIM_OP_SEEK + 1) // Statistics slot for open loop start delays
+#define SIM_OP_TYPES (SIM_OP_DELAY + 1)
+
+//
+// Type definitions
+typedef struct {
+	SG_Histogram latency;  // latency of each operation (ns)
+	uint64_t     bytes;    // bytes read or written
+} simOpStats;
+
+typedef struct {
+	simOpStats ops[SIM_OP_TYPES]; // per operation type (WL_OPEN ... WL_CLOSE, seek, delay)
+	uint64_t   elapsed;           // wall clock time of the workload (ns)
+	size_t     cacheLookups;      // block cache lookups
+	size_t     cacheHits;         // block cache hits
+	size_t     cacheEvictions;    // block cache evictions
+	size_t     posts;             // packets posted to the service
+	size_t     bytesSent;         // bytes sent to the service
+	size_t     bytesRecv;         // bytes received from the service
+	int64_t    counters[SG_PERFCTR_COUNT]; // hardware counters of the run (-1 if not available)
+} simStats;
+
+typedef struct {
+	char      *wload;             // the workload file of the stream
+	int        stream;            // the stream number
+	int        streams;           // streams sharing the workload (1 if it is the stream's own)
+	int        prefix;            // prefix object names with the stream number (own files)
+	simStats   stats;             // statistics of the stream
+	uint64_t   begin;             // time the simulation started (open loop schedule)
+	int        result;            // 0 if the stream completed, -1 if it failed
+	pthread_t  thread;            // the thread running the stream
+} simStream;
+
 //
 // Global Data
 int verbose;
+char *benchFormat = NULL; // Benchmark output format (NULL if not benchmarking)
+double replayFactor = 0; // Open loop replay speed-up of the recorded times (0 if closed loop)
+double replayRate = 0; // Open loop replay arrival rate in ops/sec (0 if closed loop)
+pthread_mutex_t simWorkloadLock = PTHREAD_MUTEX_INITIALIZER; // The workload parser is not reentrant
 unsigned long SGServiceLevel; // Service log level
 unsigned long SGDriverLevel; // Controller log level
 unsigned long SGSimulatorLevel; // Simulation log level
@@ -46,7 +127,12 @@ unsigned long SGSimulatorLevel; // Simulation log level
 //
 // Functional Prototypes
 
-int simulateScatterGather( char *wload ); // ScatterGather simulation
+int simulateScatterGather( char **wloads, int numFiles, int streams ); // ScatterGather simulation
+void * simulateStream( void *arg ); // Run the workload of one stream
+int replayStream( simStream *strm, int fd ); // Compiled workload replay
+int ownsObject( simStream *strm, const char *name ); // Object partitioning
+void waitUntil( uint64_t due ); // Wait for a scheduled time
+int reportScatterGather( simStream *strms, int numStreams, simStats *total ); // Print benchmark results
 int sg_unit_test( void ); // The program unit tests
 extern int packetUnitTest( void ); // External function (packet processing)
 
@@ -65,7 +151,9 @@ extern int packetUnitTest( void ); // External function (packet processing)
 int main( int argc, char *argv[] ) {
 
 	// Local variables
-	int ch, verbose = 0, log_initialized = 0, unit_tests = 0;
+	int ch, verbose = 0, log_initialized = 0, unit_tests = 0, streams = 1, async_log = 0;
+	SG_Endpoint_Config config = { sgServicePost, 0, SG_BLOCK_SIZE };
+	char *metrics, *flight, *confidence;
 	
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, SG_ARGUMENTS)) != -1) {
@@ -79,10 +167,96 @@ int main( int argc, char *argv[] ) {
 			verbose = 1;
 			break;
 
+		case 'a': // Asynchronous logging
+			async_log = 1;
+			break;
+
 		case 'u': // Unit test Flag
 			unit_tests = 1;
 			break;
 
+		case 's': // Local service Flag
+			config.service = sgLocalServicePost;
+			config.features |= SG_FEATURE_RANGE_UPDATE;
+			break;
+
+		case 'z': // Compression Flag
+			config.features |= SG_FEATURE_COMPRESSION;
+			break;
+
+		case 'B': // Block size
+			config.features |= SG_FEATURE_BLOCK_SIZE;
+			config.blockSize = atoi( optarg );
+			break;
+
+		case 'b': // Benchmark mode
+			if ( strcmp(optarg, "json") && strcmp(optarg, "csv") ) {
+				fprintf( stderr, "Unknown benchmark format (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			benchFormat = optarg;
+			break;
+
+		case 'p': // Parallel streams
+			if ( (streams = atoi(optarg)) < 1 ) {
+				fprintf( stderr, "Bad number of streams (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 't': // Trace capture
+			if ( sgTraceStart(optarg) ) {
+				return( -1 );
+			}
+			break;
+
+		case 'r': // Open loop at the recorded times
+			if ( (replayFactor = atof(optarg)) <= 0 ) {
+				fprintf( stderr, "Bad replay factor (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'R': // Open loop at a fixed rate
+			if ( (replayRate = atof(optarg)) <= 0 ) {
+				fprintf( stderr, "Bad replay rate (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'P': // Driver stage spans
+			if ( startSGSpans(optarg) ) {
+				return( -1 );
+			}
+			break;
+
+		case 'm': // Periodic statistics dump
+			if ( (metrics = strchr(optarg, ':')) != NULL ) {
+				*metrics++ = 0;
+			}
+			if ( startSGStatsDump(optarg, metrics ? atoi(metrics) : 0) ) {
+				return( -1 );
+			}
+			break;
+
+		case 'F': // Flight recorder dumps
+			if ( (flight = strchr(optarg, ':')) != NULL ) {
+				*flight++ = 0;
+			}
+			if ( sgFlightConfigure(optarg, flight ? strtoull(flight, NULL, 10) * 1000 : 0, SIGUSR1) ) {
+				return( -1 );
+			}
+			break;
+
+		case 'f': // Block prefetcher
+			if ( (confidence = strchr(optarg, ':')) != NULL ) {
+				*confidence++ = 0;
+			}
+			if ( sgPrefetchConfigure(strtoull(optarg, NULL, 10), confidence ? atoi(confidence) : 60) ) {
+				return( -1 );
+			}
+			break;
+
 		case 'l': // Set the log filename
 			initializeLogWithFilename( optarg );
 			log_initialized = 1;
@@ -105,6 +279,11 @@ int main( int argc, char *argv[] ) {
 		enableLogLevels( LOG_INFO_LEVEL );
 		enableLogLevels(SGServiceLevel | SGDriverLevel | SGSimulatorLevel);
 	}
+	if ( async_log && sgLogAsyncStart() ) {
+		return( -1 );
+	}
+
+	sgConfigureEndpoint( &config );
 
 	// If exgtracting file from data
 	if (unit_tests) {
@@ -112,7 +291,9 @@ int main( int argc, char *argv[] ) {
 		// Run the unit tests
 		enableLogLevels( LOG_INFO_LEVEL );
 		logMessage(LOG_INFO_LEVEL, "Running unit tests ....");
-		if (sg_unit_test() == 0) {
+		ch = sg_unit_test();
+		sgLogAsyncStop();
+		if (ch == 0) {
 			logMessage(LOG_INFO_LEVEL, "Unit tests completed successfully.\n\n");
 		} else {
 			logMessage(LOG_ERROR_LEVEL, "Unit tests failed, aborting.\n\n");
@@ -127,7 +308,9 @@ int main( int argc, char *argv[] ) {
 		}
 
 		// Run the simulation
-		if ( simulateScatterGather(argv[optind]) == 0 ) {
+		ch = simulateScatterGather( &argv[optind], argc - optind, streams );
+		sgLogAsyncStop();
+		if ( ch == 0 ) {
 			logMessage( LOG_INFO_LEVEL, "ScatterGather.com simulation completed successfully!!!\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "ScatterGather.com simulation failed.\n\n" );
@@ -142,12 +325,106 @@ int main( int argc, char *argv[] ) {
 //
 // Function     : simulateScatterGather
 // Description  : The main control loop for the processing of the SG
-//                simulation (which calls the student code).
+//                simulation (which calls the student code).  The workload
+//                is run by one or more streams sharing the driver, each on
+//                its own thread, then the driver is shut down.
 //
-// Inputs       : wload - this is the workload filename
+// Inputs       : wloads - the workload filenames
+//                numFiles - the number of workload files
+//                streams - the number of streams to split one workload into
 // Outputs      : 0 if successful test, -1 if failure
 
-int simulateScatterGather( char *wload ) {
+int simulateScatterGather( char **wloads, int numFiles, int streams ) {
+
+	/* Local variables */
+	simStream *strms;
+	simStats total;
+	uint64_t begin;
+	int i, j, ret = 0;
+
+	/* Several files run as one stream each, otherwise the objects are split */
+	if ( numFiles > 1 ) {
+		streams = numFiles;
+	}
+	if ( (strms = calloc(streams, sizeof(simStream))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG init failed." );
+		return( -1 );
+	}
+	for ( i = 0; i < streams; i++ ) {
+		strms[i].wload = wloads[(numFiles > 1) ? i : 0];
+		strms[i].stream = i;
+		strms[i].streams = (numFiles > 1) ? 1 : streams;
+		strms[i].prefix = (numFiles > 1);
+	}
+
+	/* Run the streams, a single stream stays on this thread (counted when benchmarking) */
+	if ( benchFormat != NULL ) {
+		startSGPerfCounters();
+	}
+	begin = getSGTimeNS();
+	for ( i = 0; i < streams; i++ ) {
+		strms[i].begin = begin;
+	}
+	if ( streams == 1 ) {
+		simulateStream( &strms[0] );
+	} else {
+		for ( i = 0; i < streams; i++ ) {
+			if ( pthread_create(&strms[i].thread, NULL, simulateStream, &strms[i]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG failed starting stream %d", i );
+				strms[i].result = -1;
+				streams = i;
+				break;
+			}
+		}
+		for ( i = 0; i < streams; i++ ) {
+			pthread_join( strms[i].thread, NULL );
+		}
+	}
+
+	/* Collect the driver counters (shutdown resets them), shut down */
+	memset( &total, 0, sizeof(total) );
+	for ( j = 0; j < SIM_OP_TYPES; j++ ) {
+		initSGHistogram( &total.ops[j].latency );
+	}
+	total.elapsed = getSGTimeNS() - begin;
+	readSGPerfCounters( total.counters );
+	stopSGPerfCounters();
+	getSGCacheStats( &total.cacheLookups, &total.cacheHits, &total.cacheEvictions );
+	total.posts = sgPostCount;
+	total.bytesSent = sgBytesSent;
+	total.bytesRecv = sgBytesRecv;
+	if ( sgshutdown() ) {
+		logMessage( LOG_ERROR_LEVEL, "SG shutdown failed" );
+		ret = -1;
+	}
+
+	/* Combine the stream statistics, report */
+	for ( i = 0; i < streams; i++ ) {
+		if ( strms[i].result ) {
+			ret = -1;
+		}
+		for ( j = 0; j < SIM_OP_TYPES; j++ ) {
+			mergeSGHistogram( &total.ops[j].latency, &strms[i].stats.ops[j].latency );
+			total.ops[j].bytes += strms[i].stats.ops[j].bytes;
+		}
+	}
+	if ( (ret == 0) && (benchFormat != NULL) ) {
+		reportScatterGather( strms, streams, &total );
+	}
+	free( strms );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulateStream
+// Description  : Run the workload of one stream, with its own file table
+//                and verification (thread entry point)
+//
+// Inputs       : arg - the stream (simStream), result set on return
+// Outputs      : NULL
+
+void * simulateStream( void *arg ) {
 
 	/* Local types */
 	typedef struct {
@@ -157,42 +434,78 @@ int simulateScatterGather( char *wload ) {
 	} fsysdata;
 
     /* Local variables */
+	simStream *strm = (simStream *)arg;
     workload_state state;
     workload_operation operation;
 	SgFHandle fh;
 	AssocArray fhTable;
-	char buf[10240];
-	int opens, reads, writes, seeks, closes;
+	char buf[10240], path[sizeof(operation.objname) + 16];
+	int opens = 0, reads = 0, writes = 0, seeks = 0, closes = 0, i;
 	fsysdata *fdata;
+	uint64_t start, begin;
+	char magic[SG_WLBIN_MAGIC_SIZE];
+
+	/* Setup the statistics */
+	strm->result = -1;
+	for ( i = 0; i < SIM_OP_TYPES; i++ ) {
+		initSGHistogram( &strm->stats.ops[i].latency );
+	}
+
+	/* Compiled workloads are replayed from memory */
+	if ( (i = open(strm->wload, O_RDONLY)) != -1 ) {
+		if ( (read(i, magic, sizeof(magic)) == sizeof(magic)) && !memcmp(magic, SG_WLBIN_MAGIC, sizeof(magic)) ) {
+			strm->result = replayStream( strm, i );
+			return( NULL );
+		}
+		close( i );
+	}
+
+	/* Text workloads have no schedule, replay them closed loop only */
+	if ( (replayFactor > 0) || (replayRate > 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: open loop replay needs a compiled workload [%s]", strm->wload );
+		return( NULL );
+	}
 
 	/* Initalize the local data and simulation */
 	if ( init_assoc(&fhTable, stringCompareCallback, pointerCompareCallback) ) {
 		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG init failed." );
-		return( -1 );
+		return( NULL );
 	}
 
 	/* Open the workload for processing */
-	if ( openCmpsc311Workload(&state, wload) ) {
-		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: failed opening workload [%s]", wload );
-		return( -1 );        
+	pthread_mutex_lock( &simWorkloadLock );
+	i = openCmpsc311Workload( &state, strm->wload );
+	pthread_mutex_unlock( &simWorkloadLock );
+	if ( i ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: failed opening workload [%s]", strm->wload );
+		return( NULL );
 	}
 
 	/* Loop until we are done with the workload */
-	logMessage( SGSimulatorLevel, "CMPSC311 SG : executing workload [%s]", state.filename );
+	SG_LOG( SGSimulatorLevel, "CMPSC311 SG : executing workload [%s], stream %d", state.filename, strm->stream );
+	begin = getSGTimeNS();
 	do {
 
 		/* Get the next operation to process */
-		if ( readCmpsc311Workload(&state, &operation) ) {
+		pthread_mutex_lock( &simWorkloadLock );
+		i = readCmpsc311Workload( &state, &operation );
+		pthread_mutex_unlock( &simWorkloadLock );
+		if ( i ) {
 			logMessage( LOG_ERROR_LEVEL, "CMPSC311 workload unit test failed at line %d, get op", state.lineno );
-			return( -1 );
+			return( NULL );
+		}
+
+		/* Skip the objects of other streams */
+		if ( (operation.op != WL_EOF) && !ownsObject(strm, operation.objname) ) {
+			continue;
 		}
 
 		/* Verbose log the operation */
 		if ( (operation.op == WL_READ) || (operation.op == WL_WRITE) ) {
-			logMessage( SGSimulatorLevel, "CMPSCS311 workload op: %s %s off=%d, sz=%d [%.10s <more data follows>]", operation.objname,
+			SG_LOG_TRACE( SGSimulatorLevel, "CMPSCS311 workload op: %s %s off=%d, sz=%d [%.10s <more data follows>]", operation.objname,
 				workload_operations_strings[operation.op], operation.pos, operation.size, operation.data );
 		} else {
-			logMessage( SGSimulatorLevel, "CMPSCS311 workload op: %s %s", operation.objname, 
+			SG_LOG_TRACE( SGSimulatorLevel, "CMPSCS311 workload op: %s %s", operation.objname,
 				workload_operations_strings[operation.op] );
 		}
 
@@ -201,11 +514,18 @@ int simulateScatterGather( char *wload ) {
 
 			case WL_OPEN: /* Open the file for reading/writing, check error */
 
-				/* Open the file for reading */
-				if ( (fh = sgopen(operation.objname)) == -1 ) {
+				/* Open the file for reading (under the stream's name for its own files) */
+				if ( strm->prefix ) {
+					snprintf( path, sizeof(path), "%d:%s", strm->stream, operation.objname );
+				} else {
+					strcpy( path, operation.objname );
+				}
+				start = getSGTimeNS();
+				if ( (fh = sgopen(path)) == -1 ) {
 					logMessage( LOG_ERROR_LEVEL, "SG error opening file [%s], aborting", operation.objname );
-					return( -1 );
+					return( NULL );
 				}
+				recordSGHistogram( &strm->stats.ops[WL_OPEN].latency, getSGTimeNS() - start );
 
 				/* Setup the structure */
 				fdata = malloc( sizeof(fsysdata) );
@@ -215,7 +535,7 @@ int simulateScatterGather( char *wload ) {
 
 				/* Insert the file into the table */
 				insert_assoc( &fhTable, fdata->filename, fdata );
-				logMessage( SGSimulatorLevel, "SG Open file [%s]", fdata->filename );
+				SG_LOG_TRACE( SGSimulatorLevel, "SG Open file [%s]", fdata->filename );
 				opens ++;
 				break;
 
@@ -223,40 +543,45 @@ int simulateScatterGather( char *wload ) {
 
 				/* Find the file for processing */
 				if ( (fdata = find_assoc(&fhTable, operation.objname)) == NULL ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error reading unknown file [%s], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error reading unknown file [%s], aborting",
 						operation.objname );
-					return( -1 );
+					return( NULL );
 				}
 
 				/* If the position within the file is not a read location, seek */
 				if ( fdata->pos != operation.pos ) {
+					start = getSGTimeNS();
 					if ( sgseek(fdata->fhandle, operation.pos) != operation.pos ) {
-						logMessage( LOG_ERROR_LEVEL, "SG error seek failed [%s, pos=%d], aborting", 
+						logMessage( LOG_ERROR_LEVEL, "SG error seek failed [%s, pos=%d], aborting",
 							operation.objname, operation.pos );
-						return( -1 );
+						return( NULL );
 					}
+					recordSGHistogram( &strm->stats.ops[SIM_OP_SEEK].latency, getSGTimeNS() - start );
 					fdata->pos = operation.pos;
 					seeks ++;
 				}
 
 				/* Now do the read from the file */
+				start = getSGTimeNS();
 				if ( sgread(fdata->fhandle, buf, operation.size) != operation.size ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error read failed [%s, pos=%d, size=%d], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error read failed [%s, pos=%d, size=%d], aborting",
 						operation.objname, operation.pos, operation.size );
-					return( -1 );
+					return( NULL );
 				}
+				recordSGHistogram( &strm->stats.ops[WL_READ].latency, getSGTimeNS() - start );
+				strm->stats.ops[WL_READ].bytes += operation.size;
 
 				/* Compare the data read with that in the workload data */
 				if ( strncmp(buf, operation.data, operation.size) != 0 ) {
 					logMessage( LOG_ERROR_LEVEL, "SG read data compare failed, aborting" );
 					logMessage( LOG_ERROR_LEVEL, "Read data     : [%s]", buf );
 					logMessage( LOG_ERROR_LEVEL, "Expected data : [%s]", operation.data );
-					return( -1 );
+					return( NULL );
 				}
 
 				/* Now increment the file position, log the data */
 				fdata->pos += operation.size;
-				logMessage( SGSimulatorLevel, "Correctly read from [%s], %d bytes at position %d", 
+				SG_LOG_TRACE( SGSimulatorLevel, "Correctly read from [%s], %d bytes at position %d",
 					fdata->filename, operation.size, operation.pos );
 				reads ++;
 				break;
@@ -265,32 +590,37 @@ int simulateScatterGather( char *wload ) {
 
 				/* Find the file for processing */
 				if ( (fdata = find_assoc(&fhTable, operation.objname)) == NULL ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error writing unknown file [%s], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error writing unknown file [%s], aborting",
 						operation.objname );
-					return( -1 );
+					return( NULL );
 				}
 
 				/* If the position within the file is not a read location, seek */
 				if ( fdata->pos != operation.pos ) {
+					start = getSGTimeNS();
 					if ( sgseek(fdata->fhandle, operation.pos) != operation.pos ) {
-						logMessage( LOG_ERROR_LEVEL, "SG error seek failed [%s, pos=%d], aborting", 
+						logMessage( LOG_ERROR_LEVEL, "SG error seek failed [%s, pos=%d], aborting",
 							operation.objname, operation.pos );
-						return( -1 );
+						return( NULL );
 					}
+					recordSGHistogram( &strm->stats.ops[SIM_OP_SEEK].latency, getSGTimeNS() - start );
 					fdata->pos = operation.pos;
 					seeks ++;
 				}
 
 				/* Now do the write to the file */
+				start = getSGTimeNS();
 				if ( sgwrite(fdata->fhandle, operation.data, operation.size) != operation.size ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error write failed [%s, pos=%d, size=%d], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error write failed [%s, pos=%d, size=%d], aborting",
 						operation.objname, operation.pos, operation.size );
-					return( -1 );
+					return( NULL );
 				}
+				recordSGHistogram( &strm->stats.ops[WL_WRITE].latency, getSGTimeNS() - start );
+				strm->stats.ops[WL_WRITE].bytes += operation.size;
 
 				/* Now increment the file position, log the data */
 				fdata->pos += operation.size;
-				logMessage( SGSimulatorLevel, "Wrote data to file [%s], %d bytes at position %d", 
+				SG_LOG_TRACE( SGSimulatorLevel, "Wrote data to file [%s], %d bytes at position %d",
 					fdata->filename, operation.size, operation.pos );
 				writes ++;
 				break;
@@ -299,44 +629,364 @@ int simulateScatterGather( char *wload ) {
 
 				/* Find the file for processing */
 				if ( (fdata = find_assoc(&fhTable, operation.objname)) == NULL ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error closing unknown file [%s], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error closing unknown file [%s], aborting",
 						operation.objname );
-					return( -1 );
+					return( NULL );
 				}
 
 				/* Now close the file */
+				start = getSGTimeNS();
 				if ( sgclose(fdata->fhandle) != 0 ) {
-					logMessage( LOG_ERROR_LEVEL, "SG error close failed [%s, pos=%d, size=%d], aborting", 
+					logMessage( LOG_ERROR_LEVEL, "SG error close failed [%s, pos=%d, size=%d], aborting",
 						operation.objname, operation.pos, operation.size );
-					return( -1 );
+					return( NULL );
 				}
+				recordSGHistogram( &strm->stats.ops[WL_CLOSE].latency, getSGTimeNS() - start );
 
 				/* Remove file from file handle table, clean up structures, log */
-				logMessage( SGSimulatorLevel, "Closed file [%s].", fdata->filename );
+				SG_LOG_TRACE( SGSimulatorLevel, "Closed file [%s].", fdata->filename );
 				delete_assoc( &fhTable, fdata->filename );
 				free( fdata->filename );
 				free( fdata );
 				closes ++;
 				break;
 
-			case WL_EOF: // End of the workload file
-				if ( sgshutdown() ) {
-					logMessage( LOG_ERROR_LEVEL, "SG shutdown failed" );
-					return( -1 );
-				}
-				logMessage( SGSimulatorLevel, "End of the workload file (processed)" );
+			case WL_EOF: // End of the workload file (the driver is shut down after all streams)
+				SG_LOG_TRACE( SGSimulatorLevel, "End of the workload file (processed)" );
 				break;
 
 			default: /* Unknown oepration type, bailout */
 				logMessage( LOG_ERROR_LEVEL, "Scatter/gather bad operation type [%d]", operation.op );
-				return( -1 );
+				return( NULL );
 
 		}
 
 	} while ( operation.op < WL_EOF );
-	
+
 	/* Log, close workload and delete the local file, return successfully  */
+	strm->stats.elapsed = getSGTimeNS() - begin;
+	SG_LOG( SGSimulatorLevel, "CMPSC311 SG : %d opens, %d reads, %d writes, %d seeks, %d closes",
+		opens, reads, writes, seeks, closes );
+	pthread_mutex_lock( &simWorkloadLock );
 	closeCmpsc311Workload( &state );
+	pthread_mutex_unlock( &simWorkloadLock );
+	strm->result = 0;
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replayStream
+// Description  : Replay a compiled workload (see sg_wlbin.h).  The file is
+//                mapped, writes pass pointers into the data heap straight
+//                to the driver and reads are checked against it, so the
+//                loop does no parsing or copying.
+//
+// Inputs       : strm - the stream replaying the workload
+//                fd - the open workload file (closed here)
+// Outputs      : 0 if successful test, -1 if failure
+
+int replayStream( simStream *strm, int fd ) {
+
+	/* Local variables */
+	struct stat st;
+	char *base, *heap, buf[CMPSC311_MAX_OPSIZE_MAXIMUM], path[SG_WLBIN_MAX_NAME + 16];
+	SG_Wlbin_Header *hdr;
+	SG_Wlbin_Op *ops, *op;
+	uint32_t *nameOffsets;
+	SgFHandle *handles;
+	uint64_t *positions, *times = NULL, i, start, begin, due = 0;
+	simStats *stats = &strm->stats;
+	char *owned;
+	const char *name;
+	int ret = -1;
+
+	/* Map the workload, check that the sections fit in it */
+	if ( fstat(fd, &st) || (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: failed mapping workload [%s]", strm->wload );
+		close( fd );
+		return( -1 );
+	}
+	close( fd );
+	hdr = (SG_Wlbin_Header *)base;
+	if ( (st.st_size < sizeof(*hdr)) || (hdr->version != SG_WLBIN_VERSION) || (hdr->numOps == 0) ||
+			(hdr->opsOffset + hdr->numOps * sizeof(SG_Wlbin_Op) > hdr->heapOffset) ||
+			(hdr->timesOffset && (hdr->timesOffset + hdr->numOps * sizeof(uint64_t) > hdr->heapOffset)) ||
+			(hdr->heapOffset + hdr->heapSize > st.st_size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: bad compiled workload [%s]", strm->wload );
+		munmap( base, st.st_size );
+		return( -1 );
+	}
+	if ( replayFactor > 0 ) {
+		if ( hdr->timesOffset == 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "CMPSC311 SG workload: no issue times in [%s] (capture a trace with -t)", strm->wload );
+			munmap( base, st.st_size );
+			return( -1 );
+		}
+		times = (uint64_t *)(base + hdr->timesOffset);
+	}
+	madvise( base, st.st_size, MADV_SEQUENTIAL );
+	nameOffsets = (uint32_t *)(base + hdr->namesOffset);
+	ops = (SG_Wlbin_Op *)(base + hdr->opsOffset);
+	heap = base + hdr->heapOffset;
+	handles = malloc( hdr->numObjects * sizeof(SgFHandle) );
+	positions = calloc( hdr->numObjects, sizeof(uint64_t) );
+	owned = malloc( hdr->numObjects );
+	for ( i = 0; i < hdr->numObjects; i++ ) {
+		owned[i] = ownsObject( strm, base + hdr->namesData + nameOffsets[i] );
+	}
+
+	/* Replay the operations */
+	SG_LOG( SGSimulatorLevel, "CMPSC311 SG : replaying compiled workload [%s], %lu operations, stream %d",
+		strm->wload, hdr->numOps, strm->stream );
+	begin = strm->begin;
+	for ( i = 0; i < hdr->numOps; i++ ) {
+		op = &ops[i];
+		if ( (op->op != WL_EOF) && !owned[op->object] ) {
+			continue;
+		}
+
+		/* Open loop, wait for the scheduled time, latencies count from it */
+		if ( (op->op != WL_EOF) && (times || (replayRate > 0)) ) {
+			due = begin + (times ? (uint64_t)(times[i] / replayFactor) : (uint64_t)(i * 1e9 / replayRate));
+			waitUntil( due );
+			recordSGHistogram( &stats->ops[SIM_OP_DELAY].latency, getSGTimeNS() - due );
+		}
+		name = base + hdr->namesData + nameOffsets[op->object];
+		switch ( op->op ) {
+
+			case WL_OPEN: /* Open the file, remember the handle */
+				if ( strm->prefix ) {
+					snprintf( path, sizeof(path), "%d:%s", strm->stream, name );
+					name = path;
+				}
+				start = getSGTimeNS();
+				if ( (handles[op->object] = sgopen(name)) == -1 ) {
+					logMessage( LOG_ERROR_LEVEL, "SG error opening file [%s], aborting", name );
+					goto done;
+				}
+				recordSGHistogram( &stats->ops[WL_OPEN].latency, getSGTimeNS() - (due ? due : start) );
+				positions[op->object] = 0;
+				break;
+
+			case WL_READ: /* Read and check against the data heap */
+			case WL_WRITE: /* Write straight from the data heap */
+				if ( positions[op->object] != op->pos ) {
+					start = getSGTimeNS();
+					if ( sgseek(handles[op->object], op->pos) != op->pos ) {
+						logMessage( LOG_ERROR_LEVEL, "SG error seek failed [%s, pos=%lu], aborting", name, op->pos );
+						goto done;
+					}
+					recordSGHistogram( &stats->ops[SIM_OP_SEEK].latency, getSGTimeNS() - start );
+				}
+				start = getSGTimeNS();
+				if ( op->op == WL_READ ) {
+					if ( sgread(handles[op->object], buf, op->size) != op->size ) {
+						logMessage( LOG_ERROR_LEVEL, "SG error read failed [%s, pos=%lu, size=%d], aborting",
+							name, op->pos, op->size );
+						goto done;
+					}
+				} else if ( sgwrite(handles[op->object], heap + op->data, op->size) != op->size ) {
+					logMessage( LOG_ERROR_LEVEL, "SG error write failed [%s, pos=%lu, size=%d], aborting",
+						name, op->pos, op->size );
+					goto done;
+				}
+				recordSGHistogram( &stats->ops[op->op].latency, getSGTimeNS() - (due ? due : start) );
+				stats->ops[op->op].bytes += op->size;
+				if ( (op->op == WL_READ) && memcmp(buf, heap + op->data, op->size) ) {
+					logMessage( LOG_ERROR_LEVEL, "SG read data compare failed [%s, pos=%lu, size=%d], aborting",
+						name, op->pos, op->size );
+					goto done;
+				}
+				positions[op->object] = op->pos + op->size;
+				break;
+
+			case WL_CLOSE: /* Close the file */
+				start = getSGTimeNS();
+				if ( sgclose(handles[op->object]) != 0 ) {
+					logMessage( LOG_ERROR_LEVEL, "SG error close failed [%s], aborting", name );
+					goto done;
+				}
+				recordSGHistogram( &stats->ops[WL_CLOSE].latency, getSGTimeNS() - (due ? due : start) );
+				break;
+
+			case WL_EOF: /* End of the workload (the driver is shut down after all streams) */
+				SG_LOG_TRACE( SGSimulatorLevel, "End of the workload file (processed)" );
+				break;
+
+			default: /* Unknown oepration type, bailout */
+				logMessage( LOG_ERROR_LEVEL, "Scatter/gather bad operation type [%d]", op->op );
+				goto done;
+		}
+	}
+	stats->elapsed = getSGTimeNS() - begin;
+	ret = 0;
+
+done:
+	/* Clean up, return the result */
+	free( handles );
+	free( positions );
+	free( owned );
+	munmap( base, st.st_size );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : ownsObject
+// Description  : Check if an object belongs to a stream, objects are spread
+//                over the streams sharing a workload by a hash of the name
+//
+// Inputs       : strm - the stream
+//                name - the object name
+// Outputs      : 1 if the stream runs the object's operations, 0 if not
+
+int ownsObject( simStream *strm, const char *name ) {
+	uint32_t hash = 2166136261u;
+
+	if ( strm->streams == 1 ) {
+		return( 1 );
+	}
+	while ( *name ) {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return( (int)(hash % strm->streams) == strm->stream );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : waitUntil
+// Description  : Wait for a scheduled time, sleeping for long waits and
+//                spinning for the last part (or a late schedule, not at all)
+//
+// Inputs       : due - the time to wait for (getSGTimeNS clock)
+// Outputs      : none
+
+void waitUntil( uint64_t due ) {
+	struct timespec ts;
+	uint64_t now = getSGTimeNS();
+
+	if ( due > now + 200000 ) {
+		ts.tv_sec = (due - 100000) / 1000000000ULL;
+		ts.tv_nsec = (due - 100000) % 1000000000ULL;
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL );
+	}
+	while ( getSGTimeNS() < due );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : reportScatterGather
+// Description  : Print the benchmark results of a simulation to stdout, in
+//                the format selected with -b.  Per operation rates are over
+//                the time spent in that operation, the overall rates are over
+//                the wall clock time of the workload (or of the stream).
+//
+// Inputs       : strms - the streams of the simulation
+//                numStreams - the number of streams
+//                total - the statistics of all streams (with driver counters)
+// Outputs      : 0 if successful, -1 if failure
+
+int reportScatterGather( simStream *strms, int numStreams, simStats *total ) {
+
+	/* Local variables */
+	const char *names[SIM_OP_TYPES] = { "open", "write", "read", "close", "seek", "delay" };
+	double secs, hitRate;
+	uint64_t count;
+	simStats *stats;
+	SG_Histogram *h;
+	char label[16];
+	int i, j, s;
+
+	hitRate = total->cacheLookups ? (double)total->cacheHits / total->cacheLookups : 0.0;
+
+	if ( strcmp(benchFormat, "csv") == 0 ) {
+
+		/* One row per stream (all first) and operation type, run-wide values repeated on each */
+		printf( "workload,block_size,stream,op,count,ops_per_sec,bytes,bytes_per_sec,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,"
+			"cache_hit_rate,service_posts,bytes_sent,bytes_recv" );
+		for ( i = 0; i < SG_PERFCTR_COUNT; i++ ) {
+			printf( ",%s", sgPerfCtrNames[i] );
+		}
+		printf( "\n" );
+		for ( s = -1; s < ((numStreams > 1) ? numStreams : 0); s++ ) {
+			stats = (s < 0) ? total : &strms[s].stats;
+			if ( s < 0 ) {
+				strcpy( label, "all" );
+			} else {
+				snprintf( label, sizeof(label), "%d", s );
+			}
+			for ( i = 0; i < SIM_OP_TYPES; i++ ) {
+				h = &stats->ops[i].latency;
+				secs = h->total / 1e9;
+				printf( "%s,%lu,%s,%s,%lu,%.1f,%lu,%.1f,%.1f,%lu,%lu,%lu,%lu,%lu,%.4f,%lu,%lu,%lu",
+					strms[(s < 0) ? 0 : s].wload, sgBlockSize, label, names[i], h->count,
+					secs > 0 ? h->count / secs : 0.0, stats->ops[i].bytes, secs > 0 ? stats->ops[i].bytes / secs : 0.0,
+					h->count ? (double)h->total / h->count : 0.0, getSGHistogramPercentile(h, 50), getSGHistogramPercentile(h, 90),
+					getSGHistogramPercentile(h, 99), getSGHistogramPercentile(h, 99.9), h->max,
+					hitRate, total->posts, total->bytesSent, total->bytesRecv );
+				for ( j = 0; j < SG_PERFCTR_COUNT; j++ ) {
+					if ( total->counters[j] < 0 ) {
+						printf( "," );
+					} else {
+						printf( ",%ld", total->counters[j] );
+					}
+				}
+				printf( "\n" );
+			}
+		}
+
+	} else {
+
+		/* A single JSON object, the per stream results in an array */
+		printf( "{\n  \"workload\": \"%s\",\n  \"block_size\": %lu,\n  \"streams\": %d,\n", strms[0].wload,
+			sgBlockSize, numStreams );
+		printf( "  \"schedule\": { \"mode\": \"%s\", \"rate_factor\": %.3f, \"arrival_rate\": %.1f },\n",
+			((replayFactor > 0) || (replayRate > 0)) ? "open" : "closed", replayFactor, replayRate );
+		for ( s = -1; s < ((numStreams > 1) ? numStreams : 0); s++ ) {
+			stats = (s < 0) ? total : &strms[s].stats;
+			for ( i = 0, count = 0; i < SIM_OP_DELAY; i++ ) {
+				count += stats->ops[i].latency.count;
+			}
+			if ( s == 0 ) {
+				printf( "  \"per_stream\": [\n" );
+			}
+			if ( s >= 0 ) {
+				printf( "   {\n  \"stream\": %d,\n  \"workload\": \"%s\",\n", s, strms[s].wload );
+			}
+			printf( "  \"elapsed_sec\": %.6f,\n  \"ops_per_sec\": %.1f,\n  \"ops\": {\n", stats->elapsed / 1e9,
+				stats->elapsed ? count / (stats->elapsed / 1e9) : 0.0 );
+			for ( i = 0; i < SIM_OP_TYPES; i++ ) {
+				h = &stats->ops[i].latency;
+				secs = h->total / 1e9;
+				printf( "    \"%s\": { \"count\": %lu, \"ops_per_sec\": %.1f, \"bytes\": %lu, \"bytes_per_sec\": %.1f, "
+					"\"mean_ns\": %.1f, \"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu }%s\n",
+					names[i], h->count, secs > 0 ? h->count / secs : 0.0, stats->ops[i].bytes,
+					secs > 0 ? stats->ops[i].bytes / secs : 0.0, h->count ? (double)h->total / h->count : 0.0,
+					getSGHistogramPercentile(h, 50), getSGHistogramPercentile(h, 90), getSGHistogramPercentile(h, 99),
+					getSGHistogramPercentile(h, 99.9), h->max, (i < SIM_OP_TYPES - 1) ? "," : "" );
+			}
+			if ( s < 0 ) {
+				printf( "  },\n" );
+			} else {
+				printf( "  }\n   }%s\n", (s < numStreams - 1) ? "," : "\n  ],"  );
+			}
+		}
+		printf( "  \"cache\": { \"lookups\": %lu, \"hits\": %lu, \"hit_rate\": %.4f, \"evictions\": %lu },\n"
+			"  \"service\": { \"posts\": %lu, \"bytes_sent\": %lu, \"bytes_recv\": %lu },\n  \"counters\": {",
+			total->cacheLookups, total->cacheHits, hitRate, total->cacheEvictions, total->posts, total->bytesSent,
+			total->bytesRecv );
+		for ( j = 0; j < SG_PERFCTR_COUNT; j++ ) {
+			if ( total->counters[j] < 0 ) {
+				printf( "%s \"%s\": null", j ? "," : "", sgPerfCtrNames[j] );
+			} else {
+				printf( "%s \"%s\": %ld", j ? "," : "", sgPerfCtrNames[j], total->counters[j] );
+			}
+		}
+		printf( " }\n}\n" );
+	}
+
+	/* Return successfully */
 	return( 0 );
 }
 
@@ -354,7 +1004,7 @@ int sg_unit_test( void ) {
     logMessage( LOG_INFO_LEVEL, "ScatterGather: beginning unit tests ..." );
 
     // Do the UNIT tests
-    if ( packetUnitTest() ) {
+    if ( packetUnitTest() || schedUnitTest() ) {
         logMessage( LOG_ERROR_LEVEL, "ScatterGather: unit tests failed." );
         return( -1 );
     }
@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_span.c
+//  Description    : This file contains the per-request tracing of the driver
+//                   stages.  Each thread appends its spans to its own chunked
+//                   buffer (no locking after the first span of a thread), and
+//                   all buffers are written out at once as Chrome trace-event
+//                   JSON, one track per thread.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_span.h>
+
+//
+// Type definitions
+
+// A span as recorded
+typedef struct {
+    const char *name;  // the stage
+    uint64_t    begin; // start time (ns)
+    uint64_t    end;   // end time (ns)
+} SG_Span_Event;
+
+// A chunk of a thread's buffer
+typedef struct SG_Span_Chunk {
+    struct SG_Span_Chunk *next;                  // next chunk of the thread
+    uint32_t              used;                  // events used in the chunk
+    SG_Span_Event         events[SG_SPAN_CHUNK]; // the events
+} SG_Span_Chunk;
+
+// The buffer of a thread
+typedef struct SG_Span_Thread {
+    struct SG_Span_Thread *next;    // next registered thread
+    int                    tid;     // track number in the trace
+    uint64_t               count;   // events recorded
+    uint64_t               dropped; // events past SG_SPAN_MAX_EVENTS
+    SG_Span_Chunk         *first;   // the chunks, oldest first
+    SG_Span_Chunk         *last;    // the chunk being filled
+} SG_Span_Thread;
+
+//
+// Global data
+
+int sgSpansEnabled = 0; // Spans are being recorded
+char *sgSpansPath = NULL; // Where the trace goes
+int sgSpansGeneration = 0; // Bumped each start, stale thread buffers are re-registered
+SG_Span_Thread *sgSpanThreads = NULL; // The registered thread buffers
+int sgSpanThreadCount = 0; // Threads registered
+pthread_mutex_t sgSpanLock = PTHREAD_MUTEX_INITIALIZER; // Protects the thread list
+__thread SG_Span_Thread *sgSpanLocal = NULL; // This thread's buffer
+__thread int sgSpanLocalGen = 0; // Generation of this thread's buffer
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : startSGSpans
+// Description  : Start recording spans, to be written to path by dumpSGSpans
+//                (must be called before the threads that trace start)
+//
+// Inputs       : path - the file to write the Chrome trace to
+// Outputs      : 0 if successful, -1 if failure
+
+int startSGSpans( const char *path ) {
+    if ((sgSpansPath = strdup(path)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "startSGSpans: out of memory");
+        return -1;
+    }
+    sgSpansGeneration++;
+    sgSpansEnabled = 1;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : recordSGSpan
+// Description  : Record a span in the calling thread's buffer
+//
+// Inputs       : name - the stage (a literal, kept by pointer)
+//                begin - the start time (ns)
+//                end - the end time (ns)
+// Outputs      : none
+
+void recordSGSpan( const char *name, uint64_t begin, uint64_t end ) {
+    SG_Span_Thread *thr = sgSpanLocal;
+    SG_Span_Chunk *chunk;
+    SG_Span_Event *evt;
+
+    // a span that ended after the dump
+    if (!sgSpansEnabled) {
+        return;
+    }
+
+    // first span of this thread, register its buffer
+    if (sgSpanLocalGen != sgSpansGeneration) {
+        if ((thr = calloc(1, sizeof(SG_Span_Thread))) == NULL) {
+            return;
+        }
+        pthread_mutex_lock(&sgSpanLock);
+        thr->tid = ++sgSpanThreadCount;
+        thr->next = sgSpanThreads;
+        sgSpanThreads = thr;
+        pthread_mutex_unlock(&sgSpanLock);
+        sgSpanLocal = thr;
+        sgSpanLocalGen = sgSpansGeneration;
+    }
+    if (thr->count >= SG_SPAN_MAX_EVENTS) {
+        thr->dropped++;
+        return;
+    }
+    if ((thr->last == NULL) || (thr->last->used == SG_SPAN_CHUNK)) {
+        if ((chunk = malloc(sizeof(SG_Span_Chunk))) == NULL) {
+            thr->dropped++;
+            return;
+        }
+        chunk->next = NULL;
+        chunk->used = 0;
+        if (thr->last) {
+            thr->last->next = chunk;
+        } else {
+            thr->first = chunk;
+        }
+        thr->last = chunk;
+    }
+    evt = &thr->last->events[thr->last->used++];
+    evt->name = name;
+    evt->begin = begin;
+    evt->end = end;
+    thr->count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dumpSGSpans
+// Description  : Write the recorded spans as Chrome trace JSON ("X" complete
+//                events in microseconds, relative to the first span) and stop
+//                recording.  No other thread may be tracing at this point.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int dumpSGSpans( void ) {
+    SG_Span_Thread *thr;
+    SG_Span_Chunk *chunk;
+    SG_Span_Event *evt;
+    uint64_t base = UINT64_MAX, count = 0, dropped = 0;
+    uint32_t i;
+    FILE *out;
+    int ret = 0;
+
+    if (!sgSpansEnabled) {
+        return 0;
+    }
+    sgSpansEnabled = 0;
+    for (thr = sgSpanThreads; thr != NULL; thr = thr->next) {
+        for (chunk = thr->first; chunk != NULL; chunk = chunk->next) {
+            for (i = 0; i < chunk->used; i++) {
+                base = (chunk->events[i].begin < base) ? chunk->events[i].begin : base;
+            }
+        }
+    }
+
+    // one track per thread, the nesting of the spans shows the stages
+    if ((out = fopen(sgSpansPath, "w")) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "dumpSGSpans: failed opening [%s]", sgSpansPath);
+        ret = -1;
+    } else {
+        fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"sg_driver\"}}");
+        for (thr = sgSpanThreads; thr != NULL; thr = thr->next) {
+            fprintf(out, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                    thr->tid, thr->tid);
+            for (chunk = thr->first; chunk != NULL; chunk = chunk->next) {
+                for (i = 0, evt = chunk->events; i < chunk->used; i++, evt++) {
+                    fprintf(out, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            evt->name, thr->tid, (evt->begin - base) / 1000.0, (evt->end - evt->begin) / 1000.0);
+                }
+            }
+            count += thr->count;
+            dropped += thr->dropped;
+        }
+        fprintf(out, "\n]}\n");
+        if (fclose(out)) {
+            logMessage(LOG_ERROR_LEVEL, "dumpSGSpans: failed writing [%s]", sgSpansPath);
+            ret = -1;
+        }
+    }
+    if (dropped) {
+        logMessage(LOG_WARNING_LEVEL, "dumpSGSpans: %lu spans dropped (over %d per thread)", dropped, SG_SPAN_MAX_EVENTS);
+    }
+    logMessage(LOG_INFO_LEVEL, "Wrote span trace [%s], %lu spans.", sgSpansPath, count);
+
+    // release the buffers
+    while ((thr = sgSpanThreads) != NULL) {
+        sgSpanThreads = thr->next;
+        while ((chunk = thr->first) != NULL) {
+            thr->first = chunk->next;
+            free(chunk);
+        }
+        free(thr);
+    }
+    sgSpanThreadCount = 0;
+    free(sgSpansPath);
+    sgSpansPath = NULL;
+    return ret;
+}
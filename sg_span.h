@@ -0,0 +1,69 @@
+#ifndef SG_SPAN_INCLUDED
+#define SG_SPAN_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_span.h
+//  Description    : This is the declaration of the per-request tracing of
+//                   the driver stages (cache, serialize, service post, ...).
+//                   Spans are recorded into per-thread buffers and written
+//                   as Chrome trace-event JSON (chrome://tracing, Perfetto).
+//                   When tracing is off a span costs one test of a global.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+#include <time.h>
+
+//
+// Defines
+#define SG_SPAN_CHUNK 65536           // events per buffer allocation
+#define SG_SPAN_MAX_EVENTS (1 << 22)  // events kept per thread, later ones are dropped
+
+// Time the rest of the enclosing block as a span called nm (a literal)
+#define SG_SPAN_VAR2(line) sgSpan_##line
+#define SG_SPAN_VAR(line) SG_SPAN_VAR2(line)
+#define SG_SPAN(nm) \
+    SG_Span SG_SPAN_VAR(__LINE__) __attribute__((cleanup(endSGSpan))) = \
+        { (nm), sgSpansEnabled ? getSGSpanTime() : 0 }
+
+// Type definitions
+typedef struct {
+    const char *name;  // the stage
+    uint64_t    begin; // start time (ns), 0 if not tracing
+} SG_Span;
+
+//
+// Global data
+extern int sgSpansEnabled; // Spans are being recorded
+
+//
+// Span functions
+
+int startSGSpans( const char *path );
+    // Start recording spans, to be written to path by dumpSGSpans
+
+void recordSGSpan( const char *name, uint64_t begin, uint64_t end );
+    // Record a span in the calling thread's buffer
+
+int dumpSGSpans( void );
+    // Write the recorded spans as Chrome trace JSON and stop recording
+
+// Get a monotonic timestamp in nanoseconds
+static inline uint64_t getSGSpanTime( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// End a span at the end of its block
+static inline void endSGSpan( SG_Span *span ) {
+    if (span->begin) {
+        recordSGSpan(span->name, span->begin, getSGSpanTime());
+    }
+}
+
+#endif
@@ -0,0 +1,303 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_stats.c
+//  Description    : This file contains the export of the driver statistics in
+//                   the Prometheus text format.  The file is written to a
+//                   temporary name and renamed, so a reader never sees a
+//                   partial dump.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_stats.h>
+
+//
+// Global data
+
+// Label values of the driver calls, the post classes and the service operations
+const char *sgStatsCallNames[SG_CALL_TYPES] = { "open", "read", "write", "seek", "close", "clone", "import", "export", "advise" };
+const char *sgStatsClassNames[SG_POST_CLASSES] = { "read", "write", "prefetch", "flush" };
+const char *sgStatsOpNames[SG_MAXVAL_EXT_OP] = { "init_endpoint", "stop_endpoint", "create_block", "update_block",
+                                                 "obtain_block", "delete_block", "update_range" };
+
+// Histogram bucket bounds (ns), exported in seconds
+const uint64_t sgStatsBounds[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+                                   1000000, 2500000, 5000000, 10000000, 100000000, 1000000000 };
+#define SG_STATS_BOUNDS (sizeof(sgStatsBounds) / sizeof(uint64_t))
+
+char *sgStatsPath = NULL; // Where the periodic dump goes, NULL if none
+unsigned sgStatsInterval; // Dump interval (ms)
+int sgStatsStopping; // The dump thread should exit
+pthread_t sgStatsThread; // The dump thread
+pthread_mutex_t sgStatsLock = PTHREAD_MUTEX_INITIALIZER; // Protects the stop flag
+pthread_cond_t sgStatsWake = PTHREAD_COND_INITIALIZER; // Wakes the dump thread to stop
+
+//
+// Functional Prototypes
+
+void writeSGStatsHistogram( FILE *out, const char *name, const char *label, const char *value, SG_Histogram *hist );
+void * sgStatsDumper( void *arg );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeSGStatsPrometheus
+// Description  : Write the statistics in the Prometheus text format
+//
+// Inputs       : stats - the statistics
+//                out - the file to write to
+// Outputs      : 0 if successful, -1 if failure
+
+int writeSGStatsPrometheus( SG_Driver_Stats *stats, FILE *out ) {
+    int i;
+
+    fprintf(out, "# HELP sg_packets_posted_total Packets posted to the service.\n"
+                 "# TYPE sg_packets_posted_total counter\n");
+    for (i = 0; i < SG_MAXVAL_EXT_OP; i++) {
+        fprintf(out, "sg_packets_posted_total{op=\"%s\"} %lu\n", sgStatsOpNames[i], stats->posts[i]);
+    }
+    fprintf(out, "# HELP sg_service_sent_bytes_total Bytes sent to the service.\n"
+                 "# TYPE sg_service_sent_bytes_total counter\n"
+                 "sg_service_sent_bytes_total %lu\n", stats->bytesSent);
+    fprintf(out, "# HELP sg_service_received_bytes_total Bytes received from the service.\n"
+                 "# TYPE sg_service_received_bytes_total counter\n"
+                 "sg_service_received_bytes_total %lu\n", stats->bytesRecv);
+    fprintf(out, "# HELP sg_cache_lookups_total Block cache lookups.\n"
+                 "# TYPE sg_cache_lookups_total counter\n"
+                 "sg_cache_lookups_total %lu\n", stats->cacheLookups);
+    fprintf(out, "# HELP sg_cache_hits_total Block cache hits.\n"
+                 "# TYPE sg_cache_hits_total counter\n"
+                 "sg_cache_hits_total %lu\n", stats->cacheHits);
+    fprintf(out, "# HELP sg_cache_misses_total Block cache misses.\n"
+                 "# TYPE sg_cache_misses_total counter\n"
+                 "sg_cache_misses_total %lu\n", stats->cacheMisses);
+    fprintf(out, "# HELP sg_cache_evictions_total Blocks evicted from the cache.\n"
+                 "# TYPE sg_cache_evictions_total counter\n"
+                 "sg_cache_evictions_total %lu\n", stats->cacheEvictions);
+    fprintf(out, "# HELP sg_open_files Files currently open.\n"
+                 "# TYPE sg_open_files gauge\n"
+                 "sg_open_files %lu\n", stats->openFiles);
+    fprintf(out, "# HELP sg_hole_reads_total Reads served from holes.\n"
+                 "# TYPE sg_hole_reads_total counter\n"
+                 "sg_hole_reads_total %lu\n", stats->holeReads);
+    fprintf(out, "# HELP sg_hole_writes_total All-zero blocks kept as holes.\n"
+                 "# TYPE sg_hole_writes_total counter\n"
+                 "sg_hole_writes_total %lu\n", stats->holeWrites);
+    fprintf(out, "# HELP sg_elided_writes_total Writes that left their block unchanged, no update sent.\n"
+                 "# TYPE sg_elided_writes_total counter\n"
+                 "sg_elided_writes_total %lu\n", stats->elidedWrites);
+    fprintf(out, "# HELP sg_shared_blocks Blocks shared by cloned files.\n"
+                 "# TYPE sg_shared_blocks gauge\n"
+                 "sg_shared_blocks %lu\n", stats->sharedBlocks);
+    fprintf(out, "# HELP sg_copied_blocks_total Shared blocks copied on a write.\n"
+                 "# TYPE sg_copied_blocks_total counter\n"
+                 "sg_copied_blocks_total %lu\n", stats->copiedBlocks);
+    fprintf(out, "# HELP sg_import_bytes_total Bytes of local files imported.\n"
+                 "# TYPE sg_import_bytes_total counter\n"
+                 "sg_import_bytes_total %lu\n", stats->importBytes);
+    fprintf(out, "# HELP sg_export_bytes_total Bytes of files exported to local files.\n"
+                 "# TYPE sg_export_bytes_total counter\n"
+                 "sg_export_bytes_total %lu\n", stats->exportBytes);
+    fprintf(out, "# HELP sg_pinned_blocks Cached blocks pinned by sgadvise.\n"
+                 "# TYPE sg_pinned_blocks gauge\n"
+                 "sg_pinned_blocks %lu\n", stats->pinnedBlocks);
+    fprintf(out, "# HELP sg_prefetch_issued_total Blocks fetched by the prefetcher.\n"
+                 "# TYPE sg_prefetch_issued_total counter\n"
+                 "sg_prefetch_issued_total %lu\n", stats->prefetchIssued);
+    fprintf(out, "# HELP sg_prefetch_used_total Prefetched blocks read before eviction.\n"
+                 "# TYPE sg_prefetch_used_total counter\n"
+                 "sg_prefetch_used_total %lu\n", stats->prefetchUsed);
+    fprintf(out, "# HELP sg_prefetch_wasted_total Prefetched blocks evicted or replaced unread.\n"
+                 "# TYPE sg_prefetch_wasted_total counter\n"
+                 "sg_prefetch_wasted_total %lu\n", stats->prefetchWasted);
+    fprintf(out, "# HELP sg_prefetch_threshold_percent Confidence the prefetcher asks for before prefetching.\n"
+                 "# TYPE sg_prefetch_threshold_percent gauge\n"
+                 "sg_prefetch_threshold_percent %d\n", stats->prefetchThreshold);
+    fprintf(out, "# HELP sg_class_posts_total Packets posted to the service per priority class.\n"
+                 "# TYPE sg_class_posts_total counter\n");
+    for (i = 0; i < SG_POST_CLASSES; i++) {
+        fprintf(out, "sg_class_posts_total{class=\"%s\"} %lu\n", sgStatsClassNames[i], stats->classPosts[i]);
+    }
+    fprintf(out, "# HELP sg_sched_queued_total Background requests queued.\n"
+                 "# TYPE sg_sched_queued_total counter\n"
+                 "sg_sched_queued_total %lu\n", stats->schedQueued);
+    fprintf(out, "# HELP sg_sched_promoted_total Queued requests a demand read posted first.\n"
+                 "# TYPE sg_sched_promoted_total counter\n"
+                 "sg_sched_promoted_total %lu\n", stats->schedPromoted);
+    fprintf(out, "# HELP sg_sched_dropped_total Background requests dropped (queue full or shutdown).\n"
+                 "# TYPE sg_sched_dropped_total counter\n"
+                 "sg_sched_dropped_total %lu\n", stats->schedDropped);
+
+    // latency histograms, lock wait included for the calls
+    fprintf(out, "# HELP sg_call_duration_seconds Latency of the driver calls.\n"
+                 "# TYPE sg_call_duration_seconds histogram\n");
+    for (i = 0; i < SG_CALL_TYPES; i++) {
+        writeSGStatsHistogram(out, "sg_call_duration_seconds", "call", sgStatsCallNames[i], &stats->calls[i]);
+    }
+    fprintf(out, "# HELP sg_post_duration_seconds Latency of the service posts.\n"
+                 "# TYPE sg_post_duration_seconds histogram\n");
+    for (i = 0; i < SG_MAXVAL_EXT_OP; i++) {
+        writeSGStatsHistogram(out, "sg_post_duration_seconds", "op", sgStatsOpNames[i], &stats->postLatency[i]);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dumpSGStats
+// Description  : Write the current statistics to a file, through a temporary
+//                file that replaces it
+//
+// Inputs       : path - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int dumpSGStats( const char *path ) {
+    SG_Driver_Stats *stats;
+    char tmp[strlen(path) + 5];
+    FILE *out;
+    int ret = 0;
+
+    // the histograms make the statistics too large for the stack
+    if ((stats = malloc(sizeof(SG_Driver_Stats))) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "dumpSGStats: out of memory");
+        return -1;
+    }
+    sgGetStats(stats);
+    sprintf(tmp, "%s.tmp", path);
+    if ((out = fopen(tmp, "w")) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "dumpSGStats: failed opening [%s]", tmp);
+        free(stats);
+        return -1;
+    }
+    if (writeSGStatsPrometheus(stats, out) | fclose(out)) {
+        logMessage(LOG_ERROR_LEVEL, "dumpSGStats: failed writing [%s]", tmp);
+        ret = -1;
+    } else if (rename(tmp, path)) {
+        logMessage(LOG_ERROR_LEVEL, "dumpSGStats: failed renaming [%s]", tmp);
+        ret = -1;
+    }
+    free(stats);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : startSGStatsDump
+// Description  : Dump the statistics to a file every interval ms
+//
+// Inputs       : path - the file to write
+//                interval - the dump interval (ms)
+// Outputs      : 0 if successful, -1 if failure
+
+int startSGStatsDump( const char *path, unsigned interval ) {
+    if (sgStatsPath) {
+        logMessage(LOG_ERROR_LEVEL, "startSGStatsDump: already dumping to [%s]", sgStatsPath);
+        return -1;
+    }
+    if ((sgStatsPath = strdup(path)) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "startSGStatsDump: out of memory");
+        return -1;
+    }
+    sgStatsInterval = interval ? interval : SG_STATS_DEFAULT_INTERVAL;
+    sgStatsStopping = 0;
+    if (pthread_create(&sgStatsThread, NULL, sgStatsDumper, NULL)) {
+        logMessage(LOG_ERROR_LEVEL, "startSGStatsDump: failed to start the dump thread");
+        free(sgStatsPath);
+        sgStatsPath = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stopSGStatsDump
+// Description  : Stop the periodic dump, writing the statistics one last time
+//                (must not be called with the driver lock held)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int stopSGStatsDump( void ) {
+    int ret;
+
+    if (sgStatsPath == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&sgStatsLock);
+    sgStatsStopping = 1;
+    pthread_cond_signal(&sgStatsWake);
+    pthread_mutex_unlock(&sgStatsLock);
+    pthread_join(sgStatsThread, NULL);
+    ret = dumpSGStats(sgStatsPath);
+    free(sgStatsPath);
+    sgStatsPath = NULL;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeSGStatsHistogram
+// Description  : Write one labelled histogram (cumulative buckets, seconds)
+//
+// Inputs       : out - the file to write to
+//                name - the metric name
+//                label - the label name
+//                value - the label value
+//                hist - the histogram (ns)
+// Outputs      : none
+
+void writeSGStatsHistogram( FILE *out, const char *name, const char *label, const char *value, SG_Histogram *hist ) {
+    int i;
+
+    for (i = 0; i < SG_STATS_BOUNDS; i++) {
+        fprintf(out, "%s_bucket{%s=\"%s\",le=\"%g\"} %lu\n", name, label, value, sgStatsBounds[i] / 1e9,
+                getSGHistogramCountBelow(hist, sgStatsBounds[i]));
+    }
+    fprintf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %lu\n", name, label, value, hist->count);
+    fprintf(out, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, hist->total / 1e9);
+    fprintf(out, "%s_count{%s=\"%s\"} %lu\n", name, label, value, hist->count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sgStatsDumper
+// Description  : The dump thread, writes the statistics every interval
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+void * sgStatsDumper( void *arg ) {
+    struct timespec due;
+
+    pthread_mutex_lock(&sgStatsLock);
+    while (!sgStatsStopping) {
+        clock_gettime(CLOCK_REALTIME, &due);
+        due.tv_sec += sgStatsInterval / 1000;
+        due.tv_nsec += (sgStatsInterval % 1000) * 1000000L;
+        if (due.tv_nsec >= 1000000000L) {
+            due.tv_sec++;
+            due.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&sgStatsWake, &sgStatsLock, &due);
+        if (!sgStatsStopping) {
+            pthread_mutex_unlock(&sgStatsLock);
+            dumpSGStats(sgStatsPath);
+            pthread_mutex_lock(&sgStatsLock);
+        }
+    }
+    pthread_mutex_unlock(&sgStatsLock);
+    return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef SG_STATS_INCLUDED
+#define SG_STATS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_stats.h
+//  Description    : This is the declaration of the export of the driver
+//                   statistics (sgGetStats) in the Prometheus text format,
+//                   written to a file periodically so a node exporter
+//                   (textfile collector) can pick them up.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdio.h>
+#include <sg_driver.h>
+
+//
+// Defines
+#define SG_STATS_DEFAULT_INTERVAL 1000 // default dump interval (ms)
+
+//
+// Statistics export functions
+
+int writeSGStatsPrometheus( SG_Driver_Stats *stats, FILE *out );
+    // Write the statistics in the Prometheus text format
+
+int dumpSGStats( const char *path );
+    // Write the current statistics to a file (replaced atomically)
+
+int startSGStatsDump( const char *path, unsigned interval );
+    // Dump the statistics to a file every interval ms (background thread)
+
+int stopSGStatsDump( void );
+    // Stop the periodic dump, writing the statistics one last time
+
+#endif
@@ -0,0 +1,272 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_wlbin.c
+//  Description    : This file contains the builder of compiled (binary)
+//                   workloads.  Operations are added one at a time, object
+//                   names and operation data are interned in hash tables so
+//                   each distinct value is stored once, and the workload is
+//                   written out in one go.  It is used by the workload
+//                   compiler and by the driver's trace capture.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <cmpsc311_log.h>
+
+// Project Includes
+#include <sg_wlbin.h>
+
+// Functional Prototypes
+SG_Wlbin_Slot * internWlbinKey( SG_Wlbin_Table *tbl, const char *key, uint32_t size, int terminate );
+int appendWlbinBuffer( void **buf, uint64_t *alloc, uint64_t used, const void *data, uint64_t size );
+uint64_t hashWlbinKey( const char *key, uint32_t size );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initWlbinBuilder
+// Description  : Initialize an empty workload builder
+//
+// Inputs       : bld - the builder
+//                timed - record an issue time for each operation (traces)
+// Outputs      : 0 always
+
+int initWlbinBuilder( SG_Wlbin_Builder *bld, int timed ) {
+    memset(bld, 0, sizeof(SG_Wlbin_Builder));
+    bld->timed = timed;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : addWlbinOp
+// Description  : Add an operation to the workload
+//
+// Inputs       : bld - the builder
+//                name - the object name (ignored for WL_EOF)
+//                op - the operation (workload_operations_type)
+//                pos - the position in the object (reads/writes)
+//                size - the size of the operation (reads/writes)
+//                data - the data written, or expected to be read
+//                time - the issue time (ns from the start, timed builders)
+// Outputs      : 0 if successful, -1 if failure
+
+int addWlbinOp( SG_Wlbin_Builder *bld, const char *name, int op, uint64_t pos, uint32_t size,
+                const char *data, uint64_t time ) {
+    SG_Wlbin_Op rec;
+    SG_Wlbin_Slot *slot;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.op = op;
+    if (name != NULL) {
+        if (strlen(name) >= SG_WLBIN_MAX_NAME) {
+            logMessage(LOG_ERROR_LEVEL, "addWlbinOp: object name too long [%s]", name);
+            return -1;
+        }
+        if ((slot = internWlbinKey(&bld->names, name, strlen(name), 1)) == NULL) {
+            return -1;
+        }
+        // first use of the name, it gets the next object index
+        if (slot->value == UINT32_MAX) {
+            slot->value = bld->names.used - 1;
+            if (appendWlbinBuffer((void **) &bld->nameOffsets, &bld->offsAlloc, slot->value * sizeof(uint32_t),
+                                  &slot->offset, sizeof(uint32_t))) {
+                return -1;
+            }
+            bld->nameOffsets[slot->value] = (uint32_t) slot->offset;
+        }
+        rec.object = slot->value;
+    }
+    if (data != NULL) {
+        if ((slot = internWlbinKey(&bld->heap, data, size, 0)) == NULL) {
+            return -1;
+        }
+        rec.pos = pos;
+        rec.size = size;
+        rec.data = slot->offset;
+        bld->payload += size;
+    }
+    if (appendWlbinBuffer((void **) &bld->ops, &bld->opsAlloc, bld->numOps * sizeof(rec), &rec, sizeof(rec)) ||
+        (bld->timed && appendWlbinBuffer((void **) &bld->times, &bld->timesAlloc, bld->numOps * sizeof(uint64_t),
+                                         &time, sizeof(uint64_t)))) {
+        return -1;
+    }
+    bld->numOps++;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeWlbinFile
+// Description  : Write the workload built so far to a file
+//
+// Inputs       : bld - the builder
+//                path - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int writeWlbinFile( SG_Wlbin_Builder *bld, const char *path ) {
+    SG_Wlbin_Header hdr;
+    FILE *out;
+
+    // lay out the file, header first
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SG_WLBIN_MAGIC, SG_WLBIN_MAGIC_SIZE);
+    hdr.version = SG_WLBIN_VERSION;
+    hdr.numObjects = bld->names.used;
+    hdr.numOps = bld->numOps;
+    hdr.namesOffset = sizeof(hdr);
+    hdr.namesData = hdr.namesOffset + bld->names.used * sizeof(uint32_t);
+    hdr.opsOffset = hdr.namesData + bld->names.size;
+    hdr.timesOffset = bld->timed ? hdr.opsOffset + bld->numOps * sizeof(SG_Wlbin_Op) : 0;
+    hdr.heapOffset = hdr.opsOffset + bld->numOps * (sizeof(SG_Wlbin_Op) + (bld->timed ? sizeof(uint64_t) : 0));
+    hdr.heapSize = bld->heap.size;
+    if ((out = fopen(path, "w")) == NULL) {
+        logMessage(LOG_ERROR_LEVEL, "writeWlbinFile: failed opening [%s]", path);
+        return -1;
+    }
+    if ((fwrite(&hdr, sizeof(hdr), 1, out) != 1) ||
+        (fwrite(bld->nameOffsets, sizeof(uint32_t), bld->names.used, out) != bld->names.used) ||
+        (fwrite(bld->names.data, 1, bld->names.size, out) != bld->names.size) ||
+        (fwrite(bld->ops, sizeof(SG_Wlbin_Op), bld->numOps, out) != bld->numOps) ||
+        (bld->timed && fwrite(bld->times, sizeof(uint64_t), bld->numOps, out) != bld->numOps) ||
+        (fwrite(bld->heap.data, 1, bld->heap.size, out) != bld->heap.size)) {
+        logMessage(LOG_ERROR_LEVEL, "writeWlbinFile: failed writing [%s]", path);
+        fclose(out);
+        return -1;
+    }
+    if (fclose(out)) {
+        logMessage(LOG_ERROR_LEVEL, "writeWlbinFile: failed writing [%s]", path);
+        return -1;
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : freeWlbinBuilder
+// Description  : Release the memory of a workload builder
+//
+// Inputs       : bld - the builder
+// Outputs      : none
+
+void freeWlbinBuilder( SG_Wlbin_Builder *bld ) {
+    free(bld->names.data);
+    free(bld->names.slots);
+    free(bld->heap.data);
+    free(bld->heap.slots);
+    free(bld->nameOffsets);
+    free(bld->ops);
+    free(bld->times);
+    memset(bld, 0, sizeof(SG_Wlbin_Builder));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : internWlbinKey
+// Description  : Find a key in the table, storing it if it is new (the new
+//                slot's value is UINT32_MAX).  The table doubles at half full.
+//
+// Inputs       : tbl - the table
+//                key - the key bytes
+//                size - the size of the key
+//                terminate - store a NUL after the key (names)
+// Outputs      : the slot of the key, NULL if out of memory
+
+SG_Wlbin_Slot * internWlbinKey( SG_Wlbin_Table *tbl, const char *key, uint32_t size, int terminate ) {
+    uint64_t hash = hashWlbinKey(key, size), i, j, k;
+    SG_Wlbin_Slot *old;
+    char nul = 0;
+
+    // grow the hash table, re-inserting the stored keys
+    if ((tbl->used + 1) * 2 > tbl->numSlots) {
+        old = tbl->slots;
+        j = tbl->numSlots;
+        tbl->numSlots = j ? j * 2 : 1024;
+        if ((tbl->slots = calloc(tbl->numSlots, sizeof(SG_Wlbin_Slot))) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "internWlbinKey: out of memory");
+            return NULL;
+        }
+        for (i = 0; i < j; i++) {
+            if (old[i].hash) {
+                for (k = old[i].hash & (tbl->numSlots - 1); tbl->slots[k].hash; k = (k + 1) & (tbl->numSlots - 1));
+                tbl->slots[k] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    // probe for the key
+    for (i = hash & (tbl->numSlots - 1); tbl->slots[i].hash; i = (i + 1) & (tbl->numSlots - 1)) {
+        if ((tbl->slots[i].hash == hash) && (tbl->slots[i].size == size) &&
+            (memcmp(tbl->data + tbl->slots[i].offset, key, size) == 0)) {
+            return &tbl->slots[i];
+        }
+    }
+
+    // new key, store it
+    tbl->slots[i].hash = hash;
+    tbl->slots[i].offset = tbl->size;
+    tbl->slots[i].size = size;
+    tbl->slots[i].value = UINT32_MAX;
+    if (appendWlbinBuffer((void **) &tbl->data, &tbl->alloc, tbl->size, key, size) ||
+        (terminate && appendWlbinBuffer((void **) &tbl->data, &tbl->alloc, tbl->size + size, &nul, 1))) {
+        return NULL;
+    }
+    tbl->size += size + (terminate ? 1 : 0);
+    tbl->used++;
+    return &tbl->slots[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : appendWlbinBuffer
+// Description  : Append bytes to a buffer, doubling its allocation as needed
+//
+// Inputs       : buf - the buffer (may be reallocated)
+//                alloc - the bytes allocated for the buffer
+//                used - the bytes used in the buffer
+//                data - the bytes to append
+//                size - the number of bytes to append
+// Outputs      : 0 if successful, -1 if out of memory
+
+int appendWlbinBuffer( void **buf, uint64_t *alloc, uint64_t used, const void *data, uint64_t size ) {
+    uint64_t want;
+    void *grown;
+
+    if (used + size > *alloc) {
+        for (want = *alloc ? *alloc : 4096; want < used + size; want *= 2);
+        if ((grown = realloc(*buf, want)) == NULL) {
+            logMessage(LOG_ERROR_LEVEL, "appendWlbinBuffer: out of memory");
+            return -1;
+        }
+        *buf = grown;
+        *alloc = want;
+    }
+    memcpy((char *) *buf + used, data, size);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashWlbinKey
+// Description  : Hash a key (64-bit FNV-1a), never 0 (0 marks free slots)
+//
+// Inputs       : key - the key bytes
+//                size - the size of the key
+// Outputs      : the hash
+
+uint64_t hashWlbinKey( const char *key, uint32_t size ) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t) key[i]) * 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
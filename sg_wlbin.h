@@ -0,0 +1,98 @@
+#ifndef SG_WLBIN_INCLUDED
+#define SG_WLBIN_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_wlbin.h
+//  Description    : This is the declaration of the compiled (binary) workload
+//                   format, written by sg_wlcomp and replayed by sg_sim from
+//                   an mmap of the file.  The file is a header, the object
+//                   name table, fixed-size operation records and a heap of
+//                   operation data (identical data stored once).  All offsets
+//                   are from the start of the file, in host byte order.
+//                   Traces also carry the issue time of every operation.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Includes
+#include <stdint.h>
+
+//
+// Defines
+#define SG_WLBIN_MAGIC "SGWLBIN1"  // first 8 bytes of a compiled workload
+#define SG_WLBIN_MAGIC_SIZE 8
+#define SG_WLBIN_VERSION 2
+#define SG_WLBIN_MAX_NAME 128      // longest object name (as in workload_operation)
+
+// Type definitions
+typedef struct {
+    char     magic[SG_WLBIN_MAGIC_SIZE]; // SG_WLBIN_MAGIC
+    uint32_t version;       // SG_WLBIN_VERSION
+    uint32_t numObjects;    // number of interned object names
+    uint64_t numOps;        // number of operation records (last is WL_EOF)
+    uint64_t namesOffset;   // uint32_t name offsets (into the names), one per object
+    uint64_t namesData;     // NUL terminated object names
+    uint64_t opsOffset;     // the SG_Wlbin_Op records
+    uint64_t timesOffset;   // uint64_t issue time (ns from the start) per op, 0 if untimed
+    uint64_t heapOffset;    // the data heap
+    uint64_t heapSize;      // size of the data heap
+} __attribute__((packed)) SG_Wlbin_Header;
+
+typedef struct {
+    uint64_t pos;           // position in the object
+    uint64_t data;          // offset of the data in the heap (reads and writes)
+    uint32_t object;        // interned object index
+    uint16_t size;          // size of the operation
+    uint8_t  op;            // the operation (workload_operations_type)
+    uint8_t  unused;
+} __attribute__((packed)) SG_Wlbin_Op;
+
+typedef struct {
+    uint64_t hash;          // hash of the key (0 if the slot is free)
+    uint64_t offset;        // offset of the key in the table data
+    uint32_t size;          // size of the key
+    uint32_t value;         // object index (names only)
+} SG_Wlbin_Slot;
+
+typedef struct {
+    char     *data;         // the keys stored
+    uint64_t  size;         // bytes used
+    uint64_t  alloc;        // bytes allocated
+    SG_Wlbin_Slot *slots;   // open addressing hash table over the keys
+    uint64_t  numSlots;     // number of slots (power of two)
+    uint64_t  used;         // number of slots used
+} SG_Wlbin_Table;
+
+typedef struct {
+    SG_Wlbin_Table names;   // interned object names
+    SG_Wlbin_Table heap;    // interned operation data
+    uint32_t *nameOffsets;  // name offset per object index
+    uint64_t  offsAlloc;
+    SG_Wlbin_Op *ops;       // the operation records
+    uint64_t  opsAlloc;
+    uint64_t  numOps;
+    uint64_t *times;        // issue time per operation (timed only)
+    uint64_t  timesAlloc;
+    int       timed;        // record issue times
+    uint64_t  payload;      // data bytes of all operations (before interning)
+} SG_Wlbin_Builder;
+
+//
+// Workload builder functions
+
+int initWlbinBuilder( SG_Wlbin_Builder *bld, int timed );
+    // Initialize an empty workload builder
+
+int addWlbinOp( SG_Wlbin_Builder *bld, const char *name, int op, uint64_t pos, uint32_t size,
+                const char *data, uint64_t time );
+    // Add an operation to the workload
+
+int writeWlbinFile( SG_Wlbin_Builder *bld, const char *path );
+    // Write the workload built so far to a file
+
+void freeWlbinBuilder( SG_Wlbin_Builder *bld );
+    // Release the memory of a workload builder
+
+#endif
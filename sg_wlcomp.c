@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_wlcomp.c
+//  Description    : This is the workload compiler for the ScatterGather
+//                   simulator.  It parses a text workload once (with
+//                   readCmpsc311Workload) and writes the compiled format of
+//                   sg_wlbin.h, which sg_sim replays from an mmap without
+//                   parsing or copying.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_workload.h>
+
+// Project Includes
+#include <sg_wlbin.h>
+
+// Defines
+#define USAGE \
+	"USAGE: sg_wlcomp [-h] <workload> <output>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"and\n" \
+	"    workload - is the name of the text workload file\n" \
+	"    output - is the name of the compiled workload to write\n" \
+	"\n" \
+
+//
+// Global Data
+unsigned long SGServiceLevel; // Service log level
+unsigned long SGDriverLevel; // Controller log level
+unsigned long SGSimulatorLevel; // Simulation log level
+
+//
+// Functional Prototypes
+
+int compileWorkload( char *wload, char *output ); // Compile a workload
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the workload compiler
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch;
+
+	// Process the command line parameters (only help)
+	if ((ch = getopt(argc, argv, "h")) != -1) {
+		fprintf( stderr, USAGE );
+		return( -1 );
+	}
+	if ( argc - optind != 2 ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Setup the log (the workload library logs errors)
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	SGServiceLevel = registerLogLevel("SG_SERVICE", 0); // Service log level
+	SGDriverLevel = registerLogLevel("SG_DRIVER", 0); // Controller log level
+	SGSimulatorLevel = registerLogLevel("SG_SIMULATOR", 0); // Simulation log level
+	return( compileWorkload(argv[optind], argv[optind + 1]) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compileWorkload
+// Description  : Parse the text workload and write the compiled workload
+//
+// Inputs       : wload - the text workload filename
+//                output - the compiled workload filename
+// Outputs      : 0 if successful, -1 if failure
+
+int compileWorkload( char *wload, char *output ) {
+
+	// Local variables
+	workload_state state;
+	workload_operation operation;
+	SG_Wlbin_Builder bld;
+	int data;
+
+	initWlbinBuilder( &bld, 0 );
+	if ( openCmpsc311Workload(&state, wload) ) {
+		fprintf( stderr, "Failed opening workload [%s], aborting.\n", wload );
+		return( -1 );
+	}
+
+	// Turn each operation into a record, interning names and data
+	do {
+		if ( readCmpsc311Workload(&state, &operation) ) {
+			fprintf( stderr, "Workload parse failed at line %d, aborting.\n", state.lineno );
+			return( -1 );
+		}
+		data = (operation.op == WL_READ) || (operation.op == WL_WRITE);
+		if ( addWlbinOp(&bld, (operation.op != WL_EOF) ? operation.objname : NULL, operation.op,
+				operation.pos, operation.size, data ? operation.data : NULL, 0) ) {
+			fprintf( stderr, "Workload compile failed at line %d, aborting.\n", state.lineno );
+			return( -1 );
+		}
+	} while ( operation.op < WL_EOF );
+	closeCmpsc311Workload( &state );
+
+	// Write the compiled workload
+	if ( writeWlbinFile(&bld, output) ) {
+		fprintf( stderr, "Failed writing output [%s], aborting.\n", output );
+		return( -1 );
+	}
+	printf( "%s: %lu operations, %lu objects, %lu data bytes in a %lu byte heap (%.1f%%)\n",
+		output, bld.numOps, bld.names.used, bld.payload, bld.heap.size,
+		bld.payload ? bld.heap.size * 100.0 / bld.payload : 0.0 );
+
+	// Clean up, return successfully
+	freeWlbinBuilder( &bld );
+	return( 0 );
+}
@@ -0,0 +1,497 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : sg_wlgen.c
+//  Description    : This is the synthetic workload generator for the
+//                   ScatterGather simulator.  It writes workloads in the
+//                   format read by readCmpsc311Workload, at a scale (10^6+
+//                   operations over 10^4+ objects) and with access skew that
+//                   the fixed assignment workload does not have.
+//
+//                   The library generator (createCmpsc311Workload) keeps its
+//                   objects in a WL_MAX_OBJS array and has no skew controls,
+//                   so this tool writes the format itself.  It follows the
+//                   library's workload types (WLT_LINEAR, WLT_RANDOM and
+//                   WLT_LOCALITY, with a locality weight and cache size) and
+//                   keeps every read and write inside one block, as the
+//                   driver requires.
+//
+//   Author        : Boquan Yin
+//   Last Modified : 1
+//
+
+// Include Files
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <cmpsc311_workload.h>
+
+// Defines
+#define WLGEN_ARGUMENTS "ho:n:N:s:t:z:H:r:d:b:u:S:F:L:p:"
+#define USAGE \
+	"USAGE: sg_wlgen [-h] [-o <file>] [-n <ops>] [-N <objects>] [-s <seed>] [-t <type>]\n" \
+	"                [-z <theta>] [-H <frac>:<prob>] [-r <pct>] [-d <dist>] [-b <blocksize>]\n" \
+	"                [-u <unit>] [-S <maxobj>] [-F <maxopen>] [-L <weight>:<size>] [-p <prefix>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -o - write the workload to <file> (default stdout)\n" \
+	"    -n - number of read and write operations (default 1000000)\n" \
+	"    -N - number of objects (default 10000)\n" \
+	"    -s - random seed, the output is identical for the same seed and options (default 1)\n" \
+	"    -t - access pattern within objects, linear, random or locality (default random)\n" \
+	"    -z - Zipfian skew of object popularity, 0 is uniform (default 0.99)\n" \
+	"    -H - hot set instead of Zipf, <frac> of the objects get <prob> of the accesses\n" \
+	"    -r - percentage of operations that are reads (default 33)\n" \
+	"    -d - operation size distribution (bytes, rounded to the unit):\n" \
+	"         fixed:<size>, uniform:<min>:<max> or bimodal:<small>:<large>:<pct small>\n" \
+	"         (default uniform:<unit>:<blocksize>)\n" \
+	"    -b - block size, no operation crosses a block boundary (default 1024)\n" \
+	"    -u - alignment unit of offsets and sizes (default 256)\n" \
+	"    -S - maximum object size in bytes (default 16384)\n" \
+	"    -F - maximum number of objects open at once, least recently used\n" \
+	"         objects are closed to make room (default 64)\n" \
+	"    -L - locality weight (percent of operations re-using a recent location)\n" \
+	"         and size of the recent location cache (default 75:64)\n" \
+	"    -p - object name prefix (default sg-wlgen)\n" \
+	"\n" \
+
+#define WLGEN_DIST_FIXED 0   // every operation has the same size
+#define WLGEN_DIST_UNIFORM 1 // sizes uniform between min and max
+#define WLGEN_DIST_BIMODAL 2 // small or large sizes
+
+//
+// Type definitions
+typedef struct {
+	char    *content;   // current content of the object
+	uint32_t size;      // current size of the object
+	uint32_t maxSize;   // size the object grows to by appending
+	uint32_t cursor;    // next position for linear access
+	uint64_t lastUse;   // operation counter at last use (0 if closed)
+} wlgenObject;
+
+typedef struct {
+	uint32_t object;    // the object used
+	uint32_t offset;    // the offset used
+} wlgenLocation;
+
+//
+// Global Data
+uint64_t wlgenState;          // random number generator state
+uint32_t numObjects = 10000;  // number of objects
+uint32_t blockSize = 1024;    // no operation crosses a block
+uint32_t unit = 256;          // alignment of offsets and sizes
+int      distType = WLGEN_DIST_UNIFORM;
+uint32_t distArgs[3];         // size distribution parameters
+
+//
+// Functional Prototypes
+
+int generateWorkload( FILE *out, uint64_t ops, workload_load_type type, double theta, double hotFrac,
+	double hotProb, uint32_t readPct, uint32_t maxObj, uint32_t maxOpen, uint32_t locWeight,
+	uint32_t locSize, const char *prefix ); // Generate the workload
+uint32_t wlgenSize( void ); // Draw an operation size
+uint64_t wlgenRandom( void ); // Draw a 64-bit random number
+uint32_t wlgenUniform( uint32_t n ); // Draw a random number below n
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the workload generator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, ret;
+	FILE *out = stdout;
+	uint64_t ops = 1000000, seed = 1;
+	workload_load_type type = WLT_RANDOM;
+	double theta = 0.99, hotFrac = 0, hotProb = 0;
+	uint32_t readPct = 33, maxObj = 16384, maxOpen = 64, locWeight = 75, locSize = 64;
+	const char *prefix = "sg-wlgen";
+	char *outName = NULL;
+
+	// Process the command line parameters
+	distArgs[0] = 0;
+	while ((ch = getopt(argc, argv, WLGEN_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'o': // Output file
+			outName = optarg;
+			break;
+
+		case 'n': // Number of operations
+			ops = strtoull( optarg, NULL, 10 );
+			break;
+
+		case 'N': // Number of objects
+			numObjects = atoi( optarg );
+			break;
+
+		case 's': // Random seed
+			seed = strtoull( optarg, NULL, 10 );
+			break;
+
+		case 't': // Access pattern
+			if ( strcmp(optarg, "linear") == 0 ) {
+				type = WLT_LINEAR;
+			} else if ( strcmp(optarg, "random") == 0 ) {
+				type = WLT_RANDOM;
+			} else if ( strcmp(optarg, "locality") == 0 ) {
+				type = WLT_LOCALITY;
+			} else {
+				fprintf( stderr, "Unknown workload type (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'z': // Zipfian skew
+			theta = atof( optarg );
+			break;
+
+		case 'H': // Hot set
+			if ( sscanf(optarg, "%lf:%lf", &hotFrac, &hotProb) != 2 || hotFrac <= 0 || hotFrac >= 1 ||
+					hotProb < 0 || hotProb > 1 ) {
+				fprintf( stderr, "Bad hot set (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'r': // Read percentage
+			readPct = atoi( optarg );
+			break;
+
+		case 'd': // Size distribution
+			if ( sscanf(optarg, "fixed:%u", &distArgs[0]) == 1 ) {
+				distType = WLGEN_DIST_FIXED;
+			} else if ( sscanf(optarg, "uniform:%u:%u", &distArgs[0], &distArgs[1]) == 2 ) {
+				distType = WLGEN_DIST_UNIFORM;
+			} else if ( sscanf(optarg, "bimodal:%u:%u:%u", &distArgs[0], &distArgs[1], &distArgs[2]) == 3 ) {
+				distType = WLGEN_DIST_BIMODAL;
+			} else {
+				fprintf( stderr, "Bad size distribution (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'b': // Block size
+			blockSize = atoi( optarg );
+			break;
+
+		case 'u': // Alignment unit
+			unit = atoi( optarg );
+			break;
+
+		case 'S': // Maximum object size
+			maxObj = atoi( optarg );
+			break;
+
+		case 'F': // Maximum open objects
+			maxOpen = atoi( optarg );
+			break;
+
+		case 'L': // Locality parameters
+			if ( sscanf(optarg, "%u:%u", &locWeight, &locSize) != 2 || locWeight > 100 || locSize == 0 ) {
+				fprintf( stderr, "Bad locality parameters (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'p': // Object name prefix
+			prefix = optarg;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Check the parameters
+	if ( distArgs[0] == 0 && distType == WLGEN_DIST_UNIFORM ) {
+		distArgs[0] = unit;
+		distArgs[1] = blockSize;
+	}
+	if ( unit == 0 || blockSize % unit || blockSize > CMPSC311_MAX_OPSIZE_MAXIMUM || maxObj < unit ||
+			numObjects == 0 || maxOpen == 0 || readPct > 100 ) {
+		fprintf( stderr, "Bad parameters (block size must be a multiple of the unit), aborting.\n" );
+		return( -1 );
+	}
+
+	// Open the output, generate the workload
+	if ( outName && (out = fopen(outName, "w")) == NULL ) {
+		fprintf( stderr, "Failed opening workload output [%s], aborting.\n", outName );
+		return( -1 );
+	}
+	wlgenState = seed * 0x9E3779B97F4A7C15ULL + 1;
+	fprintf( out, "# CMPSC311 Workload : sg_wlgen\n" );
+	fprintf( out, "# Type/params  : type=%d, #ops=%lu, #objs=%u, seed=%lu, theta=%.3f, hot=%.3f:%.3f, reads=%u%%, "
+		"blocksize=%u, unit=%u, maxobj=%u, maxopen=%u, loc=%u:%u\n", type, ops, numObjects, seed, theta,
+		hotFrac, hotProb, readPct, blockSize, unit, maxObj, maxOpen, locWeight, locSize );
+	ret = generateWorkload( out, ops, type, theta, hotFrac, hotProb, readPct, maxObj, maxOpen, locWeight,
+		locSize, prefix );
+	if ( outName ) {
+		fclose( out );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generateWorkload
+// Description  : Generate the workload operations.  Objects are picked by
+//                popularity (Zipf or hot set, ranks shuffled over the
+//                objects), opened on first use and closed when they are the
+//                least recently used of too many open objects.  Objects grow
+//                by appending up to their final size, reads only touch
+//                content that was written.
+//
+// Inputs       : out - the workload file
+//                ops - the number of read and write operations
+//                type - the access pattern within an object
+//                theta - the Zipfian skew (if no hot set)
+//                hotFrac, hotProb - the hot set (if hotFrac > 0)
+//                readPct - the percentage of reads
+//                maxObj - the maximum object size
+//                maxOpen - the maximum number of open objects
+//                locWeight, locSize - the locality weight and cache size
+//                prefix - the object name prefix
+// Outputs      : 0 if successful, -1 if failure
+
+int generateWorkload( FILE *out, uint64_t ops, workload_load_type type, double theta, double hotFrac,
+	double hotProb, uint32_t readPct, uint32_t maxObj, uint32_t maxOpen, uint32_t locWeight,
+	uint32_t locSize, const char *prefix ) {
+
+	// Local variables
+	wlgenObject *objs;
+	wlgenLocation *recent;
+	uint32_t *perm, *openObjs, numOpen = 0, numRecent = 0, nextRecent = 0, hot;
+	double *cdf = NULL, sum = 0, u;
+	uint64_t op, reads = 0, bytes = 0;
+	uint32_t i, j, obj, off, len, lo, hi, units;
+	int write;
+
+	// Allocate the object state, shuffle popularity ranks over the objects
+	objs = calloc( numObjects, sizeof(wlgenObject) );
+	perm = malloc( numObjects * sizeof(uint32_t) );
+	openObjs = malloc( maxOpen * sizeof(uint32_t) );
+	recent = malloc( locSize * sizeof(wlgenLocation) );
+	if ( !objs || !perm || !openObjs || !recent ) {
+		fprintf( stderr, "Out of memory generating workload, aborting.\n" );
+		return( -1 );
+	}
+	units = maxObj / unit;
+	for ( i = 0; i < numObjects; i++ ) {
+		perm[i] = i;
+		objs[i].maxSize = (1 + wlgenUniform(units)) * unit;
+	}
+	for ( i = numObjects - 1; i > 0; i-- ) {
+		j = wlgenUniform( i + 1 );
+		obj = perm[i]; perm[i] = perm[j]; perm[j] = obj;
+	}
+	hot = (uint32_t)(hotFrac * numObjects);
+	if ( hotFrac > 0 && hot == 0 ) {
+		hot = 1;
+	}
+
+	// The Zipfian CDF over ranks, searched for each pick
+	if ( hot == 0 && theta > 0 ) {
+		if ( (cdf = malloc(numObjects * sizeof(double))) == NULL ) {
+			fprintf( stderr, "Out of memory generating workload, aborting.\n" );
+			return( -1 );
+		}
+		for ( i = 0; i < numObjects; i++ ) {
+			sum += 1.0 / pow( i + 1, theta );
+			cdf[i] = sum;
+		}
+	}
+
+	for ( op = 0; op < ops; op++ ) {
+
+		// Pick the object, re-use a recent location for locality
+		off = UINT32_MAX;
+		if ( type == WLT_LOCALITY && numRecent && wlgenUniform(100) < locWeight ) {
+			i = wlgenUniform( numRecent );
+			obj = recent[i].object;
+			off = recent[i].offset;
+		} else if ( hot ) {
+			u = (wlgenRandom() >> 11) * 0x1.0p-53;
+			obj = perm[(u < hotProb || hot == numObjects) ? wlgenUniform(hot) : hot + wlgenUniform(numObjects - hot)];
+		} else if ( cdf ) {
+			u = (wlgenRandom() >> 11) * 0x1.0p-53 * sum;
+			lo = 0; hi = numObjects - 1;
+			while ( lo < hi ) {
+				j = (lo + hi) / 2;
+				if ( cdf[j] < u ) {
+					lo = j + 1;
+				} else {
+					hi = j;
+				}
+			}
+			obj = perm[lo];
+		} else {
+			obj = wlgenUniform( numObjects );
+		}
+
+		// Open the object if needed, closing the least recently used one
+		if ( objs[obj].lastUse == 0 ) {
+			if ( numOpen == maxOpen ) {
+				for ( i = 1, j = 0; i < numOpen; i++ ) {
+					if ( objs[openObjs[i]].lastUse < objs[openObjs[j]].lastUse ) {
+						j = i;
+					}
+				}
+				fprintf( out, "%s-%u CLOSE\n", prefix, openObjs[j] );
+				objs[openObjs[j]].lastUse = 0;
+				objs[openObjs[j]].cursor = 0;
+				openObjs[j] = openObjs[--numOpen];
+			}
+			fprintf( out, "%s-%u OPEN\n", prefix, obj );
+			openObjs[numOpen++] = obj;
+		}
+		objs[obj].lastUse = op + 1;
+
+		// Pick the operation, size and offset (empty objects are written)
+		len = wlgenSize();
+		write = (objs[obj].size == 0) || (wlgenUniform(100) >= readPct);
+		if ( write && objs[obj].size < objs[obj].maxSize && (type == WLT_LINEAR || off == UINT32_MAX) &&
+				(type == WLT_LINEAR || wlgenUniform(2) == 0) ) {
+			off = objs[obj].size;
+		} else if ( off == UINT32_MAX || off >= objs[obj].size ) {
+			if ( type == WLT_LINEAR ) {
+				if ( objs[obj].cursor >= objs[obj].size ) {
+					objs[obj].cursor = 0;
+				}
+				off = objs[obj].cursor;
+			} else {
+				off = wlgenUniform( objs[obj].size / unit ) * unit;
+			}
+		}
+		if ( len > blockSize - off % blockSize ) {
+			len = blockSize - off % blockSize;
+		}
+		if ( !write && len > objs[obj].size - off ) {
+			len = objs[obj].size - off;
+		}
+		objs[obj].cursor = off + len;
+
+		// Apply writes to the object, both emit the content
+		if ( write ) {
+			if ( off + len > objs[obj].size ) {
+				if ( (objs[obj].content = realloc(objs[obj].content, off + len)) == NULL ) {
+					fprintf( stderr, "Out of memory generating workload, aborting.\n" );
+					return( -1 );
+				}
+				objs[obj].size = off + len;
+			}
+			for ( i = 0; i < len; i++ ) {
+				objs[obj].content[off + i] = '!' + wlgenUniform( '~' - '!' + 1 );
+			}
+		} else {
+			reads++;
+		}
+		fprintf( out, "%s-%u %s %u %u ", prefix, obj, write ? "WRITE" : "READ", off, len );
+		fwrite( objs[obj].content + off, 1, len, out );
+		fputc( '\n', out );
+		bytes += len;
+
+		// Remember the location for locality
+		if ( type == WLT_LOCALITY ) {
+			recent[nextRecent].object = obj;
+			recent[nextRecent].offset = off;
+			nextRecent = (nextRecent + 1) % locSize;
+			if ( numRecent < locSize ) {
+				numRecent++;
+			}
+		}
+	}
+
+	// Close the remaining objects
+	for ( i = 0; i < numOpen; i++ ) {
+		fprintf( out, "%s-%u CLOSE\n", prefix, openObjs[i] );
+	}
+	fprintf( out, "# CMPSC311 Workload sg_wlgen completed, %lu operations (%lu reads), %lu bytes.\n",
+		ops, reads, bytes );
+
+	// Clean up, return successfully
+	for ( i = 0; i < numObjects; i++ ) {
+		free( objs[i].content );
+	}
+	free( objs );
+	free( perm );
+	free( openObjs );
+	free( recent );
+	free( cdf );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wlgenSize
+// Description  : Draw an operation size from the size distribution, in
+//                units, at least one unit and at most a block
+//
+// Inputs       : none
+// Outputs      : the size in bytes
+
+uint32_t wlgenSize( void ) {
+	uint32_t len;
+
+	switch ( distType ) {
+	case WLGEN_DIST_FIXED:
+		len = distArgs[0];
+		break;
+	case WLGEN_DIST_BIMODAL:
+		len = (wlgenUniform(100) < distArgs[2]) ? distArgs[0] : distArgs[1];
+		break;
+	default:
+		len = distArgs[0] + ((distArgs[1] > distArgs[0]) ? wlgenUniform(distArgs[1] - distArgs[0] + 1) : 0);
+		break;
+	}
+	len = (len + unit - 1) / unit * unit;
+	if ( len == 0 ) {
+		len = unit;
+	}
+	return( (len > blockSize) ? blockSize : len );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wlgenRandom
+// Description  : Draw a 64-bit random number (xorshift64*), the sequence is
+//                fixed by the seed
+//
+// Inputs       : none
+// Outputs      : the random number
+
+uint64_t wlgenRandom( void ) {
+	wlgenState ^= wlgenState >> 12;
+	wlgenState ^= wlgenState << 25;
+	wlgenState ^= wlgenState >> 27;
+	return( wlgenState * 0x2545F4914F6CDD1DULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wlgenUniform
+// Description  : Draw a random number uniformly below n
+//
+// Inputs       : n - the bound (n > 0)
+// Outputs      : the random number
+
+uint32_t wlgenUniform( uint32_t n ) {
+	return( (uint32_t)(((wlgenRandom() >> 32) * (uint64_t)n) >> 32) );
+}